@@ -9,6 +9,8 @@
 */
 
 #include <iomanip>
+#include <cmath>
+#include <algorithm>
 #include "constraint.h"
 #include "interaction.h"
 #include "memory.h"
@@ -28,7 +30,14 @@
 
 using namespace ALM_NS;
 
-Constraint::Constraint(ALM *alm) : Pointers(alm) {}
+Constraint::Constraint(ALM *alm) : Pointers(alm)
+{
+    nnz_rref_in = 0;
+    nnz_rref_out = 0;
+    ncall_rref = 0;
+    ncall_rref_exact = 0;
+    time_rref = 0.0;
+}
 
 Constraint::~Constraint()
 {
@@ -277,6 +286,16 @@ void Constraint::setup()
         memory->deallocate(const_rotation_cross);
         memory->deallocate(const_self);
 
+        if (ncall_rref > 0) {
+            std::cout << "  Sparse row reduction of the constraints:" << std::endl;
+            std::cout << "   Nonzero elements (input -> reduced) : "
+                << nnz_rref_in << " -> " << nnz_rref_out << std::endl;
+            std::cout << "   Reduced in exact arithmetic         : "
+                << ncall_rref_exact << " of " << ncall_rref << " matrices" << std::endl;
+            std::cout << "   Time elapsed                        : "
+                << time_rref << " sec." << std::endl << std::endl;
+        }
+
         timer->print_elapsed();
         std::cout << " -------------------------------------------------------------------" << std::endl;
         std::cout << std::endl;
@@ -552,13 +571,11 @@ void Constraint::constraint_from_symmetry(std::vector<ConstraintClass> *const_ou
     int order;
     int maxorder = interaction->maxorder;
 
-    int *index_tmp;
     int **xyzcomponent;
     int nparams;
 
     double *arr_constraint;
     bool has_constraint_from_symm = false;
-    std::set<FcProperty> list_found;
     std::vector<std::vector<double> > const_mat;
 
     for (isym = 0; isym < symmetry->nsym; ++isym) {
@@ -572,8 +589,6 @@ void Constraint::constraint_from_symmetry(std::vector<ConstraintClass> *const_ou
         std::cout << "  Generating constraints from crystal symmetry ..." << std::endl;
     }
 
-    memory->allocate(index_tmp, maxorder + 1);
-
     const_mat.clear();
 
     for (order = 0; order < maxorder; ++order) {
@@ -588,15 +603,6 @@ void Constraint::constraint_from_symmetry(std::vector<ConstraintClass> *const_ou
             }
         }
 
-        // Generate temporary list of parameters
-        list_found.clear();
-        for (std::vector<FcProperty>::iterator p = fcs->fc_set[order].begin();
-             p != fcs->fc_set[order].end(); ++p) {
-            for (i = 0; i < order + 2; ++i) index_tmp[i] = (*p).elems[i];
-            list_found.insert(FcProperty(order + 2, (*p).coef,
-                                         index_tmp, (*p).mother));
-        }
-
         nxyz = static_cast<int>(std::pow(static_cast<double>(3), order + 2));
         memory->allocate(xyzcomponent, nxyz, order + 2);
         fcs->get_xyzcomponent(order + 2, xyzcomponent);
@@ -610,12 +616,12 @@ void Constraint::constraint_from_symmetry(std::vector<ConstraintClass> *const_ou
             int j;
             int i_prim;
             int loc_nonzero;
+            int loc_found;
             int *ind;
             int *atm_index, *atm_index_symm;
             int *xyz_index;
             double c_tmp;
 
-            std::set<FcProperty>::iterator iter_found;
             std::vector<double> const_now_omp;
             std::vector<std::vector<double> > const_omp;
 
@@ -658,10 +664,11 @@ void Constraint::constraint_from_symmetry(std::vector<ConstraintClass> *const_ou
                         std::swap(ind[0], ind[i_prim]);
                         fcs->sort_tail(order + 2, ind);
 
-                        iter_found = list_found.find(FcProperty(order + 2, 1.0, ind, 1));
-                        if (iter_found != list_found.end()) {
+                        loc_found = fcs->fc_table[order].find(ind);
+                        if (loc_found != -1) {
                             c_tmp = fcs->coef_sym(order + 2, isym, xyz_index, xyzcomponent[ixyz]);
-                            const_now_omp[(*iter_found).mother] += (*iter_found).coef * c_tmp;
+                            const_now_omp[fcs->fc_set[order][loc_found].mother]
+                                += fcs->fc_set[order][loc_found].coef * c_tmp;
                         }
                     }
 
@@ -720,8 +727,6 @@ void Constraint::constraint_from_symmetry(std::vector<ConstraintClass> *const_ou
         }
     } // close loop order
 
-    memory->deallocate(index_tmp);
-
     if (has_constraint_from_symm) {
         std::cout << "  Finished !" << std::endl << std::endl;
     }
@@ -750,12 +755,10 @@ void Constraint::translational_invariance()
     unsigned int isize;
     double *arr_constraint;
 
+    int loc_found;
+
     std::vector<int> intlist, data;
-    std::set<FcProperty> list_found;
-    std::set<FcProperty>::iterator iter_found;
     std::vector<std::vector<int> > data_vec;
-    std::vector<FcProperty> list_vec;
-    std::vector<FcProperty>::iterator iter_vec;
     std::vector<int> const_now;
     std::vector<std::vector<int> > const_mat;
 
@@ -776,21 +779,16 @@ void Constraint::translational_invariance()
             continue;
         }
 
-        // Make interaction list
-
-        list_found.clear();
+        // Check the uniqueness of the interaction list.
+        // The hash table keeps the first entry of duplicated keys.
 
-        for (std::vector<FcProperty>::iterator p = fcs->fc_set[order].begin();
-             p != fcs->fc_set[order].end(); ++p) {
+        for (std::size_t ifc = 0; ifc < fcs->fc_set[order].size(); ++ifc) {
             for (i = 0; i < order + 2; ++i) {
-                ind[i] = (*p).elems[i];
+                ind[i] = fcs->fc_set[order][ifc].elems[i];
             }
-            if (list_found.find(FcProperty(order + 2, (*p).coef,
-                                           ind, (*p).mother)) != list_found.end()) {
+            if (fcs->fc_table[order].find(ind) != static_cast<int>(ifc)) {
                 error->exit("translational invariance", "Duplicate interaction list found");
             }
-            list_found.insert(FcProperty(order + 2, (*p).coef,
-                                         ind, (*p).mother));
         }
 
         // Generate xyz component for each order
@@ -824,13 +822,13 @@ void Constraint::translational_invariance()
                         for (jat = 0; jat < 3 * nat; jat += 3) {
                             intarr[1] = jat + jcrd;
 
-                            iter_found = list_found.find(
-                                FcProperty(order + 2, 1.0, intarr, 1));
+                            loc_found = fcs->fc_table[order].find(intarr);
 
                             //  If found a IFC
-                            if (iter_found != list_found.end()) {
+                            if (loc_found != -1) {
                                 // Round the coefficient to integer
-                                const_now[(*iter_found).mother] += nint((*iter_found).coef);
+                                const_now[fcs->fc_set[order][loc_found].mother]
+                                    += nint(fcs->fc_set[order][loc_found].coef);
                             }
 
                         }
@@ -885,6 +883,8 @@ void Constraint::translational_invariance()
 #endif
                 {
                     int *intarr_omp, *intarr_copy_omp;
+                    int loc_found_omp;
+                    unsigned int nuniq_omp = 0;
 
                     memory->allocate(intarr_omp, order + 2);
                     memory->allocate(intarr_copy_omp, order + 2);
@@ -896,7 +896,7 @@ void Constraint::translational_invariance()
                     const_omp.clear();
                     const_now_omp.resize(nparams);
 #ifdef _OPENMP
-#pragma omp for private(isize, ixyz, jcrd, j, jat, iter_found, loc_nonzero), schedule(guided), nowait
+#pragma omp for private(isize, ixyz, jcrd, j, jat, loc_nonzero), schedule(guided), nowait
 #endif
                     for (idata = 0; idata < ndata; ++idata) {
 
@@ -928,10 +928,10 @@ void Constraint::translational_invariance()
 
                                         fcs->sort_tail(order + 2, intarr_copy_omp);
 
-                                        iter_found = list_found.find(FcProperty(order + 2, 1.0,
-                                                                                intarr_copy_omp, 1));
-                                        if (iter_found != list_found.end()) {
-                                            const_now_omp[(*iter_found).mother] += nint((*iter_found).coef);
+                                        loc_found_omp = fcs->fc_table[order].find(intarr_copy_omp);
+                                        if (loc_found_omp != -1) {
+                                            const_now_omp[fcs->fc_set[order][loc_found_omp].mother]
+                                                += nint(fcs->fc_set[order][loc_found_omp].coef);
                                         }
 
                                     }
@@ -946,23 +946,33 @@ void Constraint::translational_invariance()
                                 }
                             }
                         }
-                        // sort-->uniq the array
-                        std::sort(const_omp.begin(), const_omp.end());
-                        const_omp.erase(std::unique(const_omp.begin(), const_omp.end()),
-                                        const_omp.end());
-
-                        // Merge vectors
-#pragma omp critical
-                        {
-                            for (std::vector<std::vector<int> >::iterator it = const_omp.begin();
-                                 it != const_omp.end(); ++it) {
-                                const_mat.push_back(*it);
-                            }
+                        // sort-->uniq the private array only when it has doubled
+                        // since the last reduction to keep the cost amortized.
+                        if (const_omp.size() > 2 * nuniq_omp + 64) {
+                            std::sort(const_omp.begin(), const_omp.end());
+                            const_omp.erase(std::unique(const_omp.begin(), const_omp.end()),
+                                            const_omp.end());
+                            nuniq_omp = const_omp.size();
                         }
-                        const_omp.clear();
 
                     }// close idata (openmp main loop)
 
+                    std::sort(const_omp.begin(), const_omp.end());
+                    const_omp.erase(std::unique(const_omp.begin(), const_omp.end()),
+                                    const_omp.end());
+
+                    // Merge vectors once per thread
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+                    {
+                        for (std::vector<std::vector<int> >::iterator it = const_omp.begin();
+                             it != const_omp.end(); ++it) {
+                            const_mat.push_back(*it);
+                        }
+                    }
+                    const_omp.clear();
+
                     memory->deallocate(intarr_omp);
                     memory->deallocate(intarr_copy_omp);
 
@@ -1017,23 +1027,20 @@ void Constraint::rotational_invariance()
 
     int i, j;
     int iat, jat;
-    int icrd, jcrd;
+    int icrd;
     int order;
     int maxorder = interaction->maxorder;
     int natmin = symmetry->natmin;
     int mu, nu;
-    int ixyz, nxyz, nxyz2;
-    int mu_lambda, lambda;
-    int levi_factor;
+    int nxyz = 0, nxyz2;
+    int idata, ndata;
+    int loc_found;
 
-    int *ind;
     int **xyzcomponent, **xyzcomponent2;
     int *nparams, nparam_sub;
-    int *interaction_index, *interaction_atom;
-    int *interaction_tmp;
+    int *interaction_index;
 
     double *arr_constraint;
-    double *arr_constraint_self;
 
     bool valid_rotation_axis[3][3];
 
@@ -1041,19 +1048,21 @@ void Constraint::rotational_invariance()
 
     std::vector<int> interaction_list, interaction_list_old, interaction_list_now;
 
-    std::set<FcProperty> list_found;
-    std::set<FcProperty> list_found_last;
-    std::set<FcProperty>::iterator iter_found;
-
     CombinationWithRepetition<int> g;
 
     std::vector<int> atom_tmp;
     std::vector<std::vector<int> > cell_dummy;
     std::set<MinimumDistanceCluster>::iterator iter_cluster;
 
+    // Constraints found for each cluster are stored in the buffers below
+    // and appended to the global lists in the order of the clusters
+    // so that the result does not depend on the number of threads.
+
+    std::vector<std::vector<int> > data_vec;
+    std::vector<std::vector<ConstraintClass> > buf_self_last, buf_self, buf_cross;
+
     setup_rotation_axis(valid_rotation_axis);
 
-    memory->allocate(ind, maxorder + 1);
     memory->allocate(nparams, maxorder);
 
     for (order = 0; order < maxorder; ++order) {
@@ -1073,35 +1082,18 @@ void Constraint::rotational_invariance()
         }
 
         memory->allocate(arr_constraint, nparam_sub);
-        memory->allocate(arr_constraint_self, nparams[order]);
-        memory->allocate(interaction_atom, order + 2);
         memory->allocate(interaction_index, order + 2);
-        memory->allocate(interaction_tmp, order + 2);
 
         if (order > 0) {
-            list_found_last = list_found;
             nxyz = static_cast<int>(pow(static_cast<double>(3), order));
             memory->allocate(xyzcomponent, nxyz, order);
             fcs->get_xyzcomponent(order, xyzcomponent);
         }
 
-        list_found.clear();
-
-        for (std::vector<FcProperty>::iterator p = fcs->fc_set[order].begin();
-             p != fcs->fc_set[order].end(); ++p) {
-            for (i = 0; i < order + 2; ++i) {
-                ind[i] = (*p).elems[i];
-            }
-            list_found.insert(FcProperty(order + 2, (*p).coef,
-                                         ind, (*p).mother));
-        }
-
         for (i = 0; i < natmin; ++i) {
 
             iat = symmetry->map_p2s[i][0];
 
-            interaction_atom[0] = iat;
-
             if (order == 0) {
 
                 interaction_list_now.clear();
@@ -1131,8 +1123,7 @@ void Constraint::rotational_invariance()
 
                                 jat = *iter_list;
                                 interaction_index[1] = 3 * jat + mu;
-                                iter_found = list_found.find(FcProperty(order + 2, 1.0,
-                                                                        interaction_index, 1));
+                                loc_found = fcs->fc_table[order].find(interaction_index);
 
                                 atom_tmp.clear();
                                 atom_tmp.push_back(jat);
@@ -1161,20 +1152,19 @@ void Constraint::rotational_invariance()
                                 }
 
 
-                                if (iter_found != list_found.end()) {
-                                    arr_constraint[(*iter_found).mother]
-                                        += (*iter_found).coef * vec_for_rot[nu];
+                                if (loc_found != -1) {
+                                    arr_constraint[fcs->fc_set[order][loc_found].mother]
+                                        += fcs->fc_set[order][loc_found].coef * vec_for_rot[nu];
                                 }
 
-                                // Exchange mu <--> nu and repeat again. 
+                                // Exchange mu <--> nu and repeat again.
                                 // Note that the sign is inverted (+ --> -) in the summation
 
                                 interaction_index[1] = 3 * jat + nu;
-                                iter_found = list_found.find(FcProperty(order + 2, 1.0,
-                                                                        interaction_index, 1));
-                                if (iter_found != list_found.end()) {
-                                    arr_constraint[(*iter_found).mother]
-                                        -= (*iter_found).coef * vec_for_rot[mu];
+                                loc_found = fcs->fc_table[order].find(interaction_index);
+                                if (loc_found != -1) {
+                                    arr_constraint[fcs->fc_set[order][loc_found].mother]
+                                        -= fcs->fc_set[order][loc_found].coef * vec_for_rot[mu];
                                 }
                             }
 
@@ -1206,8 +1196,6 @@ void Constraint::rotational_invariance()
 
                 for (icrd = 0; icrd < 3; ++icrd) {
 
-                    interaction_index[0] = 3 * iat + icrd;
-
                     CombinationWithRepetition<int> g_now(interaction_list_now.begin(),
                                                          interaction_list_now.end(), order);
                     CombinationWithRepetition<int> g_old(interaction_list_old.begin(),
@@ -1227,156 +1215,222 @@ void Constraint::rotational_invariance()
                             interaction_list = interaction_list_old;
                         }
 
-                        // Loop for the interacting pairs
-
+                        data_vec.clear();
                         do {
-                            std::vector<int> data = g.now();
+                            data_vec.push_back(g.now());
+                        } while (g.next());
 
-                            for (int idata = 0; idata < data.size(); ++idata)
-                                interaction_atom[idata + 1] = data[idata];
+                        ndata = data_vec.size();
 
-                            for (ixyz = 0; ixyz < nxyz; ++ixyz) {
+                        buf_self_last.clear();
+                        buf_self.clear();
+                        buf_cross.clear();
+                        buf_self_last.resize(ndata);
+                        buf_self.resize(ndata);
+                        buf_cross.resize(ndata);
+
+#ifdef _OPENMP
+#pragma omp parallel private(j)
+#endif
+                        {
+                            int ixyz, jcrd, lambda, mu_lambda, levi_factor;
+                            int jat_omp, mu_omp, nu_omp;
+                            int loc_found_omp;
+                            int *interaction_atom_omp, *interaction_index_omp, *interaction_tmp_omp;
+                            double *arr_constraint_omp;
+                            double vec_for_rot_omp[3];
+                            std::vector<int> atom_tmp_omp;
+                            std::vector<std::vector<int> > cell_dummy_omp;
+                            std::set<MinimumDistanceCluster>::iterator iter_cluster_omp;
+
+                            memory->allocate(interaction_atom_omp, order + 2);
+                            memory->allocate(interaction_index_omp, order + 2);
+                            memory->allocate(interaction_tmp_omp, order + 2);
+                            memory->allocate(arr_constraint_omp, nparam_sub);
+
+                            for (j = 0; j < 3; ++j) vec_for_rot_omp[j] = 0.0;
+
+                            interaction_atom_omp[0] = iat;
+                            interaction_index_omp[0] = 3 * iat + icrd;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+                            for (idata = 0; idata < ndata; ++idata) {
 
                                 for (j = 0; j < order; ++j)
-                                    interaction_index[j + 1] = 3 * interaction_atom[j + 1] + xyzcomponent[ixyz][j];
+                                    interaction_atom_omp[j + 1] = data_vec[idata][j];
 
-                                for (mu = 0; mu < 3; ++mu) {
+                                for (ixyz = 0; ixyz < nxyz; ++ixyz) {
 
-                                    for (nu = 0; nu < 3; ++nu) {
+                                    for (j = 0; j < order; ++j)
+                                        interaction_index_omp[j + 1]
+                                            = 3 * interaction_atom_omp[j + 1] + xyzcomponent[ixyz][j];
 
-                                        if (!valid_rotation_axis[mu][nu]) continue;
+                                    for (mu_omp = 0; mu_omp < 3; ++mu_omp) {
 
-                                        // Search for a new constraint below
+                                        for (nu_omp = 0; nu_omp < 3; ++nu_omp) {
 
-                                        for (j = 0; j < nparam_sub; ++j) arr_constraint[j] = 0.0;
+                                            if (!valid_rotation_axis[mu_omp][nu_omp]) continue;
 
-                                        // Loop for m_{N+1}, a_{N+1}
-                                        for (std::vector<int>::iterator iter_list = interaction_list.begin();
-                                             iter_list != interaction_list.end(); ++iter_list) {
-                                            jat = *iter_list;
+                                            // Search for a new constraint below
 
-                                            interaction_atom[order + 1] = jat;
-                                            if (!interaction->is_incutoff(order + 2, interaction_atom, order)) continue;
+                                            for (j = 0; j < nparam_sub; ++j) arr_constraint_omp[j] = 0.0;
 
-                                            atom_tmp.clear();
+                                            // Loop for m_{N+1}, a_{N+1}
+                                            for (std::vector<int>::iterator iter_list = interaction_list.begin();
+                                                 iter_list != interaction_list.end(); ++iter_list) {
+                                                jat_omp = *iter_list;
 
-                                            for (j = 1; j < order + 2; ++j) {
-                                                atom_tmp.push_back(interaction_atom[j]);
-                                            }
-                                            std::sort(atom_tmp.begin(), atom_tmp.end());
+                                                interaction_atom_omp[order + 1] = jat_omp;
+                                                if (!interaction->is_incutoff(order + 2, interaction_atom_omp, order))
+                                                    continue;
+
+                                                atom_tmp_omp.clear();
+
+                                                for (j = 1; j < order + 2; ++j) {
+                                                    atom_tmp_omp.push_back(interaction_atom_omp[j]);
+                                                }
+                                                std::sort(atom_tmp_omp.begin(), atom_tmp_omp.end());
 
-                                            iter_cluster = interaction->mindist_cluster[order][i].find(
-                                                MinimumDistanceCluster(atom_tmp, cell_dummy));
-                                            if (iter_cluster != interaction->mindist_cluster[order][i].end()) {
+                                                iter_cluster_omp = interaction->mindist_cluster[order][i].find(
+                                                    MinimumDistanceCluster(atom_tmp_omp, cell_dummy_omp));
+                                                if (iter_cluster_omp != interaction->mindist_cluster[order][i].end()) {
 
-                                                int iloc = -1;
+                                                    int iloc = -1;
 
-                                                for (j = 0; j < atom_tmp.size(); ++j) {
-                                                    if (atom_tmp[j] == jat) {
-                                                        iloc = j;
-                                                        break;
+                                                    for (j = 0; j < static_cast<int>(atom_tmp_omp.size()); ++j) {
+                                                        if (atom_tmp_omp[j] == jat_omp) {
+                                                            iloc = j;
+                                                            break;
+                                                        }
                                                     }
-                                                }
 
-                                                if (iloc == -1) {
-                                                    error->exit("rotational_invariance", "This cannot happen.");
-                                                }
+                                                    if (iloc == -1) {
+                                                        error->exit("rotational_invariance", "This cannot happen.");
+                                                    }
 
-                                                for (j = 0; j < 3; ++j) vec_for_rot[j] = 0.0;
+                                                    for (j = 0; j < 3; ++j) vec_for_rot_omp[j] = 0.0;
 
-                                                int nsize_equiv = (*iter_cluster).cell.size();
+                                                    int nsize_equiv = (*iter_cluster_omp).cell.size();
 
-                                                for (j = 0; j < nsize_equiv; ++j) {
-                                                    for (int k = 0; k < 3; ++k) {
-                                                        vec_for_rot[k] += interaction->x_image[(*iter_cluster).cell[j][iloc]][jat][k];
+                                                    for (j = 0; j < nsize_equiv; ++j) {
+                                                        for (int k = 0; k < 3; ++k) {
+                                                            vec_for_rot_omp[k]
+                                                                += interaction->x_image[(*iter_cluster_omp).cell[j][iloc]][jat_omp][k];
+                                                        }
                                                     }
-                                                }
 
-                                                for (j = 0; j < 3; ++j) {
-                                                    vec_for_rot[j] /= static_cast<double>(nsize_equiv);
+                                                    for (j = 0; j < 3; ++j) {
+                                                        vec_for_rot_omp[j] /= static_cast<double>(nsize_equiv);
+                                                    }
                                                 }
-                                            }
 
 
-                                            // mu, nu
+                                                // mu, nu
 
-                                            interaction_index[order + 1] = 3 * jat + mu;
-                                            for (j = 0; j < order + 2; ++j) interaction_tmp[j] = interaction_index[j];
+                                                interaction_index_omp[order + 1] = 3 * jat_omp + mu_omp;
+                                                for (j = 0; j < order + 2; ++j)
+                                                    interaction_tmp_omp[j] = interaction_index_omp[j];
 
-                                            fcs->sort_tail(order + 2, interaction_tmp);
+                                                fcs->sort_tail(order + 2, interaction_tmp_omp);
 
-                                            iter_found = list_found.find(FcProperty(order + 2, 1.0, interaction_tmp, 1));
-                                            if (iter_found != list_found.end()) {
-                                                arr_constraint[nparams[order - 1] + (*iter_found).mother]
-                                                    += (*iter_found).coef * vec_for_rot[nu];
-                                            }
+                                                loc_found_omp = fcs->fc_table[order].find(interaction_tmp_omp);
+                                                if (loc_found_omp != -1) {
+                                                    arr_constraint_omp[nparams[order - 1]
+                                                                       + fcs->fc_set[order][loc_found_omp].mother]
+                                                        += fcs->fc_set[order][loc_found_omp].coef * vec_for_rot_omp[nu_omp];
+                                                }
 
-                                            // Exchange mu <--> nu and repeat again.
+                                                // Exchange mu <--> nu and repeat again.
 
-                                            interaction_index[order + 1] = 3 * jat + nu;
-                                            for (j = 0; j < order + 2; ++j) interaction_tmp[j] = interaction_index[j];
+                                                interaction_index_omp[order + 1] = 3 * jat_omp + nu_omp;
+                                                for (j = 0; j < order + 2; ++j)
+                                                    interaction_tmp_omp[j] = interaction_index_omp[j];
 
-                                            fcs->sort_tail(order + 2, interaction_tmp);
+                                                fcs->sort_tail(order + 2, interaction_tmp_omp);
 
-                                            iter_found = list_found.find(FcProperty(order + 2, 1.0, interaction_tmp, 1));
-                                            if (iter_found != list_found.end()) {
-                                                arr_constraint[nparams[order - 1] + (*iter_found).mother]
-                                                    -= (*iter_found).coef * vec_for_rot[mu];
+                                                loc_found_omp = fcs->fc_table[order].find(interaction_tmp_omp);
+                                                if (loc_found_omp != -1) {
+                                                    arr_constraint_omp[nparams[order - 1]
+                                                                       + fcs->fc_set[order][loc_found_omp].mother]
+                                                        -= fcs->fc_set[order][loc_found_omp].coef * vec_for_rot_omp[mu_omp];
+                                                }
                                             }
-                                        }
 
-                                        for (lambda = 0; lambda < order + 1; ++lambda) {
+                                            for (lambda = 0; lambda < order + 1; ++lambda) {
 
-                                            mu_lambda = interaction_index[lambda] % 3;
+                                                mu_lambda = interaction_index_omp[lambda] % 3;
 
-                                            for (jcrd = 0; jcrd < 3; ++jcrd) {
+                                                for (jcrd = 0; jcrd < 3; ++jcrd) {
 
-                                                for (j = 0; j < order + 1; ++j) interaction_tmp[j] = interaction_index[j];
+                                                    for (j = 0; j < order + 1; ++j)
+                                                        interaction_tmp_omp[j] = interaction_index_omp[j];
 
-                                                interaction_tmp[lambda] = 3 * interaction_atom[lambda] + jcrd;
+                                                    interaction_tmp_omp[lambda] = 3 * interaction_atom_omp[lambda] + jcrd;
 
-                                                levi_factor = 0;
+                                                    levi_factor = 0;
 
-                                                for (j = 0; j < 3; ++j) {
-                                                    levi_factor += levi_civita(j, mu, nu) * levi_civita(j, mu_lambda, jcrd);
-                                                }
+                                                    for (j = 0; j < 3; ++j) {
+                                                        levi_factor += levi_civita(j, mu_omp, nu_omp)
+                                                            * levi_civita(j, mu_lambda, jcrd);
+                                                    }
 
-                                                if (levi_factor == 0) continue;
+                                                    if (levi_factor == 0) continue;
 
-                                                fcs->sort_tail(order + 1, interaction_tmp);
+                                                    fcs->sort_tail(order + 1, interaction_tmp_omp);
 
-                                                iter_found = list_found_last.find(FcProperty(order + 1, 1.0,
-                                                                                             interaction_tmp, 1));
-                                                if (iter_found != list_found_last.end()) {
-                                                    arr_constraint[(*iter_found).mother]
-                                                        += (*iter_found).coef * static_cast<double>(levi_factor);
+                                                    loc_found_omp = fcs->fc_table[order - 1].find(interaction_tmp_omp);
+                                                    if (loc_found_omp != -1) {
+                                                        arr_constraint_omp[fcs->fc_set[order - 1][loc_found_omp].mother]
+                                                            += fcs->fc_set[order - 1][loc_found_omp].coef
+                                                            * static_cast<double>(levi_factor);
+                                                    }
                                                 }
                                             }
-                                        }
 
-                                        if (!is_allzero(nparam_sub, arr_constraint)) {
-
-                                            // A Candidate for another constraint found !
-                                            // Add to the appropriate set
-
-                                            if (is_allzero(nparam_sub, arr_constraint, nparams[order - 1])) {
-                                                const_rotation_self[order - 1].push_back(
-                                                    ConstraintClass(nparams[order - 1], arr_constraint));
-                                            } else if (is_allzero(nparams[order - 1], arr_constraint)) {
-                                                const_rotation_self[order].push_back(
-                                                    ConstraintClass(nparam_sub, arr_constraint, nparams[order - 1]));
-                                            } else {
-                                                const_rotation_cross[order].push_back(
-                                                    ConstraintClass(nparam_sub, arr_constraint));
+                                            if (!is_allzero(nparam_sub, arr_constraint_omp)) {
+
+                                                // A Candidate for another constraint found !
+                                                // Add to the appropriate set
+
+                                                if (is_allzero(nparam_sub, arr_constraint_omp, nparams[order - 1])) {
+                                                    buf_self_last[idata].push_back(
+                                                        ConstraintClass(nparams[order - 1], arr_constraint_omp));
+                                                } else if (is_allzero(nparams[order - 1], arr_constraint_omp)) {
+                                                    buf_self[idata].push_back(
+                                                        ConstraintClass(nparam_sub, arr_constraint_omp,
+                                                                        nparams[order - 1]));
+                                                } else {
+                                                    buf_cross[idata].push_back(
+                                                        ConstraintClass(nparam_sub, arr_constraint_omp));
+                                                }
                                             }
-                                        }
-
-                                    } // nu
-                                } // mu
-
-                            } // ixyz
 
-                        } while (g.next());
+                                        } // nu
+                                    } // mu
+
+                                } // ixyz
+                            } // idata
+
+                            memory->deallocate(interaction_atom_omp);
+                            memory->deallocate(interaction_index_omp);
+                            memory->deallocate(interaction_tmp_omp);
+                            memory->deallocate(arr_constraint_omp);
+
+                        } // close openmp region
+
+                        for (idata = 0; idata < ndata; ++idata) {
+                            const_rotation_self[order - 1].insert(const_rotation_self[order - 1].end(),
+                                                                  buf_self_last[idata].begin(),
+                                                                  buf_self_last[idata].end());
+                            const_rotation_self[order].insert(const_rotation_self[order].end(),
+                                                              buf_self[idata].begin(),
+                                                              buf_self[idata].end());
+                            const_rotation_cross[order].insert(const_rotation_cross[order].end(),
+                                                               buf_cross[idata].begin(),
+                                                               buf_cross[idata].end());
+                        }
 
                     } // direction
                 } // icrd
@@ -1393,71 +1447,111 @@ void Constraint::rotational_invariance()
 
                 for (icrd = 0; icrd < 3; ++icrd) {
 
-                    interaction_index[0] = 3 * interaction_atom[0] + icrd;
-
                     CombinationWithRepetition<int> g_now(interaction_list_now.begin(),
                                                          interaction_list_now.end(), order + 1);
+                    data_vec.clear();
                     do {
+                        data_vec.push_back(g_now.now());
+                    } while (g_now.next());
 
-                        std::vector<int> data = g_now.now();
+                    ndata = data_vec.size();
 
-                        for (int idata = 0; idata < data.size(); ++idata)
-                            interaction_atom[idata + 1] = data[idata];
+                    buf_self.clear();
+                    buf_self.resize(ndata);
+
+#ifdef _OPENMP
+#pragma omp parallel private(j)
+#endif
+                    {
+                        int ixyz, jcrd, lambda, mu_lambda, levi_factor;
+                        int mu_omp, nu_omp;
+                        int loc_found_omp;
+                        int *interaction_atom_omp, *interaction_index_omp, *interaction_tmp_omp;
+                        double *arr_constraint_self_omp;
 
-                        for (ixyz = 0; ixyz < nxyz2; ++ixyz) {
+                        memory->allocate(interaction_atom_omp, order + 2);
+                        memory->allocate(interaction_index_omp, order + 2);
+                        memory->allocate(interaction_tmp_omp, order + 2);
+                        memory->allocate(arr_constraint_self_omp, nparams[order]);
+
+                        interaction_atom_omp[0] = iat;
+                        interaction_index_omp[0] = 3 * iat + icrd;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+                        for (idata = 0; idata < ndata; ++idata) {
 
                             for (j = 0; j < order + 1; ++j)
-                                interaction_index[j + 1] = 3 * interaction_atom[j + 1] + xyzcomponent2[ixyz][j];
+                                interaction_atom_omp[j + 1] = data_vec[idata][j];
 
-                            for (mu = 0; mu < 3; ++mu) {
+                            for (ixyz = 0; ixyz < nxyz2; ++ixyz) {
 
-                                for (nu = 0; nu < 3; ++nu) {
+                                for (j = 0; j < order + 1; ++j)
+                                    interaction_index_omp[j + 1]
+                                        = 3 * interaction_atom_omp[j + 1] + xyzcomponent2[ixyz][j];
 
-                                    if (!valid_rotation_axis[mu][nu]) continue;
+                                for (mu_omp = 0; mu_omp < 3; ++mu_omp) {
 
-                                    for (j = 0; j < nparams[order]; ++j) arr_constraint_self[j] = 0.0;
+                                    for (nu_omp = 0; nu_omp < 3; ++nu_omp) {
 
-                                    for (lambda = 0; lambda < order + 2; ++lambda) {
+                                        if (!valid_rotation_axis[mu_omp][nu_omp]) continue;
 
-                                        mu_lambda = interaction_index[lambda] % 3;
+                                        for (j = 0; j < nparams[order]; ++j) arr_constraint_self_omp[j] = 0.0;
 
-                                        for (jcrd = 0; jcrd < 3; ++jcrd) {
+                                        for (lambda = 0; lambda < order + 2; ++lambda) {
 
-                                            for (j = 0; j < order + 2; ++j)
-                                                interaction_tmp[j] = interaction_index[j];
+                                            mu_lambda = interaction_index_omp[lambda] % 3;
 
-                                            interaction_tmp[lambda] = 3 * interaction_atom[lambda] + jcrd;
+                                            for (jcrd = 0; jcrd < 3; ++jcrd) {
 
-                                            levi_factor = 0;
-                                            for (j = 0; j < 3; ++j) {
-                                                levi_factor += levi_civita(j, mu, nu) * levi_civita(j, mu_lambda, jcrd);
-                                            }
+                                                for (j = 0; j < order + 2; ++j)
+                                                    interaction_tmp_omp[j] = interaction_index_omp[j];
 
-                                            if (levi_factor == 0) continue;
+                                                interaction_tmp_omp[lambda] = 3 * interaction_atom_omp[lambda] + jcrd;
 
-                                            fcs->sort_tail(order + 2, interaction_tmp);
+                                                levi_factor = 0;
+                                                for (j = 0; j < 3; ++j) {
+                                                    levi_factor += levi_civita(j, mu_omp, nu_omp)
+                                                        * levi_civita(j, mu_lambda, jcrd);
+                                                }
 
-                                            iter_found = list_found.find(FcProperty(order + 2, 1.0,
-                                                                                    interaction_tmp, 1));
-                                            if (iter_found != list_found.end()) {
-                                                arr_constraint_self[(*iter_found).mother]
-                                                    += (*iter_found).coef * static_cast<double>(levi_factor);
-                                            }
-                                        } // jcrd
-                                    } // lambda
+                                                if (levi_factor == 0) continue;
 
-                                    if (!is_allzero(nparams[order], arr_constraint_self)) {
-                                        const_rotation_self[order].push_back(
-                                            ConstraintClass(nparams[order], arr_constraint_self));
-                                    }
+                                                fcs->sort_tail(order + 2, interaction_tmp_omp);
 
-                                } // nu
-                            } // mu
+                                                loc_found_omp = fcs->fc_table[order].find(interaction_tmp_omp);
+                                                if (loc_found_omp != -1) {
+                                                    arr_constraint_self_omp[fcs->fc_set[order][loc_found_omp].mother]
+                                                        += fcs->fc_set[order][loc_found_omp].coef
+                                                        * static_cast<double>(levi_factor);
+                                                }
+                                            } // jcrd
+                                        } // lambda
 
-                        } // ixyz
+                                        if (!is_allzero(nparams[order], arr_constraint_self_omp)) {
+                                            buf_self[idata].push_back(
+                                                ConstraintClass(nparams[order], arr_constraint_self_omp));
+                                        }
 
+                                    } // nu
+                                } // mu
 
-                    } while (g_now.next());
+                            } // ixyz
+                        } // idata
+
+                        memory->deallocate(interaction_atom_omp);
+                        memory->deallocate(interaction_index_omp);
+                        memory->deallocate(interaction_tmp_omp);
+                        memory->deallocate(arr_constraint_self_omp);
+
+                    } // close openmp region
+
+                    for (idata = 0; idata < ndata; ++idata) {
+                        const_rotation_self[order].insert(const_rotation_self[order].end(),
+                                                          buf_self[idata].begin(),
+                                                          buf_self[idata].end());
+                    }
 
                 } // icrd
 
@@ -1471,12 +1565,13 @@ void Constraint::rotational_invariance()
             memory->deallocate(xyzcomponent);
         }
         memory->deallocate(arr_constraint);
-        memory->deallocate(arr_constraint_self);
-        memory->deallocate(interaction_tmp);
         memory->deallocate(interaction_index);
-        memory->deallocate(interaction_atom);
     } // order
 
+    buf_self_last.clear();
+    buf_self.clear();
+    buf_cross.clear();
+
     for (order = 0; order < maxorder; ++order) {
         remove_redundant_rows(nparam_sub, const_rotation_cross[order], eps6);
         remove_redundant_rows(nparams[order], const_rotation_self[order], eps6);
@@ -1484,7 +1579,6 @@ void Constraint::rotational_invariance()
 
     std::cout << "  Finished !" << std::endl << std::endl;
 
-    memory->deallocate(ind);
     memory->deallocate(nparams);
 }
 
@@ -1559,76 +1653,41 @@ void Constraint::remove_redundant_rows(const int n,
     }
 #else 
     int i, j;
-
+    std::size_t k;
+    int nrank;
     int nparam = n;
-    int nconst = Constraint_vec.size();
     double *arr_tmp;
-    double **mat_tmp;
-
-    int nrank;
+    std::vector<std::vector<std::pair<int, double> > > rows;
 
-    if (nconst > 0) {
+    if (Constraint_vec.size() > 0) {
 
-        memory->allocate(mat_tmp, nconst, nparam);
+        rows.resize(Constraint_vec.size());
 
         i = 0;
-
         for (std::vector<ConstraintClass>::iterator p = Constraint_vec.begin();
              p != Constraint_vec.end(); ++p) {
             for (j = 0; j < nparam; ++j) {
-                mat_tmp[i][j] = (*p).w_const[j];
+                if ((*p).w_const[j] != 0.0) {
+                    rows[i].push_back(std::pair<int, double>(j, (*p).w_const[j]));
+                }
             }
             ++i;
         }
 
-        rref(nconst, nparam, mat_tmp, nrank, tolerance);
-
-        /*
-        // 		// Transpose matrix A 
-
-        memory->allocate(arr_tmp, nconst * nparam);
-
-        k = 0;
-
-        for (j = 0; j < nparam; ++j) {
-        for (i = 0; i < nconst; ++i) {
-        arr_tmp[k++] = mat_tmp[i][j];
-        }
-        }
-
-        // Perform LU decomposition
-
-        int nmin = std::min<int>(nconst, nparam);
-        memory->allocate(ipiv, nmin);
-
-        dgetrf_(&nconst, &nparam, arr_tmp, &nconst, ipiv, &INFO);
-
-        k = 0;
-
-        for (j = 0; j < nparam; ++j) {
-        for (i = 0; i < nconst; ++i) {
-        mat_tmp[i][j] = arr_tmp[k++];
-        }
-        }
-
-        memory->deallocate(arr_tmp);
-        memory->deallocate(ipiv);
-        */
+        rref_sparse(nparam, rows, nrank, tolerance);
 
         memory->allocate(arr_tmp, nparam);
 
         Constraint_vec.clear();
 
         for (i = 0; i < nrank; ++i) {
-            for (j = 0; j < i; ++j) arr_tmp[j] = 0.0;
-
-            for (j = i; j < nparam; ++j) {
-                arr_tmp[j] = mat_tmp[i][j];
+            for (j = 0; j < nparam; ++j) arr_tmp[j] = 0.0;
+            for (k = 0; k < rows[i].size(); ++k) {
+                arr_tmp[rows[i][k].first] = rows[i][k].second;
             }
             Constraint_vec.push_back(ConstraintClass(nparam, arr_tmp));
         }
 
-        memory->deallocate(mat_tmp);
         memory->deallocate(arr_tmp);
     }
 
@@ -1731,62 +1790,287 @@ void Constraint::rref(int nrows,
 {
     // Return the reduced row echelon form (rref) of matrix mat.
     // In addition, rank of the matrix is estimated.
+    // The rows below the rank are set to zero.
 
-    int irow, icol, jrow, jcol;
-    int pivot;
-    double tmp, *arr;
-
-    memory->allocate(arr, ncols);
+    int irow, icol;
+    std::size_t j;
+    std::vector<std::vector<std::pair<int, double> > > rows(nrows);
 
-    nrank = 0;
+    for (irow = 0; irow < nrows; ++irow) {
+        for (icol = 0; icol < ncols; ++icol) {
+            if (mat[irow][icol] != 0.0) {
+                rows[irow].push_back(std::pair<int, double>(icol, mat[irow][icol]));
+            }
+        }
+    }
 
-    icol = 0;
+    rref_sparse(ncols, rows, nrank, tolerance);
 
     for (irow = 0; irow < nrows; ++irow) {
+        for (icol = 0; icol < ncols; ++icol) {
+            mat[irow][icol] = 0.0;
+        }
+    }
+    for (irow = 0; irow < nrank; ++irow) {
+        for (j = 0; j < rows[irow].size(); ++j) {
+            mat[irow][rows[irow][j].first] = rows[irow][j].second;
+        }
+    }
+}
+
+namespace
+{
+    // Scalar operations used in Constraint::rref_sparse_impl
+
+    inline bool is_zero_value(const double x)
+    {
+        return x == 0.0;
+    }
+
+    inline bool is_zero_value(const ALM_NS::RationalNumber &x)
+    {
+        return x.num == 0;
+    }
+
+    // Criteria for a pivot element. Floating-point elements smaller than
+    // the tolerance are not used as pivots, while exact rational elements
+    // only need to be nonzero.
 
-        pivot = irow;
+    struct PivotAboveTolerance
+    {
+        double tolerance;
 
-        while (std::abs(mat[pivot][icol]) < tolerance) {
-            ++pivot;
+        PivotAboveTolerance(const double tol) : tolerance(tol) {}
 
-            if (pivot == nrows) {
-                pivot = irow;
-                ++icol;
+        bool operator()(const double x) const
+        {
+            return std::abs(x) >= tolerance;
+        }
+    };
 
-                if (icol == ncols) break;
+    struct PivotNonzero
+    {
+        bool operator()(const ALM_NS::RationalNumber &x) const
+        {
+            return x.num != 0;
+        }
+    };
+
+    inline bool is_negligible(const double x)
+    {
+        return std::abs(x) < eps15;
+    }
+
+    inline bool is_negligible(const ALM_NS::RationalNumber &x)
+    {
+        return x.num == 0;
+    }
+
+    inline bool is_representable(const double)
+    {
+        return true;
+    }
+
+    inline bool is_representable(const ALM_NS::RationalNumber &x)
+    {
+        return x.is_small();
+    }
+
+    bool to_rational(const double x, ALM_NS::RationalNumber &r)
+    {
+        // Accept x = n / d with d <= 12
+
+        long long n;
+        double xd;
+
+        for (long long d = 1; d <= 12; ++d) {
+            xd = x * static_cast<double>(d);
+            if (std::abs(xd) > 1.0e+9) return false;
+            n = static_cast<long long>(xd > 0.0 ? xd + 0.5 : xd - 0.5);
+            if (std::abs(xd - static_cast<double>(n)) < eps12 * std::max<double>(1.0, std::abs(xd))) {
+                r = ALM_NS::RationalNumber(n, d);
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+template <typename T, typename Pivot>
+bool Constraint::rref_sparse_impl(const int ncols,
+                                  std::vector<std::vector<std::pair<int, T> > > &rows,
+                                  const Pivot &is_pivot_candidate)
+{
+    // Gauss-Jordan elimination on sparse rows.
+    // Each input row is reduced against the pivot rows found so far, and
+    // becomes a new pivot row if a nonzero element remains. The pivot rows
+    // are then reduced from the last pivot column backward.
+    // On exit, rows contains the nonzero rows of the rref sorted by the pivot column.
+    // Returns false if an element cannot be represented by T.
+
+    std::size_t i, j, k;
+    int ip, icol, ipiv;
+    int lead;
+    T factor;
+    std::vector<std::vector<std::pair<int, T> > > echelon;
+    std::vector<std::pair<int, T> > row_new;
+    std::vector<int> pivot_index(ncols, -1);
+    std::vector<int> pivot_cols;
+    std::vector<T> work(ncols, T(0));
+    std::set<int> nonzero;
+    std::set<int>::iterator it;
+
+    // Forward elimination
+
+    for (i = 0; i < rows.size(); ++i) {
+
+        nonzero.clear();
+        for (j = 0; j < rows[i].size(); ++j) {
+            work[rows[i][j].first] = rows[i][j].second;
+            nonzero.insert(rows[i][j].first);
+        }
+
+        for (it = nonzero.begin(); it != nonzero.end(); ++it) {
+            ip = pivot_index[*it];
+            if (ip == -1 || is_zero_value(work[*it])) continue;
+
+            factor = work[*it];
+            for (j = 1; j < echelon[ip].size(); ++j) {
+                icol = echelon[ip][j].first;
+                nonzero.insert(icol);
+                work[icol] = work[icol] - factor * echelon[ip][j].second;
+                if (!is_representable(work[icol])) return false;
+            }
+            work[*it] = T(0);
+        }
+
+        lead = -1;
+        row_new.clear();
+
+        for (it = nonzero.begin(); it != nonzero.end(); ++it) {
+            if (lead == -1) {
+                if (is_pivot_candidate(work[*it])) {
+                    lead = *it;
+                    row_new.push_back(std::pair<int, T>(*it, work[*it]));
+                }
+            } else if (!is_negligible(work[*it])) {
+                row_new.push_back(std::pair<int, T>(*it, work[*it]));
             }
+            work[*it] = T(0);
         }
 
-        if (icol == ncols) break;
+        if (lead == -1) continue;
 
-        if (std::abs(mat[pivot][icol]) > tolerance) ++nrank;
+        factor = T(1) / row_new[0].second;
+        if (!is_representable(factor)) return false;
 
-        if (pivot != irow) {
-#pragma omp parallel for private(tmp)
-            for (jcol = icol; jcol < ncols; ++jcol) {
-                tmp = mat[pivot][jcol];
-                mat[pivot][jcol] = mat[irow][jcol];
-                mat[irow][jcol] = tmp;
+        row_new[0].second = T(1);
+        for (j = 1; j < row_new.size(); ++j) {
+            row_new[j].second = row_new[j].second * factor;
+            if (!is_representable(row_new[j].second)) return false;
+        }
+
+        pivot_index[lead] = echelon.size();
+        pivot_cols.push_back(lead);
+        echelon.push_back(row_new);
+    }
+
+    // Backward elimination. A pivot row contains no other pivot columns
+    // once the rows of the larger pivot columns are reduced.
+
+    std::sort(pivot_cols.begin(), pivot_cols.end());
+
+    for (ipiv = static_cast<int>(pivot_cols.size()) - 1; ipiv >= 0; --ipiv) {
+
+        std::vector<std::pair<int, T> > &row_now = echelon[pivot_index[pivot_cols[ipiv]]];
+
+        nonzero.clear();
+        for (j = 0; j < row_now.size(); ++j) {
+            work[row_now[j].first] = row_now[j].second;
+            nonzero.insert(row_now[j].first);
+        }
+
+        for (j = 1; j < row_now.size(); ++j) {
+            ip = pivot_index[row_now[j].first];
+            if (ip == -1) continue;
+
+            factor = row_now[j].second;
+            for (k = 1; k < echelon[ip].size(); ++k) {
+                icol = echelon[ip][k].first;
+                nonzero.insert(icol);
+                work[icol] = work[icol] - factor * echelon[ip][k].second;
+                if (!is_representable(work[icol])) return false;
             }
+            work[row_now[j].first] = T(0);
         }
 
-        tmp = mat[irow][icol];
-        tmp = 1.0 / tmp;
-#pragma omp parallel for
-        for (jcol = icol; jcol < ncols; ++jcol) {
-            mat[irow][jcol] *= tmp;
+        row_new.clear();
+        for (it = nonzero.begin(); it != nonzero.end(); ++it) {
+            if (*it == pivot_cols[ipiv] || !is_negligible(work[*it])) {
+                row_new.push_back(std::pair<int, T>(*it, work[*it]));
+            }
+            work[*it] = T(0);
         }
+        row_now.swap(row_new);
+    }
 
-        for (jrow = 0; jrow < nrows; ++jrow) {
-            if (jrow == irow) continue;
+    rows.resize(pivot_cols.size());
+    for (i = 0; i < pivot_cols.size(); ++i) {
+        rows[i].swap(echelon[pivot_index[pivot_cols[i]]]);
+    }
+
+    return true;
+}
+
+void Constraint::rref_sparse(const int ncols,
+                             std::vector<std::vector<std::pair<int, double> > > &rows,
+                             int &nrank,
+                             const double tolerance)
+{
+    // Reduced row echelon form of the matrix given by the sparse rows.
+    // The elements of each row must be sorted by the column index.
+    // When all the elements are integers or simple fractions, the elimination
+    // is performed in exact rational arithmetic.
+    // On exit, rows contains the nrank nonzero rows of the rref.
+
+    std::size_t i, j;
+    bool is_rational = true;
+    double time_start = timer->elapsed();
+    RationalNumber r;
+    std::vector<std::vector<std::pair<int, RationalNumber> > > rows_rational;
+
+    ++ncall_rref;
+    for (i = 0; i < rows.size(); ++i) nnz_rref_in += rows[i].size();
+
+    rows_rational.resize(rows.size());
+    for (i = 0; i < rows.size() && is_rational; ++i) {
+        for (j = 0; j < rows[i].size(); ++j) {
+            if (!to_rational(rows[i][j].second, r)) {
+                is_rational = false;
+                break;
+            }
+            rows_rational[i].push_back(std::pair<int, RationalNumber>(rows[i][j].first, r));
+        }
+    }
 
-            tmp = mat[jrow][icol];
-#pragma omp parallel for
-            for (jcol = icol; jcol < ncols; ++jcol) {
-                mat[jrow][jcol] -= tmp * mat[irow][jcol];
+    if (is_rational) is_rational = rref_sparse_impl(ncols, rows_rational, PivotNonzero());
+
+    if (is_rational) {
+        ++ncall_rref_exact;
+        rows.resize(rows_rational.size());
+        for (i = 0; i < rows_rational.size(); ++i) {
+            rows[i].resize(rows_rational[i].size());
+            for (j = 0; j < rows_rational[i].size(); ++j) {
+                rows[i][j].first = rows_rational[i][j].first;
+                rows[i][j].second = rows_rational[i][j].second.to_double();
             }
         }
+    } else {
+        rref_sparse_impl(ncols, rows, PivotAboveTolerance(tolerance));
     }
 
-    memory->deallocate(arr);
+    nrank = rows.size();
+    for (i = 0; i < rows.size(); ++i) nnz_rref_out += rows[i].size();
+
+    time_rref += timer->elapsed() - time_start;
 }
@@ -14,6 +14,8 @@
 #include <vector>
 #include <set>
 #include <string>
+#include <utility>
+#include <climits>
 #include "pointers.h"
 #include "constants.h"
 #include <boost/bimap.hpp>
@@ -49,6 +51,130 @@ namespace ALM_NS
         }
     };
 
+    // Rational number num / den (den > 0) used for the exact row reduction
+    // of constraints whose coefficients are integers or simple fractions.
+    // The arithmetic is checked for overflow of long long. is_small() becomes
+    // false when an overflow has occurred or the numbers grow too large to be
+    // multiplied safely, in which case the reduction is done in floating point.
+
+    class RationalNumber
+    {
+    public:
+        long long num, den;
+        bool overflow;
+
+        RationalNumber()
+        {
+            num = 0;
+            den = 1;
+            overflow = false;
+        }
+
+        RationalNumber(const long long n, const long long d = 1)
+        {
+            num = n;
+            den = d;
+            overflow = false;
+            normalize();
+        }
+
+        RationalNumber operator-(const RationalNumber &a) const
+        {
+            RationalNumber ret;
+            long long x1, x2;
+            long long g = gcd(den, a.den);
+
+            ret.overflow = overflow || a.overflow
+                || !multiply(num, a.den / g, x1)
+                || !multiply(a.num, den / g, x2)
+                || !subtract(x1, x2, ret.num)
+                || !multiply(den, a.den / g, ret.den);
+            if (!ret.overflow) ret.normalize();
+            return ret;
+        }
+
+        RationalNumber operator*(const RationalNumber &a) const
+        {
+            RationalNumber ret;
+            long long g1 = gcd(num, a.den);
+            long long g2 = gcd(a.num, den);
+
+            ret.overflow = overflow || a.overflow
+                || !multiply(num / g1, a.num / g2, ret.num)
+                || !multiply(den / g2, a.den / g1, ret.den);
+            if (!ret.overflow) ret.normalize();
+            return ret;
+        }
+
+        RationalNumber operator/(const RationalNumber &a) const
+        {
+            RationalNumber inv(a.den, a.num);
+            inv.overflow = a.overflow;
+            return *this * inv;
+        }
+
+        bool is_small() const
+        {
+            const long long limit = 2147483647LL;
+            return !overflow && num < limit && num > -limit && den < limit;
+        }
+
+        double to_double() const
+        {
+            return static_cast<double>(num) / static_cast<double>(den);
+        }
+
+    private:
+        static long long gcd(long long a, long long b)
+        {
+            long long r;
+            if (a < 0) a = -a;
+            if (b < 0) b = -b;
+            while (b != 0) {
+                r = a % b;
+                a = b;
+                b = r;
+            }
+            return a == 0 ? 1 : a;
+        }
+
+        // c = a * b and c = a - b. Return false if |c| would exceed LLONG_MAX.
+
+        static bool multiply(const long long a, const long long b, long long &c)
+        {
+            long long abs_a = a < 0 ? -a : a;
+            long long abs_b = b < 0 ? -b : b;
+            if (abs_b != 0 && abs_a > LLONG_MAX / abs_b) return false;
+            c = a * b;
+            return true;
+        }
+
+        static bool subtract(const long long a, const long long b, long long &c)
+        {
+            if ((b > 0 && a < -LLONG_MAX + b) || (b < 0 && a > LLONG_MAX + b)) {
+                return false;
+            }
+            c = a - b;
+            return true;
+        }
+
+        void normalize()
+        {
+            long long g;
+            if (den < 0) {
+                num = -num;
+                den = -den;
+            }
+            if (num == 0) {
+                den = 1;
+                return;
+            }
+            g = gcd(num, den);
+            num /= g;
+            den /= g;
+        }
+    };
+
     class ConstraintTypeFix
     {
     public:
@@ -112,6 +238,10 @@ namespace ALM_NS
                                     std::vector<ConstraintTypeRelate> *,
                                     boost::bimap<int, int> *, const bool);
 
+        void rref(int, int, double **, int &, double tolerance = eps12);
+        void rref_sparse(const int, std::vector<std::vector<std::pair<int, double> > > &,
+                         int &, const double tolerance = eps12);
+
     private:
 
         bool impose_inv_T, impose_inv_R, exclude_last_R;
@@ -136,9 +266,17 @@ namespace ALM_NS
         void remove_redundant_rows(const int, std::vector<ConstraintClass> &,
                                    const double tolerance = eps12);
 
+        template <typename T, typename Pivot>
+        bool rref_sparse_impl(const int, std::vector<std::vector<std::pair<int, T> > > &,
+                              const Pivot &);
+
+        // Statistics of rref_sparse
+        unsigned long nnz_rref_in, nnz_rref_out;
+        int ncall_rref, ncall_rref_exact;
+        double time_rref;
+
         void remove_redundant_rows2(const int, std::vector<ConstraintClass> &,
                                     const double tolerance = eps12);
-        void rref(int, int, double **, int &, double tolerance = eps12);
     };
 
     extern "C"
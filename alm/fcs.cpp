@@ -12,6 +12,7 @@
 #include <iomanip>
 #include <string>
 #include <cmath>
+#include <algorithm>
 #include "../external/combination.hpp"
 #include <boost/lexical_cast.hpp>
 #include "files.h"
@@ -23,12 +24,24 @@
 #include "system.h"
 #include "timer.h"
 #include "constants.h"
+#include "mathfunctions.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 using namespace ALM_NS;
 
-Fcs::Fcs(ALM *alm) : Pointers(alm) {};
+Fcs::Fcs(ALM *alm) : Pointers(alm)
+{
+    fc_table = NULL;
+};
 
-Fcs::~Fcs() {};
+Fcs::~Fcs()
+{
+    if (fc_table) {
+        memory->deallocate(fc_table);
+    }
+};
 
 void Fcs::init()
 {
@@ -72,6 +85,14 @@ void Fcs::init()
         }
     }
 
+    // Hash tables for looking up the IFCs in fc_set
+
+    if (fc_table) memory->deallocate(fc_table);
+    memory->allocate(fc_table, maxorder);
+    for (int order = 0; order < maxorder; ++order) {
+        fc_table[order].build(fc_set[order], order + 2);
+    }
+
     memory->deallocate(nints);
     memory->deallocate(nzero);
     timer->print_elapsed();
@@ -82,14 +103,18 @@ void Fcs::init()
 
 void Fcs::generate_fclists(int maxorder)
 {
-    int i, j;
-    int i1, i2;
+    // The independent IFCs are searched in the order of the interacting clusters
+    // and their xyz components. For each block of these candidates, the symmetry
+    // orbits are first constructed in parallel and then registered serially
+    // in the original order, which gives the same fc_set and ndup as the
+    // straightforward serial search independent of the number of threads.
+
+    int i, j, k;
     int order;
-    int i_prim;
-    int *atmn, *atmn_mapped;
-    int *ind, *ind_mapped;
-    int *ind_tmp, *ind_mapped_tmp;
+    int *ind_mapped, *ind_mapped_tmp;
     int nxyz;
+    int nsym_avail;
+    int ncand, nblock, icand, ibegin, iend;
     unsigned int isym;
 
     double c_tmp;
@@ -97,21 +122,43 @@ void Fcs::generate_fclists(int maxorder)
     int **xyzcomponent;
 
     int nmother;
+    int ndeps;
     int nat = system->nat;
 
     bool is_zero;
+    bool has_rot_table;
     bool *is_searched;
 
+    std::vector<unsigned int> sym_list;
+    std::vector<std::vector<int> > cluster_atoms;
+    std::vector<int> cand_cluster, cand_xyz;
+    std::vector<std::vector<std::pair<int, double> > > rot_table;
+
+    // Data of the candidates in the current block
+
+    std::vector<IntList> cand_ind;
+    std::vector<char> cand_found, cand_zero;
+    std::vector<std::vector<int> > orbit_ind;
+    std::vector<std::vector<double> > orbit_coef;
+
     std::cout << "  Finding symmetrically-independent force constants ..." << std::endl;
 
-    memory->allocate(atmn, maxorder + 1);
-    memory->allocate(atmn_mapped, maxorder + 1);
-    memory->allocate(ind, maxorder + 1);
     memory->allocate(ind_mapped, maxorder + 1);
-    memory->allocate(ind_tmp, maxorder - 1);
     memory->allocate(ind_mapped_tmp, maxorder + 1);
     memory->allocate(is_searched, 3 * nat);
 
+    sym_list.clear();
+    for (isym = 0; isym < symmetry->nsym; ++isym) {
+        if (symmetry->sym_available[isym]) sym_list.push_back(isym);
+    }
+    nsym_avail = sym_list.size();
+
+#ifdef _OPENMP
+    nblock = 64 * omp_get_max_threads();
+#else
+    nblock = 64;
+#endif
+
     for (order = 0; order < maxorder; ++order) {
 
         std::cout << "   " << std::setw(8) << interaction->str_order[order] << " ...";
@@ -125,94 +172,222 @@ void Fcs::generate_fclists(int maxorder)
         memory->allocate(xyzcomponent, nxyz, order + 2);
         get_xyzcomponent(order + 2, xyzcomponent);
 
-        std::set<IntList> list_found;
+        // Nonzero elements of the rotation tensors
+        // R_{i1,i2} = prod_k symrel[isym][xyz_{i2}(k)][xyz_{i1}(k)]
+        // for all the available symmetry operations.
+        // Computed on the fly when the table is too large.
+
+        has_rot_table = static_cast<double>(nsym_avail) * static_cast<double>(nxyz)
+            * static_cast<double>(nxyz) <= static_cast<double>(1 << 24);
+
+        rot_table.clear();
+        if (has_rot_table) {
+            rot_table.resize(nsym_avail * nxyz);
+#ifdef _OPENMP
+#pragma omp parallel for private(i, j, c_tmp), schedule(dynamic)
+#endif
+            for (k = 0; k < nsym_avail * nxyz; ++k) {
+                i = k / nxyz;
+                for (j = 0; j < nxyz; ++j) {
+                    c_tmp = coef_sym(order + 2, sym_list[i], xyzcomponent[k % nxyz], xyzcomponent[j]);
+                    if (std::abs(c_tmp) > eps12) {
+                        rot_table[k].push_back(std::pair<int, double>(j, c_tmp));
+                    }
+                }
+            }
+        }
+
+        // List of the candidates (cluster, xyz) with ascending indices
+
+        cluster_atoms.clear();
+        cand_cluster.clear();
+        cand_xyz.clear();
 
         for (std::set<IntList>::iterator iter = interaction->pairs[order].begin();
              iter != interaction->pairs[order].end(); ++iter) {
 
-            for (i = 0; i < order + 2; ++i) atmn[i] = (*iter).iarray[i];
-
-            for (i1 = 0; i1 < nxyz; ++i1) {
+            for (j = 0; j < nxyz; ++j) {
                 for (i = 0; i < order + 2; ++i)
-                    ind[i] = 3 * atmn[i] + xyzcomponent[i1][i];
+                    ind_mapped[i] = 3 * (*iter).iarray[i] + xyzcomponent[j][i];
 
-                if (!is_ascending(order + 2, ind)) continue;
+                if (!is_ascending(order + 2, ind_mapped)) continue;
 
-                i_prim = min_inprim(order + 2, ind);
-                std::swap(ind[0], ind[i_prim]);
-                sort_tail(order + 2, ind);
+                cand_cluster.push_back(cluster_atoms.size());
+                cand_xyz.push_back(j);
+            }
+            cluster_atoms.push_back((*iter).iarray);
+        }
+
+        ncand = cand_cluster.size();
+
+        std::set<IntList> list_found;
+
+        for (ibegin = 0; ibegin < ncand; ibegin += nblock) {
+
+            iend = std::min(ibegin + nblock, ncand);
+
+            cand_ind.resize(iend - ibegin);
+            cand_found.assign(iend - ibegin, 0);
+            cand_zero.assign(iend - ibegin, 0);
+            orbit_ind.resize(iend - ibegin);
+            orbit_coef.resize(iend - ibegin);
+
+            // Construct the orbits of the candidates not found in the previous blocks.
+            // list_found is only read here.
+
+#ifdef _OPENMP
+#pragma omp parallel private(i, j, isym)
+#endif
+            {
+                int i1, i2, iloc, iprim_omp;
+                int *atmn, *atmn_mapped, *ind, *ind_orbit;
+                double c_omp;
+                bool zero_omp;
+                std::vector<std::pair<int, double> > rot_tmp;
+                std::vector<std::pair<int, double> >::const_iterator it_rot, it_end;
+
+                memory->allocate(atmn, order + 2);
+                memory->allocate(atmn_mapped, order + 2);
+                memory->allocate(ind, order + 2);
+                memory->allocate(ind_orbit, order + 2);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+                for (icand = ibegin; icand < iend; ++icand) {
+
+                    iloc = icand - ibegin;
+                    i1 = cand_xyz[icand];
+
+                    for (i = 0; i < order + 2; ++i) {
+                        atmn[i] = cluster_atoms[cand_cluster[icand]][i];
+                        ind[i] = 3 * atmn[i] + xyzcomponent[i1][i];
+                    }
+
+                    iprim_omp = min_inprim(order + 2, ind);
+                    std::swap(ind[0], ind[iprim_omp]);
+                    sort_tail(order + 2, ind);
+
+                    cand_ind[iloc].iarray.assign(ind, ind + order + 2);
+                    orbit_ind[iloc].clear();
+                    orbit_coef[iloc].clear();
+
+                    if (list_found.find(cand_ind[iloc]) != list_found.end()) {
+                        cand_found[iloc] = 1;
+                        continue;
+                    }
 
-                is_zero = false;
+                    // Search symmetrically-dependent parameter set
 
-                if (list_found.find(IntList(order + 2, ind)) != list_found.end()) continue; // Already exits!
+                    zero_omp = false;
 
-                // Search symmetrically-dependent parameter set
+                    for (j = 0; j < nsym_avail; ++j) {
 
-                int ndeps = 0;
+                        isym = sym_list[j];
 
-                for (isym = 0; isym < symmetry->nsym; ++isym) {
+                        for (i = 0; i < order + 2; ++i)
+                            atmn_mapped[i] = symmetry->map_sym[atmn[i]][isym];
 
-                    if (!symmetry->sym_available[isym]) continue;
+                        if (!is_inprim(order + 2, atmn_mapped)) continue;
 
-                    for (i = 0; i < order + 2; ++i)
-                        atmn_mapped[i] = symmetry->map_sym[atmn[i]][isym];
+                        if (has_rot_table) {
+                            it_rot = rot_table[j * nxyz + i1].begin();
+                            it_end = rot_table[j * nxyz + i1].end();
+                        } else {
+                            rot_tmp.clear();
+                            for (i2 = 0; i2 < nxyz; ++i2) {
+                                c_omp = coef_sym(order + 2, isym, xyzcomponent[i1], xyzcomponent[i2]);
+                                if (std::abs(c_omp) > eps12) {
+                                    rot_tmp.push_back(std::pair<int, double>(i2, c_omp));
+                                }
+                            }
+                            it_rot = rot_tmp.begin();
+                            it_end = rot_tmp.end();
+                        }
 
-                    if (!is_inprim(order + 2, atmn_mapped)) continue;
+                        for (; it_rot != it_end; ++it_rot) {
+                            i2 = (*it_rot).first;
+                            c_omp = (*it_rot).second;
 
-                    for (i2 = 0; i2 < nxyz; ++i2) {
-                        c_tmp = coef_sym(order + 2, isym, xyzcomponent[i1], xyzcomponent[i2]);
-                        if (std::abs(c_tmp) > eps12) {
                             for (i = 0; i < order + 2; ++i)
-                                ind_mapped[i] = 3 * atmn_mapped[i] + xyzcomponent[i2][i];
+                                ind_orbit[i] = 3 * atmn_mapped[i] + xyzcomponent[i2][i];
 
-                            i_prim = min_inprim(order + 2, ind_mapped);
-                            std::swap(ind_mapped[0], ind_mapped[i_prim]);
-                            sort_tail(order + 2, ind_mapped);
+                            iprim_omp = min_inprim(order + 2, ind_orbit);
+                            std::swap(ind_orbit[0], ind_orbit[iprim_omp]);
+                            sort_tail(order + 2, ind_orbit);
 
-                            if (!is_zero) {
+                            if (!zero_omp) {
                                 bool zeroflag = true;
                                 for (i = 0; i < order + 2; ++i) {
-                                    zeroflag = zeroflag & (ind[i] == ind_mapped[i]);
+                                    zeroflag = zeroflag & (ind[i] == ind_orbit[i]);
                                 }
-                                zeroflag = zeroflag & (std::abs(c_tmp + 1.0) < eps8);
-                                is_zero = zeroflag;
+                                zeroflag = zeroflag & (std::abs(c_omp + 1.0) < eps8);
+                                zero_omp = zeroflag;
                             }
 
-                            // Add to found list (set) and fcset (vector) if the created is new one.
+                            for (i = 0; i < order + 2; ++i) orbit_ind[iloc].push_back(ind_orbit[i]);
+                            orbit_coef[iloc].push_back(c_omp);
+                        }
+                    } // close symmetry loop
 
-                            if (list_found.find(IntList(order + 2, ind_mapped)) == list_found.end()) {
-                                list_found.insert(IntList(order + 2, ind_mapped));
+                    cand_zero[iloc] = zero_omp;
+                }
 
-                                fc_set[order].push_back(FcProperty(order + 2, c_tmp,
-                                                                   ind_mapped, nmother));
-                                ++ndeps;
+                memory->deallocate(atmn);
+                memory->deallocate(atmn_mapped);
+                memory->deallocate(ind);
+                memory->deallocate(ind_orbit);
 
-                                // Add equivalent interaction list (permutation) if there are two or more indices
-                                // which belong to the primitive cell.
-                                // This procedure is necessary for fitting.
+            } // close openmp region
 
-                                for (i = 0; i < 3 * nat; ++i) is_searched[i] = false;
-                                is_searched[ind_mapped[0]] = true;
-                                for (i = 1; i < order + 2; ++i) {
-                                    if ((!is_searched[ind_mapped[i]]) && is_inprim(ind_mapped[i])) {
+            // Register the orbits in the original order
 
-                                        for (j = 0; j < order + 2; ++j) ind_mapped_tmp[j] = ind_mapped[j];
-                                        std::swap(ind_mapped_tmp[0], ind_mapped_tmp[i]);
-                                        sort_tail(order + 2, ind_mapped_tmp);
-                                        fc_set[order].push_back(FcProperty(order + 2, c_tmp,
-                                                                           ind_mapped_tmp, nmother));
+            for (icand = ibegin; icand < iend; ++icand) {
 
-                                        ++ndeps;
+                const int iloc = icand - ibegin;
 
-                                        is_searched[ind_mapped[i]] = true;
-                                    }
-                                }
+                if (cand_found[iloc]) continue;
+                if (list_found.find(cand_ind[iloc]) != list_found.end()) continue; // Already exits!
+
+                ndeps = 0;
+                is_zero = cand_zero[iloc];
+
+                for (k = 0; k < static_cast<int>(orbit_coef[iloc].size()); ++k) {
+
+                    for (i = 0; i < order + 2; ++i) ind_mapped[i] = orbit_ind[iloc][k * (order + 2) + i];
+                    c_tmp = orbit_coef[iloc][k];
 
+                    // Add to found list (set) and fcset (vector) if the created is new one.
 
+                    if (list_found.find(IntList(order + 2, ind_mapped)) == list_found.end()) {
+                        list_found.insert(IntList(order + 2, ind_mapped));
+
+                        fc_set[order].push_back(FcProperty(order + 2, c_tmp,
+                                                           ind_mapped, nmother));
+                        ++ndeps;
+
+                        // Add equivalent interaction list (permutation) if there are two or more indices
+                        // which belong to the primitive cell.
+                        // This procedure is necessary for fitting.
+
+                        for (i = 0; i < 3 * nat; ++i) is_searched[i] = false;
+                        is_searched[ind_mapped[0]] = true;
+                        for (i = 1; i < order + 2; ++i) {
+                            if ((!is_searched[ind_mapped[i]]) && is_inprim(ind_mapped[i])) {
+
+                                for (j = 0; j < order + 2; ++j) ind_mapped_tmp[j] = ind_mapped[j];
+                                std::swap(ind_mapped_tmp[0], ind_mapped_tmp[i]);
+                                sort_tail(order + 2, ind_mapped_tmp);
+                                fc_set[order].push_back(FcProperty(order + 2, c_tmp,
+                                                                   ind_mapped_tmp, nmother));
+
+                                ++ndeps;
+
+                                is_searched[ind_mapped[i]] = true;
                             }
                         }
                     }
-                } // close symmetry loop
+                }
 
                 if (is_zero) {
                     for (i = 0; i < ndeps; ++i) fc_set[order].pop_back();
@@ -221,20 +396,16 @@ void Fcs::generate_fclists(int maxorder)
                     ndup[order].push_back(ndeps);
                     ++nmother;
                 }
-
-            } // close xyz component loop
-        } // close atom number loop (iterator)
+            }
+        } // close loop over blocks
 
         memory->deallocate(xyzcomponent);
         list_found.clear();
+        rot_table.clear();
         std::cout << " done. " << std::endl;
     } //close order loop
 
-    memory->deallocate(atmn);
-    memory->deallocate(atmn_mapped);
-    memory->deallocate(ind);
     memory->deallocate(ind_mapped);
-    memory->deallocate(ind_tmp);
     memory->deallocate(ind_mapped_tmp);
     memory->deallocate(is_searched);
 
@@ -387,3 +558,77 @@ std::string Fcs::easyvizint(const int n)
 
     return str_tmp;
 }
+
+FcHashTable::FcHashTable()
+{
+    nelems = 0;
+    mask = 0;
+}
+
+void FcHashTable::build(const std::vector<FcProperty> &fc_list,
+                        const int nelems_in)
+{
+    // If the same elements appear more than once, the first one is registered.
+
+    int i, j;
+    unsigned long h;
+    unsigned long nslots = 16;
+    const int nfcs = fc_list.size();
+
+    nelems = nelems_in;
+
+    while (nslots < 2 * static_cast<unsigned long>(nfcs)) nslots *= 2;
+    mask = nslots - 1;
+
+    keys.resize(nfcs * nelems);
+    slots.assign(nslots, -1);
+
+    for (i = 0; i < nfcs; ++i) {
+        for (j = 0; j < nelems; ++j) {
+            keys[i * nelems + j] = fc_list[i].elems[j];
+        }
+    }
+
+    for (i = 0; i < nfcs; ++i) {
+        if (find(&keys[i * nelems]) != -1) continue;
+
+        h = hash(&keys[i * nelems]) & mask;
+        while (slots[h] != -1) h = (h + 1) & mask;
+        slots[h] = i;
+    }
+}
+
+int FcHashTable::find(const int *arr) const
+{
+    // Returns the position in fc_set, or -1 if not found.
+
+    int j;
+    int loc;
+    unsigned long h;
+
+    if (slots.empty()) return -1;
+
+    h = hash(arr) & mask;
+
+    while ((loc = slots[h]) != -1) {
+        for (j = 0; j < nelems; ++j) {
+            if (keys[loc * nelems + j] != arr[j]) break;
+        }
+        if (j == nelems) return loc;
+        h = (h + 1) & mask;
+    }
+    return -1;
+}
+
+unsigned long FcHashTable::hash(const int *arr) const
+{
+    // FNV-1a over the bytes of the element indices followed by a final mixing
+
+    unsigned long h = fnv1a_hash(reinterpret_cast<const char *>(arr),
+                                 sizeof(int) * nelems);
+
+    h ^= h >> 15;
+    h *= 2246822507UL;
+    h ^= h >> 13;
+    return h;
+}
@@ -52,6 +52,27 @@ namespace ALM_NS
         }
     };
 
+    // Open-addressing hash table which returns the position of an IFC
+    // in fc_set from its element indices. The element indices of all IFCs
+    // are packed into one array so that a lookup does not allocate memory.
+
+    class FcHashTable
+    {
+    public:
+        FcHashTable();
+
+        void build(const std::vector<FcProperty> &, const int);
+        int find(const int *) const;
+
+    private:
+        int nelems;
+        unsigned long mask;
+        std::vector<int> keys;    // [nfcs][nelems]
+        std::vector<int> slots;   // Position in fc_set (-1 for empty slots)
+
+        unsigned long hash(const int *) const;
+    };
+
     class Fcs: protected Pointers
     {
     public:
@@ -64,6 +85,7 @@ namespace ALM_NS
 
         std::vector<int> *ndup;
         std::vector<FcProperty> *fc_set;
+        FcHashTable *fc_table;
 
         std::string easyvizint(const int);
         void get_xyzcomponent(int, int **);
@@ -14,6 +14,7 @@
 #include <cmath>
 #include <string>
 #include <vector>
+#include <algorithm>
 #include <boost/lexical_cast.hpp>
 #include "fitting.h"
 #include "files.h"
@@ -47,6 +48,8 @@ using namespace ALM_NS;
 
 Fitting::Fitting(ALM *alm): Pointers(alm)
 {
+    use_sparse_solver = false;
+    nchunk = 0;
     seed = static_cast<unsigned int>(time(NULL));
 #ifdef _VSL
     brng = VSL_BRNG_MT19937;
@@ -83,7 +86,8 @@ void Fitting::fitmain()
     int ndata_used = nend - nstart + 1;
 
     double **u, **f;
-    double **amat, *amat_1D, *fsum;
+    double *amat, *amat_1D, *fsum;
+    SparseMatrixCSR amat_sparse;
     double *fsum_orig;
     double *param_tmp;
 
@@ -93,6 +97,11 @@ void Fitting::fitmain()
     fsum_orig = NULL;
     param_tmp = NULL;
 
+    // M and nmulti are not used when the data sets are read in chunks.
+    M = 0;
+    N_new = 0;
+    nmulti = 1;
+
     std::cout << " FITTING" << std::endl;
     std::cout << " =======" << std::endl << std::endl;
 
@@ -105,11 +114,25 @@ void Fitting::fitmain()
     std::cout << "  " << ndata_used << " entries will be used for fitting."
         << std::endl << std::endl;
 
-    // Read displacement-force training data set from files
+    if (nchunk > 0 && (constraint->constraint_algebraic || nskip != 0)) {
+        error->warn("fitmain",
+                    "NCHUNK > 0 is supported only with NSKIP = 0 and ICONST < 10. All data sets are read at once instead.");
+        nchunk = 0;
+    }
+    if (nchunk > 0 && use_sparse_solver) {
+        error->warn("fitmain",
+                    "SPARSE = 1 is ignored because NCHUNK > 0.");
+        use_sparse_solver = false;
+    }
+
+    // Read displacement-force training data set from files.
+    // When NCHUNK > 0, the data sets are read later in chunks by fit_normal_equations.
 
-    data_multiplier(nat, ndata, nstart, nend, ndata_used, nmulti,
-                    symmetry->multiply_data, u, f,
-                    files->file_disp, files->file_force);
+    if (nchunk == 0) {
+        data_multiplier(nat, ndata, nstart, ndata_used, nmulti,
+                        symmetry->multiply_data, u, f,
+                        files->file_disp, files->file_force);
+    }
 
     N = 0;
     for (i = 0; i < maxorder; ++i) {
@@ -118,11 +141,23 @@ void Fitting::fitmain()
     std::cout << "  Total Number of Parameters : "
         << N << std::endl << std::endl;
 
+    if (use_sparse_solver && (constraint->constraint_algebraic || nskip != 0)) {
+        error->warn("fitmain",
+                    "SPARSE = 1 is supported only with NSKIP = 0 and ICONST < 10. The dense solver is used instead.");
+        use_sparse_solver = false;
+    }
+
     // Calculate matrix elements for fitting
 
-    M = 3 * natmin * ndata_used * nmulti;
+    if (!constraint->constraint_algebraic) setup_fc_terms(maxorder);
 
-    if (constraint->constraint_algebraic) {
+    if (nchunk > 0) {
+
+        // The matrix elements are accumulated in fit_normal_equations.
+
+    } else if (constraint->constraint_algebraic) {
+
+        M = 3 * natmin * ndata_used * nmulti;
 
 
         N_new = 0;
@@ -141,17 +176,32 @@ void Fitting::fitmain()
                                                   nmulti, maxorder, u, f, amat_1D, fsum,
                                                   fsum_orig);
 
+    } else if (use_sparse_solver) {
+
+        M = 3 * natmin * ndata_used * nmulti;
+        memory->allocate(fsum, M);
+
+        calc_matrix_elements_sparse(M, N, natmin, ndata_used,
+                                    nmulti, u, f, amat_sparse, fsum);
+
     } else {
 
-        memory->allocate(amat, M, N);
+        M = 3 * natmin * ndata_used * nmulti;
+        memory->allocate(amat, N * M);
         memory->allocate(fsum, M);
 
-        calc_matrix_elements(M, N, nat, natmin, ndata_used,
-                             nmulti, maxorder, u, f, amat, fsum);
+        std::cout << "  Calculation of matrix elements for direct fitting started ... ";
+
+        calc_matrix_elements(M, N, natmin, ndata_used,
+                             nmulti, u, f, amat, fsum);
+
+        std::cout << "done!" << std::endl << std::endl;
     }
 
-    memory->deallocate(u);
-    memory->deallocate(f);
+    if (nchunk == 0) {
+        memory->deallocate(u);
+        memory->deallocate(f);
+    }
 
     // Execute fitting
 
@@ -165,6 +215,26 @@ void Fitting::fitmain()
             fit_algebraic_constraints(N_new, M, amat_1D, fsum, param_tmp,
                                       fsum_orig, maxorder);
 
+        } else if (nchunk > 0) {
+            if (constraint->exist_constraint) {
+                fit_normal_equations(N, P, nat, natmin, ndata, nstart, nend,
+                                     param_tmp,
+                                     constraint->const_mat,
+                                     constraint->const_rhs);
+            } else {
+                fit_normal_equations(N, 0, nat, natmin, ndata, nstart, nend,
+                                     param_tmp, NULL, NULL);
+            }
+
+        } else if (use_sparse_solver) {
+            if (constraint->exist_constraint) {
+                fit_sparse(N, M, P, amat_sparse, fsum, param_tmp,
+                           constraint->const_mat,
+                           constraint->const_rhs);
+            } else {
+                fit_sparse(N, M, 0, amat_sparse, fsum, param_tmp, NULL, NULL);
+            }
+
         } else if (constraint->exist_constraint) {
             fit_with_constraints(N, M, P, amat, fsum, param_tmp,
                                  constraint->const_mat,
@@ -241,7 +311,6 @@ void Fitting::fitmain()
 void Fitting::data_multiplier(const int nat,
                               const int ndata,
                               const int nstart,
-                              const int nend,
                               const int ndata_used,
                               int &nmulti,
                               const int multiply_data,
@@ -250,12 +319,8 @@ void Fitting::data_multiplier(const int nat,
                               const std::string file_disp,
                               const std::string file_force)
 {
-    int i, j, k;
-    int idata, itran, isym;
-    int n_mapped;
     double u_in, f_in;
     double *u_tmp, *f_tmp;
-    std::vector<int> vec_data;
     unsigned int nline_f, nline_u;
     unsigned int nreq;
 
@@ -297,6 +362,29 @@ void Fitting::data_multiplier(const int nat,
 
     // Multiply data
 
+    nmulti = get_multiplier(multiply_data);
+
+    memory->allocate(u, ndata_used * nmulti, 3 * nat);
+    memory->allocate(f, ndata_used * nmulti, 3 * nat);
+
+    generate_symmetric_copies(nat, ndata_used, multiply_data,
+                              u_tmp + 3 * nat * (nstart - 1),
+                              f_tmp + 3 * nat * (nstart - 1),
+                              u, f);
+
+    memory->deallocate(u_tmp);
+    memory->deallocate(f_tmp);
+
+    ifs_disp.close();
+    ifs_force.close();
+}
+
+int Fitting::get_multiplier(const int multiply_data)
+{
+    // Returns the number of data sets generated from one displacement-force data set.
+
+    int nmulti = 1;
+
     if (multiply_data == 0) {
 
         std::cout << " MULTDAT = 0: Given displacement-force data sets will be used as is."
@@ -304,47 +392,66 @@ void Fitting::data_multiplier(const int nat,
 
         nmulti = 1;
 
-        memory->allocate(u, ndata_used * nmulti, 3 * nat);
-        memory->allocate(f, ndata_used * nmulti, 3 * nat);
+    } else if (multiply_data == 1) {
 
-        idata = 0;
+        std::cout << "  MULTDAT = 1: Generate symmetrically equivalent displacement-force " << std::endl;
+        std::cout << "               data sets by using pure translational operations only." << std::endl << std::endl;
+
+        nmulti = symmetry->ntran;
+
+    } else if (multiply_data == 2) {
+
+        std::cout << "  MULTDAT = 2: Generate symmetrically equivalent displacement-force" << std::endl;
+        std::cout << "                data sets. (including rotational part) " << std::endl << std::endl;
+
+        nmulti = symmetry->nsym;
+
+    } else {
+        error->exit("data_multiplier", "Unsupported MULTDAT");
+    }
+
+    return nmulti;
+}
+
+void Fitting::generate_symmetric_copies(const int nat,
+                                        const int nsnap,
+                                        const int multiply_data,
+                                        const double *u_in,
+                                        const double *f_in,
+                                        double **u,
+                                        double **f)
+{
+    // Generate the symmetrically equivalent data sets of the nsnap data sets
+    // stored contiguously in u_in and f_in.
+    // The copies of the i-th data set are stored in u[nmulti * i + j].
+
+    int i, j, k;
+    int idata, itran, isym;
+    int n_mapped;
 
-        for (i = 0; i < ndata; ++i) {
-            if (i < nstart - 1) continue;
-            if (i > nend - 1) break;
+    if (multiply_data == 0) {
 
+        for (i = 0; i < nsnap; ++i) {
             for (j = 0; j < nat; ++j) {
                 for (k = 0; k < 3; ++k) {
-                    u[idata][3 * j + k] = u_tmp[3 * nat * i + 3 * j + k];
-                    f[idata][3 * j + k] = f_tmp[3 * nat * i + 3 * j + k];
+                    u[i][3 * j + k] = u_in[3 * nat * i + 3 * j + k];
+                    f[i][3 * j + k] = f_in[3 * nat * i + 3 * j + k];
                 }
             }
-            ++idata;
         }
 
     } else if (multiply_data == 1) {
 
-        std::cout << "  MULTDAT = 1: Generate symmetrically equivalent displacement-force " << std::endl;
-        std::cout << "               data sets by using pure translational operations only." << std::endl << std::endl;
-
-        nmulti = symmetry->ntran;
-
-        memory->allocate(u, ndata_used * nmulti, 3 * nat);
-        memory->allocate(f, ndata_used * nmulti, 3 * nat);
-
         idata = 0;
 
-        for (i = 0; i < ndata; ++i) {
-            if (i < nstart - 1) continue;
-            if (i > nend - 1) break;
-
+        for (i = 0; i < nsnap; ++i) {
             for (itran = 0; itran < symmetry->ntran; ++itran) {
                 for (j = 0; j < nat; ++j) {
                     n_mapped = symmetry->map_sym[j][symmetry->symnum_tran[itran]];
 
                     for (k = 0; k < 3; ++k) {
-                        u[idata][3 * n_mapped + k] = u_tmp[3 * nat * i + 3 * j + k];
-                        f[idata][3 * n_mapped + k] = f_tmp[3 * nat * i + 3 * j + k];
+                        u[idata][3 * n_mapped + k] = u_in[3 * nat * i + 3 * j + k];
+                        f[idata][3 * n_mapped + k] = f_in[3 * nat * i + 3 * j + k];
                     }
                 }
                 ++idata;
@@ -354,67 +461,52 @@ void Fitting::data_multiplier(const int nat,
     } else if (multiply_data == 2) {
 
         double u_rot[3], f_rot[3];
+        int nmulti = symmetry->nsym;
 
-        std::cout << "  MULTDAT = 2: Generate symmetrically equivalent displacement-force" << std::endl;
-        std::cout << "                data sets. (including rotational part) " << std::endl << std::endl;
-
-        nmulti = symmetry->nsym;
-
-        memory->allocate(u, ndata_used * nmulti, 3 * nat);
-        memory->allocate(f, ndata_used * nmulti, 3 * nat);
-
-        idata = 0;
-
-        for (i = 0; i < ndata; ++i) {
-            if (i < nstart - 1) continue;
-            if (i > nend - 1) break;
+        for (i = 0; i < nsnap; ++i) {
 
+#ifdef _OPENMP
 #pragma omp parallel for private(j, n_mapped, k, u_rot, f_rot)
+#endif
             for (isym = 0; isym < symmetry->nsym; ++isym) {
                 for (j = 0; j < nat; ++j) {
                     n_mapped = symmetry->map_sym[j][isym];
 
                     for (k = 0; k < 3; ++k) {
-                        u_rot[k] = u_tmp[3 * nat * i + 3 * j + k];
-                        f_rot[k] = f_tmp[3 * nat * i + 3 * j + k];
+                        u_rot[k] = u_in[3 * nat * i + 3 * j + k];
+                        f_rot[k] = f_in[3 * nat * i + 3 * j + k];
                     }
 
                     rotvec(u_rot, u_rot, symmetry->symrel[isym]);
                     rotvec(f_rot, f_rot, symmetry->symrel[isym]);
 
                     for (k = 0; k < 3; ++k) {
-                        u[nmulti * idata + isym][3 * n_mapped + k] = u_rot[k];
-                        f[nmulti * idata + isym][3 * n_mapped + k] = f_rot[k];
+                        u[nmulti * i + isym][3 * n_mapped + k] = u_rot[k];
+                        f[nmulti * i + isym][3 * n_mapped + k] = f_rot[k];
                     }
                 }
             }
-            ++idata;
         }
 
     } else {
-        error->exit("data_multiplier", "Unsupported MULTDAT");
+        error->exit("generate_symmetric_copies", "Unsupported MULTDAT");
     }
-
-    memory->deallocate(u_tmp);
-    memory->deallocate(f_tmp);
-
-    ifs_disp.close();
-    ifs_force.close();
 }
 
 void Fitting::fit_without_constraints(int N,
                                       int M,
-                                      double **amat,
+                                      double *amat,
                                       double *bvec,
                                       double *param_out)
 {
-    int i, j;
-    unsigned long k;
+    // amat is the column-major M x N matrix A, which is overwritten.
+
+    int i;
     int nrhs = 1, nrank, INFO, LWORK;
     int LMIN, LMAX;
     double rcond = -1.0;
     double f_square = 0.0;
-    double *WORK, *S, *amat_mod, *fsum2;
+    double *WORK, *S, *fsum2;
 
     std::cout << "  Entering fitting routine: SVD without constraints" << std::endl;
 
@@ -427,16 +519,8 @@ void Fitting::fit_without_constraints(int N,
     memory->allocate(WORK, LWORK);
     memory->allocate(S, LMIN);
 
-    // transpose matrix A
-    memory->allocate(amat_mod, M * N);
     memory->allocate(fsum2, LMAX);
 
-    k = 0;
-    for (j = 0; j < N; ++j) {
-        for (i = 0; i < M; ++i) {
-            amat_mod[k++] = amat[i][j];
-        }
-    }
     for (i = 0; i < M; ++i) {
         fsum2[i] = bvec[i];
         f_square += std::pow(bvec[i], 2);
@@ -446,7 +530,7 @@ void Fitting::fit_without_constraints(int N,
     std::cout << "  SVD has started ... ";
 
     // Fitting with singular value decomposition
-    dgelss_(&M, &N, &nrhs, amat_mod, &M, fsum2, &LMAX,
+    dgelss_(&M, &N, &nrhs, amat, &M, fsum2, &LMAX,
             S, &rcond, &nrank, WORK, &LWORK, &INFO);
 
     std::cout << "finished !" << std::endl << std::endl;
@@ -474,18 +558,19 @@ void Fitting::fit_without_constraints(int N,
     memory->deallocate(WORK);
     memory->deallocate(S);
     memory->deallocate(fsum2);
-    memory->deallocate(amat_mod);
 }
 
 void Fitting::fit_with_constraints(int N,
                                    int M,
                                    int P,
-                                   double **amat,
+                                   double *amat,
                                    double *bvec,
                                    double *param_out,
                                    double **cmat,
                                    double *dvec)
 {
+    // amat is the column-major M x N matrix A, which is overwritten.
+
     int i, j;
     unsigned long k;
     int nrank;
@@ -502,7 +587,7 @@ void Fitting::fit_with_constraints(int N,
     memory->allocate(mat_tmp2, M + P, N);
     for (i = 0; i < M; ++i) {
         for (j = 0; j < N; ++j) {
-            mat_tmp2[i][j] = amat[i][j];
+            mat_tmp2[i][j] = amat[i + static_cast<unsigned long>(M) * j];
         }
     }
     for (i = 0; i < P; ++i) {
@@ -524,7 +609,7 @@ void Fitting::fit_with_constraints(int N,
 
     for (j = 0; j < N; ++j) {
         for (i = 0; i < M; ++i) {
-            mat_tmp[k++] = amat[i][j];
+            mat_tmp[k++] = amat[i + static_cast<unsigned long>(M) * j];
         }
         for (i = 0; i < P; ++i) {
             mat_tmp[k++] = cmat[i][j];
@@ -560,17 +645,10 @@ void Fitting::fit_with_constraints(int N,
     }
     std::cout << "  QR-Decomposition has started ...";
 
-    double *amat_mod, *cmat_mod;
-    memory->allocate(amat_mod, M * N);
+    double *cmat_mod;
     memory->allocate(cmat_mod, P * N);
 
-    // transpose matrix A and C
-    k = 0;
-    for (j = 0; j < N; ++j) {
-        for (i = 0; i < M; ++i) {
-            amat_mod[k++] = amat[i][j];
-        }
-    }
+    // transpose matrix C
     k = 0;
     for (j = 0; j < N; ++j) {
         for (i = 0; i < P; ++i) {
@@ -586,7 +664,7 @@ void Fitting::fit_with_constraints(int N,
     memory->allocate(WORK, LWORK);
     memory->allocate(x, N);
 
-    dgglse_(&M, &N, &P, amat_mod, &M, cmat_mod, &P,
+    dgglse_(&M, &N, &P, amat, &M, cmat_mod, &P,
             fsum2, dvec, x, WORK, &LWORK, &INFO);
 
     std::cout << " finished. " << std::endl;
@@ -606,7 +684,6 @@ void Fitting::fit_with_constraints(int N,
         param_out[i] = x[i];
     }
 
-    memory->deallocate(amat_mod);
     memory->deallocate(cmat_mod);
     memory->deallocate(WORK);
     memory->deallocate(x);
@@ -726,7 +803,7 @@ void Fitting::fit_bootstrap(int N,
                             int natmin,
                             int ndata_used,
                             int nmulti,
-                            double **amat,
+                            double *amat,
                             double *bvec,
                             double **cmat,
                             double *dvec)
@@ -816,7 +893,7 @@ void Fitting::fit_bootstrap(int N,
             for (i = 0; i < ndata_used; ++i) {
                 iloc = rnd_index[i];
                 for (k = iloc * mset; k < (iloc + 1) * mset; ++k) {
-                    amat_mod[l++] = amat[k][j];
+                    amat_mod[l++] = amat[k + static_cast<unsigned long>(M) * j];
                 }
             }
         }
@@ -868,7 +945,7 @@ void Fitting::fit_consecutively(int N,
                                 const int ndata_used,
                                 const int nmulti,
                                 const int nskip,
-                                double **amat,
+                                double *amat,
                                 double *bvec,
                                 double **cmat,
                                 double *dvec)
@@ -936,11 +1013,11 @@ void Fitting::fit_consecutively(int N,
 
         memory->allocate(amat_mod, M * N);
 
-        // Transpose matrix A
+        // Leading M rows of the column-major matrix A
         k = 0;
         for (j = 0; j < N; ++j) {
             for (i = M_Start; i < M_End; ++i) {
-                amat_mod[k++] = amat[i][j];
+                amat_mod[k++] = amat[i + static_cast<unsigned long>(mset) * ndata_used * j];
             }
         }
 
@@ -993,29 +1070,153 @@ void Fitting::fit_consecutively(int N,
     std::cout << "  Consecutive fitting finished." << std::endl;
 }
 
+void Fitting::setup_fc_terms(const int maxorder)
+{
+    // Flatten fcs->fc_set into fc_terms so that the matrix elements can be
+    // evaluated without calling gamma() for every data set.
+
+    int i, j;
+    int order, mm, iparam;
+    int *ind;
+
+    memory->allocate(ind, maxorder + 1);
+
+    fc_terms.iparam.clear();
+    fc_terms.irow.clear();
+    fc_terms.prefactor.clear();
+    fc_terms.disp_index.clear();
+    fc_terms.disp_start.clear();
+    fc_terms.disp_start.push_back(0);
+
+    iparam = 0;
+
+    for (order = 0; order < maxorder; ++order) {
+
+        mm = 0;
+
+        for (std::vector<int>::iterator iter = fcs->ndup[order].begin();
+             iter != fcs->ndup[order].end(); ++iter) {
+            for (i = 0; i < *iter; ++i) {
+                for (j = 0; j < order + 2; ++j) {
+                    ind[j] = fcs->fc_set[order][mm].elems[j];
+                }
+                fc_terms.iparam.push_back(iparam);
+                fc_terms.irow.push_back(inprim_index(ind[0]));
+                fc_terms.prefactor.push_back(-(gamma(order + 2, ind) * fcs->fc_set[order][mm].coef));
+                for (j = 1; j < order + 2; ++j) {
+                    fc_terms.disp_index.push_back(ind[j]);
+                }
+                fc_terms.disp_start.push_back(fc_terms.disp_index.size());
+                ++mm;
+            }
+            ++iparam;
+        }
+    }
+
+    fc_terms.nterms = fc_terms.iparam.size();
+
+    memory->deallocate(ind);
+}
+
+
 void Fitting::calc_matrix_elements(const int M,
                                    const int N,
-                                   const int nat,
                                    const int natmin,
                                    const int ndata_fit,
                                    const int nmulti,
-                                   const int maxorder,
                                    double **u,
                                    double **f,
-                                   double **amat,
+                                   double *amat,
                                    double *bvec)
 {
-    int i, j;
-    int irow;
+    // The matrix A is stored in the column-major order, A(i, j) = amat[i + M * j],
+    // so that it can be passed to LAPACK without being transposed.
+    // The data sets are processed in blocks of nblock_size, and each thread
+    // fills the rows of A belonging to its block.
+
+    int iblock, nblock;
     int ncycle;
+    int i;
+    int natmin3 = 3 * natmin;
+    const int nblock_size = 16;
+    const unsigned long nelem = static_cast<unsigned long>(M) * N;
 
-    std::cout << "  Calculation of matrix elements for direct fitting started ... ";
-    for (i = 0; i < M; ++i) {
-        for (j = 0; j < N; ++j) {
-            amat[i][j] = 0.0;
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (long ii = 0; ii < static_cast<long>(nelem); ++ii) {
+        amat[ii] = 0.0;
+    }
+    for (i = 0; i < M; ++i) bvec[i] = 0.0;
+
+    ncycle = ndata_fit * nmulti;
+    nblock = (ncycle + nblock_size - 1) / nblock_size;
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (iblock = 0; iblock < nblock; ++iblock) {
+
+        int irow, ibegin, iend;
+        int iterm, iat, j, k;
+        unsigned long offset;
+        double amat_tmp;
+
+        ibegin = iblock * nblock_size;
+        iend = std::min<int>(ibegin + nblock_size, ncycle);
+
+        // generate r.h.s vector B
+
+        for (irow = ibegin; irow < iend; ++irow) {
+            for (j = 0; j < natmin; ++j) {
+                iat = symmetry->map_p2s[j][0];
+                for (k = 0; k < 3; ++k) {
+                    bvec[3 * j + k + natmin3 * irow] = f[irow][3 * iat + k];
+                }
+            }
+        }
+
+        // generate l.h.s. matrix A
+
+        for (iterm = 0; iterm < fc_terms.nterms; ++iterm) {
+
+            offset = static_cast<unsigned long>(M) * fc_terms.iparam[iterm]
+                + fc_terms.irow[iterm];
+
+            for (irow = ibegin; irow < iend; ++irow) {
+                amat_tmp = 1.0;
+                for (j = fc_terms.disp_start[iterm]; j < fc_terms.disp_start[iterm + 1]; ++j) {
+                    amat_tmp *= u[irow][fc_terms.disp_index[j]];
+                }
+                amat[offset + natmin3 * irow] += fc_terms.prefactor[iterm] * amat_tmp;
+            }
         }
-        bvec[i] = 0.0;
     }
+}
+
+
+void Fitting::calc_matrix_elements_sparse(const int M,
+                                          const int N,
+                                          const int natmin,
+                                          const int ndata_fit,
+                                          const int nmulti,
+                                          double **u,
+                                          double **f,
+                                          SparseMatrixCSR &amat,
+                                          double *bvec)
+{
+    // Same as calc_matrix_elements, but the matrix A is stored in the CSR format.
+    // Each row of A has only a small number of nonzero elements because
+    // a force constant contributes only to the force on its first atom.
+
+    int i, j;
+    int irow;
+    int ncycle;
+    int natmin3 = 3 * natmin;
+    unsigned long nnz;
+    std::vector<std::vector<std::pair<int, double> > > row_entries(M);
+
+    std::cout << "  Calculation of matrix elements for direct fitting (sparse) started ... ";
 
     ncycle = ndata_fit * nmulti;
 
@@ -1023,13 +1224,11 @@ void Fitting::calc_matrix_elements(const int M,
 #pragma omp parallel private(irow, i, j)
 #endif
     {
-        int *ind;
-        int mm, order, iat, k;
-        int im, idata, iparam;
+        int iterm, iat;
+        int im, idata;
+        int nuniq;
         double amat_tmp;
 
-        memory->allocate(ind, maxorder + 1);
-
 #ifdef _OPENMP
 #pragma omp for schedule(guided)
 #endif
@@ -1039,43 +1238,870 @@ void Fitting::calc_matrix_elements(const int M,
             for (i = 0; i < natmin; ++i) {
                 iat = symmetry->map_p2s[i][0];
                 for (j = 0; j < 3; ++j) {
-                    im = 3 * i + j + 3 * natmin * irow;
+                    im = 3 * i + j + natmin3 * irow;
                     bvec[im] = f[irow][3 * iat + j];
                 }
             }
 
             // generate l.h.s. matrix A
 
-            idata = 3 * natmin * irow;
-            iparam = 0;
+            idata = natmin3 * irow;
 
-            for (order = 0; order < maxorder; ++order) {
+            for (iterm = 0; iterm < fc_terms.nterms; ++iterm) {
+                amat_tmp = 1.0;
+                for (j = fc_terms.disp_start[iterm]; j < fc_terms.disp_start[iterm + 1]; ++j) {
+                    amat_tmp *= u[irow][fc_terms.disp_index[j]];
+                }
+                row_entries[idata + fc_terms.irow[iterm]].push_back(
+                    std::pair<int, double>(fc_terms.iparam[iterm],
+                                           fc_terms.prefactor[iterm] * amat_tmp));
+            }
 
-                mm = 0;
+            // Merge the entries belonging to the same parameter.
+            // The entries are already sorted by the column index
+            // because fc_terms is ordered by the parameter.
 
-                for (std::vector<int>::iterator iter = fcs->ndup[order].begin();
-                     iter != fcs->ndup[order].end(); ++iter) {
-                    for (i = 0; i < *iter; ++i) {
-                        ind[0] = fcs->fc_set[order][mm].elems[0];
-                        k = idata + inprim_index(fcs->fc_set[order][mm].elems[0]);
-                        amat_tmp = 1.0;
-                        for (j = 1; j < order + 2; ++j) {
-                            ind[j] = fcs->fc_set[order][mm].elems[j];
-                            amat_tmp *= u[irow][fcs->fc_set[order][mm].elems[j]];
-                        }
-                        amat[k][iparam] -= gamma(order + 2, ind) * fcs->fc_set[order][mm].coef * amat_tmp;
-                        ++mm;
+            for (i = 0; i < natmin3; ++i) {
+                std::vector<std::pair<int, double> > &row_now = row_entries[idata + i];
+
+                nuniq = 0;
+                for (j = 0; j < static_cast<int>(row_now.size()); ++j) {
+                    if (nuniq > 0 && row_now[nuniq - 1].first == row_now[j].first) {
+                        row_now[nuniq - 1].second += row_now[j].second;
+                    } else {
+                        row_now[nuniq++] = row_now[j];
                     }
-                    ++iparam;
                 }
+                row_now.resize(nuniq);
             }
         }
+    }
 
-        memory->deallocate(ind);
+    amat.nrows = M;
+    amat.ncols = N;
+    amat.row_ptr.resize(M + 1);
+    amat.row_ptr[0] = 0;
+
+    for (i = 0; i < M; ++i) {
+        amat.row_ptr[i + 1] = amat.row_ptr[i] + row_entries[i].size();
+    }
 
+    nnz = amat.row_ptr[M];
+    amat.col_index.resize(nnz);
+    amat.val.resize(nnz);
+
+    for (i = 0; i < M; ++i) {
+        nnz = amat.row_ptr[i];
+        for (j = 0; j < static_cast<int>(row_entries[i].size()); ++j) {
+            amat.col_index[nnz + j] = row_entries[i][j].first;
+            amat.val[nnz + j] = row_entries[i][j].second;
+        }
+        std::vector<std::pair<int, double> >().swap(row_entries[i]);
     }
 
-    std::cout << "done!" << std::endl << std::endl;
+    std::cout << "done!" << std::endl;
+    std::cout << "  Number of nonzero elements of the matrix : " << amat.row_ptr[M]
+        << " (" << std::setprecision(3)
+        << 100.0 * static_cast<double>(amat.row_ptr[M])
+        / (static_cast<double>(M) * static_cast<double>(N))
+        << " %)" << std::endl << std::endl;
+    std::cout << std::setprecision(6);
+}
+
+
+void Fitting::fit_sparse(int N,
+                         int M,
+                         int P,
+                         const SparseMatrixCSR &amat,
+                         double *bvec,
+                         double *param_out,
+                         double **cmat,
+                         double *dvec)
+{
+    // Solve the constrained least-squares problem min |Ax - b| subject to Cx = d
+    // without forming dense copies of A.
+    // After eliminating the constraints as x = x0 + Z y (see eliminate_constraints),
+    // the reduced problem min |AZ y - (b - A x0)| is solved by LSQR
+    // with the columns of AZ normalized.
+
+    int i, j;
+    int irow;
+    int nfree, nzero_col;
+    int niter, maxiter;
+    bool converged;
+    unsigned long k, nnz;
+    double f_square, f_residual;
+    double tmp;
+    double *scale, *yvec, *rhs, *xvec, *ax;
+    std::vector<int> index_free, pivot_row;
+    std::vector<double> pivot_rhs;
+    std::vector<std::vector<std::pair<int, double> > > relation;
+    std::vector<std::vector<std::pair<int, double> > > row_entries(M);
+    SparseMatrixCSR bmat, bmat_t;
+
+    if (P > 0) {
+        std::cout << "  Entering fitting routine: LSQR with constraints eliminated" << std::endl;
+    } else {
+        std::cout << "  Entering fitting routine: LSQR without constraints" << std::endl;
+    }
+
+    nfree = eliminate_constraints(N, P, cmat, dvec, index_free,
+                                  pivot_row, pivot_rhs, relation);
+
+    // Construct the reduced matrix AZ and the r.h.s. vector b - A x0
+
+    memory->allocate(rhs, M);
+
+#ifdef _OPENMP
+#pragma omp parallel private(irow, j, k, tmp)
+#endif
+    {
+        int ip, icol;
+        int nuniq;
+
+#ifdef _OPENMP
+#pragma omp for schedule(guided)
+#endif
+        for (irow = 0; irow < M; ++irow) {
+
+            std::vector<std::pair<int, double> > &row_now = row_entries[irow];
+
+            rhs[irow] = bvec[irow];
+
+            for (k = amat.row_ptr[irow]; k < amat.row_ptr[irow + 1]; ++k) {
+                icol = amat.col_index[k];
+                tmp = amat.val[k];
+                ip = pivot_row[icol];
+
+                if (ip == -1) {
+                    row_now.push_back(std::pair<int, double>(index_free[icol], tmp));
+                } else {
+                    rhs[irow] -= tmp * pivot_rhs[ip];
+                    for (j = 0; j < static_cast<int>(relation[ip].size()); ++j) {
+                        row_now.push_back(std::pair<int, double>(relation[ip][j].first,
+                                                                 -tmp * relation[ip][j].second));
+                    }
+                }
+            }
+
+            std::sort(row_now.begin(), row_now.end());
+
+            nuniq = 0;
+            for (j = 0; j < static_cast<int>(row_now.size()); ++j) {
+                if (nuniq > 0 && row_now[nuniq - 1].first == row_now[j].first) {
+                    row_now[nuniq - 1].second += row_now[j].second;
+                } else {
+                    row_now[nuniq++] = row_now[j];
+                }
+            }
+            row_now.resize(nuniq);
+        }
+    }
+
+    bmat.nrows = M;
+    bmat.ncols = nfree;
+    bmat.row_ptr.resize(M + 1);
+    bmat.row_ptr[0] = 0;
+
+    for (i = 0; i < M; ++i) {
+        bmat.row_ptr[i + 1] = bmat.row_ptr[i] + row_entries[i].size();
+    }
+    nnz = bmat.row_ptr[M];
+    bmat.col_index.resize(nnz);
+    bmat.val.resize(nnz);
+
+    for (i = 0; i < M; ++i) {
+        k = bmat.row_ptr[i];
+        for (j = 0; j < static_cast<int>(row_entries[i].size()); ++j) {
+            bmat.col_index[k + j] = row_entries[i][j].first;
+            bmat.val[k + j] = row_entries[i][j].second;
+        }
+        std::vector<std::pair<int, double> >().swap(row_entries[i]);
+    }
+
+    // Normalize the columns of the reduced matrix
+
+    memory->allocate(scale, nfree);
+    for (j = 0; j < nfree; ++j) scale[j] = 0.0;
+    for (k = 0; k < nnz; ++k) {
+        scale[bmat.col_index[k]] += bmat.val[k] * bmat.val[k];
+    }
+
+    nzero_col = 0;
+    for (j = 0; j < nfree; ++j) {
+        if (scale[j] > 0.0) {
+            scale[j] = 1.0 / std::sqrt(scale[j]);
+        } else {
+            ++nzero_col;
+        }
+    }
+    for (k = 0; k < nnz; ++k) {
+        bmat.val[k] *= scale[bmat.col_index[k]];
+    }
+
+    if (nzero_col > 0) {
+        error->warn("fit_sparse",
+                    "Matrix is rank-deficient. Force constants could not be determined uniquely :(");
+    }
+
+    bmat.transpose(bmat_t);
+
+    // Least-squares fitting of the free parameters
+
+    memory->allocate(yvec, nfree);
+
+    maxiter = std::max<int>(1000, 10 * nfree);
+
+    std::cout << "  LSQR has started ...";
+
+    converged = lsqr(bmat, bmat_t, rhs, yvec, eps10, maxiter, niter);
+
+    std::cout << " finished. (" << niter << " iterations)" << std::endl;
+
+    if (!converged) {
+        error->warn("fit_sparse",
+                    "LSQR did not converge within the maximum number of iterations.");
+    }
+
+    // Recover all the parameters x = x0 + Z y
+
+    memory->allocate(xvec, N);
+
+    for (j = 0; j < nfree; ++j) yvec[j] *= scale[j];
+
+    recover_parameters(N, yvec, index_free, pivot_row, pivot_rhs, relation, xvec);
+
+    // The residual is evaluated with the original matrix A
+    // so that it can be compared with that of the dense solver.
+
+    memory->allocate(ax, M);
+    amat.multiply(xvec, ax);
+
+    f_square = 0.0;
+    f_residual = 0.0;
+    for (i = 0; i < M; ++i) {
+        f_square += std::pow(bvec[i], 2);
+        f_residual += std::pow(bvec[i] - ax[i], 2);
+    }
+
+    std::cout << std::endl << "  Residual sum of squares for the solution: "
+        << sqrt(f_residual) << std::endl;
+    std::cout << "  Fitting error (%) : "
+        << std::sqrt(f_residual / f_square) * 100.0 << std::endl;
+
+    for (i = 0; i < N; ++i) {
+        param_out[i] = xvec[i];
+    }
+
+    memory->deallocate(rhs);
+    memory->deallocate(scale);
+    memory->deallocate(yvec);
+    memory->deallocate(xvec);
+    memory->deallocate(ax);
+}
+
+
+int Fitting::eliminate_constraints(const int N,
+                                   const int P,
+                                   double **cmat,
+                                   double *dvec,
+                                   std::vector<int> &index_free,
+                                   std::vector<int> &pivot_row,
+                                   std::vector<double> &pivot_rhs,
+                                   std::vector<std::vector<std::pair<int, double> > > &relation)
+{
+    // Eliminate the linear constraints Cx = d by the reduced row echelon form
+    // of (C|d). The parameter at the pivot column of the i-th row is given by
+    //   x[p_i] = pivot_rhs[i] - sum_{(j, c) in relation[i]} c * y[j],
+    // where y are the remaining free parameters, i.e., x = x0 + Z y.
+    // index_free[j] is the index of x[j] in y (-1 for pivot columns), and
+    // pivot_row[j] is the row whose pivot is at column j (-1 for free columns).
+    // Returns the number of free parameters.
+
+    int i, j;
+    int nrank, nfree;
+    double **cmat_aug = NULL;
+    std::vector<int> pivot_col;
+
+    nrank = 0;
+    pivot_row.assign(N, -1);
+    index_free.assign(N, -1);
+
+    if (P > 0) {
+        memory->allocate(cmat_aug, P, N + 1);
+
+        for (i = 0; i < P; ++i) {
+            for (j = 0; j < N; ++j) {
+                cmat_aug[i][j] = cmat[i][j];
+            }
+            cmat_aug[i][N] = dvec[i];
+        }
+
+        constraint->rref(P, N + 1, cmat_aug, nrank);
+
+        for (i = 0; i < nrank; ++i) {
+            for (j = 0; j <= N; ++j) {
+                if (std::abs(cmat_aug[i][j]) > eps12) break;
+            }
+            if (j >= N) {
+                error->exit("eliminate_constraints",
+                            "The constraints are inconsistent with each other.");
+            }
+            pivot_col.push_back(j);
+            pivot_row[j] = i;
+        }
+    }
+
+    nfree = 0;
+    for (j = 0; j < N; ++j) {
+        if (pivot_row[j] == -1) index_free[j] = nfree++;
+    }
+
+    relation.clear();
+    relation.resize(nrank);
+    pivot_rhs.resize(nrank);
+
+    for (i = 0; i < nrank; ++i) {
+        pivot_rhs[i] = cmat_aug[i][N];
+        for (j = pivot_col[i] + 1; j < N; ++j) {
+            if (index_free[j] != -1 && std::abs(cmat_aug[i][j]) > eps15) {
+                relation[i].push_back(std::pair<int, double>(index_free[j], cmat_aug[i][j]));
+            }
+        }
+    }
+
+    if (P > 0) {
+        memory->deallocate(cmat_aug);
+    }
+
+    std::cout << "  Number of free parameters after eliminating constraints : "
+        << nfree << std::endl;
+
+    return nfree;
+}
+
+
+void Fitting::recover_parameters(const int N,
+                                 const double *yvec,
+                                 const std::vector<int> &index_free,
+                                 const std::vector<int> &pivot_row,
+                                 const std::vector<double> &pivot_rhs,
+                                 const std::vector<std::vector<std::pair<int, double> > > &relation,
+                                 double *xvec)
+{
+    // x = x0 + Z y
+
+    int i, j, ip;
+    double tmp;
+
+    for (i = 0; i < N; ++i) {
+        if (index_free[i] != -1) {
+            xvec[i] = yvec[index_free[i]];
+        } else {
+            ip = pivot_row[i];
+            tmp = pivot_rhs[ip];
+            for (j = 0; j < static_cast<int>(relation[ip].size()); ++j) {
+                tmp -= relation[ip][j].second * yvec[relation[ip][j].first];
+            }
+            xvec[i] = tmp;
+        }
+    }
+}
+
+
+void Fitting::fit_normal_equations(const int N,
+                                   const int P,
+                                   const int nat,
+                                   const int natmin,
+                                   const int ndata,
+                                   const int nstart,
+                                   const int nend,
+                                   double *param_out,
+                                   double **cmat,
+                                   double *dvec)
+{
+    // Least-squares fitting through the normal equations.
+    // The displacement-force data sets are read NCHUNK at a time, and
+    // A^T A and A^T b are accumulated chunk by chunk so that the memory usage
+    // does not depend on the number of data sets.
+    // After eliminating the constraints as x = x0 + Z y, the reduced equations
+    //   Z^T A^T A Z y = Z^T (A^T b - A^T A x0)
+    // are solved with the columns scaled to unity.
+
+    int i, j, a;
+    int ichunk, nsnap, nmulti;
+    int M_chunk, nfree, nrank, nzero_col;
+    int ndata_used = nend - nstart + 1;
+    unsigned long k;
+    unsigned int nline_u, nline_f, nreq;
+    double u_in, f_in;
+    double btb, f_residual, xAtb, xAtAx;
+    double tmp;
+    double *u_tmp, *f_tmp;
+    double **u, **f;
+    double *amat, *bvec;
+    double **ata, *atb;
+    double **hmat, *gvec, *ata_x0;
+    double *scale, *xvec;
+    std::vector<int> index_free, pivot_row;
+    std::vector<double> pivot_rhs;
+    std::vector<std::vector<std::pair<int, double> > > relation, zcol;
+    std::ifstream ifs_disp, ifs_force;
+
+    const int natmin3 = 3 * natmin;
+
+    std::cout << "  NCHUNK = " << nchunk << ": A^T A and A^T b are accumulated by reading "
+        << nchunk << " data sets at a time." << std::endl << std::endl;
+
+    nmulti = get_multiplier(symmetry->multiply_data);
+
+    ifs_disp.open(files->file_disp.c_str(), std::ios::in);
+    if (!ifs_disp) error->exit("openfiles", "cannot open disp file");
+    ifs_force.open(files->file_force.c_str(), std::ios::in);
+    if (!ifs_force) error->exit("openfiles", "cannot open force file");
+
+    // Skip the data sets before NSTART
+
+    nreq = 3 * nat * (nstart - 1);
+    for (nline_u = 0; nline_u < nreq && ifs_disp >> u_in; ++nline_u);
+    for (nline_f = 0; nline_f < nreq && ifs_force >> f_in; ++nline_f);
+
+    memory->allocate(u_tmp, 3 * nat * nchunk);
+    memory->allocate(f_tmp, 3 * nat * nchunk);
+    memory->allocate(u, nchunk * nmulti, 3 * nat);
+    memory->allocate(f, nchunk * nmulti, 3 * nat);
+    memory->allocate(amat, natmin3 * nchunk * nmulti * N);
+    memory->allocate(bvec, natmin3 * nchunk * nmulti);
+    memory->allocate(ata, N, N);
+    memory->allocate(atb, N);
+
+    for (i = 0; i < N; ++i) {
+        for (j = 0; j < N; ++j) {
+            ata[i][j] = 0.0;
+        }
+        atb[i] = 0.0;
+    }
+    btb = 0.0;
+
+    std::cout << "  Accumulation of the normal equations started ... ";
+
+    for (ichunk = 0; ichunk < ndata_used; ichunk += nchunk) {
+
+        nsnap = std::min<int>(nchunk, ndata_used - ichunk);
+        nreq = 3 * nat * nsnap;
+
+        nline_u = 0;
+        while (nline_u < nreq && ifs_disp >> u_in) {
+            u_tmp[nline_u++] = u_in;
+        }
+        if (nline_u < nreq)
+            error->exit("fit_normal_equations",
+                        "The number of lines in DFILE is too small for the given NDATA = ",
+                        ndata);
+
+        nline_f = 0;
+        while (nline_f < nreq && ifs_force >> f_in) {
+            f_tmp[nline_f++] = f_in;
+        }
+        if (nline_f < nreq)
+            error->exit("fit_normal_equations",
+                        "The number of lines in FFILE is too small for the given NDATA = ",
+                        ndata);
+
+        generate_symmetric_copies(nat, nsnap, symmetry->multiply_data,
+                                  u_tmp, f_tmp, u, f);
+
+        M_chunk = natmin3 * nsnap * nmulti;
+
+        calc_matrix_elements(M_chunk, N, natmin, nsnap,
+                             nmulti, u, f, amat, bvec);
+
+        // A^T A += A_chunk^T A_chunk
+        // Only the upper triangle in the column-major order,
+        // i.e., ata[j][i] with i <= j, is updated.
+
+        char uplo = 'U';
+        char trans = 'T';
+        double one = 1.0;
+        int N_tmp = N;
+
+        dsyrk_(&uplo, &trans, &N_tmp, &M_chunk, &one, amat, &M_chunk,
+               &one, ata[0], &N_tmp);
+
+#ifdef _OPENMP
+#pragma omp parallel for private(i, tmp)
+#endif
+        for (j = 0; j < N; ++j) {
+            tmp = 0.0;
+            for (i = 0; i < M_chunk; ++i) {
+                tmp += amat[i + static_cast<unsigned long>(M_chunk) * j] * bvec[i];
+            }
+            atb[j] += tmp;
+        }
+        for (i = 0; i < M_chunk; ++i) {
+            btb += bvec[i] * bvec[i];
+        }
+    }
+
+    std::cout << "done!" << std::endl << std::endl;
+
+    ifs_disp.close();
+    ifs_force.close();
+
+    memory->deallocate(u_tmp);
+    memory->deallocate(f_tmp);
+    memory->deallocate(u);
+    memory->deallocate(f);
+    memory->deallocate(amat);
+    memory->deallocate(bvec);
+
+    for (j = 0; j < N; ++j) {
+        for (i = j + 1; i < N; ++i) {
+            ata[j][i] = ata[i][j];
+        }
+    }
+
+    if (P > 0) {
+        std::cout << "  Entering fitting routine: normal equations with constraints eliminated" << std::endl;
+    } else {
+        std::cout << "  Entering fitting routine: normal equations without constraints" << std::endl;
+    }
+
+    nfree = eliminate_constraints(N, P, cmat, dvec, index_free,
+                                  pivot_row, pivot_rhs, relation);
+
+    // Nonzero elements of each column of Z
+
+    zcol.resize(nfree);
+
+    for (i = 0; i < N; ++i) {
+        if (index_free[i] != -1) {
+            zcol[index_free[i]].push_back(std::pair<int, double>(i, 1.0));
+        } else {
+            for (j = 0; j < static_cast<int>(relation[pivot_row[i]].size()); ++j) {
+                zcol[relation[pivot_row[i]][j].first].push_back(
+                    std::pair<int, double>(i, -relation[pivot_row[i]][j].second));
+            }
+        }
+    }
+
+    memory->allocate(ata_x0, N);
+
+#ifdef _OPENMP
+#pragma omp parallel for private(j, tmp)
+#endif
+    for (i = 0; i < N; ++i) {
+        tmp = 0.0;
+        for (j = 0; j < N; ++j) {
+            if (pivot_row[j] != -1) tmp += ata[i][j] * pivot_rhs[pivot_row[j]];
+        }
+        ata_x0[i] = tmp;
+    }
+
+    // H = Z^T A^T A Z and g = Z^T (A^T b - A^T A x0)
+
+    memory->allocate(hmat, nfree, nfree);
+    memory->allocate(gvec, nfree);
+
+#ifdef _OPENMP
+#pragma omp parallel private(i, j, k, tmp)
+#endif
+    {
+        int b;
+        std::vector<double> work(N);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for (a = 0; a < nfree; ++a) {
+
+            // work = A^T A Z e_a
+
+            for (j = 0; j < N; ++j) work[j] = 0.0;
+            for (k = 0; k < zcol[a].size(); ++k) {
+                i = zcol[a][k].first;
+                tmp = zcol[a][k].second;
+                for (j = 0; j < N; ++j) {
+                    work[j] += ata[i][j] * tmp;
+                }
+            }
+
+            for (b = 0; b < nfree; ++b) {
+                tmp = 0.0;
+                for (k = 0; k < zcol[b].size(); ++k) {
+                    tmp += zcol[b][k].second * work[zcol[b][k].first];
+                }
+                hmat[a][b] = tmp;
+            }
+
+            tmp = 0.0;
+            for (k = 0; k < zcol[a].size(); ++k) {
+                i = zcol[a][k].first;
+                tmp += zcol[a][k].second * (atb[i] - ata_x0[i]);
+            }
+            gvec[a] = tmp;
+        }
+    }
+
+    memory->deallocate(ata_x0);
+
+    // Scale the reduced equations and solve them
+
+    memory->allocate(scale, nfree);
+
+    nzero_col = 0;
+    for (a = 0; a < nfree; ++a) {
+        if (hmat[a][a] > 0.0) {
+            scale[a] = 1.0 / std::sqrt(hmat[a][a]);
+        } else {
+            scale[a] = 0.0;
+            ++nzero_col;
+        }
+    }
+    for (a = 0; a < nfree; ++a) {
+        for (j = 0; j < nfree; ++j) {
+            hmat[a][j] *= scale[a] * scale[j];
+        }
+        gvec[a] *= scale[a];
+    }
+
+    std::cout << "  SVD has started ... ";
+
+    int nrhs = 1, INFO, LWORK;
+    double rcond = -1.0;
+    double *WORK, *S;
+
+    LWORK = 2 * (5 * nfree + 1);
+    memory->allocate(WORK, LWORK);
+    memory->allocate(S, nfree);
+
+    dgelss_(&nfree, &nfree, &nrhs, hmat[0], &nfree, gvec, &nfree,
+            S, &rcond, &nrank, WORK, &LWORK, &INFO);
+
+    std::cout << "finished !" << std::endl << std::endl;
+
+    std::cout << "  RANK of the matrix = " << nrank << std::endl;
+    if (nrank < nfree || nzero_col > 0)
+        error->warn("fit_normal_equations",
+                    "Matrix is rank-deficient. Force constants could not be determined uniquely :(");
+
+    memory->deallocate(WORK);
+    memory->deallocate(S);
+
+    for (a = 0; a < nfree; ++a) gvec[a] *= scale[a];
+
+    memory->allocate(xvec, N);
+
+    recover_parameters(N, gvec, index_free, pivot_row, pivot_rhs, relation, xvec);
+
+    // |Ax - b|^2 = x^T A^T A x - 2 x^T A^T b + b^T b
+
+    xAtb = 0.0;
+    xAtAx = 0.0;
+    for (i = 0; i < N; ++i) {
+        xAtb += xvec[i] * atb[i];
+        tmp = 0.0;
+        for (j = 0; j < N; ++j) {
+            tmp += ata[i][j] * xvec[j];
+        }
+        xAtAx += xvec[i] * tmp;
+    }
+    f_residual = std::max<double>(xAtAx - 2.0 * xAtb + btb, 0.0);
+
+    std::cout << std::endl << "  Residual sum of squares for the solution: "
+        << sqrt(f_residual) << std::endl;
+    std::cout << "  Fitting error (%) : "
+        << std::sqrt(f_residual / btb) * 100.0 << std::endl;
+
+    for (i = 0; i < N; ++i) {
+        param_out[i] = xvec[i];
+    }
+
+    memory->deallocate(ata);
+    memory->deallocate(atb);
+    memory->deallocate(hmat);
+    memory->deallocate(gvec);
+    memory->deallocate(scale);
+    memory->deallocate(xvec);
+}
+
+
+bool Fitting::lsqr(const SparseMatrixCSR &amat,
+                   const SparseMatrixCSR &amat_t,
+                   const double *bvec,
+                   double *xvec,
+                   const double tolerance,
+                   const int maxiter,
+                   int &niter)
+{
+    // LSQR algorithm of Paige and Saunders for min |Ax - b|.
+    // amat_t is the transpose of amat. tolerance is used for both
+    // the relative residual (btol) and the relative normal-equation
+    // residual (atol) of the stopping criteria.
+    // Returns false if the criteria are not met within maxiter iterations.
+
+    int i, iter;
+    bool converged;
+    int m = amat.nrows;
+    int n = amat.ncols;
+    double alpha, beta, rho, rhobar, phi, phibar;
+    double c, s, theta;
+    double anorm, bnorm, rnorm, arnorm, xnorm;
+    double *uvec, *vvec, *wvec, *work_m, *work_n;
+
+    memory->allocate(uvec, m);
+    memory->allocate(vvec, n);
+    memory->allocate(wvec, n);
+    memory->allocate(work_m, m);
+    memory->allocate(work_n, n);
+
+    for (i = 0; i < n; ++i) xvec[i] = 0.0;
+
+    beta = 0.0;
+    for (i = 0; i < m; ++i) {
+        uvec[i] = bvec[i];
+        beta += uvec[i] * uvec[i];
+    }
+    beta = std::sqrt(beta);
+    bnorm = beta;
+    if (beta > 0.0) {
+        for (i = 0; i < m; ++i) uvec[i] /= beta;
+    }
+
+    amat_t.multiply(uvec, vvec);
+    alpha = 0.0;
+    for (i = 0; i < n; ++i) alpha += vvec[i] * vvec[i];
+    alpha = std::sqrt(alpha);
+    if (alpha > 0.0) {
+        for (i = 0; i < n; ++i) vvec[i] /= alpha;
+    }
+
+    for (i = 0; i < n; ++i) wvec[i] = vvec[i];
+
+    phibar = beta;
+    rhobar = alpha;
+    anorm = 0.0;
+
+    iter = 0;
+    converged = true;
+
+    if (alpha * beta > 0.0) {
+
+        converged = false;
+
+        for (iter = 1; iter <= maxiter; ++iter) {
+
+            // Golub-Kahan bidiagonalization
+
+            amat.multiply(vvec, work_m);
+            beta = 0.0;
+            for (i = 0; i < m; ++i) {
+                uvec[i] = work_m[i] - alpha * uvec[i];
+                beta += uvec[i] * uvec[i];
+            }
+            beta = std::sqrt(beta);
+            if (beta > 0.0) {
+                for (i = 0; i < m; ++i) uvec[i] /= beta;
+            }
+
+            anorm = std::sqrt(anorm * anorm + alpha * alpha + beta * beta);
+
+            amat_t.multiply(uvec, work_n);
+            alpha = 0.0;
+            for (i = 0; i < n; ++i) {
+                vvec[i] = work_n[i] - beta * vvec[i];
+                alpha += vvec[i] * vvec[i];
+            }
+            alpha = std::sqrt(alpha);
+            if (alpha > 0.0) {
+                for (i = 0; i < n; ++i) vvec[i] /= alpha;
+            }
+
+            // Plane rotation to eliminate the subdiagonal element beta
+
+            rho = std::sqrt(rhobar * rhobar + beta * beta);
+            c = rhobar / rho;
+            s = beta / rho;
+            theta = s * alpha;
+            rhobar = -c * alpha;
+            phi = c * phibar;
+            phibar = s * phibar;
+
+            xnorm = 0.0;
+            for (i = 0; i < n; ++i) {
+                xvec[i] += (phi / rho) * wvec[i];
+                wvec[i] = vvec[i] - (theta / rho) * wvec[i];
+                xnorm += xvec[i] * xvec[i];
+            }
+            xnorm = std::sqrt(xnorm);
+
+            // Convergence tests for compatible and least-squares problems
+
+            rnorm = phibar;
+            arnorm = alpha * std::abs(c) * phibar;
+
+            if (rnorm <= tolerance * bnorm + tolerance * anorm * xnorm
+                || arnorm <= tolerance * anorm * rnorm) {
+                converged = true;
+                break;
+            }
+        }
+        if (iter > maxiter) iter = maxiter;
+    }
+
+    memory->deallocate(uvec);
+    memory->deallocate(vvec);
+    memory->deallocate(wvec);
+    memory->deallocate(work_m);
+    memory->deallocate(work_n);
+
+    niter = iter;
+    return converged;
+}
+
+
+void SparseMatrixCSR::multiply(const double *x, double *y) const
+{
+    // y = A x
+
+    int i;
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (i = 0; i < nrows; ++i) {
+        double tmp = 0.0;
+        for (unsigned long k = row_ptr[i]; k < row_ptr[i + 1]; ++k) {
+            tmp += val[k] * x[col_index[k]];
+        }
+        y[i] = tmp;
+    }
+}
+
+
+void SparseMatrixCSR::transpose(SparseMatrixCSR &mat_t) const
+{
+    int i;
+    unsigned long k, pos;
+    std::vector<unsigned long> offset(ncols + 1, 0);
+
+    mat_t.nrows = ncols;
+    mat_t.ncols = nrows;
+
+    for (k = 0; k < row_ptr[nrows]; ++k) ++offset[col_index[k] + 1];
+    for (i = 0; i < ncols; ++i) offset[i + 1] += offset[i];
+
+    mat_t.row_ptr = offset;
+    mat_t.col_index.resize(row_ptr[nrows]);
+    mat_t.val.resize(row_ptr[nrows]);
+
+    for (i = 0; i < nrows; ++i) {
+        for (k = row_ptr[i]; k < row_ptr[i + 1]; ++k) {
+            pos = offset[col_index[k]]++;
+            mat_t.col_index[pos] = i;
+            mat_t.val[pos] = val[k];
+        }
+    }
 }
 
 
@@ -14,12 +14,55 @@
 #include <vector>
 #include <set>
 #include <string>
+#include <utility>
 #ifdef _VSL
 #include "mkl_vsl.h"
 #endif
 
 namespace ALM_NS
 {
+    // Sparse matrix in the compressed sparse row (CSR) format.
+    // The column indices and values of the i-th row are stored in
+    // [row_ptr[i], row_ptr[i + 1]).
+
+    class SparseMatrixCSR
+    {
+    public:
+        int nrows, ncols;
+        std::vector<unsigned long> row_ptr;
+        std::vector<int> col_index;
+        std::vector<double> val;
+
+        SparseMatrixCSR()
+        {
+            nrows = 0;
+            ncols = 0;
+        }
+
+        void multiply(const double *, double *) const;
+        void transpose(SparseMatrixCSR &) const;
+    };
+
+    // Terms of the matrix A for fitting flattened from fcs->fc_set.
+    // The displacement indices of the i-th term are
+    // disp_index[disp_start[i]], ..., disp_index[disp_start[i + 1] - 1].
+
+    class FcTermTable
+    {
+    public:
+        int nterms;
+        std::vector<int> iparam;        // Index of the parameter
+        std::vector<int> irow;          // Row index in the data set (inprim_index)
+        std::vector<double> prefactor;  // -gamma * coef
+        std::vector<int> disp_start;
+        std::vector<int> disp_index;
+
+        FcTermTable()
+        {
+            nterms = 0;
+        }
+    };
+
     class Fitting: protected Pointers
     {
     public:
@@ -31,8 +74,10 @@ namespace ALM_NS
         double *params;
         unsigned int nboot;
         unsigned int seed;
+        bool use_sparse_solver;
+        int nchunk;
 
-        void data_multiplier(const int, const int, const int, const int, const int,
+        void data_multiplier(const int, const int, const int, const int,
                              int &, const int,
                              double **&, double **&,
                              const std::string, const std::string);
@@ -47,28 +92,63 @@ namespace ALM_NS
 
     private:
 
+        FcTermTable fc_terms;
+
         int inprim_index(const int);
-        void fit_without_constraints(int, int, double **, double *, double *);
+        void fit_without_constraints(int, int, double *, double *, double *);
         void fit_algebraic_constraints(int, int, double *, double *,
                                        double *, double *, const int);
 
-        void fit_with_constraints(int, int, int, double **, double *,
+        void fit_with_constraints(int, int, int, double *, double *,
                                   double *, double **, double *);
 
         void fit_consecutively(int, int, const int, const int,
                                const int, const int,
-                               double **, double *, double **, double *);
+                               double *, double *, double **, double *);
+
+        void setup_fc_terms(const int);
 
         void calc_matrix_elements(const int, const int, const int,
-                                  const int, const int, const int, const int,
-                                  double **, double **, double **, double *);
+                                  const int, const int,
+                                  double **, double **, double *, double *);
+
+        void calc_matrix_elements_sparse(const int, const int, const int,
+                                         const int, const int,
+                                         double **, double **,
+                                         SparseMatrixCSR &, double *);
+
+        void fit_sparse(int, int, int, const SparseMatrixCSR &, double *,
+                        double *, double **, double *);
+
+        int eliminate_constraints(const int, const int, double **, double *,
+                                  std::vector<int> &, std::vector<int> &,
+                                  std::vector<double> &,
+                                  std::vector<std::vector<std::pair<int, double> > > &);
+
+        void recover_parameters(const int, const double *,
+                                const std::vector<int> &, const std::vector<int> &,
+                                const std::vector<double> &,
+                                const std::vector<std::vector<std::pair<int, double> > > &,
+                                double *);
+
+        void fit_normal_equations(const int, const int, const int, const int,
+                                  const int, const int, const int,
+                                  double *, double **, double *);
+
+        int get_multiplier(const int);
+        void generate_symmetric_copies(const int, const int, const int,
+                                       const double *, const double *,
+                                       double **, double **);
+
+        bool lsqr(const SparseMatrixCSR &, const SparseMatrixCSR &,
+                  const double *, double *, const double, const int, int &);
 
         void calc_matrix_elements_algebraic_constraint(const int, const int, const int, const int,
                                                        const int, const int, const int, const int,
                                                        double **, double **, double *, double *, double *);
 
         void fit_bootstrap(int, int, int, int, int,
-                           double **, double *, double **, double *);
+                           double *, double *, double **, double *);
 
         int factorial(const int);
         int rankSVD(const int, const int, double *, const double);
@@ -96,6 +176,10 @@ namespace ALM_NS
         void dgeqrf_(int *m, int *n, double *a, int *lda, double *tau,
                      double *work, int *lwork, int *info);
 
+        void dsyrk_(const char *uplo, const char *trans, int *n, int *k,
+                    double *alpha, double *a, int *lda, double *beta,
+                    double *c, int *ldc);
+
         void dgeqp3_(int *m, int *n, double *a, int *lda, int *jpvt,
                      double *tau, double *work, int *lwork, int *info);
     }
@@ -716,10 +716,11 @@ void Input::parse_fitting_vars()
     int ndata, nstart, nend, nskip, nboot;
     std::string dfile, ffile;
     int multiply_data, constraint_flag;
+    int sparse, nchunk;
     std::string rotation_axis;
     std::string fc2_file, fc3_file;
 
-    std::string str_allowed_list = "NDATA NSTART NEND NSKIP NBOOT DFILE FFILE MULTDAT ICONST ROTAXIS FC2XML FC3XML";
+    std::string str_allowed_list = "NDATA NSTART NEND NSKIP NBOOT DFILE FFILE MULTDAT ICONST ROTAXIS FC2XML FC3XML SPARSE NCHUNK";
     std::string str_no_defaults = "NDATA DFILE FFILE";
     std::vector<std::string> no_defaults;
 
@@ -805,6 +806,24 @@ void Input::parse_fitting_vars()
         assign_val(constraint_flag, "ICONST", fitting_var_dict);
     }
 
+    if (fitting_var_dict["SPARSE"].empty()) {
+        sparse = 0;
+    } else {
+        assign_val(sparse, "SPARSE", fitting_var_dict);
+    }
+    if (sparse != 0 && sparse != 1) {
+        error->exit("parse_fitting_vars", "SPARSE should be 0 or 1.");
+    }
+
+    if (fitting_var_dict["NCHUNK"].empty()) {
+        nchunk = 0;
+    } else {
+        assign_val(nchunk, "NCHUNK", fitting_var_dict);
+    }
+    if (nchunk < 0) {
+        error->exit("parse_fitting_vars", "NCHUNK should be a non-negative integer.");
+    }
+
     fc2_file = fitting_var_dict["FC2XML"];
     if (fc2_file.empty()) {
         fix_harmonic = false;
@@ -833,6 +852,8 @@ void Input::parse_fitting_vars()
     system->nskip = nskip;
 
     fitting->nboot = nboot;
+    fitting->use_sparse_solver = (sparse == 1);
+    fitting->nchunk = nchunk;
     files->file_disp = dfile;
     files->file_force = ffile;
     symmetry->multiply_data = multiply_data;
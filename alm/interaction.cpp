@@ -24,6 +24,7 @@ or http://opensource.org/licenses/mit-license.php for information.
 #include "files.h"
 #include "timer.h"
 #include "fcs.h"
+#include "mathfunctions.h"
 #include <cmath>
 
 using namespace ALM_NS;
@@ -75,8 +76,8 @@ void Interaction::init()
     nneib = 27;
     memory->allocate(x_image, nneib, nat, 3);
     memory->allocate(exist_image, nneib);
-    memory->allocate(distall, nat, nat);
-    memory->allocate(mindist_pairs, nat, nat);
+    memory->allocate(distall, symmetry->natmin, nat);
+    memory->allocate(mindist_pairs, nat);
     memory->allocate(interaction_pair, maxorder, symmetry->natmin);
     memory->allocate(mindist_cluster, maxorder, symmetry->natmin);
     memory->allocate(pairs, maxorder);
@@ -87,9 +88,8 @@ void Interaction::init()
                                   distall, mindist_pairs);
     print_neighborlist(mindist_pairs);
     search_interactions(interaction_pair, pairs);
-    //    calc_mindist_clusters2(interaction_pair, mindist_pairs, distall, exist_image, mindist_cluster);
-    calc_mindist_clusters(interaction_pair, mindist_pairs,
-                          distall, exist_image, mindist_cluster);
+    //    calc_mindist_clusters2(interaction_pair, distall, exist_image, mindist_cluster);
+    calc_mindist_clusters(interaction_pair, distall, exist_image, mindist_cluster);
     generate_pairs(pairs, mindist_cluster);
 
     timer->print_elapsed();
@@ -223,22 +223,146 @@ void Interaction::get_pairs_of_minimum_distance(int nat,
                                                 double ***xc_in,
                                                 int *exist,
                                                 std::vector<DistInfo> **distall,
-                                                std::vector<DistInfo> **mindist_pairs)
+                                                std::map<int, std::vector<DistInfo> > *mindist_pairs)
 {
     //
     // Calculate the minimum distance between atom i and j 
-    // under the periodic boundary conditions
+    // under the periodic boundary conditions.
+    //
+    // Only the pairs whose minimum distance is within the largest cutoff radius
+    // of the kind pair (over all orders) are stored in mindist_pairs[i], which is
+    // keyed on the second atom j. The candidate pairs are found with a cell list
+    // unless a cutoff radius is 'None'.
+    // distall is stored only for the atoms in the primitive cell [natmin][nat].
     //
-    int icell = 0;
     int i, j, k;
-    double dist_tmp;
-    double vec[3];
+    int ikd, jkd;
+    int order;
+    int nkd = system->nkd;
+    int natmin = symmetry->natmin;
+    int nbin[3], nbin_tot;
+    int *bin_atom;
+    double **rc_pair;
+    double rc_search = 0.0;
+    double lavec_inv[3][3];
+    double xf_tmp;
+    bool has_none = false;
+
+    std::vector<int> prim_index(nat, -1);
+    std::vector<std::vector<int> > atoms_in_bin;
+
+    for (i = 0; i < natmin; ++i) prim_index[symmetry->map_p2s[i][0]] = i;
+
+    // Largest cutoff radius for each kind pair (negative for 'None')
+
+    memory->allocate(rc_pair, nkd, nkd);
+
+    for (ikd = 0; ikd < nkd; ++ikd) {
+        for (jkd = 0; jkd < nkd; ++jkd) {
+            rc_pair[ikd][jkd] = 0.0;
+            for (order = 0; order < maxorder; ++order) {
+                if (rcs[order][ikd][jkd] < 0.0) {
+                    rc_pair[ikd][jkd] = -1.0;
+                    break;
+                }
+                rc_pair[ikd][jkd] = std::max(rc_pair[ikd][jkd], rcs[order][ikd][jkd]);
+            }
+            if (rc_pair[ikd][jkd] < 0.0) {
+                has_none = true;
+            } else {
+                rc_search = std::max(rc_search, rc_pair[ikd][jkd]);
+            }
+        }
+    }
+
+    // Divide the supercell into bins whose widths are larger than rc_search
+    // so that the neighbors of an atom are in the adjacent bins.
+
+    // The width of the supercell along the k-th axis is 1 / |b_k|,
+    // where b_k is the k-th row of lavec^{-1}.
 
+    invmat3(lavec_inv, system->lavec);
+
+    for (k = 0; k < 3; ++k) {
+        if (has_none || !is_periodic[k]) {
+            nbin[k] = 1;
+        } else {
+            xf_tmp = 1.0 / std::sqrt(lavec_inv[k][0] * lavec_inv[k][0]
+                                     + lavec_inv[k][1] * lavec_inv[k][1]
+                                     + lavec_inv[k][2] * lavec_inv[k][2]);
+            nbin[k] = static_cast<int>(xf_tmp / (rc_search + eps6));
+            nbin[k] = std::min(std::max(nbin[k], 1), 64);
+        }
+    }
+    nbin_tot = nbin[0] * nbin[1] * nbin[2];
+
+    memory->allocate(bin_atom, 3 * nat);
+    atoms_in_bin.resize(nbin_tot);
 
     for (i = 0; i < nat; ++i) {
-        for (j = 0; j < nat; ++j) {
+        for (k = 0; k < 3; ++k) {
+            xf_tmp = system->xcoord[i][k] - std::floor(system->xcoord[i][k]);
+            bin_atom[3 * i + k] = std::min(static_cast<int>(xf_tmp * nbin[k]), nbin[k] - 1);
+        }
+        atoms_in_bin[(bin_atom[3 * i] * nbin[1] + bin_atom[3 * i + 1]) * nbin[2]
+            + bin_atom[3 * i + 2]].push_back(i);
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for private(j, k, ikd, jkd), schedule(dynamic)
+#endif
+    for (i = 0; i < nat; ++i) {
+
+        int icell, ibin[3], m[3];
+        double dist_tmp, dist_min, rc_tmp;
+        double vec[3];
+        std::vector<int> bin_list, candidates;
+        std::vector<DistInfo> dist_list;
+
+        mindist_pairs[i].clear();
+        if (prim_index[i] >= 0) {
+            for (j = 0; j < nat; ++j) distall[prim_index[i]][j].clear();
+        }
+
+        // Atoms in the adjacent bins
+
+        bin_list.clear();
+        for (m[0] = -1; m[0] <= 1; ++m[0]) {
+            for (m[1] = -1; m[1] <= 1; ++m[1]) {
+                for (m[2] = -1; m[2] <= 1; ++m[2]) {
+                    for (k = 0; k < 3; ++k) {
+                        ibin[k] = bin_atom[3 * i + k] + m[k];
+                        if (ibin[k] < 0 || ibin[k] >= nbin[k]) {
+                            if (!is_periodic[k]) break;
+                            ibin[k] = (ibin[k] + nbin[k]) % nbin[k];
+                        }
+                    }
+                    if (k < 3) continue;
+                    bin_list.push_back((ibin[0] * nbin[1] + ibin[1]) * nbin[2] + ibin[2]);
+                }
+            }
+        }
+        std::sort(bin_list.begin(), bin_list.end());
+        bin_list.erase(std::unique(bin_list.begin(), bin_list.end()), bin_list.end());
+
+        candidates.clear();
+        for (j = 0; j < static_cast<int>(bin_list.size()); ++j) {
+            candidates.insert(candidates.end(),
+                              atoms_in_bin[bin_list[j]].begin(),
+                              atoms_in_bin[bin_list[j]].end());
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        ikd = system->kd[i] - 1;
+
+        for (std::vector<int>::const_iterator it_atom = candidates.begin();
+             it_atom != candidates.end(); ++it_atom) {
 
-            distall[i][j].clear();
+            j = *it_atom;
+            jkd = system->kd[j] - 1;
+            rc_tmp = rc_pair[ikd][jkd];
+
+            dist_list.clear();
 
             for (icell = 0; icell < nneib; ++icell) {
 
@@ -248,39 +372,47 @@ void Interaction::get_pairs_of_minimum_distance(int nat,
 
                     for (k = 0; k < 3; ++k) vec[k] = xc_in[icell][j][k] - xc_in[0][i][k];
 
-                    distall[i][j].push_back(DistInfo(icell, dist_tmp, vec));
+                    dist_list.push_back(DistInfo(icell, dist_tmp, vec));
                 }
             }
-            std::sort(distall[i][j].begin(), distall[i][j].end());
-        }
-    }
+            std::sort(dist_list.begin(), dist_list.end());
 
-    // Construct pairs of minimum distance.
+            dist_min = dist_list[0].dist;
+            if (rc_tmp >= 0.0 && dist_min > rc_tmp) continue;
 
-    double dist_min;
-    for (i = 0; i < nat; ++i) {
-        for (j = 0; j < nat; ++j) {
-            mindist_pairs[i][j].clear();
+            // Construct pairs of minimum distance.
 
-            dist_min = distall[i][j][0].dist;
-            for (std::vector<DistInfo>::const_iterator it = distall[i][j].begin();
-                 it != distall[i][j].end(); ++it) {
+            std::vector<DistInfo> &mindist_now = mindist_pairs[i][j];
+
+            for (std::vector<DistInfo>::const_iterator it = dist_list.begin();
+                 it != dist_list.end(); ++it) {
                 if (std::abs((*it).dist - dist_min) < eps8) {
-                    mindist_pairs[i][j].push_back(DistInfo(*it));
+                    mindist_now.push_back(DistInfo(*it));
+                }
+            }
+
+            if (prim_index[i] >= 0) {
+                for (std::vector<DistInfo>::const_iterator it = dist_list.begin();
+                     it != dist_list.end(); ++it) {
+                    if (rc_tmp < 0.0 || (*it).dist <= rc_tmp) {
+                        distall[prim_index[i]][j].push_back(DistInfo(*it));
+                    }
                 }
             }
         }
     }
+
+    memory->deallocate(rc_pair);
+    memory->deallocate(bin_atom);
 }
 
-void Interaction::print_neighborlist(std::vector<DistInfo> **mindist)
+void Interaction::print_neighborlist(std::map<int, std::vector<DistInfo> > *mindist)
 {
     //
     // Print the list of neighboring atoms and distances
     //
     int i, j, k;
     int iat;
-    int nat = system->nat;
     int icount;
 
     double dist_tmp;
@@ -293,8 +425,10 @@ void Interaction::print_neighborlist(std::vector<DistInfo> **mindist)
 
         iat = symmetry->map_p2s[i][0];
 
-        for (j = 0; j < nat; ++j) {
-            neighborlist[i].push_back(DistList(j, mindist[iat][j][0].dist));
+        // Only the atoms within the cutoff radii are stored
+        for (std::map<int, std::vector<DistInfo> >::const_iterator it = mindist[iat].begin();
+             it != mindist[iat].end(); ++it) {
+            neighborlist[i].push_back(DistList((*it).first, (*it).second[0].dist));
         }
         std::sort(neighborlist[i].begin(), neighborlist[i].end());
     }
@@ -318,7 +452,7 @@ void Interaction::print_neighborlist(std::vector<DistInfo> **mindist)
 
         dist_tmp = 0.0;
 
-        for (j = 0; j < nat; ++j) {
+        for (j = 0; j < static_cast<int>(neighborlist[i].size()); ++j) {
 
             if (neighborlist[i][j].dist < eps8) continue; // distance is zero
 
@@ -401,11 +535,8 @@ void Interaction::search_interactions(std::vector<int> **interaction_list_out,
     int ikd, jkd;
 
     double cutoff_tmp;
-    std::set<IntList> *interacting_atom_pairs;
     std::vector<int> intlist;
 
-    memory->allocate(interacting_atom_pairs, maxorder);
-
     for (order = 0; order < maxorder; ++order) {
         for (i = 0; i < natmin; ++i) {
             interaction_list_out[order][i].clear();
@@ -426,7 +557,9 @@ void Interaction::search_interactions(std::vector<int> **interaction_list_out,
 
                 } else {
 
-                    if (mindist_pairs[iat][jat][0].dist <= cutoff_tmp) {
+                    const std::vector<DistInfo> &mindist_now = mindist_pair(iat, jat);
+
+                    if (!mindist_now.empty() && mindist_now[0].dist <= cutoff_tmp) {
                         interaction_list_out[order][i].push_back(jat);
                     }
                 }
@@ -440,8 +573,6 @@ void Interaction::search_interactions(std::vector<int> **interaction_list_out,
 
     for (order = 0; order < maxorder; ++order) {
 
-        interacting_atom_pairs[order].clear();
-
         std::cout << std::endl << "   ***" << str_order[order] << "***" << std::endl;
 
         for (i = 0; i < natmin; ++i) {
@@ -483,43 +614,11 @@ void Interaction::search_interactions(std::vector<int> **interaction_list_out,
             std::cout << "    Number of total interaction pairs = "
                 << interaction_list_out[order][i].size() << std::endl << std::endl;
 
-            int *intarr;
-            memory->allocate(intarr, order + 2);
-
-            if (intlist.size() > 0) {
-                if (order == 0) {
-                    for (unsigned int ielem = 0; ielem < intlist.size(); ++ielem) {
-                        intarr[0] = iat;
-                        intarr[1] = intlist[ielem];
-                        insort(2, intarr);
-
-                        interacting_atom_pairs[0].insert(IntList(2, intarr));
-                    }
-                } else if (order > 0) {
-                    CombinationWithRepetition<int> g(intlist.begin(), intlist.end(), order + 1);
-                    do {
-                        std::vector<int> data = g.now();
-                        intarr[0] = iat;
-                        intarr[1] = data[0];
-                        for (unsigned int isize = 1; isize < data.size(); ++isize) {
-                            intarr[isize + 1] = data[isize];
-                        }
-                        if (!is_incutoff(order + 2, intarr, order)) continue;
-
-                        insort(order + 2, intarr);
-                        interacting_atom_pairs[order].insert(IntList(order + 2, intarr));
-
-                    } while (g.next());
-                }
-            }
             intlist.clear();
-            memory->deallocate(intarr);
         }
     }
 
     std::cout << std::endl;
-
-    memory->deallocate(interacting_atom_pairs);
 }
 
 bool Interaction::is_incutoff(const int n,
@@ -546,9 +645,10 @@ bool Interaction::is_incutoff(const int n,
 
             cutoff_tmp = rcs[order][ikd][jkd];
 
-            if (cutoff_tmp >= 0.0 &&
-                (mindist_pairs[iat][jat][0].dist > cutoff_tmp))
-                return false;
+            if (cutoff_tmp >= 0.0) {
+                const std::vector<DistInfo> &mindist_now = mindist_pair(iat, jat);
+                if (mindist_now.empty() || mindist_now[0].dist > cutoff_tmp) return false;
+            }
 
         }
     }
@@ -623,8 +723,10 @@ bool Interaction::is_incutoff2(const int n,
         jat = atomnumlist[i + 1];
         jkd = system->kd[jat] - 1;
 
+        const std::vector<DistInfo> &mindist_ij = mindist_pair(iat, jat);
+
         if (rcs[order][ikd][jkd] >= 0.0 &&
-            (mindist_pairs[iat][jat][0].dist > rcs[order][ikd][jkd]))
+            (mindist_ij.empty() || mindist_ij[0].dist > rcs[order][ikd][jkd]))
             return false;
 
         for (j = i + 1; j < ncheck; ++j) {
@@ -632,8 +734,10 @@ bool Interaction::is_incutoff2(const int n,
             kat = atomnumlist[j + 1];
             kkd = system->kd[kat] - 1;
 
+            const std::vector<DistInfo> &mindist_ik = mindist_pair(iat, kat);
+
             if (rcs[order][ikd][kkd] >= 0.0 &&
-                (mindist_pairs[iat][kat][0].dist > rcs[order][ikd][kkd]))
+                (mindist_ik.empty() || mindist_ik[0].dist > rcs[order][ikd][kkd]))
                 return false;
 
             cutoff_tmp = rcs[order][jkd][kkd];
@@ -642,10 +746,8 @@ bool Interaction::is_incutoff2(const int n,
 
                 in_cutoff_tmp = false;
 
-                for (it = mindist_pairs[iat][jat].begin();
-                     it != mindist_pairs[iat][jat].end(); ++it) {
-                    for (it2 = mindist_pairs[iat][kat].begin();
-                         it2 != mindist_pairs[iat][kat].end(); ++it2) {
+                for (it = mindist_ij.begin(); it != mindist_ij.end(); ++it) {
+                    for (it2 = mindist_ik.begin(); it2 != mindist_ik.end(); ++it2) {
                         dist_tmp = distance(x_image[(*it).cell][jat], x_image[(*it2).cell][kat]);
 
                         if (dist_tmp <= cutoff_tmp) {
@@ -661,6 +763,18 @@ bool Interaction::is_incutoff2(const int n,
     return true;
 }
 
+const std::vector<DistInfo> &Interaction::mindist_pair(const int iat,
+                                                       const int jat) const
+{
+    // Returns the pairs of minimum distance between iat and jat.
+    // An empty list is returned when the pair is beyond the cutoff radii.
+
+    std::map<int, std::vector<DistInfo> >::const_iterator it = mindist_pairs[iat].find(jat);
+
+    if (it == mindist_pairs[iat].end()) return mindist_none;
+    return (*it).second;
+}
+
 void Interaction::set_ordername()
 {
     std::string strnum;
@@ -692,7 +806,6 @@ int Interaction::nbody(const int n, const int *arr)
 
 
 void Interaction::calc_mindist_clusters(std::vector<int> **interaction_pair_in,
-                                        std::vector<DistInfo> **mindist_pair_in,
                                         std::vector<DistInfo> **distance_image,
                                         int *exist,
                                         std::set<MinimumDistanceCluster> **mindist_cluster_out)
@@ -731,6 +844,11 @@ void Interaction::calc_mindist_clusters(std::vector<int> **interaction_pair_in,
     std::vector<MinDistList> distance_list;
     std::vector<std::vector<int> > data_vec;
 
+    int nlist, depth, jj;
+    bool **is_compatible;
+    std::vector<int> comb_index;
+    std::vector<std::vector<int> > cell_allowed;
+
     for (order = 0; order < maxorder; ++order) {
         for (i = 0; i < symmetry->natmin; ++i) {
 
@@ -759,12 +877,15 @@ void Interaction::calc_mindist_clusters(std::vector<int> **interaction_pair_in,
                     jat = intlist[ielem];
                     atom_tmp.push_back(jat);
 
-                    for (j = 0; j < mindist_pair_in[iat][jat].size(); ++j) {
+                    const std::vector<DistInfo> &mindist_now = mindist_pair(iat, jat);
+
+                    for (std::vector<DistInfo>::const_iterator it = mindist_now.begin();
+                         it != mindist_now.end(); ++it) {
                         cell_tmp.clear();
-                        cell_tmp.push_back(mindist_pair_in[iat][jat][j].cell);
+                        cell_tmp.push_back((*it).cell);
                         comb_cell_min.push_back(cell_tmp);
                     }
-                    distmax = mindist_pair_in[iat][jat][0].dist;
+                    distmax = mindist_now[0].dist;
                     mindist_cluster_out[order][i].insert(MinimumDistanceCluster(atom_tmp,
                                                                                 comb_cell_min,
                                                                                 distmax));
@@ -778,20 +899,106 @@ void Interaction::calc_mindist_clusters(std::vector<int> **interaction_pair_in,
                 memory->allocate(list_now, order + 2);
 
                 // First, we generate all possible combinations of interaction clusters.
-                CombinationWithRepetition<int> g(intlist.begin(), intlist.end(), order + 1);
-                do {
-                    std::vector<int> data = g.now();
+                // The clusters are extended atom by atom, and only the atoms that can be
+                // within the cutoff radius of all the other atoms in the cluster
+                // for some combination of the cell images are added.
+                // Clusters failing this condition are never accepted below,
+                // so the resulting set is the same as that from all the combinations.
+
+                nlist = intlist.size();
+
+                cell_allowed.clear();
+                cell_allowed.resize(nlist);
+
+                for (j = 0; j < nlist; ++j) {
+                    jat = intlist[j];
+                    rc_tmp = rcs[order][ikd][system->kd[jat] - 1];
+
+                    for (std::vector<DistInfo>::const_iterator it = distance_image[i][jat].begin();
+                         it != distance_image[i][jat].end(); ++it) {
+                        if (exist[(*it).cell]) {
+                            if (rc_tmp < 0.0 || (*it).dist <= rc_tmp) {
+                                cell_allowed[j].push_back((*it).cell);
+                            }
+                        }
+                    }
+                }
 
-                    list_now[0] = iat;
-                    for (j = 0; j < order + 1; ++j) list_now[j + 1] = data[j];
+                memory->allocate(is_compatible, nlist, nlist);
+
+                for (j = 0; j < nlist; ++j) {
+                    is_compatible[j][j] = !cell_allowed[j].empty();
+
+                    for (k = j + 1; k < nlist; ++k) {
+                        rc_tmp = rcs[order][system->kd[intlist[j]] - 1][system->kd[intlist[k]] - 1];
+                        isok = false;
+
+                        if (!cell_allowed[j].empty() && !cell_allowed[k].empty()) {
+                            if (rc_tmp < 0.0) {
+                                isok = true;
+                            } else {
+                                for (std::vector<int>::const_iterator it = cell_allowed[j].begin();
+                                     it != cell_allowed[j].end() && !isok; ++it) {
+                                    for (std::vector<int>::const_iterator it2 = cell_allowed[k].begin();
+                                         it2 != cell_allowed[k].end(); ++it2) {
+                                        dist_tmp = distance(x_image[*it][intlist[j]],
+                                                            x_image[*it2][intlist[k]]);
+                                        if (dist_tmp <= rc_tmp) {
+                                            isok = true;
+                                            break;
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                        is_compatible[j][k] = isok;
+                        is_compatible[k][j] = isok;
+                    }
+                }
+
+                // Depth-first search over the combinations with repetition
+
+                comb_index.resize(order + 1);
+                list_now[0] = iat;
+                depth = 0;
+                comb_index[0] = -1;
+
+                while (depth >= 0) {
+
+                    ++comb_index[depth];
+
+                    if (comb_index[depth] >= nlist) {
+                        --depth;
+                        continue;
+                    }
+
+                    jj = comb_index[depth];
+                    if (!is_compatible[jj][jj]) continue;
+
+                    for (k = 0; k < depth; ++k) {
+                        if (!is_compatible[comb_index[k]][jj]) break;
+                    }
+                    if (k < depth) continue;
+
+                    if (depth < order) {
+                        ++depth;
+                        comb_index[depth] = jj - 1;
+                        continue;
+                    }
+
+                    data_now.resize(order + 1);
+                    for (j = 0; j < order + 1; ++j) {
+                        data_now[j] = intlist[comb_index[j]];
+                        list_now[j + 1] = data_now[j];
+                    }
 
                     // Save as a candidate if the cluster satisfies the NBODY-rule.
                     if (nbody(order + 2, list_now) <= nbody_include[order]) {
-                        data_vec.push_back(data);
+                        data_vec.push_back(data_now);
                     }
+                }
 
-                } while (g.next());
-
+                memory->deallocate(is_compatible);
                 intlist.clear();
 
                 int ndata = data_vec.size();
@@ -829,8 +1036,8 @@ void Interaction::calc_mindist_clusters(std::vector<int> **interaction_pair_in,
 
                         // Loop over the cell images of atom 'jat' and add to the list 
                         // as a candidate for the minimum distance cluster
-                        for (std::vector<DistInfo>::const_iterator it = distance_image[iat][jat].begin();
-                             it != distance_image[iat][jat].end(); ++it) {
+                        for (std::vector<DistInfo>::const_iterator it = distance_image[i][jat].begin();
+                             it != distance_image[i][jat].end(); ++it) {
                             if (exist[(*it).cell]) {
                                 if (rc_tmp < 0.0 || (*it).dist <= rc_tmp) {
                                     cell_vector.push_back((*it).cell);
@@ -891,8 +1098,11 @@ void Interaction::calc_mindist_clusters(std::vector<int> **interaction_pair_in,
                             jat = intpair_uniq[j];
                             cell_vector.clear();
 
-                            for (ii = 0; ii < mindist_pair_in[iat][jat].size(); ++ii) {
-                                cell_vector.push_back(mindist_pair_in[iat][jat][ii].cell);
+                            const std::vector<DistInfo> &mindist_now = mindist_pair(iat, jat);
+
+                            for (std::vector<DistInfo>::const_iterator it = mindist_now.begin();
+                                 it != mindist_now.end(); ++it) {
+                                cell_vector.push_back((*it).cell);
                             }
                             pairs_icell.push_back(cell_vector);
                         }
@@ -961,7 +1171,6 @@ void Interaction::calc_mindist_clusters(std::vector<int> **interaction_pair_in,
 }
 
 void Interaction::calc_mindist_clusters2(std::vector<int> **interaction_pair_in,
-                                         std::vector<DistInfo> **mindist_pair_in,
                                          std::vector<DistInfo> **distance_image,
                                          int *exist,
                                          std::set<MinimumDistanceCluster> **mindist_cluster_out)
@@ -1019,12 +1228,15 @@ void Interaction::calc_mindist_clusters2(std::vector<int> **interaction_pair_in,
                         jat = intlist[ielem];
                         atom_tmp.push_back(jat);
 
-                        for (j = 0; j < mindist_pair_in[iat][jat].size(); ++j) {
+                        const std::vector<DistInfo> &mindist_now = mindist_pair(iat, jat);
+
+                        for (std::vector<DistInfo>::const_iterator it = mindist_now.begin();
+                             it != mindist_now.end(); ++it) {
                             cell_tmp.clear();
-                            cell_tmp.push_back(mindist_pair_in[iat][jat][j].cell);
+                            cell_tmp.push_back((*it).cell);
                             comb_cell_min.push_back(cell_tmp);
                         }
-                        dist_max = mindist_pair_in[iat][jat][0].dist;
+                        dist_max = mindist_now[0].dist;
                         mindist_cluster_out[order][i].insert(MinimumDistanceCluster(atom_tmp,
                                                                                     comb_cell_min));
                     }
@@ -1068,8 +1280,8 @@ void Interaction::calc_mindist_clusters2(std::vector<int> **interaction_pair_in,
 
                             // Loop over the cell images of atom 'jat' and add to the list 
                             // as a candidate for the minimum distance cluster
-                            for (std::vector<DistInfo>::const_iterator it = distance_image[iat][jat].begin();
-                                 it != distance_image[iat][jat].end(); ++it) {
+                            for (std::vector<DistInfo>::const_iterator it = distance_image[i][jat].begin();
+                                 it != distance_image[i][jat].end(); ++it) {
                                 if (exist[(*it).cell]) {
                                     if (rc_tmp < 0.0 || (*it).dist <= rc_tmp) {
                                         cell_vector.push_back((*it).cell);
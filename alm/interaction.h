@@ -13,6 +13,7 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <map>
 #include <iterator>
 #include <algorithm>
 #include "pointers.h"
@@ -230,8 +231,8 @@ namespace ALM_NS
         int *exist_image;
 
         std::string *str_order;
-        std::vector<DistInfo> **distall;
-        std::vector<DistInfo> **mindist_pairs;
+        std::vector<DistInfo> **distall;        // [natmin][nat] : images within the cutoff radii
+        std::map<int, std::vector<DistInfo> > *mindist_pairs;  // [nat] : only the pairs within the cutoff radii
         std::set<IntList> *pairs;
         std::vector<int> **interaction_pair;
         std::set<MinimumDistanceCluster> **mindist_cluster;
@@ -241,6 +242,7 @@ namespace ALM_NS
         int nbody(const int, const int *);
         bool is_incutoff(const int, int *, const int);
         bool is_incutoff2(const int, int *, const int);
+        const std::vector<DistInfo> &mindist_pair(const int, const int) const;
 
         template <typename T>
         void insort(int n, T *arr)
@@ -261,21 +263,21 @@ namespace ALM_NS
         void generate_coordinate_of_periodic_images(const unsigned int, double **,
                                                     const int [3], double ***, int *);
 
+        std::vector<DistInfo> mindist_none;
+
         void get_pairs_of_minimum_distance(int, double ***, int *,
                                            std::vector<DistInfo> **,
-                                           std::vector<DistInfo> **);
+                                           std::map<int, std::vector<DistInfo> > *);
 
-        void print_neighborlist(std::vector<DistInfo> **);
+        void print_neighborlist(std::map<int, std::vector<DistInfo> > *);
         void search_interactions(std::vector<int> **, std::set<IntList> *);
         void set_ordername();
 
         void calc_mindist_clusters(std::vector<int> **,
-                                   std::vector<DistInfo> **,
                                    std::vector<DistInfo> **,
                                    int *, std::set<MinimumDistanceCluster> **);
 
         void calc_mindist_clusters2(std::vector<int> **,
-                                    std::vector<DistInfo> **,
                                     std::vector<DistInfo> **,
                                     int *, std::set<MinimumDistanceCluster> **);
 
@@ -254,6 +254,10 @@ void Symmetry::find_lattice_symmetry(double aa[3][3],
     Metric tensor G = (g)_{ij} = a_{i} * a_{j} is invariant under crystal symmetry operations T,
     i.e. T^{t}GT = G. Since G can be written as G = A^{t}A, the invariance condition is given by
     (AT)^{t}(AT) = G0 (original).
+
+    The candidates T' with elements -1, 0, 1 are generated for the reduced basis A' = AP, 
+    for which all the lattice symmetry operations are of this form, and transformed back
+    to the original basis by T = P T' P^{-1}.
     */
 
     int i, j, k;
@@ -261,6 +265,8 @@ void Symmetry::find_lattice_symmetry(double aa[3][3],
 
     int nsym_tmp = 0;
     int mat_tmp[3][3];
+    int mat_red[3][3], mat_work[3][3];
+    int pmat[3][3], pmat_inv[3][3];
     double det, res;
     double rot_tmp[3][3];
     double aa_rot[3][3];
@@ -278,6 +284,9 @@ void Symmetry::find_lattice_symmetry(double aa[3][3],
         }
     }
 
+    reduce_lattice(aa, pmat);
+    invmat3_i(pmat_inv, pmat);
+
     for (i = 0; i < 3; ++i) {
         for (j = 0; j < 3; ++j) {
             if (i == j) {
@@ -312,15 +321,25 @@ void Symmetry::find_lattice_symmetry(double aa[3][3],
 
                                         if (det != 1 && det != -1) continue;
 
-                                        rot_tmp[0][0] = m11;
-                                        rot_tmp[0][1] = m12;
-                                        rot_tmp[0][2] = m13;
-                                        rot_tmp[1][0] = m21;
-                                        rot_tmp[1][1] = m22;
-                                        rot_tmp[1][2] = m23;
-                                        rot_tmp[2][0] = m31;
-                                        rot_tmp[2][1] = m32;
-                                        rot_tmp[2][2] = m33;
+                                        mat_red[0][0] = m11;
+                                        mat_red[0][1] = m12;
+                                        mat_red[0][2] = m13;
+                                        mat_red[1][0] = m21;
+                                        mat_red[1][1] = m22;
+                                        mat_red[1][2] = m23;
+                                        mat_red[2][0] = m31;
+                                        mat_red[2][1] = m32;
+                                        mat_red[2][2] = m33;
+
+                                        // Back to the original basis
+                                        matmul3(mat_work, mat_red, pmat_inv);
+                                        matmul3(mat_tmp, pmat, mat_work);
+
+                                        for (i = 0; i < 3; ++i) {
+                                            for (j = 0; j < 3; ++j) {
+                                                rot_tmp[i][j] = static_cast<double>(mat_tmp[i][j]);
+                                            }
+                                        }
 
                                         // Here, aa_rot = aa * rot_tmp is correct.
                                         matmul3(aa_rot, aa, rot_tmp);
@@ -345,11 +364,6 @@ void Symmetry::find_lattice_symmetry(double aa[3][3],
 
                                         if (res < tolerance * tolerance) {
                                             ++nsym_tmp;
-                                            for (i = 0; i < 3; ++i) {
-                                                for (j = 0; j < 3; ++j) {
-                                                    mat_tmp[i][j] = static_cast<int>(rot_tmp[i][j]);
-                                                }
-                                            }
                                             LatticeSymmList.push_back(mat_tmp);
                                         }
 
@@ -368,6 +382,76 @@ void Symmetry::find_lattice_symmetry(double aa[3][3],
     }
 }
 
+void Symmetry::reduce_lattice(double aa[3][3],
+                              int pmat[3][3])
+{
+    /*
+    Reduce the lattice vectors (columns of aa) so that none of them can be
+    shortened by adding or subtracting the other two (Minkowski reduction in 3D).
+    The reduced basis is given by aa * pmat, where pmat is unimodular.
+    */
+
+    int i, j, k;
+    int ivec, jvec, kvec;
+    int nj, nk, nj_best, nk_best;
+    int iter;
+    double avec[3][3];
+    double norm_now, norm_best, vec[3];
+    bool is_changed;
+
+    for (i = 0; i < 3; ++i) {
+        for (j = 0; j < 3; ++j) {
+            avec[j][i] = aa[i][j]; // avec[j] is the j-th lattice vector
+            pmat[i][j] = (i == j) ? 1 : 0;
+        }
+    }
+
+    for (iter = 0; iter < 100; ++iter) {
+
+        is_changed = false;
+
+        for (ivec = 0; ivec < 3; ++ivec) {
+
+            jvec = (ivec + 1) % 3;
+            kvec = (ivec + 2) % 3;
+
+            norm_best = avec[ivec][0] * avec[ivec][0]
+                + avec[ivec][1] * avec[ivec][1]
+                + avec[ivec][2] * avec[ivec][2];
+            nj_best = 0;
+            nk_best = 0;
+
+            for (nj = -1; nj <= 1; ++nj) {
+                for (nk = -1; nk <= 1; ++nk) {
+                    if (nj == 0 && nk == 0) continue;
+
+                    for (k = 0; k < 3; ++k) {
+                        vec[k] = avec[ivec][k] + nj * avec[jvec][k] + nk * avec[kvec][k];
+                    }
+                    norm_now = vec[0] * vec[0] + vec[1] * vec[1] + vec[2] * vec[2];
+
+                    // Replace only when the vector becomes shorter beyond the numerical noise
+                    if (norm_now < norm_best * (1.0 - eps8)) {
+                        norm_best = norm_now;
+                        nj_best = nj;
+                        nk_best = nk;
+                    }
+                }
+            }
+
+            if (nj_best != 0 || nk_best != 0) {
+                for (k = 0; k < 3; ++k) {
+                    avec[ivec][k] += nj_best * avec[jvec][k] + nk_best * avec[kvec][k];
+                    pmat[k][ivec] += nj_best * pmat[k][jvec] + nk_best * pmat[k][kvec];
+                }
+                is_changed = true;
+            }
+        }
+
+        if (!is_changed) break;
+    }
+}
+
 void Symmetry::find_crystal_symmetry(int nat,
                                      int nclass,
                                      std::vector<unsigned int> *atomclass,
@@ -375,26 +459,24 @@ void Symmetry::find_crystal_symmetry(int nat,
                                      std::vector<RotationMatrix> LatticeSymmList,
                                      std::vector<SymmetryOperation> &CrystalSymmList)
 {
+    /*
+    Test all the pairs of a lattice symmetry operation and a candidate translation,
+    which maps the first atom of atomclass[0] to an atom of the same class.
+    The images of the atoms are searched with AtomPositionHash.
+    The order of the operations found here depends on the threads, and it is
+    fixed by sorting the list afterwards.
+    */
+
     unsigned int i, j;
-    unsigned int iat, jat, kat, lat;
-    double x_rot[3];
-    double rot[3][3], rot_tmp[3][3], rot_cart[3][3];
-    double mag[3], mag_rot[3];
+    unsigned int iat;
+    int ilat, nlat, ncand, icand;
+    unsigned int itype;
     double tran[3];
-    double x_rot_tmp[3];
-    double tmp[3];
-    double diff;
 
     int rot_int[3][3];
 
-    int ii, jj, kk;
-    unsigned int itype;
-
-    bool is_found;
-    bool isok;
-    bool mag_sym1, mag_sym2;
-
-    bool is_identity_matrix;
+    std::vector<AtomPositionHash> class_hash(nclass);
+    std::vector<std::vector<double> > x_rot_iat;
 
 
     // Add identity matrix first.
@@ -411,126 +493,134 @@ void Symmetry::find_crystal_symmetry(int nat,
 
     CrystalSymmList.push_back(SymmetryOperation(rot_int, tran));
 
+    for (itype = 0; itype < static_cast<unsigned int>(nclass); ++itype) {
+        class_hash[itype].build(atomclass[itype], x, tolerance);
+    }
 
-    for (std::vector<RotationMatrix>::iterator it_latsym = LatticeSymmList.begin();
-         it_latsym != LatticeSymmList.end(); ++it_latsym) {
+    iat = atomclass[0][0];
+    nlat = LatticeSymmList.size();
+    ncand = nlat * atomclass[0].size();
 
-        iat = atomclass[0][0];
+    x_rot_iat.resize(nlat, std::vector<double>(3));
 
+    for (ilat = 0; ilat < nlat; ++ilat) {
+        double rot[3][3];
         for (i = 0; i < 3; ++i) {
             for (j = 0; j < 3; ++j) {
-                rot[i][j] = static_cast<double>((*it_latsym).mat[i][j]);
+                rot[i][j] = static_cast<double>(LatticeSymmList[ilat].mat[i][j]);
             }
         }
-
-        rotvec(x_rot, x[iat], rot);
+        rotvec(&x_rot_iat[ilat][0], x[iat], rot);
+    }
 
 #ifdef _OPENMP
-#pragma omp parallel for private(jat, tran, isok, kat, x_rot_tmp, is_found, lat, tmp, diff, \
-    i, j, itype, jj, kk, is_identity_matrix, mag, mag_rot, rot_tmp, rot_cart, mag_sym1, mag_sym2)
+#pragma omp parallel for private(i, j, itype), schedule(dynamic)
 #endif
-        for (ii = 0; ii < atomclass[0].size(); ++ii) {
-            jat = atomclass[0][ii];
+    for (icand = 0; icand < ncand; ++icand) {
+
+        int ii, ilat_now;
+        unsigned int jj, jat, kat;
+        double rot[3][3], rot_tmp[3][3], rot_cart[3][3];
+        double mag[3], mag_rot[3];
+        double tran_omp[3];
+        double x_rot_tmp[3];
+        bool isok;
+        bool mag_sym1, mag_sym2;
+        bool is_identity_matrix;
+
+        ilat_now = icand / atomclass[0].size();
+        ii = icand % atomclass[0].size();
+        jat = atomclass[0][ii];
 
-            for (i = 0; i < 3; ++i) {
-                tran[i] = x[jat][i] - x_rot[i];
-                tran[i] = tran[i] - nint(tran[i]);
+        for (i = 0; i < 3; ++i) {
+            for (j = 0; j < 3; ++j) {
+                rot[i][j] = static_cast<double>(LatticeSymmList[ilat_now].mat[i][j]);
             }
+        }
 
-            if ((std::abs(tran[0]) > eps12 && !interaction->is_periodic[0]) ||
-                (std::abs(tran[1]) > eps12 && !interaction->is_periodic[1]) ||
-                (std::abs(tran[2]) > eps12 && !interaction->is_periodic[2]))
-                continue;
-
-            is_identity_matrix =
-                (std::pow(rot[0][0] - 1.0, 2) + std::pow(rot[0][1], 2) + std::pow(rot[0][2], 2)
-                    + std::pow(rot[1][0], 2) + std::pow(rot[1][1] - 1.0, 2) + std::pow(rot[1][2], 2)
-                    + std::pow(rot[2][0], 2) + std::pow(rot[2][1], 2) + std::pow(rot[2][2] - 1.0, 2)
-                    + std::pow(tran[0], 2) + std::pow(tran[1], 2) + std::pow(tran[2], 2)) < eps12;
-            if (is_identity_matrix) continue;
-
-            isok = true;
-
-            for (itype = 0; itype < nclass; ++itype) {
+        for (i = 0; i < 3; ++i) {
+            tran_omp[i] = x[jat][i] - x_rot_iat[ilat_now][i];
+            tran_omp[i] = tran_omp[i] - nint(tran_omp[i]);
+        }
 
-                for (jj = 0; jj < atomclass[itype].size(); ++jj) {
+        if ((std::abs(tran_omp[0]) > eps12 && !interaction->is_periodic[0]) ||
+            (std::abs(tran_omp[1]) > eps12 && !interaction->is_periodic[1]) ||
+            (std::abs(tran_omp[2]) > eps12 && !interaction->is_periodic[2]))
+            continue;
 
-                    kat = atomclass[itype][jj];
+        is_identity_matrix =
+            (std::pow(rot[0][0] - 1.0, 2) + std::pow(rot[0][1], 2) + std::pow(rot[0][2], 2)
+                + std::pow(rot[1][0], 2) + std::pow(rot[1][1] - 1.0, 2) + std::pow(rot[1][2], 2)
+                + std::pow(rot[2][0], 2) + std::pow(rot[2][1], 2) + std::pow(rot[2][2] - 1.0, 2)
+                + std::pow(tran_omp[0], 2) + std::pow(tran_omp[1], 2) + std::pow(tran_omp[2], 2)) < eps12;
+        if (is_identity_matrix) continue;
 
-                    rotvec(x_rot_tmp, x[kat], rot);
+        isok = true;
 
-                    for (i = 0; i < 3; ++i) {
-                        x_rot_tmp[i] += tran[i];
-                    }
+        for (itype = 0; itype < static_cast<unsigned int>(nclass) && isok; ++itype) {
 
-                    is_found = false;
+            for (jj = 0; jj < atomclass[itype].size(); ++jj) {
 
-                    for (kk = 0; kk < atomclass[itype].size(); ++kk) {
+                kat = atomclass[itype][jj];
 
-                        lat = atomclass[itype][kk];
+                rotvec(x_rot_tmp, x[kat], rot);
 
-                        for (i = 0; i < 3; ++i) {
-                            tmp[i] = std::fmod(std::abs(x[lat][i] - x_rot_tmp[i]), 1.0);
-                            tmp[i] = std::min<double>(tmp[i], 1.0 - tmp[i]);
-                        }
-                        diff = tmp[0] * tmp[0] + tmp[1] * tmp[1] + tmp[2] * tmp[2];
-                        if (diff < tolerance * tolerance) {
-                            is_found = true;
-                            break;
-                        }
-                    }
+                for (i = 0; i < 3; ++i) {
+                    x_rot_tmp[i] += tran_omp[i];
+                }
 
-                    if (!is_found) isok = false;
+                if (class_hash[itype].find(x_rot_tmp, x) == -1) {
+                    isok = false;
+                    break;
                 }
             }
+        }
 
-            if (isok && system->lspin && system->noncollinear) {
-                for (i = 0; i < 3; ++i) {
-                    mag[i] = system->magmom[jat][i];
-                    mag_rot[i] = system->magmom[iat][i];
-                }
+        if (isok && system->lspin && system->noncollinear) {
+            for (i = 0; i < 3; ++i) {
+                mag[i] = system->magmom[jat][i];
+                mag_rot[i] = system->magmom[iat][i];
+            }
 
-                matmul3(rot_tmp, rot, system->rlavec);
-                matmul3(rot_cart, system->lavec, rot_tmp);
+            matmul3(rot_tmp, rot, system->rlavec);
+            matmul3(rot_cart, system->lavec, rot_tmp);
 
-                for (i = 0; i < 3; ++i) {
-                    for (j = 0; j < 3; ++j) {
-                        rot_cart[i][j] /= (2.0 * pi);
-                    }
+            for (i = 0; i < 3; ++i) {
+                for (j = 0; j < 3; ++j) {
+                    rot_cart[i][j] /= (2.0 * pi);
                 }
-                rotvec(mag_rot, mag_rot, rot_cart);
+            }
+            rotvec(mag_rot, mag_rot, rot_cart);
 
-                // In the case of improper rotation, the factor -1 should be multiplied
-                // because the inversion operation doesn't flip the spin.
-                if (!is_proper(rot_cart)) {
-                    for (i = 0; i < 3; ++i) {
-                        mag_rot[i] = -mag_rot[i];
-                    }
+            // In the case of improper rotation, the factor -1 should be multiplied
+            // because the inversion operation doesn't flip the spin.
+            if (!is_proper(rot_cart)) {
+                for (i = 0; i < 3; ++i) {
+                    mag_rot[i] = -mag_rot[i];
                 }
+            }
 
-                mag_sym1 = (std::pow(mag[0] - mag_rot[0], 2.0)
-                    + std::pow(mag[1] - mag_rot[1], 2.0)
-                    + std::pow(mag[2] - mag_rot[2], 2.0)) < eps6;
+            mag_sym1 = (std::pow(mag[0] - mag_rot[0], 2.0)
+                + std::pow(mag[1] - mag_rot[1], 2.0)
+                + std::pow(mag[2] - mag_rot[2], 2.0)) < eps6;
 
-                mag_sym2 = (std::pow(mag[0] + mag_rot[0], 2.0)
-                    + std::pow(mag[1] + mag_rot[1], 2.0)
-                    + std::pow(mag[2] + mag_rot[2], 2.0)) < eps6;
+            mag_sym2 = (std::pow(mag[0] + mag_rot[0], 2.0)
+                + std::pow(mag[1] + mag_rot[1], 2.0)
+                + std::pow(mag[2] + mag_rot[2], 2.0)) < eps6;
 
-                if (!mag_sym1 && !mag_sym2) {
-                    isok = false;
-                } else if (!mag_sym1 && mag_sym2 && !trev_sym_mag) {
-                    isok = false;
-                }
+            if (!mag_sym1 && !mag_sym2) {
+                isok = false;
+            } else if (!mag_sym1 && mag_sym2 && !trev_sym_mag) {
+                isok = false;
             }
+        }
 
-            if (isok) {
+        if (isok) {
 #ifdef _OPENMP
 #pragma omp critical
 #endif
-                CrystalSymmList.push_back(SymmetryOperation((*it_latsym).mat, tran));
-            }
+            CrystalSymmList.push_back(SymmetryOperation(LatticeSymmList[ilat_now].mat, tran_omp));
         }
-
     }
 }
 
@@ -641,10 +731,9 @@ void Symmetry::genmaps(int nat,
 {
     int isym, iat, jat;
     int i, j;
-    int itype;
-    int ii, jj;
+    unsigned int itype, ii;
+    int jj;
     double xnew[3];
-    double tmp[3], diff;
     double rot_double[3][3];
 
     for (iat = 0; iat < nat; ++iat) {
@@ -653,8 +742,14 @@ void Symmetry::genmaps(int nat,
         }
     }
 
+    std::vector<AtomPositionHash> class_hash(system->nclassatom);
+
+    for (itype = 0; itype < system->nclassatom; ++itype) {
+        class_hash[itype].build(system->atomlist_class[itype], x, tolerance);
+    }
+
 #ifdef _OPENMP
-#pragma omp parallel for private(i, j, rot_double, itype, ii, iat, xnew, jj, jat, tmp, diff, isym)
+#pragma omp parallel for private(i, j, rot_double, itype, ii, iat, xnew, jj, isym)
 #endif
     for (isym = 0; isym < nsym; ++isym) {
 
@@ -674,20 +769,8 @@ void Symmetry::genmaps(int nat,
 
                 for (i = 0; i < 3; ++i) xnew[i] += tnons[isym][i];
 
-                for (jj = 0; jj < system->atomlist_class[itype].size(); ++jj) {
-
-                    jat = system->atomlist_class[itype][jj];
-
-                    for (i = 0; i < 3; ++i) {
-                        tmp[i] = std::fmod(std::abs(x[jat][i] - xnew[i]), 1.0);
-                        tmp[i] = std::min<double>(tmp[i], 1.0 - tmp[i]);
-                    }
-                    diff = tmp[0] * tmp[0] + tmp[1] * tmp[1] + tmp[2] * tmp[2];
-                    if (diff < tolerance * tolerance) {
-                        map_sym[iat][isym] = jat;
-                        break;
-                    }
-                }
+                jj = class_hash[itype].find(xnew, x);
+                if (jj != -1) map_sym[iat][isym] = system->atomlist_class[itype][jj];
                 if (map_sym[iat][isym] == -1) {
                     error->exit("genmaps",
                                 "cannot find symmetry for operation # ",
@@ -959,3 +1042,92 @@ bool Symmetry::is_proper(double rot[3][3])
     return ret;
 }
 
+AtomPositionHash::AtomPositionHash()
+{
+    nbin = 1;
+    tol = 0.0;
+}
+
+void AtomPositionHash::build(const std::vector<unsigned int> &atoms_in,
+                             double **x,
+                             const double tol_in)
+{
+    // The bin width 1 / nbin must not be smaller than the tolerance
+    // so that the atoms within the tolerance are in the neighboring bins.
+
+    int i, ibin[3];
+
+    atoms = atoms_in;
+    tol = tol_in;
+
+    nbin = static_cast<int>(std::pow(static_cast<double>(atoms.size()), 1.0 / 3.0));
+    if (tol > 0.0) nbin = std::min(nbin, static_cast<int>(1.0 / tol));
+    if (nbin < 3) nbin = 1;
+
+    bins.clear();
+    bins.resize(nbin * nbin * nbin);
+
+    for (i = 0; i < static_cast<int>(atoms.size()); ++i) {
+        for (int k = 0; k < 3; ++k) ibin[k] = get_bin(x[atoms[i]][k]);
+        bins[(ibin[0] * nbin + ibin[1]) * nbin + ibin[2]].push_back(i);
+    }
+}
+
+int AtomPositionHash::find(const double xin[3],
+                           double **x) const
+{
+    int i, k;
+    int ibin[3], jbin[3], m[3];
+    int loc = -1;
+    unsigned int lat;
+    double tmp[3], diff;
+
+    // When the point is farther than the tolerance from the boundaries of its bin,
+    // the atoms in the other bins cannot be within the tolerance.
+
+    bool is_inner = true;
+
+    for (k = 0; k < 3; ++k) {
+        ibin[k] = get_bin(xin[k]);
+        tmp[k] = (xin[k] - std::floor(xin[k])) * nbin - static_cast<double>(ibin[k]);
+        if (std::min(tmp[k], 1.0 - tmp[k]) < tol * nbin) is_inner = false;
+    }
+
+    const int nshift = (nbin == 1 || is_inner) ? 0 : 1;
+
+    for (m[0] = -nshift; m[0] <= nshift; ++m[0]) {
+        for (m[1] = -nshift; m[1] <= nshift; ++m[1]) {
+            for (m[2] = -nshift; m[2] <= nshift; ++m[2]) {
+
+                for (k = 0; k < 3; ++k) jbin[k] = (ibin[k] + m[k] + nbin) % nbin;
+
+                const std::vector<int> &bin_now = bins[(jbin[0] * nbin + jbin[1]) * nbin + jbin[2]];
+
+                for (std::vector<int>::const_iterator it = bin_now.begin(); it != bin_now.end(); ++it) {
+
+                    // Keep the first atom in the class as in the linear search
+                    if (loc != -1 && *it > loc) break;
+
+                    lat = atoms[*it];
+
+                    for (i = 0; i < 3; ++i) {
+                        tmp[i] = std::fmod(std::abs(x[lat][i] - xin[i]), 1.0);
+                        tmp[i] = std::min<double>(tmp[i], 1.0 - tmp[i]);
+                    }
+                    diff = tmp[0] * tmp[0] + tmp[1] * tmp[1] + tmp[2] * tmp[2];
+                    if (diff < tol * tol) {
+                        loc = *it;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+    return loc;
+}
+
+int AtomPositionHash::get_bin(const double xf) const
+{
+    const double xwrap = xf - std::floor(xf);
+    return std::min(static_cast<int>(xwrap * nbin), nbin - 1);
+}
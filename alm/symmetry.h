@@ -86,6 +86,28 @@ namespace ALM_NS
         }
     };
 
+    // Hash of the fractional coordinates of the atoms in an atomic class.
+    // find() returns the position in the class of the first atom located within
+    // the tolerance of the given point under the periodic boundary conditions,
+    // by checking only the atoms in the neighboring bins.
+
+    class AtomPositionHash
+    {
+    public:
+        AtomPositionHash();
+
+        void build(const std::vector<unsigned int> &, double **, const double);
+        int find(const double [3], double **) const;
+
+    private:
+        int nbin;
+        double tol;
+        std::vector<unsigned int> atoms;
+        std::vector<std::vector<int> > bins;
+
+        int get_bin(const double) const;
+    };
+
     class Symmetry: protected Pointers
     {
     public:
@@ -139,6 +161,7 @@ namespace ALM_NS
         void symop_availability_check(double ***, bool *, const int, int &);
 
         void find_lattice_symmetry(double [3][3], std::vector<RotationMatrix> &);
+        void reduce_lattice(double [3][3], int [3][3]);
 
         void find_crystal_symmetry(int, int,
                                    std::vector<unsigned int> *, double **x,
@@ -306,40 +306,20 @@ void System::load_reference_system_xml(std::string file_reference_fcs,
     }
 
     int i;
-    std::set<FcProperty> list_found;
-    std::set<FcProperty>::iterator iter_found;
-    int *ind;
-    int nterms = order_fcs + 2;
-    memory->allocate(ind, nterms);
-
-    list_found.clear();
-
-    for (std::vector<FcProperty>::iterator p = fcs->fc_set[order_fcs].begin();
-         p != fcs->fc_set[order_fcs].end(); ++p) {
-        FcProperty list_tmp = *p; // Using copy constructor
-        for (i = 0; i < nterms; ++i) {
-            ind[i] = list_tmp.elems[i];
-        }
-        list_found.insert(FcProperty(nterms, list_tmp.coef,
-                                     ind, list_tmp.mother));
-    }
+    int loc_found;
 
     for (i = 0; i < nfcs_ref; ++i) {
-        iter_found = list_found.find(FcProperty(nterms, 1.0,
-                                                intpair_ref[i], 1));
-        if (iter_found == list_found.end()) {
+        loc_found = fcs->fc_table[order_fcs].find(intpair_ref[i]);
+        if (loc_found == -1) {
             error->exit("load_reference_system",
                         "Cannot find equivalent force constant, number: ",
                         i + 1);
         }
-        FcProperty arrtmp = *iter_found;
-        const_out[arrtmp.mother] = fcs_ref[i];
+        const_out[fcs->fc_set[order_fcs][loc_found].mother] = fcs_ref[i];
     }
 
     memory->deallocate(intpair_ref);
     memory->deallocate(fcs_ref);
-    memory->deallocate(ind);
-    list_found.clear();
 }
 
 void System::load_reference_system()
@@ -498,17 +478,7 @@ void System::load_reference_system()
                 ifs_fc2 >> fc2_ref[i] >> intpair_tmp[i][0] >> intpair_tmp[i][1];
             }
 
-            std::set<FcProperty> list_found;
-            std::set<FcProperty>::iterator iter_found;
-            int *ind;
-            memory->allocate(ind, 2);
-
-            list_found.clear();
-            for (std::vector<FcProperty>::iterator p = fcs->fc_set[0].begin();
-                 p != fcs->fc_set[0].end(); ++p) {
-                for (i = 0; i < 2; ++i) ind[i] = (*p).elems[i];
-                list_found.insert(FcProperty(2, (*p).coef, ind, (*p).mother));
-            }
+            int loc_found;
 
             for (i = 0; i < nparam_harmonic; ++i) {
                 constraint->const_mat[i][i] = 1.0;
@@ -516,19 +486,17 @@ void System::load_reference_system()
 
             for (i = 0; i < nparam_harmonic; ++i) {
 
-                iter_found = list_found.find(FcProperty(2, 1.0, intpair_tmp[i], 1));
-                if (iter_found == list_found.end()) {
+                loc_found = fcs->fc_table[0].find(intpair_tmp[i]);
+                if (loc_found == -1) {
                     error->exit("load_reference_system",
                                 "Cannot find equivalent force constant, number: ",
                                 i + 1);
                 }
-                constraint->const_rhs[(*iter_found).mother] = fc2_ref[i];
+                constraint->const_rhs[fcs->fc_set[0][loc_found].mother] = fc2_ref[i];
             }
 
             memory->deallocate(intpair_tmp);
-            memory->deallocate(ind);
             memory->deallocate(fc2_ref);
-            list_found.clear();
         }
     }
 
@@ -83,6 +83,8 @@ void Writes::write_input_vars()
         std::cout << "  ROTAXIS = " << constraint->rotation_axis << std::endl;
         std::cout << "  FC2XML = " << constraint->fc2_file << std::endl;
         std::cout << "  FC3XML = " << constraint->fc3_file << std::endl;
+        std::cout << "  SPARSE = " << fitting->use_sparse_solver
+            << "; NCHUNK = " << fitting->nchunk << std::endl;
         std::cout << std::endl;
     }
     std::cout << " -------------------------------------------------------------------" << std::endl;
@@ -438,7 +440,7 @@ void Writes::write_misc_xml()
                   boost::lexical_cast<std::string>(fcs->fc_set[0][ihead].elems[0])
                   + " " + boost::lexical_cast<std::string>(fcs->fc_set[0][ihead].elems[1]));
         child.put("<xmlattr>.multiplicity",
-                  interaction->mindist_pairs[pair_tmp[0]][pair_tmp[1]].size());
+                  interaction->mindist_pair(pair_tmp[0], pair_tmp[1]).size());
         ihead += fcs->ndup[0][ui];
         ++k;
     }
@@ -499,11 +501,13 @@ void Writes::write_misc_xml()
             pair_tmp[k] = fctmp.elems[k] / 3;
         }
         j = symmetry->map_s2p[pair_tmp[0]].atom_num;
-        for (std::vector<DistInfo>::iterator it2 = interaction->mindist_pairs[pair_tmp[0]][pair_tmp[1]].begin();
-             it2 != interaction->mindist_pairs[pair_tmp[0]][pair_tmp[1]].end(); ++it2) {
+        const std::vector<DistInfo> &mindist_now = interaction->mindist_pair(pair_tmp[0], pair_tmp[1]);
+
+        for (std::vector<DistInfo>::const_iterator it2 = mindist_now.begin();
+             it2 != mindist_now.end(); ++it2) {
             ptree &child = pt.add("Data.ForceConstants.HARMONIC.FC2",
                                   double2string(fitting->params[ip] * fctmp.coef
-                                      / static_cast<double>(interaction->mindist_pairs[pair_tmp[0]][pair_tmp[1]].size())));
+                                      / static_cast<double>(mindist_now.size())));
 
             child.put("<xmlattr>.pair1", boost::lexical_cast<std::string>(j + 1)
                       + " " + boost::lexical_cast<std::string>(fctmp.elems[0] % 3 + 1));
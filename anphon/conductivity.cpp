@@ -12,6 +12,7 @@
 #include <iostream>
 #include <fstream>
 #include <iomanip>
+#include <sstream>
 #include "conductivity.h"
 #include "dynamical.h"
 #include "error.h"
@@ -27,14 +28,22 @@
 #include "constants.h"
 #include <set>
 #include <vector>
+#include <algorithm>
+#include <cstring>
 #include "mathfunctions.h"
 #include "isotope.h"
 #include "phonon_dos.h"
+#include "symmetry_core.h"
+#include <cstdio>
 
 using namespace PHON_NS;
 
+const char Conductivity::checkpoint_magic[9] = "ANPHCHK1";
+
 Conductivity::Conductivity(PHON *phon): Pointers(phon)
 {
+    solve_bte = false;
+    kappa_bte = 0;
 }
 
 Conductivity::~Conductivity()
@@ -44,7 +53,11 @@ Conductivity::~Conductivity()
 void Conductivity::setup_kappa()
 {
     unsigned int i, j, k;
-    unsigned int nks_total, nks_each_thread, nrem;
+    unsigned int nks_total;
+
+    MPI_Bcast(&solve_bte, 1, MPI_LOGICAL, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&bte_maxiter, 1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&bte_tolerance, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
 
     nk = kpoint->nk;
     ns = dynamical->neval;
@@ -57,20 +70,13 @@ void Conductivity::setup_kappa()
     }
 
     nks_total = kpoint->nk_reduced * ns;
-    nks_each_thread = nks_total / mympi->nprocs;
-    nrem = nks_total - nks_each_thread * mympi->nprocs;
-
-    if (nrem > 0) {
-        memory->allocate(damping3, (nks_each_thread + 1) * mympi->nprocs, ntemp);
-    } else {
-        memory->allocate(damping3, nks_total, ntemp);
-    }
+    memory->allocate(damping3, nks_total, ntemp);
 
     if (mympi->my_rank == 0) {
         memory->allocate(vel, nk, ns, 3);
 
         for (i = 0; i < nk; ++i) {
-            phonon_velocity->phonon_vel_k(kpoint->xk[i], vel[i]);
+            phonon_velocity->phonon_vel_k(kpoint->xk[i], vel[i], i);
 
             // Generate phonon velocity in Cartesian coordinate
             for (j = 0; j < ns; ++j) {
@@ -88,13 +94,17 @@ void Conductivity::setup_kappa()
             vks_job.insert(i * ns + j);
         }
     }
+
+    if (solve_bte) open_bte_store();
 }
 
 void Conductivity::prepare_restart()
 {
-    // Write phonon frequency to result file
+    // Load the linewidths of the modes already computed
+    // from the binary checkpoint file (or from the text result file
+    // when no checkpoint is available) and prepare the checkpoint
+    // for appending new records.
 
-    int ik, is;
     int i;
     std::set<int>::iterator it_set;
     std::string line_tmp;
@@ -104,30 +114,27 @@ void Conductivity::prepare_restart()
 
     double vel_dummy[3];
 
-    nshift_restart = 0;
-
     vks_done.clear();
 
     if (mympi->my_rank == 0) {
 
+        file_checkpoint = writes->file_result + ".chk";
+
         if (!phon->restart_flag) {
 
-            writes->fs_result << "##Phonon Frequency" << std::endl;
-            writes->fs_result << "#K-point (irreducible), Branch, Omega (cm^-1)" << std::endl;
+            write_result_frequency();
+            create_checkpoint();
 
-            for (i = 0; i < kpoint->nk_reduced; ++i) {
-                ik = kpoint->kpoint_irred_all[i][0].knum;
-                for (is = 0; is < dynamical->neval; ++is) {
-                    writes->fs_result << std::setw(6) << i + 1 << std::setw(6) << is + 1;
-                    writes->fs_result << std::setw(15) << writes->in_kayser(dynamical->eval_phonon[ik][is]) << std::endl;
-                }
-            }
+        } else if (load_checkpoint()) {
 
-            writes->fs_result << "##END Phonon Frequency" << std::endl << std::endl;
-            writes->fs_result << "##Phonon Relaxation Time" << std::endl;
+            std::cout << " Linewidths of " << vks_done.size()
+                << " modes are loaded from the checkpoint file " << file_checkpoint << std::endl;
 
         } else {
 
+            // Checkpoint file is not available.
+            // Parse the #GAMMA_EACH entries of the text result file instead.
+
             while (writes->fs_result >> line_tmp) {
 
                 if (line_tmp == "#GAMMA_EACH") {
@@ -148,6 +155,11 @@ void Conductivity::prepare_restart()
                     vks_done.push_back(nks_tmp);
                 }
             }
+
+            create_checkpoint();
+            for (i = 0; i < static_cast<int>(vks_done.size()); ++i) {
+                append_checkpoint(vks_done[i], damping3[vks_done[i]]);
+            }
         }
 
         writes->fs_result.close();
@@ -170,8 +182,6 @@ void Conductivity::prepare_restart()
     }
     MPI_Bcast(arr_done, nks_done, MPI_INT, 0, MPI_COMM_WORLD);
 
-    nshift_restart = nks_done;
-
     // Remove vks_done elements from vks_job
 
     for (i = 0; i < nks_done; ++i) {
@@ -189,6 +199,218 @@ void Conductivity::prepare_restart()
     vks_done.clear();
 }
 
+void Conductivity::set_checkpoint_metadata(int *ival, double *dval)
+{
+    ival[0] = checkpoint_version;
+    ival[1] = system->natmin;
+    ival[2] = system->nkd;
+    ival[3] = kpoint->nkx;
+    ival[4] = kpoint->nky;
+    ival[5] = kpoint->nkz;
+    ival[6] = kpoint->nk_reduced;
+    ival[7] = ns;
+    ival[8] = ntemp;
+    ival[9] = integration->ismear;
+
+    dval[0] = integration->epsilon;
+    dval[1] = system->Tmin;
+    dval[2] = system->Tmax;
+    dval[3] = system->dT;
+}
+
+void Conductivity::create_checkpoint()
+{
+    // The checkpoint file consists of a header
+    //   magic[8], ival[10] (int), dval[4] (double), checksum, padding
+    // followed by fixed-size records of the form
+    //   iks (int), checksum of iks and damping, damping[ntemp] (double).
+
+    int ival[10];
+    double dval[4];
+    unsigned int hash, pad = 0;
+
+    set_checkpoint_metadata(ival, dval);
+
+    hash = fnv1a_hash(reinterpret_cast<const char *>(ival), sizeof(ival));
+    hash = fnv1a_hash(reinterpret_cast<const char *>(dval), sizeof(dval), hash);
+
+    if (ofs_checkpoint.is_open()) ofs_checkpoint.close();
+    ofs_checkpoint.open(file_checkpoint.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!ofs_checkpoint) error->exit("create_checkpoint", "Could not open the checkpoint file");
+
+    ofs_checkpoint.write(checkpoint_magic, 8);
+    ofs_checkpoint.write(reinterpret_cast<const char *>(ival), sizeof(ival));
+    ofs_checkpoint.write(reinterpret_cast<const char *>(dval), sizeof(dval));
+    ofs_checkpoint.write(reinterpret_cast<const char *>(&hash), sizeof(hash));
+    ofs_checkpoint.write(reinterpret_cast<const char *>(&pad), sizeof(pad));
+    ofs_checkpoint.flush();
+}
+
+void Conductivity::append_checkpoint(const int iks, const double *damping_in)
+{
+    unsigned int hash;
+
+    hash = fnv1a_hash(reinterpret_cast<const char *>(&iks), sizeof(int));
+    hash = fnv1a_hash(reinterpret_cast<const char *>(damping_in), sizeof(double) * ntemp, hash);
+
+    ofs_checkpoint.write(reinterpret_cast<const char *>(&iks), sizeof(int));
+    ofs_checkpoint.write(reinterpret_cast<const char *>(&hash), sizeof(hash));
+    ofs_checkpoint.write(reinterpret_cast<const char *>(damping_in), sizeof(double) * ntemp);
+    ofs_checkpoint.flush();
+}
+
+bool Conductivity::load_checkpoint()
+{
+    // Read the checkpoint file at once and scan the records.
+    // Records after the first truncated or corrupted one are discarded
+    // and the file is cut back to the last valid record.
+    // Returns false if the checkpoint file does not exist.
+
+    int i;
+    int ival[10], ival_file[10];
+    double dval[4], dval_file[4];
+    unsigned int hash, hash_file;
+    int iks;
+    std::size_t nbytes, pos;
+    std::vector<char> buf, is_done;
+    std::ifstream ifs;
+
+    const std::size_t size_header = 8 + sizeof(ival) + sizeof(dval) + 2 * sizeof(unsigned int);
+    const std::size_t size_record = sizeof(int) + sizeof(unsigned int) + sizeof(double) * ntemp;
+    const int nks_total = kpoint->nk_reduced * ns;
+
+    ifs.open(file_checkpoint.c_str(), std::ios::in | std::ios::binary);
+    if (!ifs) return false;
+
+    ifs.seekg(0, std::ios::end);
+    nbytes = static_cast<std::size_t>(ifs.tellg());
+    ifs.seekg(0, std::ios::beg);
+
+    if (nbytes < size_header) {
+        error->exit("load_checkpoint", "The checkpoint file is too short");
+    }
+
+    buf.resize(nbytes);
+    ifs.read(&buf[0], nbytes);
+    ifs.close();
+
+    // Check the header
+
+    if (std::string(&buf[0], 8) != std::string(checkpoint_magic, 8)) {
+        error->exit("load_checkpoint", "The checkpoint file has a wrong format");
+    }
+    pos = 8;
+    std::memcpy(ival_file, &buf[pos], sizeof(ival_file));
+    pos += sizeof(ival_file);
+    std::memcpy(dval_file, &buf[pos], sizeof(dval_file));
+    pos += sizeof(dval_file);
+    std::memcpy(&hash_file, &buf[pos], sizeof(unsigned int));
+
+    hash = fnv1a_hash(reinterpret_cast<const char *>(ival_file), sizeof(ival_file));
+    hash = fnv1a_hash(reinterpret_cast<const char *>(dval_file), sizeof(dval_file), hash);
+    if (hash != hash_file) {
+        error->exit("load_checkpoint", "The header of the checkpoint file is broken");
+    }
+
+    set_checkpoint_metadata(ival, dval);
+
+    for (i = 0; i < 10; ++i) {
+        if (ival[i] != ival_file[i]) {
+            error->exit("load_checkpoint",
+                        "The checkpoint file is not consistent with the present calculation");
+        }
+    }
+    if ((ival[9] != -1 && std::abs(writes->in_kayser(dval[0] - dval_file[0])) >= eps4)
+        || dval[1] != dval_file[1] || dval[2] != dval_file[2] || dval[3] != dval_file[3]) {
+        error->exit("load_checkpoint",
+                    "The checkpoint file is not consistent with the present calculation");
+    }
+
+    // Scan the records
+
+    pos = size_header;
+    is_done.assign(nks_total, 0);
+
+    while (pos + size_record <= nbytes) {
+
+        std::memcpy(&iks, &buf[pos], sizeof(int));
+        std::memcpy(&hash_file, &buf[pos + sizeof(int)], sizeof(unsigned int));
+
+        hash = fnv1a_hash(&buf[pos], sizeof(int));
+        hash = fnv1a_hash(&buf[pos + sizeof(int) + sizeof(unsigned int)], sizeof(double) * ntemp, hash);
+
+        if (hash != hash_file || iks < 0 || iks >= nks_total) break;
+
+        std::memcpy(damping3[iks], &buf[pos + sizeof(int) + sizeof(unsigned int)],
+                    sizeof(double) * ntemp);
+        if (!is_done[iks]) {
+            is_done[iks] = 1;
+            vks_done.push_back(iks);
+        }
+        pos += size_record;
+    }
+
+    if (pos < nbytes) {
+        std::cout << " " << nbytes - pos << " bytes at the end of the checkpoint file are discarded" << std::endl;
+        std::cout << " since the last record is truncated or corrupted." << std::endl;
+        error->warn("load_checkpoint", "Incomplete record found in the checkpoint file");
+
+        ofs_checkpoint.open(file_checkpoint.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!ofs_checkpoint) error->exit("load_checkpoint", "Could not open the checkpoint file");
+        ofs_checkpoint.write(&buf[0], pos);
+        ofs_checkpoint.close();
+    }
+
+    ofs_checkpoint.open(file_checkpoint.c_str(), std::ios::out | std::ios::binary | std::ios::app);
+    if (!ofs_checkpoint) error->exit("load_checkpoint", "Could not open the checkpoint file");
+
+    return true;
+}
+
+void Conductivity::write_result_frequency()
+{
+    unsigned int i, ik, is;
+
+    writes->fs_result << "##Phonon Frequency" << std::endl;
+    writes->fs_result << "#K-point (irreducible), Branch, Omega (cm^-1)" << std::endl;
+
+    for (i = 0; i < kpoint->nk_reduced; ++i) {
+        ik = kpoint->kpoint_irred_all[i][0].knum;
+        for (is = 0; is < dynamical->neval; ++is) {
+            writes->fs_result << std::setw(6) << i + 1 << std::setw(6) << is + 1;
+            writes->fs_result << std::setw(15) << writes->in_kayser(dynamical->eval_phonon[ik][is]) << std::endl;
+        }
+    }
+
+    writes->fs_result << "##END Phonon Frequency" << std::endl << std::endl;
+    writes->fs_result << "##Phonon Relaxation Time" << std::endl;
+}
+
+void Conductivity::write_result()
+{
+    // Regenerate the text result file from the linewidths of all modes.
+    // The #GAMMA_EACH entries are written in the order of (k,s).
+
+    if (mympi->my_rank == 0) {
+
+        unsigned int iks;
+
+        ofs_checkpoint.close();
+
+        writes->fs_result.close();
+        writes->fs_result.open(writes->file_result.c_str(), std::ios::out);
+        if (!writes->fs_result) error->exit("write_result", "Could not open file_result");
+
+        writes->write_result_header();
+        write_result_frequency();
+
+        for (iks = 0; iks < kpoint->nk_reduced * ns; ++iks) {
+            write_result_gamma(iks, vel, damping3);
+        }
+        writes->fs_result.flush();
+    }
+}
+
 void Conductivity::finish_kappa()
 {
     if (mympi->my_rank == 0) {
@@ -198,140 +420,233 @@ void Conductivity::finish_kappa()
             memory->deallocate(kappa_spec);
         }
     }
+    if (solve_bte) {
+        memory->deallocate(kappa_bte);
+    }
     memory->deallocate(damping3);
     memory->deallocate(Temperature);
 }
 
 void Conductivity::calc_anharmonic_imagself()
 {
-    unsigned int nks_g;
-    unsigned int i, j;
-    unsigned int knum, snum;
-    unsigned int *nks_thread;
+    // The remaining (k,s) jobs are grouped by the irreducible k point so that
+    // all modes of a k point are computed by the same process in a row, which
+    // keeps the Phi3 cache effective. The groups are sorted by their estimated
+    // cost and taken one after another by all MPI processes through a shared
+    // counter in an MPI window on rank 0.
+    // Rank 0 computes as well and receives the results of the other processes
+    // between its own modes. The other processes send their results without
+    // waiting for rank 0 using two alternating buffers.
+
+    int j;
+    int ijob, njob, nks_g;
     int iks;
-    double omega;
-    double *damping3_loc;
-
-
-    // Distribute (k,s) to individual MPI threads
-
-    nks_g = vks_job.size();
-    vks_l.clear();
-
-    unsigned int icount = 0;
-
-    for (std::set<int>::iterator it = vks_job.begin(); it != vks_job.end(); ++it) {
-        if (icount % mympi->nprocs == mympi->my_rank) {
-            vks_l.push_back(*it);
-        }
-        ++icount;
-    }
+    int ndone = 0;
+    int ibuf = 0;
+    int one = 1;
+    int *counter;
+    double **damping3_loc;
+    std::vector<int> vks_queue, job_begin;
+    MPI_Win counter_window;
+    MPI_Request request[2];
 
     if (mympi->my_rank == 0) {
-        memory->allocate(nks_thread, mympi->nprocs);
+        sort_jobs_by_cost(vks_queue, job_begin);
+        nks_g = vks_queue.size();
+        njob = job_begin.size() - 1;
     }
-
-    unsigned int nks_tmp = vks_l.size();
-    MPI_Gather(&nks_tmp, 1, MPI_UNSIGNED, &nks_thread[mympi->my_rank],
-               1, MPI_UNSIGNED, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&nks_g, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&njob, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    vks_queue.resize(nks_g);
+    job_begin.resize(njob + 1);
+    if (nks_g > 0) MPI_Bcast(&vks_queue[0], nks_g, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&job_begin[0], njob + 1, MPI_INT, 0, MPI_COMM_WORLD);
 
     if (mympi->my_rank == 0) {
         std::cout << std::endl;
         std::cout << " Start calculating anharmonic phonon self-energies ... " << std::endl;
         std::cout << " Total Number of phonon modes to be calculated : " << nks_g << std::endl;
-        std::cout << " All modes are distributed to MPI threads as the following :" << std::endl;
-        for (i = 0; i < mympi->nprocs; ++i) {
-            std::cout << " RANK: " << std::setw(5) << i + 1;
-            std::cout << std::setw(8) << "MODES: " << std::setw(5) << nks_thread[i] << std::endl;
+        if (mympi->nprocs > 1) {
+            std::cout << " Modes of the same k point are dispatched together to " << mympi->nprocs
+                << " MPI process(es)," << std::endl;
+            std::cout << " in descending order of the number of triplets." << std::endl;
+            std::cout << " MPI rank 0 collects the results and writes them to the checkpoint file." << std::endl;
         }
         std::cout << std::endl << std::flush;
+    }
 
-        memory->deallocate(nks_thread);
+    MPI_Win_allocate(mympi->my_rank == 0 ? sizeof(int) : 0, sizeof(int), MPI_INFO_NULL,
+                     MPI_COMM_WORLD, &counter, &counter_window);
+    if (mympi->my_rank == 0) {
+        MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, counter_window);
+        *counter = 0;
+        MPI_Win_unlock(0, counter_window);
     }
+    MPI_Barrier(MPI_COMM_WORLD);
 
-    unsigned int nk_tmp = nks_g / mympi->nprocs + 1;
+    memory->allocate(damping3_loc, 2, ntemp + 1);
+    request[0] = MPI_REQUEST_NULL;
+    request[1] = MPI_REQUEST_NULL;
 
-    if (nks_g % mympi->nprocs != 0) {
-        nk_tmp = nks_g / mympi->nprocs + 1;
-    } else {
-        nk_tmp = nks_g / mympi->nprocs;
+    while (true) {
+
+        MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, counter_window);
+        MPI_Fetch_and_op(&one, &ijob, MPI_INT, 0, 0, MPI_SUM, counter_window);
+        MPI_Win_unlock(0, counter_window);
+
+        if (ijob >= njob) break;
+
+        for (j = job_begin[ijob]; j < job_begin[ijob + 1]; ++j) {
+            iks = vks_queue[j];
+
+            if (mympi->my_rank == 0) {
+                calc_damping_mode(iks, damping3[iks]);
+                store_damping_mode(iks, damping3[iks], ndone);
+                receive_damping_mode(false, damping3_loc[0], ndone);
+            } else {
+                MPI_Wait(&request[ibuf], MPI_STATUS_IGNORE);
+                calc_damping_mode(iks, &damping3_loc[ibuf][1]);
+                damping3_loc[ibuf][0] = static_cast<double>(iks);
+                MPI_Isend(damping3_loc[ibuf], ntemp + 1, MPI_DOUBLE, 0, 0,
+                          MPI_COMM_WORLD, &request[ibuf]);
+                ibuf = 1 - ibuf;
+            }
+        }
     }
 
-    if (vks_l.size() < nk_tmp) {
-        vks_l.push_back(-1);
+    if (mympi->my_rank == 0) {
+        while (ndone < nks_g) receive_damping_mode(true, damping3_loc[0], ndone);
+    } else {
+        MPI_Waitall(2, request, MPI_STATUSES_IGNORE);
     }
 
-    memory->allocate(damping3_loc, ntemp);
+    MPI_Win_free(&counter_window);
+    memory->deallocate(damping3_loc);
+}
 
+void Conductivity::store_damping_mode(const int iks, const double *damping_in, int &ndone)
+{
+    unsigned int i;
 
-    for (i = 0; i < nk_tmp; ++i) {
+    if (damping_in != damping3[iks]) {
+        for (i = 0; i < ntemp; ++i) damping3[iks][i] = damping_in[i];
+    }
+    append_checkpoint(iks, damping3[iks]);
+    ++ndone;
+    std::cout << " MODE " << std::setw(5) << ndone << " done." << std::endl << std::flush;
+}
 
-        iks = vks_l[i];
+void Conductivity::receive_damping_mode(const bool wait, double *buf, int &ndone)
+{
+    // Receive the [iks, damping(T)...] messages from the other processes.
+    // If wait is false, only the messages that have already arrived are
+    // received. Otherwise, one message is received.
 
-        if (iks == -1) {
+    int flag = 1;
+    MPI_Status status;
 
-            for (j = 0; j < ntemp; ++j) damping3_loc[j] = eps; // do nothing
+    while (true) {
+        if (!wait) {
+            MPI_Iprobe(MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, &flag, &status);
+            if (!flag) break;
+        }
+        MPI_Recv(buf, ntemp + 1, MPI_DOUBLE, MPI_ANY_SOURCE, 0, MPI_COMM_WORLD, &status);
+        store_damping_mode(nint(buf[0]), &buf[1], ndone);
+        if (wait) break;
+    }
+}
 
-        } else {
+void Conductivity::sort_jobs_by_cost(std::vector<int> &vks_queue,
+                                     std::vector<int> &job_begin)
+{
+    // The modes of vks_job are grouped by the irreducible k point.
+    // The cost of a group is estimated as (number of unique triplets) * ns^2
+    // times the number of modes, which is the number of V3 matrix elements
+    // evaluated for the group. Groups are sorted in descending order of the
+    // cost (largest first) so that the expensive ones do not end up as stragglers.
+    // On return, the modes of the i-th group are
+    // vks_queue[job_begin[i]], ..., vks_queue[job_begin[i + 1] - 1].
+
+    unsigned int ik;
+    double cost;
+    std::vector<int> modes_now;
+    std::vector<std::vector<int> > modes_group;
+    std::vector<std::pair<double, int> > cost_and_job;
+    std::set<int>::const_iterator it = vks_job.begin();
+
+    while (it != vks_job.end()) {
+        ik = static_cast<unsigned int>(*it) / ns;
+        modes_now.clear();
+        while (it != vks_job.end() && static_cast<unsigned int>(*it) / ns == ik) {
+            modes_now.push_back(*it);
+            ++it;
+        }
+        cost = static_cast<double>(relaxation->get_number_of_unique_triplets(ik))
+            * static_cast<double>(ns * ns) * static_cast<double>(modes_now.size());
+        cost_and_job.push_back(std::pair<double, int>(-cost, modes_group.size()));
+        modes_group.push_back(modes_now);
+    }
 
-            knum = kpoint->kpoint_irred_all[iks / ns][0].knum;
-            snum = iks % ns;
+    std::sort(cost_and_job.begin(), cost_and_job.end());
 
-            omega = dynamical->eval_phonon[knum][snum];
+    vks_queue.clear();
+    job_begin.clear();
+    job_begin.push_back(0);
+    for (std::vector<std::pair<double, int> >::const_iterator it_job = cost_and_job.begin();
+         it_job != cost_and_job.end(); ++it_job) {
+        const std::vector<int> &modes = modes_group[(*it_job).second];
+        vks_queue.insert(vks_queue.end(), modes.begin(), modes.end());
+        job_begin.push_back(vks_queue.size());
+    }
+}
 
-            if (integration->ismear == 0 || integration->ismear == 1) {
-                relaxation->calc_damping_smearing(ntemp, Temperature, omega, iks / ns, snum, damping3_loc);
-            } else if (integration->ismear == -1) {
-                relaxation->calc_damping_tetrahedron(ntemp, Temperature, omega, iks / ns, snum, damping3_loc);
-            }
-        }
+void Conductivity::calc_damping_mode(const int iks, double *damping_out)
+{
+    unsigned int knum = kpoint->kpoint_irred_all[iks / ns][0].knum;
+    unsigned int snum = iks % ns;
+    double omega = dynamical->eval_phonon[knum][snum];
 
-        MPI_Gather(&damping3_loc[0], ntemp, MPI_DOUBLE,
-                   damping3[nshift_restart + i * mympi->nprocs], ntemp,
-                   MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    ScatteringRecord record;
+    ScatteringRecord *ptr_record = 0;
 
-        if (mympi->my_rank == 0) {
-            write_result_gamma(i, nshift_restart, vel, damping3);
-            std::cout << " MODE " << std::setw(5) << i + 1 << " done." << std::endl << std::flush;
-        }
+    if (solve_bte) ptr_record = &record;
+
+    if (integration->ismear == 0 || integration->ismear == 1) {
+        relaxation->calc_damping_smearing(ntemp, Temperature, omega, iks / ns, snum,
+                                          damping_out, ptr_record);
+    } else if (integration->ismear == -1) {
+        relaxation->calc_damping_tetrahedron(ntemp, Temperature, omega, iks / ns, snum,
+                                             damping_out, ptr_record);
     }
 
-    memory->deallocate(damping3_loc);
+    if (solve_bte) write_bte_record(iks, record);
 }
 
-void Conductivity::write_result_gamma(const unsigned int ik, const unsigned int nshift,
+void Conductivity::write_result_gamma(const unsigned int iks,
                                       double ***vel_in, double **damp_in)
 {
-    unsigned int np = mympi->nprocs;
-    unsigned int j, k, iks_g;
+    unsigned int k;
     unsigned int nk_equiv;
     unsigned int ktmp;
 
-    for (j = 0; j < np; ++j) {
-
-        iks_g = ik * np + j + nshift;
-
-        if (iks_g >= kpoint->nk_reduced * ns) break;
+    writes->fs_result << "#GAMMA_EACH" << std::endl;
+    writes->fs_result << iks / ns + 1 << " " << iks % ns + 1 << std::endl;
 
-        writes->fs_result << "#GAMMA_EACH" << std::endl;
-        writes->fs_result << iks_g / ns + 1 << " " << iks_g % ns + 1 << std::endl;
+    nk_equiv = kpoint->kpoint_irred_all[iks / ns].size();
 
-        nk_equiv = kpoint->kpoint_irred_all[iks_g / ns].size();
-
-        writes->fs_result << nk_equiv << std::endl;
-        for (k = 0; k < nk_equiv; ++k) {
-            ktmp = kpoint->kpoint_irred_all[iks_g / ns][k].knum;
-            writes->fs_result << std::setw(15) << vel_in[ktmp][iks_g % ns][0];
-            writes->fs_result << std::setw(15) << vel_in[ktmp][iks_g % ns][1];
-            writes->fs_result << std::setw(15) << vel_in[ktmp][iks_g % ns][2] << std::endl;
-        }
+    writes->fs_result << nk_equiv << std::endl;
+    for (k = 0; k < nk_equiv; ++k) {
+        ktmp = kpoint->kpoint_irred_all[iks / ns][k].knum;
+        writes->fs_result << std::setw(15) << vel_in[ktmp][iks % ns][0];
+        writes->fs_result << std::setw(15) << vel_in[ktmp][iks % ns][1];
+        writes->fs_result << std::setw(15) << vel_in[ktmp][iks % ns][2] << std::endl;
+    }
 
-        for (k = 0; k < ntemp; ++k) {
-            writes->fs_result << std::setw(15)
-                << damp_in[iks_g][k] * Hz_to_kayser / time_ry << std::endl;
-        }
-        writes->fs_result << "#END GAMMA_EACH" << std::endl;
+    for (k = 0; k < ntemp; ++k) {
+        writes->fs_result << std::setw(15)
+            << damp_in[iks][k] * Hz_to_kayser / time_ry << std::endl;
     }
+    writes->fs_result << "#END GAMMA_EACH" << std::endl;
 }
 
 void Conductivity::compute_kappa()
@@ -449,6 +764,525 @@ void Conductivity::compute_kappa()
 }
 
 
+void Conductivity::open_bte_store()
+{
+    // Each MPI process writes the scattering weights of the modes
+    // it computes to its own scratch file.
+
+    std::ostringstream ss;
+
+    ss << input->job_title << ".v3store." << mympi->my_rank;
+    file_bte_store = ss.str();
+    vks_bte_store.clear();
+
+    ofs_bte_store.open(file_bte_store.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!ofs_bte_store) error->exit("open_bte_store", "Could not open the scratch file for the BTE");
+}
+
+void Conductivity::write_bte_record(const int iks, const ScatteringRecord &record)
+{
+    // Record layout:
+    //   iks, ngroup, nmember_total, nentry_total (int),
+    //   nmember[ngroup], nentry[ngroup], kpair[2 * nmember_total],
+    //   ibranch[nentry_total] (int), weight[2 * nentry_total] (float)
+
+    int header[4];
+
+    header[0] = iks;
+    header[1] = record.nmember.size();
+    header[2] = record.kpair.size() / 2;
+    header[3] = record.ibranch.size();
+
+    ofs_bte_store.write(reinterpret_cast<const char *>(header), sizeof(header));
+
+    if (header[1] > 0) {
+        ofs_bte_store.write(reinterpret_cast<const char *>(&record.nmember[0]), sizeof(int) * header[1]);
+        ofs_bte_store.write(reinterpret_cast<const char *>(&record.nentry[0]), sizeof(int) * header[1]);
+        ofs_bte_store.write(reinterpret_cast<const char *>(&record.kpair[0]), sizeof(int) * 2 * header[2]);
+        ofs_bte_store.write(reinterpret_cast<const char *>(&record.ibranch[0]), sizeof(int) * header[3]);
+        ofs_bte_store.write(reinterpret_cast<const char *>(&record.weight[0]), sizeof(float) * 2 * header[3]);
+    }
+    if (!ofs_bte_store) error->exit("write_bte_record", "Could not write to the scratch file for the BTE");
+
+    vks_bte_store.push_back(iks);
+}
+
+void Conductivity::complete_bte_store()
+{
+    // The scattering weights are not available for the modes loaded from
+    // the checkpoint file. They are recomputed here by all the MPI processes.
+
+    unsigned int i;
+    const unsigned int nks_total = kpoint->nk_reduced * ns;
+    int *flag_loc, *flag;
+    double *damping_tmp;
+    std::vector<int> vks_missing;
+
+    memory->allocate(flag_loc, nks_total);
+    memory->allocate(flag, nks_total);
+
+    for (i = 0; i < nks_total; ++i) flag_loc[i] = 0;
+    for (i = 0; i < vks_bte_store.size(); ++i) flag_loc[vks_bte_store[i]] = 1;
+
+    MPI_Allreduce(flag_loc, flag, nks_total, MPI_INT, MPI_MAX, MPI_COMM_WORLD);
+
+    for (i = 0; i < nks_total; ++i) {
+        if (flag[i] == 0) vks_missing.push_back(i);
+    }
+
+    memory->deallocate(flag_loc);
+    memory->deallocate(flag);
+
+    if (!vks_missing.empty()) {
+        if (mympi->my_rank == 0) {
+            std::cout << " Scattering weights of " << vks_missing.size()
+                << " modes loaded from the checkpoint are recomputed." << std::endl;
+        }
+
+        memory->allocate(damping_tmp, ntemp);
+        for (i = mympi->my_rank; i < vks_missing.size(); i += mympi->nprocs) {
+            calc_damping_mode(vks_missing[i], damping_tmp);
+        }
+        memory->deallocate(damping_tmp);
+    }
+
+    ofs_bte_store.close();
+}
+
+void Conductivity::compute_kappa_bte()
+{
+    // Solve the linearized Boltzmann transport equation iteratively.
+    // The mean free displacement of mode (k,s) is updated as
+    //
+    //   F_{ks} = tau0_{ks} * (v_{ks} + Delta_{ks}),
+    //   Delta_{ks} = 2 * sum_{k1 + k2 = k} R * (w1/w * F_{k1s1} + w2/w * F_{k2s2}),
+    //
+    // where tau0 is the lifetime in the RTA and R is the contribution of the
+    // process to the linewidth. The first iteration (Delta = 0) gives the RTA result.
+    // Isotope scattering is included only in tau0.
+
+    if (!solve_bte) return;
+
+    unsigned int i, j, k;
+    unsigned int iks, iter;
+    unsigned int knum, snum;
+    const unsigned int nks_irred = kpoint->nk_reduced * ns;
+    bool converged = false;
+    double omega, gamma_tmp;
+    double diff, norm, diff_max;
+
+    int *kmap_irred, *sign_k;
+    double ***rotc;
+    double **tau0, **occupation;
+    double ***delta, ***mfd;
+    double ***kappa_prev;
+
+    complete_bte_store();
+
+    if (mympi->my_rank == 0) {
+        std::cout << std::endl;
+        std::cout << " Solving the linearized BTE iteratively ..." << std::endl;
+    }
+
+    // Distribute the group velocities and the RTA lifetimes
+
+    if (mympi->my_rank != 0) memory->allocate(vel, nk, ns, 3);
+    MPI_Bcast(&vel[0][0][0], nk * ns * 3, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    memory->allocate(tau0, nks_irred, ntemp);
+    memory->allocate(occupation, nks_irred, ntemp);
+
+    if (mympi->my_rank == 0) {
+        for (iks = 0; iks < nks_irred; ++iks) {
+            knum = kpoint->kpoint_irred_all[iks / ns][0].knum;
+            snum = iks % ns;
+            omega = dynamical->eval_phonon[knum][snum];
+
+            for (i = 0; i < ntemp; ++i) {
+                gamma_tmp = damping3[iks][i];
+                if (isotope->include_isotope) gamma_tmp += isotope->gamma_isotope[iks / ns][snum];
+
+                if (relaxation->is_imaginary[iks / ns][snum] || omega < eps8
+                    || Temperature[i] < eps || gamma_tmp <= 0.0) {
+                    tau0[iks][i] = 0.0;
+                } else {
+                    tau0[iks][i] = 0.5 / gamma_tmp;
+                }
+            }
+        }
+    }
+    MPI_Bcast(&tau0[0][0], nks_irred * ntemp, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+    for (iks = 0; iks < nks_irred; ++iks) {
+        knum = kpoint->kpoint_irred_all[iks / ns][0].knum;
+        omega = dynamical->eval_phonon[knum][iks % ns];
+        for (i = 0; i < ntemp; ++i) {
+            occupation[iks][i] = thermodynamics->fB(omega, Temperature[i]);
+        }
+    }
+
+    memory->allocate(kmap_irred, nk);
+    memory->allocate(sign_k, nk);
+    memory->allocate(rotc, nk, 3, 3);
+
+    setup_kpoint_rotation(kmap_irred, sign_k, rotc);
+
+    memory->allocate(delta, nks_irred, ntemp, 3);
+    memory->allocate(mfd, nk * ns, ntemp, 3);
+    memory->allocate(kappa_bte, ntemp, 3, 3);
+    memory->allocate(kappa_prev, ntemp, 3, 3);
+
+    for (iks = 0; iks < nks_irred; ++iks) {
+        for (i = 0; i < ntemp; ++i) {
+            for (j = 0; j < 3; ++j) delta[iks][i][j] = 0.0;
+        }
+    }
+
+    calc_mean_free_displacement(tau0, delta, kmap_irred, sign_k, rotc, mfd);
+    calc_kappa_from_mean_free_displacement(kmap_irred, mfd, kappa_bte);
+
+    for (iter = 1; iter <= bte_maxiter; ++iter) {
+
+        for (i = 0; i < ntemp; ++i) {
+            for (j = 0; j < 3; ++j) {
+                for (k = 0; k < 3; ++k) kappa_prev[i][j][k] = kappa_bte[i][j][k];
+            }
+        }
+
+        calc_scattering_term(kmap_irred, occupation, mfd, delta);
+        calc_mean_free_displacement(tau0, delta, kmap_irred, sign_k, rotc, mfd);
+        calc_kappa_from_mean_free_displacement(kmap_irred, mfd, kappa_bte);
+
+        // Maximum relative change of kappa over temperatures
+
+        diff_max = 0.0;
+        for (i = 0; i < ntemp; ++i) {
+            if (Temperature[i] < eps) continue;
+            diff = 0.0;
+            norm = 0.0;
+            for (j = 0; j < 3; ++j) {
+                for (k = 0; k < 3; ++k) {
+                    diff += std::pow(kappa_bte[i][j][k] - kappa_prev[i][j][k], 2);
+                    norm += std::pow(kappa_bte[i][j][k], 2);
+                }
+            }
+            if (norm > 0.0) diff_max = std::max<double>(diff_max, std::sqrt(diff / norm));
+        }
+
+        if (mympi->my_rank == 0) {
+            std::cout << "  ITER " << std::setw(4) << iter
+                << " : max relative change of kappa = "
+                << std::scientific << std::setprecision(4) << diff_max << std::endl;
+            std::cout.unsetf(std::ios::scientific);
+        }
+
+        if (diff_max < bte_tolerance) {
+            converged = true;
+            break;
+        }
+    }
+
+    if (mympi->my_rank == 0) {
+        if (converged) {
+            std::cout << " The BTE solution converged after " << iter << " iterations." << std::endl;
+        } else {
+            error->warn("compute_kappa_bte", "The iterative solution of the BTE did not converge");
+        }
+    }
+
+    std::remove(file_bte_store.c_str());
+
+    memory->deallocate(kappa_prev);
+    memory->deallocate(mfd);
+    memory->deallocate(delta);
+    memory->deallocate(rotc);
+    memory->deallocate(sign_k);
+    memory->deallocate(kmap_irred);
+    memory->deallocate(occupation);
+    memory->deallocate(tau0);
+    if (mympi->my_rank != 0) memory->deallocate(vel);
+}
+
+void Conductivity::setup_kpoint_rotation(int *kmap_irred, int *sign_k, double ***rotc)
+{
+    // For each k point, find the irreducible k point k0 and the symmetry operation S
+    // satisfying k = sign * S k0 (sign = 1 or -1), and the rotation matrix of S
+    // in the Cartesian basis. The operations with sign = 1 are preferred.
+
+    unsigned int ik, isym;
+    int i, j, knum, ksym, isign;
+    double srot[3][3], srot_cart[3][3], mat_tmp[3][3];
+    double lavec[3][3], lavec_inv[3][3];
+
+    for (i = 0; i < 3; ++i) {
+        for (j = 0; j < 3; ++j) lavec[i][j] = system->lavec_p[i][j];
+    }
+    invmat3(lavec_inv, lavec);
+
+    for (ik = 0; ik < nk; ++ik) kmap_irred[ik] = -1;
+
+    for (isign = 1; isign >= -1; isign -= 2) {
+        for (ik = 0; ik < kpoint->nk_reduced; ++ik) {
+            knum = kpoint->kpoint_irred_all[ik][0].knum;
+
+            for (isym = 0; isym < symmetry->nsym; ++isym) {
+                ksym = kpoint->knum_sym(knum, isym);
+                if (isign == -1) ksym = kpoint->knum_minus[ksym];
+                if (kmap_irred[ksym] != -1) continue;
+
+                for (i = 0; i < 3; ++i) {
+                    for (j = 0; j < 3; ++j) {
+                        srot[i][j] = static_cast<double>(symmetry->SymmList[isym].rot[i][j]);
+                    }
+                }
+                matmul3(mat_tmp, srot, lavec_inv);
+                matmul3(srot_cart, lavec, mat_tmp);
+
+                kmap_irred[ksym] = ik;
+                sign_k[ksym] = isign;
+                for (i = 0; i < 3; ++i) {
+                    for (j = 0; j < 3; ++j) rotc[ksym][i][j] = srot_cart[i][j];
+                }
+            }
+        }
+    }
+
+    for (ik = 0; ik < nk; ++ik) {
+        if (kmap_irred[ik] == -1) {
+            error->exit("setup_kpoint_rotation",
+                        "Symmetry operation connecting the k point to the irreducible one not found");
+        }
+    }
+}
+
+void Conductivity::calc_mean_free_displacement(double **tau0,
+                                               double ***delta,
+                                               const int *kmap_irred,
+                                               const int *sign_k,
+                                               double ***rotc,
+                                               double ***mfd)
+{
+    // F_{ks} = tau0_{ks} * (v_{ks} + sign * R Delta_{k0s}) for all the k points
+
+    int ik;
+
+#ifdef _OPENMP
+#pragma omp parallel for
+#endif
+    for (ik = 0; ik < static_cast<int>(nk); ++ik) {
+        unsigned int is, i, j;
+        unsigned int iks_irred;
+        double delta_rot[3];
+
+        for (is = 0; is < ns; ++is) {
+            iks_irred = kmap_irred[ik] * ns + is;
+
+            for (i = 0; i < ntemp; ++i) {
+                rotvec(delta_rot, delta[iks_irred][i], rotc[ik]);
+                for (j = 0; j < 3; ++j) {
+                    mfd[ik * ns + is][i][j] = tau0[iks_irred][i]
+                        * (vel[ik][is][j] + static_cast<double>(sign_k[ik]) * delta_rot[j]);
+                }
+            }
+        }
+    }
+}
+
+void Conductivity::calc_scattering_term(const int *kmap_irred,
+                                        double **occupation,
+                                        double ***mfd,
+                                        double ***delta)
+{
+    // Evaluate Delta_{ks} of the irreducible modes from the scattering weights
+    // stored by this MPI process, and sum up the contributions of all the processes.
+
+    unsigned int i, j;
+    int header[4];
+    int igroup;
+    int iks, knum, snum;
+    double omega;
+    double ***delta_loc;
+    std::vector<int> nmember, nentry, kpair, ibranch;
+    std::vector<int> offset_member, offset_entry;
+    std::vector<float> weight;
+    std::ifstream ifs;
+
+    const unsigned int nks_irred = kpoint->nk_reduced * ns;
+
+    memory->allocate(delta_loc, nks_irred, ntemp, 3);
+
+    for (i = 0; i < nks_irred; ++i) {
+        for (j = 0; j < ntemp; ++j) {
+            delta_loc[i][j][0] = 0.0;
+            delta_loc[i][j][1] = 0.0;
+            delta_loc[i][j][2] = 0.0;
+        }
+    }
+
+    ifs.open(file_bte_store.c_str(), std::ios::in | std::ios::binary);
+    if (!ifs) error->exit("calc_scattering_term", "Could not open the scratch file for the BTE");
+
+    while (ifs.read(reinterpret_cast<char *>(header), sizeof(header))) {
+
+        iks = header[0];
+        knum = kpoint->kpoint_irred_all[iks / ns][0].knum;
+        snum = iks % ns;
+        omega = dynamical->eval_phonon[knum][snum];
+
+        if (header[1] == 0) continue;
+
+        nmember.resize(header[1]);
+        nentry.resize(header[1]);
+        kpair.resize(2 * header[2]);
+        ibranch.resize(header[3]);
+        weight.resize(2 * header[3]);
+
+        ifs.read(reinterpret_cast<char *>(&nmember[0]), sizeof(int) * header[1]);
+        ifs.read(reinterpret_cast<char *>(&nentry[0]), sizeof(int) * header[1]);
+        ifs.read(reinterpret_cast<char *>(&kpair[0]), sizeof(int) * 2 * header[2]);
+        ifs.read(reinterpret_cast<char *>(&ibranch[0]), sizeof(int) * header[3]);
+        ifs.read(reinterpret_cast<char *>(&weight[0]), sizeof(float) * 2 * header[3]);
+        if (!ifs) error->exit("calc_scattering_term", "The scratch file for the BTE is broken");
+
+        if (relaxation->is_imaginary[iks / ns][snum] || omega < eps8) continue;
+
+        offset_member.resize(header[1]);
+        offset_entry.resize(header[1]);
+        offset_member[0] = 0;
+        offset_entry[0] = 0;
+        for (igroup = 1; igroup < header[1]; ++igroup) {
+            offset_member[igroup] = offset_member[igroup - 1] + nmember[igroup - 1];
+            offset_entry[igroup] = offset_entry[igroup - 1] + nentry[igroup - 1];
+        }
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+        {
+            int ig, ie, im;
+            unsigned int it;
+            int k1, k2, is, js;
+            int ks1, ks2;
+            int ib;
+            double xi1, xi2;
+            double *rate;
+            double **delta_thread;
+
+            memory->allocate(rate, ntemp);
+            memory->allocate(delta_thread, ntemp, 3);
+
+            for (it = 0; it < ntemp; ++it) {
+                delta_thread[it][0] = 0.0;
+                delta_thread[it][1] = 0.0;
+                delta_thread[it][2] = 0.0;
+            }
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+            for (ig = 0; ig < header[1]; ++ig) {
+                for (ie = 0; ie < nentry[ig]; ++ie) {
+
+                    ib = ibranch[offset_entry[ig] + ie];
+                    is = ib / ns;
+                    js = ib % ns;
+
+                    // All the members share the frequencies and the weights
+                    // with the representative pair.
+
+                    k1 = kpair[2 * offset_member[ig]];
+                    k2 = kpair[2 * offset_member[ig] + 1];
+                    ks1 = kmap_irred[k1] * ns + is;
+                    ks2 = kmap_irred[k2] * ns + js;
+
+                    xi1 = dynamical->eval_phonon[k1][is] / omega;
+                    xi2 = dynamical->eval_phonon[k2][js] / omega;
+
+                    // n1 = f1 + f2 + 1, n2 = f1 - f2
+                    for (it = 0; it < ntemp; ++it) {
+                        rate[it] = 2.0 * (weight[2 * (offset_entry[ig] + ie)]
+                                          * (occupation[ks1][it] + occupation[ks2][it] + 1.0)
+                                          - weight[2 * (offset_entry[ig] + ie) + 1]
+                                          * (occupation[ks1][it] - occupation[ks2][it]));
+                    }
+
+                    for (im = 0; im < nmember[ig]; ++im) {
+                        k1 = kpair[2 * (offset_member[ig] + im)];
+                        k2 = kpair[2 * (offset_member[ig] + im) + 1];
+
+                        for (it = 0; it < ntemp; ++it) {
+                            delta_thread[it][0] += rate[it] * (xi1 * mfd[k1 * ns + is][it][0]
+                                                               + xi2 * mfd[k2 * ns + js][it][0]);
+                            delta_thread[it][1] += rate[it] * (xi1 * mfd[k1 * ns + is][it][1]
+                                                               + xi2 * mfd[k2 * ns + js][it][1]);
+                            delta_thread[it][2] += rate[it] * (xi1 * mfd[k1 * ns + is][it][2]
+                                                               + xi2 * mfd[k2 * ns + js][it][2]);
+                        }
+                    }
+                }
+            }
+
+#ifdef _OPENMP
+#pragma omp critical
+#endif
+            for (it = 0; it < ntemp; ++it) {
+                delta_loc[iks][it][0] += delta_thread[it][0];
+                delta_loc[iks][it][1] += delta_thread[it][1];
+                delta_loc[iks][it][2] += delta_thread[it][2];
+            }
+
+            memory->deallocate(delta_thread);
+            memory->deallocate(rate);
+        }
+    }
+
+    ifs.close();
+
+    MPI_Allreduce(&delta_loc[0][0][0], &delta[0][0][0], 3 * nks_irred * ntemp,
+                  MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+
+    memory->deallocate(delta_loc);
+}
+
+void Conductivity::calc_kappa_from_mean_free_displacement(const int *kmap_irred,
+                                                          double ***mfd,
+                                                          double ***kappa_out)
+{
+    // kappa_{ij} = 1/(N V) sum_{ks} C_{ks} v_{ks,i} F_{ks,j}
+
+    unsigned int i, j, k;
+    unsigned int ik, is;
+    unsigned int knum;
+    double omega, cv;
+    double factor_toSI = 1.0e+18 / (std::pow(Bohr_in_Angstrom, 3) * system->volume_p)
+        * 1.0e+12 * time_ry / static_cast<double>(nk);
+
+    for (i = 0; i < ntemp; ++i) {
+        for (j = 0; j < 3; ++j) {
+            for (k = 0; k < 3; ++k) kappa_out[i][j][k] = 0.0;
+        }
+
+        if (Temperature[i] < eps) continue;
+
+        for (ik = 0; ik < nk; ++ik) {
+            knum = kpoint->kpoint_irred_all[kmap_irred[ik]][0].knum;
+            for (is = 0; is < ns; ++is) {
+                omega = dynamical->eval_phonon[knum][is];
+                cv = thermodynamics->Cv(omega, Temperature[i]);
+                for (j = 0; j < 3; ++j) {
+                    for (k = 0; k < 3; ++k) {
+                        kappa_out[i][j][k] += cv * vel[ik][is][j] * mfd[ik * ns + is][i][k];
+                    }
+                }
+            }
+        }
+
+        for (j = 0; j < 3; ++j) {
+            for (k = 0; k < 3; ++k) kappa_out[i][j][k] *= factor_toSI;
+        }
+    }
+}
+
 void Conductivity::average_self_energy_at_degenerate_point(const int n,
                                                            const int m,
                                                            double **damping)
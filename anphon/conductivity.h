@@ -11,8 +11,11 @@
 #pragma once
 
 #include "pointers.h"
+#include "relaxation.h"
 #include <vector>
 #include <set>
+#include <string>
+#include <fstream>
 
 namespace PHON_NS
 {
@@ -24,7 +27,9 @@ namespace PHON_NS
         void setup_kappa();
         void prepare_restart();
         void calc_anharmonic_imagself();
+        void write_result();
         void compute_kappa();
+        void compute_kappa_bte();
         void finish_kappa();
 
         int calc_kappa_spec;
@@ -34,15 +39,51 @@ namespace PHON_NS
         double ***kappa_spec;
         double *Temperature;
 
+        // Iterative solution of the linearized BTE
+        bool solve_bte;
+        unsigned int bte_maxiter;
+        double bte_tolerance;
+        double ***kappa_bte;
+
     private:
         double ***vel;
         unsigned int nk, ns;
-        int nshift_restart;
-        std::vector<int> vks, vks_l, vks_done;
+        std::vector<int> vks, vks_done;
         std::set<int> vks_job;
 
+        // Binary checkpoint of damping3 used for restarting
+        std::string file_checkpoint;
+        std::ofstream ofs_checkpoint;
+        static const int checkpoint_version = 1;
+        static const char checkpoint_magic[9];
+
+        void set_checkpoint_metadata(int *, double *);
+        void create_checkpoint();
+        void append_checkpoint(const int, const double *);
+        bool load_checkpoint();
+        void write_result_frequency();
+
+        // Scattering weights of the modes computed on this MPI process,
+        // stored on disk for the iterative solution of the BTE
+        std::string file_bte_store;
+        std::ofstream ofs_bte_store;
+        std::vector<int> vks_bte_store;
+
+        void open_bte_store();
+        void write_bte_record(const int, const ScatteringRecord &);
+        void complete_bte_store();
+        void setup_kpoint_rotation(int *, int *, double ***);
+        void calc_mean_free_displacement(double **, double ***,
+                                         const int *, const int *, double ***,
+                                         double ***);
+        void calc_scattering_term(const int *, double **, double ***, double ***);
+        void calc_kappa_from_mean_free_displacement(const int *, double ***, double ***);
+
+        void sort_jobs_by_cost(std::vector<int> &, std::vector<int> &);
+        void store_damping_mode(const int, const double *, int &);
+        void receive_damping_mode(const bool, double *, int &);
+        void calc_damping_mode(const int, double *);
         void write_result_gamma(const unsigned int,
-                                const unsigned int,
                                 double ***,
                                 double **);
         void average_self_energy_at_degenerate_point(const int,
@@ -20,6 +20,8 @@
 #include "fcs_phonon.h"
 #include <iomanip>
 #include <fstream>
+#include <map>
+#include <algorithm>
 #include "timer.h"
 #include "error.h"
 #include "symmetry_core.h"
@@ -27,11 +29,16 @@
 #include "write_phonons.h"
 #include "phonon_dos.h"
 #include "gruneisen.h"
+#include "fft.h"
 
 using namespace PHON_NS;
 
 Dynamical::Dynamical(PHON *phon): Pointers(phon)
 {
+    evec_shared = false;
+    nfc2_block = 0;
+    fc2_block_vec = NULL;
+    fc2_block = NULL;
 }
 
 Dynamical::~Dynamical()
@@ -132,13 +139,19 @@ void PHON_NS::Dynamical::finish_dynamical()
     memory->deallocate(xshift_s);
 
     if (kpoint->kpoint_mode < 3) {
-        memory->deallocate(evec_phonon);
+        deallocate_evec_phonon();
         memory->deallocate(eval_phonon);
     }
 
     if (nonanalytic) {
         memory->deallocate(borncharge);
     }
+
+    if (fc2_block) {
+        memory->deallocate(fc2_block_vec);
+        memory->deallocate(fc2_block);
+        nfc2_block = 0;
+    }
 }
 
 
@@ -232,7 +245,7 @@ double Dynamical::distance(double *x1, double *x2)
 }
 
 
-void Dynamical::eval_k(double *xk_in, double *kvec_in, std::vector<FcsClassExtent> fc2_ext,
+void Dynamical::eval_k(double *xk_in, double *kvec_in, const std::vector<FcsClassExtent> &fc2_ext,
                        double *eval_out, std::complex<double> **evec_out, bool require_evec)
 {
     // Calculate phonon energy for the specific k-point given in fractional basis
@@ -330,7 +343,7 @@ void Dynamical::eval_k(double *xk_in, double *kvec_in, std::vector<FcsClassExten
 
 
 void Dynamical::calc_analytic_k(double *xk_in,
-                                std::vector<FcsClassExtent> fc2_in,
+                                const std::vector<FcsClassExtent> &fc2_in,
                                 std::complex<double> **dymat_out)
 {
     int i, j;
@@ -486,7 +499,7 @@ void Dynamical::calc_nonanalytic_k(double *xk_in,
 
 
 void Dynamical::calc_nonanalytic_k2(double *xk_in, double *kvec_na_in,
-                                    std::vector<FcsClassExtent> fc2_in,
+                                    const std::vector<FcsClassExtent> &fc2_in,
                                     std::complex<double> **dymat_na_out)
 {
     // Calculate the non-analytic part of dynamical matrices 
@@ -606,33 +619,457 @@ void Dynamical::diagonalize_dynamical_all()
     memory->allocate(eval_phonon, nk, neval);
     if (eigenvectors) {
         require_evec = true;
-        memory->allocate(evec_phonon, nk, neval, neval);
+        allocate_evec_phonon(nk, neval, neval);
     } else {
         require_evec = false;
-        memory->allocate(evec_phonon, nk, 1, 1);
+        allocate_evec_phonon(nk, 1, 1);
     }
 
-    // Calculate phonon eigenvalues and eigenvectors for all k-points
+    // When the eigenvectors are shared within a node, only the first process
+    // of the node diagonalizes the dynamical matrices.
+
+    if (evec_shared) MPI_Win_fence(0, evec_window);
+
+    if (!evec_shared || mympi->my_rank_node == 0) {
+
+        // Calculate phonon eigenvalues and eigenvectors for all k-points
+
+        if (setup_fc2_block(fcs_phonon->fc2_ext)) {
+
+            if (!diagonalize_dynamical_fft(nk, kpoint->xk, kpoint->kvec_na,
+                                           eval_phonon, evec_phonon, require_evec)) {
+                diagonalize_dynamical_batch(nk, kpoint->xk, kpoint->kvec_na,
+                                            eval_phonon, evec_phonon, require_evec);
+            }
+
+        } else {
+
 #ifdef _OPENMP
-#pragma omp parallel for private (is)
+#pragma omp parallel for
 #endif
-    for (ik = 0; ik < nk; ++ik) {
-
-        eval_k(kpoint->xk[ik], kpoint->kvec_na[ik], fcs_phonon->fc2_ext,
-               eval_phonon[ik], evec_phonon[ik], require_evec);
+            for (ik = 0; ik < static_cast<int>(nk); ++ik) {
+                eval_k(kpoint->xk[ik], kpoint->kvec_na[ik], fcs_phonon->fc2_ext,
+                       eval_phonon[ik], evec_phonon[ik], require_evec);
+            }
+        }
 
         // Phonon energy is the square-root of the eigenvalue 
-        for (is = 0; is < neval; ++is) {
-            eval_phonon[ik][is] = freq(eval_phonon[ik][is]);
+        for (ik = 0; ik < static_cast<int>(nk); ++ik) {
+            for (is = 0; is < neval; ++is) {
+                eval_phonon[ik][is] = freq(eval_phonon[ik][is]);
+            }
         }
     }
 
+    if (evec_shared) {
+        MPI_Win_fence(0, evec_window);
+        MPI_Bcast(&eval_phonon[0][0], nk * neval, MPI_DOUBLE, 0, mympi->comm_node);
+    }
+
     if (mympi->my_rank == 0) {
         std::cout << "done!" << std::endl;
     }
 }
 
 
+void Dynamical::allocate_evec_phonon(const unsigned int n1,
+                                     const unsigned int n2,
+                                     const unsigned int n3)
+{
+    // Allocate evec_phonon[n1][n2][n3] with the same layout as memory->allocate.
+    // If several processes run on a node, the data is placed once in an MPI-3
+    // shared memory window and every process of the node points into it,
+    // so that the memory usage per node does not grow with the number of processes.
+
+    evec_shared = false;
+
+#if MPI_VERSION >= 3
+    if (mympi->nprocs_node > 1 && n2 * n3 > 1) {
+
+        unsigned int i, j;
+        int disp_unit;
+        MPI_Aint nbytes;
+        std::complex<double> *base;
+
+        nbytes = (mympi->my_rank_node == 0)
+                     ? static_cast<MPI_Aint>(n1) * n2 * n3 * sizeof(std::complex<double>)
+                     : 0;
+
+        MPI_Win_allocate_shared(nbytes, sizeof(std::complex<double>), MPI_INFO_NULL,
+                                mympi->comm_node, &base, &evec_window);
+        MPI_Win_shared_query(evec_window, 0, &nbytes, &disp_unit, &base);
+
+        evec_phonon = new std::complex<double> **[n1];
+        evec_phonon[0] = new std::complex<double> *[n1 * n2];
+        for (i = 0; i < n1; ++i) {
+            evec_phonon[i] = evec_phonon[0] + i * n2;
+            for (j = 0; j < n2; ++j) {
+                evec_phonon[i][j] = base + (static_cast<std::size_t>(i) * n2 + j) * n3;
+            }
+        }
+        evec_shared = true;
+        return;
+    }
+#endif
+
+    memory->allocate(evec_phonon, n1, n2, n3);
+}
+
+
+void Dynamical::deallocate_evec_phonon()
+{
+    if (evec_shared) {
+        delete [] evec_phonon[0];
+        delete [] evec_phonon;
+        MPI_Win_free(&evec_window);
+        evec_shared = false;
+    } else {
+        memory->deallocate(evec_phonon);
+    }
+}
+
+
+bool Dynamical::setup_fc2_block(const std::vector<FcsClassExtent> &fc2_in)
+{
+    // Group the harmonic force constants by the lattice vector connecting
+    // the two atoms so that D(k) = sum_R D(R) exp(i R.k) can be evaluated
+    // for many k points at once by a matrix-matrix product.
+    // Returns false if some relative vector is not a lattice vector of the primitive cell.
+
+    unsigned int i;
+    unsigned int ib;
+    unsigned int atm1_s, atm2_s;
+    unsigned int atm1_p, atm2_p;
+    unsigned int icell;
+    unsigned int nmode = neval;
+    unsigned int nmode2 = nmode * nmode;
+    double vec[3], xtmp;
+    std::vector<int> ivec(3);
+    std::map<std::vector<int>, unsigned int> block_index;
+    std::vector<std::vector<int> > block_vec;
+    std::vector<unsigned int> ielem;
+
+    if (fc2_block) return true;
+
+    ielem.reserve(fc2_in.size());
+
+    for (std::vector<FcsClassExtent>::const_iterator it = fc2_in.begin();
+         it != fc2_in.end(); ++it) {
+
+        atm2_s = (*it).atm2;
+        icell = (*it).cell_s;
+        atm2_p = system->map_s2p[atm2_s].atom_num;
+
+        for (i = 0; i < 3; ++i) {
+            vec[i] = system->xr_s[atm2_s][i] + xshift_s[icell][i]
+                - system->xr_s[system->map_p2s[atm2_p][0]][i];
+        }
+
+        rotvec(vec, vec, system->lavec_s);
+        rotvec(vec, vec, system->rlavec_p);
+
+        for (i = 0; i < 3; ++i) {
+            xtmp = vec[i] / (2.0 * pi);
+            ivec[i] = nint(xtmp);
+            if (std::abs(xtmp - static_cast<double>(ivec[i])) > eps6) return false;
+        }
+
+        std::map<std::vector<int>, unsigned int>::const_iterator itr = block_index.find(ivec);
+        if (itr == block_index.end()) {
+            ib = block_vec.size();
+            block_index.insert(std::make_pair(ivec, ib));
+            block_vec.push_back(ivec);
+        } else {
+            ib = (*itr).second;
+        }
+        ielem.push_back(ib);
+    }
+
+    nfc2_block = block_vec.size();
+    if (nfc2_block == 0) return false;
+
+    memory->allocate(fc2_block_vec, nfc2_block, 3);
+    memory->allocate(fc2_block, nfc2_block * nmode2);
+
+    for (ib = 0; ib < nfc2_block; ++ib) {
+        for (i = 0; i < 3; ++i) {
+            fc2_block_vec[ib][i] = 2.0 * pi * static_cast<double>(block_vec[ib][i]);
+        }
+    }
+    for (i = 0; i < nfc2_block * nmode2; ++i) {
+        fc2_block[i] = std::complex<double>(0.0, 0.0);
+    }
+
+    i = 0;
+    for (std::vector<FcsClassExtent>::const_iterator it = fc2_in.begin();
+         it != fc2_in.end(); ++it) {
+
+        atm1_p = (*it).atm1;
+        atm2_s = (*it).atm2;
+        atm1_s = system->map_p2s[atm1_p][0];
+        atm2_p = system->map_s2p[atm2_s].atom_num;
+
+        fc2_block[ielem[i++] * nmode2 + 3 * atm1_p + (*it).xyz1 + (3 * atm2_p + (*it).xyz2) * nmode]
+            += (*it).fcs_val / std::sqrt(system->mass[atm1_s] * system->mass[atm2_s]);
+    }
+
+    return true;
+}
+
+
+void Dynamical::diagonalize_dynamical_batch(const unsigned int nk_in,
+                                            double **xk_in,
+                                            double **kvec_in,
+                                            double **eval_out,
+                                            std::complex<double> ***evec_out,
+                                            bool require_evec)
+{
+    // Evaluate the dynamical matrices of a batch of k points as
+    // D[nmode^2][nbatch] = fc2_block[nmode^2][nblock] * phase[nblock][nbatch]
+    // and diagonalize them. Each thread keeps its own work arrays.
+
+    int ibatch;
+    int nmode = neval;
+    int nmode2 = nmode * nmode;
+    int nblock = nfc2_block;
+    int nbatch_max, nbatch_tot;
+    std::size_t ntmp;
+
+    // Keep the batched dynamical matrices of a thread within ~8 MB.
+    ntmp = 8 * 1024 * 1024 / (sizeof(std::complex<double>) * nmode2);
+    nbatch_max = std::max<int>(1, std::min<int>(64, ntmp));
+    nbatch_tot = (nk_in + nbatch_max - 1) / nbatch_max;
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        int ik, kb, ib, nb;
+        int LWORK = (2 * nmode - 1) * 10;
+        char TRANSA = 'N', TRANSB = 'N';
+        double phase;
+        double *RWORK;
+        std::complex<double> *WORK;
+        std::complex<double> *phase_mat, *dmat;
+        std::complex<double> **dymat_na_k = NULL;
+        std::complex<double> im(0.0, 1.0);
+        std::complex<double> alpha(1.0, 0.0), beta(0.0, 0.0);
+
+        memory->allocate(RWORK, 3 * nmode - 2);
+        memory->allocate(WORK, LWORK);
+        memory->allocate(phase_mat, nblock * nbatch_max);
+        memory->allocate(dmat, nmode2 * nbatch_max);
+        if (nonanalytic) memory->allocate(dymat_na_k, nmode, nmode);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for (ibatch = 0; ibatch < nbatch_tot; ++ibatch) {
+
+            nb = std::min<int>(nbatch_max, nk_in - ibatch * nbatch_max);
+
+            for (kb = 0; kb < nb; ++kb) {
+                ik = ibatch * nbatch_max + kb;
+                for (ib = 0; ib < nblock; ++ib) {
+                    phase = fc2_block_vec[ib][0] * xk_in[ik][0]
+                        + fc2_block_vec[ib][1] * xk_in[ik][1]
+                        + fc2_block_vec[ib][2] * xk_in[ik][2];
+                    phase_mat[kb * nblock + ib] = std::exp(im * phase);
+                }
+            }
+
+            zgemm_(&TRANSA, &TRANSB, &nmode2, &nb, &nblock, &alpha,
+                   fc2_block, &nmode2, phase_mat, &nblock, &beta, dmat, &nmode2);
+
+            for (kb = 0; kb < nb; ++kb) {
+                ik = ibatch * nbatch_max + kb;
+                diagonalize_dymat_k(xk_in[ik], kvec_in[ik], dmat + kb * nmode2,
+                                    eval_out[ik], evec_out[ik], require_evec,
+                                    WORK, LWORK, RWORK, dymat_na_k);
+            }
+        }
+
+        memory->deallocate(RWORK);
+        memory->deallocate(WORK);
+        memory->deallocate(phase_mat);
+        memory->deallocate(dmat);
+        if (nonanalytic) memory->deallocate(dymat_na_k);
+    }
+}
+
+
+bool Dynamical::diagonalize_dynamical_fft(const unsigned int nk_in,
+                                          double **xk_in,
+                                          double **kvec_in,
+                                          double **eval_out,
+                                          std::complex<double> ***evec_out,
+                                          bool require_evec)
+{
+    // When all k points lie on the uniform mesh, the dynamical matrices
+    // D(k) = sum_R D(R) exp(i R.k) are obtained at once by a 3D FFT of
+    // the blocks D(R) folded into the mesh (R -> R mod N).
+    // All periodic images of a pair (mindist_list) are already contained
+    // in fc2_ext with their weights, so the folding is exact.
+    // Returns false if the k points are not on the mesh.
+
+    int ik;
+    unsigned int i, ib, ic;
+    unsigned int n[3];
+    unsigned int nmode = neval;
+    unsigned int nmode2 = nmode * nmode;
+    unsigned int nmesh;
+    int *kindex;
+    double xtmp;
+    std::complex<double> *dmat_mesh;
+    FFT3D fft;
+
+    if (kpoint->kpoint_mode != 2) return false;
+
+    n[0] = kpoint->nkx;
+    n[1] = kpoint->nky;
+    n[2] = kpoint->nkz;
+    nmesh = n[0] * n[1] * n[2];
+
+    if (nk_in != nmesh) return false;
+
+    // The folded blocks for all mesh points must fit in the memory (~1 GB).
+    if (static_cast<double>(nmode2) * static_cast<double>(nmesh)
+        * sizeof(std::complex<double>) > 1.0e+9) {
+        return false;
+    }
+
+    memory->allocate(kindex, nk_in);
+
+    for (ik = 0; ik < static_cast<int>(nk_in); ++ik) {
+        int m[3];
+        for (i = 0; i < 3; ++i) {
+            xtmp = xk_in[ik][i] * static_cast<double>(n[i]);
+            m[i] = nint(xtmp);
+            if (std::abs(xtmp - static_cast<double>(m[i])) > eps6) {
+                memory->deallocate(kindex);
+                return false;
+            }
+            m[i] = ((m[i] % static_cast<int>(n[i])) + n[i]) % n[i];
+        }
+        kindex[ik] = m[2] + n[2] * (m[1] + n[1] * m[0]);
+    }
+
+    // dmat_mesh[ic][imesh] with ic = i + j * nmode
+    memory->allocate(dmat_mesh, nmode2 * nmesh);
+    for (i = 0; i < nmode2 * nmesh; ++i) {
+        dmat_mesh[i] = std::complex<double>(0.0, 0.0);
+    }
+
+    for (ib = 0; ib < nfc2_block; ++ib) {
+        int m[3];
+        for (i = 0; i < 3; ++i) {
+            m[i] = nint(fc2_block_vec[ib][i] / (2.0 * pi));
+            m[i] = ((m[i] % static_cast<int>(n[i])) + n[i]) % n[i];
+        }
+        const unsigned int imesh = m[2] + n[2] * (m[1] + n[1] * m[0]);
+        for (ic = 0; ic < nmode2; ++ic) {
+            dmat_mesh[ic * nmesh + imesh] += fc2_block[ib * nmode2 + ic];
+        }
+    }
+
+    fft.setup(n[0], n[1], n[2]);
+    fft.execute(dmat_mesh, nmode2, 1);
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        int LWORK = (2 * nmode - 1) * 10;
+        double *RWORK;
+        std::complex<double> *WORK, *amat;
+        std::complex<double> **dymat_na_k = NULL;
+
+        memory->allocate(RWORK, 3 * nmode - 2);
+        memory->allocate(WORK, LWORK);
+        memory->allocate(amat, nmode2);
+        if (nonanalytic) memory->allocate(dymat_na_k, nmode, nmode);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for (ik = 0; ik < static_cast<int>(nk_in); ++ik) {
+            for (unsigned int jc = 0; jc < nmode2; ++jc) {
+                amat[jc] = dmat_mesh[jc * nmesh + kindex[ik]];
+            }
+            diagonalize_dymat_k(xk_in[ik], kvec_in[ik], amat,
+                                eval_out[ik], evec_out[ik], require_evec,
+                                WORK, LWORK, RWORK, dymat_na_k);
+        }
+
+        memory->deallocate(RWORK);
+        memory->deallocate(WORK);
+        memory->deallocate(amat);
+        if (nonanalytic) memory->deallocate(dymat_na_k);
+    }
+
+    memory->deallocate(dmat_mesh);
+    memory->deallocate(kindex);
+
+    return true;
+}
+
+
+void Dynamical::diagonalize_dymat_k(double *xk_in,
+                                    double *kvec_in,
+                                    std::complex<double> *amat,
+                                    double *eval_out,
+                                    std::complex<double> **evec_out,
+                                    bool require_evec,
+                                    std::complex<double> *WORK,
+                                    int LWORK,
+                                    double *RWORK,
+                                    std::complex<double> **dymat_na_k)
+{
+    // Diagonalize the analytic part of the dynamical matrix amat (column-major)
+    // after adding the non-analytic correction. amat is overwritten.
+
+    int i, j;
+    int INFO;
+    int nmode = neval;
+    char JOBZ = require_evec ? 'V' : 'N';
+
+    if (nonanalytic) {
+        if (nonanalytic == 1) {
+            calc_nonanalytic_k(xk_in, kvec_in, dymat_na_k);
+        } else if (nonanalytic == 2) {
+            calc_nonanalytic_k2(xk_in, kvec_in, fcs_phonon->fc2_ext, dymat_na_k);
+        }
+        for (j = 0; j < nmode; ++j) {
+            for (i = 0; i < nmode; ++i) {
+                amat[i + j * nmode] += dymat_na_k[i][j];
+            }
+        }
+    }
+
+    // Force the dynamical matrix be real when k point is
+    // zone-center or zone-boundaries.
+
+    if (std::sqrt(std::pow(std::fmod(xk_in[0], 0.5), 2.0)
+        + std::pow(std::fmod(xk_in[1], 0.5), 2.0)
+        + std::pow(std::fmod(xk_in[2], 0.5), 2.0)) < eps) {
+        for (i = 0; i < nmode * nmode; ++i) {
+            amat[i] = std::complex<double>(amat[i].real(), 0.0);
+        }
+    }
+
+    zheev_(&JOBZ, &UPLO, &nmode, amat, &nmode, eval_out,
+           WORK, &LWORK, RWORK, &INFO);
+
+    if (eigenvectors && require_evec) {
+        for (j = 0; j < nmode; ++j) {
+            for (i = 0; i < nmode; ++i) {
+                evec_out[j][i] = amat[i + j * nmode];
+            }
+        }
+    }
+}
+
+
 void Dynamical::modify_eigenvectors()
 {
     bool *flag_done;
@@ -656,6 +1093,14 @@ void Dynamical::modify_eigenvectors()
 
     for (ik = 0; ik < nk; ++ik) flag_done[ik] = false;
 
+    // The shared eigenvectors are modified by the first process of each node.
+    if (evec_shared) {
+        MPI_Win_fence(0, evec_window);
+        if (mympi->my_rank_node != 0) {
+            for (ik = 0; ik < nk; ++ik) flag_done[ik] = true;
+        }
+    }
+
     for (ik = 0; ik < nk; ++ik) {
 
         if (!flag_done[ik]) {
@@ -683,6 +1128,8 @@ void Dynamical::modify_eigenvectors()
     memory->deallocate(flag_done);
     memory->deallocate(evec_tmp);
 
+    if (evec_shared) MPI_Win_fence(0, evec_window);
+
     MPI_Barrier(MPI_COMM_WORLD);
     if (mympi->my_rank == 0) {
         std::cout << " done !" << std::endl;
@@ -11,6 +11,7 @@
 #pragma once
 
 #include "pointers.h"
+#include "mpi_common.h"
 #include "fcs_phonon.h"
 #include <vector>
 #include <complex>
@@ -58,12 +59,13 @@ namespace PHON_NS
         double na_sigma;
 
         double **eval_phonon;
-        std::complex<double> ***evec_phonon;
+        std::complex<double> ***evec_phonon; // shared by the processes of a node if evec_shared
+        bool evec_shared;
 
         void setup_dynamical(std::string);
 
         void eval_k(double *, double *,
-                    std::vector<FcsClassExtent>,
+                    const std::vector<FcsClassExtent> &,
                     double *, std::complex<double> **, bool);
         void modify_eigenvectors();
 
@@ -78,12 +80,22 @@ namespace PHON_NS
 
         void load_born();
         void calc_analytic_k(double *,
-                             std::vector<FcsClassExtent>,
+                             const std::vector<FcsClassExtent> &,
                              std::complex<double> **);
         void calc_nonanalytic_k(double *, double *,
                                 std::complex<double> **);
         void calc_nonanalytic_k2(double *, double *,
-                                 std::vector<FcsClassExtent>,
+                                 const std::vector<FcsClassExtent> &,
+                                 std::complex<double> **);
+
+        bool setup_fc2_block(const std::vector<FcsClassExtent> &);
+        void diagonalize_dynamical_batch(const unsigned int, double **, double **,
+                                         double **, std::complex<double> ***, bool);
+        bool diagonalize_dynamical_fft(const unsigned int, double **, double **,
+                                       double **, std::complex<double> ***, bool);
+        void diagonalize_dymat_k(double *, double *, std::complex<double> *,
+                                 double *, std::complex<double> **, bool,
+                                 std::complex<double> *, int, double *,
                                  std::complex<double> **);
 
         void prepare_mindist_list(std::vector<int> **);
@@ -100,6 +112,18 @@ namespace PHON_NS
         double ***borncharge;
 
         std::vector<int> **mindist_list;
+
+        MPI_Win evec_window;
+
+        void allocate_evec_phonon(const unsigned int, const unsigned int, const unsigned int);
+        void deallocate_evec_phonon();
+
+        // Harmonic force constants grouped by the lattice vector of the primitive cell.
+        // fc2_block[ib * neval * neval + i + j * neval] is the mass-weighted (i,j) element
+        // of the ib-th block, and its phase factor is exp(i * fc2_block_vec[ib] . xk).
+        unsigned int nfc2_block;
+        double **fc2_block_vec;
+        std::complex<double> *fc2_block;
     };
 
     extern "C"
@@ -109,6 +133,9 @@ namespace PHON_NS
         void zgemm_(const char *transa, const char *transb, int *m, int *n, int *k,
                     std::complex<double> *alpha, std::complex<double> *a, int *lda, std::complex<double> *b, int *ldb,
                     std::complex<double> *beta, std::complex<double> *c, int *ldc);
+        void cgemm_(const char *transa, const char *transb, int *m, int *n, int *k,
+                    std::complex<float> *alpha, std::complex<float> *a, int *lda, std::complex<float> *b, int *ldb,
+                    std::complex<float> *beta, std::complex<float> *c, int *ldc);
     }
 }
 
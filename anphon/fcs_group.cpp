@@ -0,0 +1,197 @@
+/*
+ fcs_group.cpp
+
+ Copyright (c) 2026 Terumasa Tadano
+
+ This file is distributed under the terms of the MIT license.
+ Please see the file 'LICENCE.txt' in the root directory
+ or http://opensource.org/licenses/mit-license.php for information.
+*/
+
+#include "fcs_group.h"
+#include "constants.h"
+#include "mathfunctions.h"
+#include <cmath>
+#include <cstring>
+#include <string>
+
+using namespace PHON_NS;
+
+FcsGroupArray::FcsGroupArray()
+{
+    order = 0;
+    ngroup = 0;
+    nelem = 0;
+    fcs = 0;
+    relvec = 0;
+    lattice_vec = 0;
+    has_lattice_vec = false;
+    group_start = 0;
+    evec_index = 0;
+    invmass = 0;
+}
+
+FcsGroupArray::~FcsGroupArray()
+{
+    deallocate();
+}
+
+template <typename T>
+T *FcsGroupArray::allocate_aligned(const std::size_t n)
+{
+    char *raw = new char[n * sizeof(T) + alignment];
+    std::size_t addr = reinterpret_cast<std::size_t>(raw);
+
+    raw_buffers.push_back(raw);
+    addr = (addr + alignment - 1) / alignment * alignment;
+
+    return reinterpret_cast<T *>(addr);
+}
+
+void FcsGroupArray::allocate(const unsigned int order_in,
+                             const unsigned int ngroup_in,
+                             const unsigned int nelem_in)
+{
+    deallocate();
+
+    order = order_in;
+    ngroup = ngroup_in;
+    nelem = nelem_in;
+
+    fcs = allocate_aligned<double>(nelem);
+    relvec = allocate_aligned<double>(3 * (order - 1) * nelem);
+    lattice_vec = allocate_aligned<int>(3 * (order - 1) * nelem);
+    group_start = allocate_aligned<int>(ngroup + 1);
+    evec_index = allocate_aligned<int>(order * ngroup);
+    invmass = allocate_aligned<double>(ngroup);
+    has_lattice_vec = false;
+}
+
+void FcsGroupArray::deallocate()
+{
+    for (std::vector<char *>::iterator it = raw_buffers.begin(); it != raw_buffers.end(); ++it) {
+        delete [] *it;
+    }
+    raw_buffers.clear();
+
+    ngroup = 0;
+    nelem = 0;
+    fcs = 0;
+    relvec = 0;
+    lattice_vec = 0;
+    has_lattice_vec = false;
+    group_start = 0;
+    evec_index = 0;
+    invmass = 0;
+}
+
+void FcsGroupArray::set_lattice_vector()
+{
+    // The relative vectors are 2pi times lattice vectors of the primitive cell.
+    // Store them as integers if this holds for all the elements.
+
+    unsigned int i;
+    const unsigned int n = 3 * (order - 1) * nelem;
+    double xtmp;
+    double inv2pi = 1.0 / (2.0 * pi);
+
+    has_lattice_vec = true;
+
+    for (i = 0; i < n; ++i) {
+        xtmp = relvec[i] * inv2pi;
+        lattice_vec[i] = nint(xtmp);
+        if (std::abs(xtmp - static_cast<double>(lattice_vec[i])) > eps6) {
+            has_lattice_vec = false;
+            break;
+        }
+    }
+}
+
+void FcsGroupArray::serialize(std::vector<char> &buf) const
+{
+    // Layout: magic[8], order, ngroup, nelem, has_lattice_vec,
+    // fcs, relvec, lattice_vec, group_start, evec_index, invmass, checksum
+
+    unsigned int header[4];
+    unsigned int hash;
+    std::size_t pos;
+    const std::size_t nvec = 3 * (order - 1) * nelem;
+    const std::size_t nbytes = 8 + sizeof(header)
+        + sizeof(double) * (nelem + nvec + ngroup)
+        + sizeof(int) * (nvec + ngroup + 1 + order * ngroup)
+        + sizeof(unsigned int);
+
+    header[0] = order;
+    header[1] = ngroup;
+    header[2] = nelem;
+    header[3] = has_lattice_vec ? 1 : 0;
+
+    buf.resize(nbytes);
+    pos = 0;
+
+    std::memcpy(&buf[pos], "ANPHFCG1", 8);
+    pos += 8;
+    std::memcpy(&buf[pos], header, sizeof(header));
+    pos += sizeof(header);
+    std::memcpy(&buf[pos], fcs, sizeof(double) * nelem);
+    pos += sizeof(double) * nelem;
+    std::memcpy(&buf[pos], relvec, sizeof(double) * nvec);
+    pos += sizeof(double) * nvec;
+    std::memcpy(&buf[pos], lattice_vec, sizeof(int) * nvec);
+    pos += sizeof(int) * nvec;
+    std::memcpy(&buf[pos], group_start, sizeof(int) * (ngroup + 1));
+    pos += sizeof(int) * (ngroup + 1);
+    std::memcpy(&buf[pos], evec_index, sizeof(int) * order * ngroup);
+    pos += sizeof(int) * order * ngroup;
+    std::memcpy(&buf[pos], invmass, sizeof(double) * ngroup);
+    pos += sizeof(double) * ngroup;
+
+    hash = fnv1a_hash(&buf[0], pos);
+    std::memcpy(&buf[pos], &hash, sizeof(unsigned int));
+}
+
+bool FcsGroupArray::deserialize(const std::vector<char> &buf)
+{
+    // Returns false if the buffer is not a valid serialized FcsGroupArray.
+
+    unsigned int header[4];
+    unsigned int hash;
+    std::size_t pos, nvec;
+
+    if (buf.size() < 8 + sizeof(header) + sizeof(unsigned int)) return false;
+    if (std::string(&buf[0], 8) != "ANPHFCG1") return false;
+
+    std::memcpy(header, &buf[8], sizeof(header));
+
+    if (header[0] < 2) return false;
+    nvec = 3 * (header[0] - 1) * static_cast<std::size_t>(header[2]);
+
+    if (buf.size() != 8 + sizeof(header)
+        + sizeof(double) * (header[2] + nvec + header[1])
+        + sizeof(int) * (nvec + header[1] + 1 + header[0] * header[1])
+        + sizeof(unsigned int)) {
+        return false;
+    }
+
+    pos = buf.size() - sizeof(unsigned int);
+    std::memcpy(&hash, &buf[pos], sizeof(unsigned int));
+    if (hash != fnv1a_hash(&buf[0], pos)) return false;
+
+    allocate(header[0], header[1], header[2]);
+    has_lattice_vec = (header[3] == 1);
+
+    pos = 8 + sizeof(header);
+    std::memcpy(fcs, &buf[pos], sizeof(double) * nelem);
+    pos += sizeof(double) * nelem;
+    std::memcpy(relvec, &buf[pos], sizeof(double) * nvec);
+    pos += sizeof(double) * nvec;
+    std::memcpy(lattice_vec, &buf[pos], sizeof(int) * nvec);
+    pos += sizeof(int) * nvec;
+    std::memcpy(group_start, &buf[pos], sizeof(int) * (ngroup + 1));
+    pos += sizeof(int) * (ngroup + 1);
+    std::memcpy(evec_index, &buf[pos], sizeof(int) * order * ngroup);
+    pos += sizeof(int) * order * ngroup;
+    std::memcpy(invmass, &buf[pos], sizeof(double) * ngroup);
+
+    return true;
+}
@@ -0,0 +1,59 @@
+/*
+ fcs_group.h
+
+ Copyright (c) 2026 Terumasa Tadano
+
+ This file is distributed under the terms of the MIT license.
+ Please see the file 'LICENCE.txt' in the root directory
+ or http://opensource.org/licenses/mit-license.php for information.
+*/
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+namespace PHON_NS
+{
+    // Anharmonic force constants grouped by the atomic indices (evec_index),
+    // stored as contiguous arrays (structure of arrays) for V3 and V4.
+    // The elements of group i are in [group_start[i], group_start[i + 1]).
+    // All arrays are aligned to 64-byte boundaries.
+
+    class FcsGroupArray
+    {
+    public:
+        FcsGroupArray();
+        ~FcsGroupArray();
+
+        unsigned int order;        // Number of phonons in the vertex (3 or 4)
+        unsigned int ngroup;
+        unsigned int nelem;
+
+        double *fcs;               // [nelem]
+        double *relvec;            // [nelem][order - 1][3] : 2pi * lattice vectors
+        int *lattice_vec;          // [nelem][order - 1][3] : lattice vectors in integer
+        bool has_lattice_vec;      // true if relvec / 2pi is integral for all elements
+        int *group_start;          // [ngroup + 1]
+        int *evec_index;           // [ngroup][order]
+        double *invmass;           // [ngroup] : 1 / sqrt(m_1 * ... * m_order)
+
+        void allocate(const unsigned int, const unsigned int, const unsigned int);
+        void deallocate();
+        void set_lattice_vector();
+
+        void serialize(std::vector<char> &) const;
+        bool deserialize(const std::vector<char> &);
+
+    private:
+        static const std::size_t alignment = 64;
+        std::vector<char *> raw_buffers;
+
+        // Not copyable since the object owns raw_buffers
+        FcsGroupArray(const FcsGroupArray &);
+        FcsGroupArray &operator=(const FcsGroupArray &);
+
+        template <typename T>
+        T *allocate_aligned(const std::size_t);
+    };
+}
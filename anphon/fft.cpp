@@ -0,0 +1,171 @@
+/*
+ fft.cpp
+
+ Copyright (c) 2026 Terumasa Tadano
+
+ This file is distributed under the terms of the MIT license.
+ Please see the file 'LICENCE.txt' in the root directory
+ or http://opensource.org/licenses/mit-license.php for information.
+*/
+
+#include "fft.h"
+#include "constants.h"
+#include <cmath>
+#include <algorithm>
+
+using namespace PHON_NS;
+
+FFT3D::FFT3D()
+{
+    for (int i = 0; i < 3; ++i) nsize[i] = 0;
+}
+
+FFT3D::~FFT3D()
+{
+}
+
+void FFT3D::setup(const unsigned int n1,
+                  const unsigned int n2,
+                  const unsigned int n3)
+{
+    unsigned int i, j;
+    double theta;
+
+    nsize[0] = n1;
+    nsize[1] = n2;
+    nsize[2] = n3;
+
+    for (i = 0; i < 3; ++i) {
+        factorize(nsize[i], factors[i]);
+        twiddle[i].resize(nsize[i]);
+        for (j = 0; j < nsize[i]; ++j) {
+            theta = 2.0 * pi * static_cast<double>(j) / static_cast<double>(nsize[i]);
+            twiddle[i][j] = std::complex<double>(std::cos(theta), std::sin(theta));
+        }
+    }
+}
+
+void FFT3D::factorize(const unsigned int n, std::vector<int> &factor_out) const
+{
+    unsigned int m = n;
+    unsigned int p = 2;
+
+    factor_out.clear();
+
+    while (m > 1) {
+        if (p * p > m) {
+            factor_out.push_back(m);
+            break;
+        }
+        if (m % p == 0) {
+            factor_out.push_back(p);
+            m /= p;
+        } else {
+            ++p;
+        }
+    }
+}
+
+void FFT3D::fft_1d(const std::complex<double> *in,
+                   const unsigned int stride,
+                   std::complex<double> *out,
+                   const unsigned int n,
+                   const unsigned int idim,
+                   const unsigned int ifac,
+                   const int sign,
+                   const int ntwiddle_step,
+                   std::complex<double> *work) const
+{
+    // Recursive decimation-in-time transform of length n = p * m.
+    // ntwiddle_step = N / n, where N is the full length along idim.
+
+    unsigned int j, k, q, r;
+    const unsigned int nfull = nsize[idim];
+    const unsigned int p = (ifac < factors[idim].size()) ? factors[idim][ifac] : 1;
+    std::complex<double> w, ctmp;
+
+    if (n == 1) {
+        out[0] = in[0];
+        return;
+    }
+
+    if (p == n) {
+        // Direct DFT for the last (prime) factor
+        for (k = 0; k < n; ++k) {
+            ctmp = std::complex<double>(0.0, 0.0);
+            for (j = 0; j < n; ++j) {
+                w = twiddle[idim][(j * k * ntwiddle_step) % nfull];
+                if (sign < 0) w = std::conj(w);
+                ctmp += w * in[j * stride];
+            }
+            out[k] = ctmp;
+        }
+        return;
+    }
+
+    const unsigned int m = n / p;
+
+    for (r = 0; r < p; ++r) {
+        fft_1d(in + r * stride, stride * p, out + r * m, m,
+               idim, ifac + 1, sign, ntwiddle_step * p, work);
+    }
+
+    for (k = 0; k < m; ++k) {
+        for (q = 0; q < p; ++q) {
+            ctmp = std::complex<double>(0.0, 0.0);
+            for (r = 0; r < p; ++r) {
+                w = twiddle[idim][(r * (k + q * m) * ntwiddle_step) % nfull];
+                if (sign < 0) w = std::conj(w);
+                ctmp += w * out[r * m + k];
+            }
+            work[q] = ctmp;
+        }
+        for (q = 0; q < p; ++q) out[k + q * m] = work[q];
+    }
+}
+
+void FFT3D::execute(std::complex<double> *data,
+                    const unsigned int nbatch,
+                    const int sign) const
+{
+    int ibatch;
+    const unsigned int ntot = nsize[0] * nsize[1] * nsize[2];
+    const unsigned int nmax = std::max(nsize[0], std::max(nsize[1], nsize[2]));
+
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+    {
+        unsigned int idim, i, j, iline, nline;
+        unsigned int n, stride, inner, start;
+        std::complex<double> *ptr;
+        std::vector<std::complex<double> > buf_in(nmax), buf_out(nmax), work(nmax);
+
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (ibatch = 0; ibatch < static_cast<int>(nbatch); ++ibatch) {
+
+            ptr = data + static_cast<std::size_t>(ibatch) * ntot;
+
+            for (idim = 0; idim < 3; ++idim) {
+                n = nsize[idim];
+                if (n == 1) continue;
+
+                stride = 1;
+                for (i = idim + 1; i < 3; ++i) stride *= nsize[i];
+                nline = ntot / n;
+
+                for (iline = 0; iline < nline; ++iline) {
+                    // Starting index of the iline-th line along idim
+                    inner = iline % stride;
+                    start = (iline / stride) * stride * n + inner;
+
+                    for (j = 0; j < n; ++j) buf_in[j] = ptr[start + j * stride];
+                    fft_1d(&buf_in[0], 1, &buf_out[0], n, idim, 0, sign, 1, &work[0]);
+                    for (j = 0; j < n; ++j) ptr[start + j * stride] = buf_out[j];
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,43 @@
+/*
+ fft.h
+
+ Copyright (c) 2026 Terumasa Tadano
+
+ This file is distributed under the terms of the MIT license.
+ Please see the file 'LICENCE.txt' in the root directory
+ or http://opensource.org/licenses/mit-license.php for information.
+*/
+
+#pragma once
+
+#include <vector>
+#include <complex>
+
+namespace PHON_NS
+{
+    // A lightweight mixed-radix FFT for 3D complex data of arbitrary size.
+    // execute() performs, for each of the nbatch data sets stored contiguously
+    // as data[ibatch][i1][i2][i3], the unnormalized transform
+    //   f(m1,m2,m3) = sum_{n} f(n1,n2,n3) exp(sign * 2 pi i (n1*m1/N1 + n2*m2/N2 + n3*m3/N3)).
+
+    class FFT3D
+    {
+    public:
+        FFT3D();
+        ~FFT3D();
+
+        void setup(const unsigned int, const unsigned int, const unsigned int);
+        void execute(std::complex<double> *, const unsigned int, const int) const;
+
+    private:
+        unsigned int nsize[3];
+        std::vector<int> factors[3];
+        std::vector<std::complex<double> > twiddle[3]; // exp(2 pi i j / N)
+
+        void factorize(const unsigned int, std::vector<int> &) const;
+        void fft_1d(const std::complex<double> *, const unsigned int,
+                    std::complex<double> *, const unsigned int,
+                    const unsigned int, const unsigned int, const int,
+                    const int, std::complex<double> *) const;
+    };
+}
@@ -58,11 +58,14 @@ Kpoint::~Kpoint()
     }
     if (small_group_of_k)
         memory->deallocate(small_group_of_k);
+    if (knum_sym_table)
+        memory->deallocate(knum_sym_table);
 }
 
 void Kpoint::kpoint_setups(std::string mode)
 {
     small_group_of_k = NULL;
+    knum_sym_table = NULL;
     symmetry->symmetry_flag = true;
 
     unsigned int i, j;
@@ -398,12 +401,13 @@ void PHON_NS::Kpoint::setup_kpoint_mesh(std::vector<KpointInp> &kpinfo,
 
         memory->allocate(xk, nk, 3);
         memory->allocate(kdirec, nk, 3);
+        memory->allocate(knum_sym_table, symmetry->nsym, nk);
 
         nk_tmp[0] = nkx;
         nk_tmp[1] = nky;
         nk_tmp[2] = nkz;
 
-        gen_kmesh(usesym, nk_tmp, xk, kp_irreducible);
+        gen_kmesh(usesym, nk_tmp, knum_sym_table, xk, kp_irreducible);
 
         for (i = 0; i < nk; ++i) {
             for (j = 0; j < 3; ++j) kdirec[i][j] = xk[i][j];
@@ -427,10 +431,12 @@ void PHON_NS::Kpoint::setup_kpoint_mesh(std::vector<KpointInp> &kpinfo,
     if (mympi->my_rank > 0) {
         memory->allocate(xk, nk, 3);
         memory->allocate(kdirec, nk, 3);
+        memory->allocate(knum_sym_table, symmetry->nsym, nk);
     }
 
     MPI_Bcast(&xk[0][0], 3 * nk, MPI_DOUBLE, 0, MPI_COMM_WORLD);
     MPI_Bcast(&kdirec[0][0], 3 * nk, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&knum_sym_table[0][0], symmetry->nsym * nk, MPI_INT, 0, MPI_COMM_WORLD);
 
     mpi_broadcast_kpoint_vector(kp_irreducible);
 }
@@ -570,6 +576,7 @@ void Kpoint::setup_kpoint_plane(std::vector<KpointInp> &kpinfo,
 
 void Kpoint::gen_kmesh(const bool usesym,
                        const unsigned int nk_in[3],
+                       int **perm,
                        double **xk_out,
                        std::vector<std::vector<KpointList> > &kplist_out)
 {
@@ -594,12 +601,14 @@ void Kpoint::gen_kmesh(const bool usesym,
         }
     }
 
+    gen_symmetry_permutation(nk_in, perm);
+
     if (usesym) {
         nsym = symmetry->SymmList.size();
     } else {
         nsym = 1;
     }
-    reduce_kpoints(nsym, xkr, nk_in, kplist_out);
+    reduce_kpoints(nsym, xkr, nk_in, perm, kplist_out);
 
     for (ik = 0; ik < nk_tot; ++ik) {
         for (i = 0; i < 3; ++i) {
@@ -613,14 +622,21 @@ void Kpoint::gen_kmesh(const bool usesym,
 void Kpoint::reduce_kpoints(const unsigned int nsym,
                             double **xkr,
                             const unsigned int nk_in[3],
+                            int **perm,
                             std::vector<std::vector<KpointList> > &kplist_out)
 {
+    // Group the k points into stars using the permutation table perm.
+    // The coordinates of the rotated k points are evaluated only for
+    // the k points newly added to a star.
+
     unsigned int ik;
     unsigned int i, j;
-    int nloc, isym;
+    int nloc, isym, itr;
+    int ntr;
     unsigned int nk_tot;
 
     bool *k_found;
+    int *kminus;
 
     std::vector<KpointList> k_group;
     std::vector<double> ktmp;
@@ -656,8 +672,22 @@ void Kpoint::reduce_kpoints(const unsigned int nsym,
 
     nk_tot = nk_in[0] * nk_in[1] * nk_in[2];
     memory->allocate(k_found, nk_tot);
+    memory->allocate(kminus, nk_tot);
+
+    for (ik = 0; ik < nk_tot; ++ik) {
+        k_found[ik] = false;
+        kminus[ik] = ((nk_in[2] - ik % nk_in[2]) % nk_in[2])
+            + nk_in[2] * ((nk_in[1] - (ik / nk_in[2]) % nk_in[1]) % nk_in[1])
+            + nk_in[1] * nk_in[2] * ((nk_in[0] - ik / (nk_in[1] * nk_in[2])) % nk_in[0]);
+    }
 
-    for (ik = 0; ik < nk_tot; ++ik) k_found[ik] = false;
+    // Time-reversal symmetry
+
+    if (symmetry->time_reversal_sym) {
+        ntr = 2;
+    } else {
+        ntr = 1;
+    }
 
     for (ik = 0; ik < nk_tot; ++ik) {
 
@@ -668,24 +698,25 @@ void Kpoint::reduce_kpoints(const unsigned int nsym,
         for (i = 0; i < 3; ++i) xk_orig[i] = xkr[ik][i];
 
         for (isym = 0; isym < nsym; ++isym) {
+            for (itr = 0; itr < ntr; ++itr) {
 
-            rotvec(xk_sym, xk_orig, symop_k[isym]);
-
-            for (i = 0; i < 3; ++i) xk_sym[i] = xk_sym[i] - nint(xk_sym[i]);
-
-            //            nloc = get_knum(xk_sym[0], xk_sym[1], xk_sym[2]);
+                nloc = perm[isym][ik];
 
-            nloc = get_knum(xk_sym, nk_in);
-
-
-            if (nloc == -1) {
-
-                error->exit("reduce_kpoints", "Cannot find the kpoint");
+                if (nloc == -1) {
+                    error->exit("reduce_kpoints", "Cannot find the kpoint");
+                }
 
-            } else {
+                if (itr == 1) nloc = kminus[nloc];
 
                 if (!k_found[nloc]) {
                     k_found[nloc] = true;
+
+                    rotvec(xk_sym, xk_orig, symop_k[isym]);
+                    for (i = 0; i < 3; ++i) xk_sym[i] = xk_sym[i] - nint(xk_sym[i]);
+                    if (itr == 1) {
+                        for (i = 0; i < 3; ++i) xk_sym[i] *= -1.0;
+                    }
+
                     ktmp.clear();
                     ktmp.push_back(xk_sym[0]);
                     ktmp.push_back(xk_sym[1]);
@@ -693,39 +724,99 @@ void Kpoint::reduce_kpoints(const unsigned int nsym,
 
                     k_group.push_back(KpointList(nloc, ktmp));
                 }
-
             }
+        }
+        kplist_out.push_back(k_group);
+    }
 
-            // Time-reversal symmetry
+    memory->deallocate(k_found);
+    memory->deallocate(kminus);
+    memory->deallocate(symop_k);
+}
 
-            if (symmetry->time_reversal_sym) {
+void Kpoint::gen_symmetry_permutation(const unsigned int nk_in[3],
+                                      int **perm)
+{
+    // perm[isym][ik] is the index of S(isym) * xk[ik] on the uniform mesh,
+    // or -1 if the rotated point is not on the mesh.
+    // For xk = (n1/N1, n2/N2, n3/N3), the rotated point xk' = (S^{-1})^T xk
+    // is evaluated with integer arithmetic as
+    //   N_i * xk'_i = sum_j M_ij * n_j * (L / N_j) / (L / N_i),
+    // where M = (S^{-1})^T and L is the least common multiple of N1, N2, and N3.
+
+    int isym, i, j;
+    int nsym = symmetry->nsym;
+    int nk_tot = nk_in[0] * nk_in[1] * nk_in[2];
+    int srot[3][3], srot_inv[3][3];
+    int ***symop_k;
+    long lcm_nk, a, b, r;
+    long fac[3];
+
+    lcm_nk = 1;
+    for (i = 0; i < 3; ++i) {
+        a = lcm_nk;
+        b = nk_in[i];
+        while (b != 0) {
+            r = a % b;
+            a = b;
+            b = r;
+        }
+        lcm_nk = lcm_nk / a * nk_in[i];
+    }
+    for (i = 0; i < 3; ++i) fac[i] = lcm_nk / nk_in[i];
 
-                for (i = 0; i < 3; ++i) xk_sym[i] *= -1.0;
-                //                nloc = get_knum(xk_sym[0], xk_sym[1], xk_sym[2]);
-                nloc = get_knum(xk_sym, nk_in);
+    memory->allocate(symop_k, nsym, 3, 3);
 
-                if (nloc == -1) {
+    for (isym = 0; isym < nsym; ++isym) {
+        for (i = 0; i < 3; ++i) {
+            for (j = 0; j < 3; ++j) {
+                srot[i][j] = symmetry->SymmList[isym].rot[i][j];
+            }
+        }
+        invmat3_i(srot_inv, srot);
 
-                    error->exit("reduce_kpoints", "Cannot find the kpoint");
+        for (i = 0; i < 3; ++i) {
+            for (j = 0; j < 3; ++j) {
+                symop_k[isym][i][j] = srot_inv[j][i];
+            }
+        }
+    }
 
-                } else {
+#ifdef _OPENMP
+#pragma omp parallel for private(isym, i, j)
+#endif
+    for (int ik = 0; ik < nk_tot; ++ik) {
+        long n_orig[3], num;
+        int n_sym[3];
+        bool on_mesh;
 
-                    if (!k_found[nloc]) {
-                        k_found[nloc] = true;
-                        ktmp.clear();
-                        ktmp.push_back(xk_sym[0]);
-                        ktmp.push_back(xk_sym[1]);
-                        ktmp.push_back(xk_sym[2]);
+        n_orig[0] = ik / (nk_in[1] * nk_in[2]);
+        n_orig[1] = (ik / nk_in[2]) % nk_in[1];
+        n_orig[2] = ik % nk_in[2];
 
-                        k_group.push_back(KpointList(nloc, ktmp));
-                    }
+        for (isym = 0; isym < nsym; ++isym) {
+            on_mesh = true;
+
+            for (i = 0; i < 3; ++i) {
+                num = 0;
+                for (j = 0; j < 3; ++j) num += symop_k[isym][i][j] * n_orig[j] * fac[j];
+
+                if (num % fac[i] != 0) {
+                    on_mesh = false;
+                    break;
                 }
+                num /= fac[i];
+                n_sym[i] = static_cast<int>(((num % nk_in[i]) + nk_in[i]) % nk_in[i]);
+            }
+
+            if (on_mesh) {
+                perm[isym][ik] = n_sym[2] + nk_in[2] * n_sym[1] + nk_in[1] * nk_in[2] * n_sym[0];
+            } else {
+                perm[isym][ik] = -1;
             }
         }
-        kplist_out.push_back(k_group);
     }
 
-    memory->deallocate(k_found);
     memory->deallocate(symop_k);
 }
 
@@ -1123,12 +1214,16 @@ void Kpoint::get_small_group_k(double *xk_in,
         for (i = 0; i < 3; ++i) xk_orig[i] = xk_in[i];
 
         rotvec(xk_sym, xk_orig, srot_inv_t);
-        for (i = 0; i < 3; ++i) xk_sym[i] = xk_sym[i] - nint(xk_sym[i]);
 
+        // S k and k are equivalent if they differ by a reciprocal lattice vector
+        for (i = 0; i < 3; ++i) {
+            xk_sym[i] -= xk_orig[i];
+            xk_sym[i] -= static_cast<double>(nint(xk_sym[i]));
+        }
 
-        if (std::sqrt(std::pow(xk_sym[0] - xk_orig[0], 2)
-            + std::pow(xk_sym[1] - xk_orig[1], 2)
-            + std::pow(xk_sym[2] - xk_orig[2], 2)) < 1.0e-10) {
+        if (std::sqrt(std::pow(xk_sym[0], 2)
+            + std::pow(xk_sym[1], 2)
+            + std::pow(xk_sym[2], 2)) < 1.0e-10) {
             sym_list.push_back(isym);
 
             for (i = 0; i < 3; ++i) {
@@ -1151,33 +1246,28 @@ int Kpoint::knum_sym(const int ik_in,
 {
     // Returns kpoint index of S(symop_num)*xk[ik_in]
     // Works only for gamma-centered mesh calculations
-    int i, j;
-
-    double srot[3][3];
-    double srot_inv[3][3], srot_inv_t[3][3];
-    double xk_orig[3], xk_sym[3];
 
     if (symop_num < 0 || symop_num >= symmetry->nsym) {
         error->exit("knum_sym", "Invalid symop_num");
     }
 
-    for (i = 0; i < 3; ++i) {
-        for (j = 0; j < 3; ++j) {
-            srot[i][j] = static_cast<double>(symmetry->SymmList[symop_num].rot[i][j]);
-        }
-    }
-
-    invmat3(srot_inv, srot);
-    transpose3(srot_inv_t, srot_inv);
+    return knum_sym_table[symop_num][ik_in];
+}
 
-    for (i = 0; i < 3; ++i) xk_orig[i] = xk[ik_in][i];
+int Kpoint::knum_diff(const int ik,
+                      const int jk)
+{
+    // Returns kpoint index of xk[ik] - xk[jk]
+    // Works only for gamma-centered mesh calculations
 
-    rotvec(xk_sym, xk_orig, srot_inv_t);
-    for (i = 0; i < 3; ++i) {
-        xk_sym[i] = xk_sym[i] - nint(xk_sym[i]);
-    }
+    int n1 = static_cast<int>(nkx);
+    int n2 = static_cast<int>(nky);
+    int n3 = static_cast<int>(nkz);
+    int i1, i2, i3;
 
-    int ret = get_knum(xk_sym[0], xk_sym[1], xk_sym[2]);
+    i1 = (ik / (n2 * n3) - jk / (n2 * n3) + n1) % n1;
+    i2 = ((ik / n3) % n2 - (jk / n3) % n2 + n2) % n2;
+    i3 = (ik % n3 - jk % n3 + n3) % n3;
 
-    return ret;
+    return i3 + n3 * i2 + n2 * n3 * i1;
 }
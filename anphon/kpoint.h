@@ -156,6 +156,7 @@ namespace PHON_NS
         unsigned int nk_reduced;
         std::map<int, int> kmap_to_irreducible;
         std::vector<int> *small_group_of_k;
+        int **knum_sym_table; // [nsym][nk] : index of S(isym) * xk[ik] on the uniform mesh
 
 
         int get_knum(const double, const double, const double);
@@ -167,11 +168,12 @@ namespace PHON_NS
                                        double **, const int, int ***);
 
         void gen_kmesh(const bool, const unsigned int [3],
-                       double **,
+                       int **, double **,
                        std::vector<std::vector<KpointList> > &);
 
         void get_small_group_k(double *, std::vector<int> &, double [3][3]);
         int knum_sym(const int, const int);
+        int knum_diff(const int, const int);
 
 
     private:
@@ -194,9 +196,11 @@ namespace PHON_NS
                                 std::vector<KpointPlane> *&);
 
         void reduce_kpoints(const unsigned int, double **,
-                            const unsigned int [3],
+                            const unsigned int [3], int **,
                             std::vector<std::vector<KpointList> > &);
 
+        void gen_symmetry_permutation(const unsigned int [3], int **);
+
         void gen_nkminus(const unsigned int, unsigned int *, double **);
 
         void gen_kpoints_plane(std::vector<KpointInp>,
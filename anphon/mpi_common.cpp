@@ -19,9 +19,21 @@ MyMPI::MyMPI(PHON *phon, MPI_Comm comm): Pointers(phon)
 {
     MPI_Comm_rank(comm, &my_rank);
     MPI_Comm_size(comm, &nprocs);
+
+#if MPI_VERSION >= 3
+    MPI_Comm_split_type(comm, MPI_COMM_TYPE_SHARED, my_rank, MPI_INFO_NULL, &comm_node);
+#else
+    // Without MPI-3, every process is regarded as a node by itself.
+    MPI_Comm_split(comm, my_rank, 0, &comm_node);
+#endif
+    MPI_Comm_rank(comm_node, &my_rank_node);
+    MPI_Comm_size(comm_node, &nprocs_node);
 }
 
-MyMPI::~MyMPI() {}
+MyMPI::~MyMPI()
+{
+    MPI_Comm_free(&comm_node);
+}
 
 void MyMPI::MPI_Bcast_string(std::string &str, int root, MPI_Comm comm)
 {
@@ -31,6 +31,11 @@ namespace PHON_NS
 
         int my_rank;
         int nprocs;
+
+        // Communicator of the processes sharing the memory of a node
+        MPI_Comm comm_node;
+        int my_rank_node;
+        int nprocs_node;
     };
 }
 
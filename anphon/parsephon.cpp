@@ -102,6 +102,11 @@ void Input::parse_general_vars()
     bool restart;
     bool sym_time_reversal, use_triplet_symmetry;
     bool update_fc2;
+    int phi3_cache_size;
+    int tetra_memory_size;
+    int phi3_mesh[3];
+    bool use_triplet_file;
+    bool use_mixed_precision;
 
     struct stat st;
     std::string prefix, mode, fcsinfo, fc2info;
@@ -110,10 +115,11 @@ void Input::parse_general_vars()
     std::string str_tmp;
     std::string str_allowed_list = "PREFIX MODE NSYM TOLERANCE PRINTSYM FCSXML FC2XML TMIN TMAX DT \
                                    NBANDS NONANALYTIC BORNINFO NA_SIGMA ISMEAR EPSILON EMIN EMAX DELTA_E \
-                                   RESTART TREVSYM NKD KD MASS TRISYM";
+                                   RESTART TREVSYM NKD KD MASS TRISYM PHI3_CACHE TETRA_MEMORY PHI3_MESH \
+                                   TRIPLET_FILE V3_MIXED";
     std::string str_no_defaults = "PREFIX MODE FCSXML NKD KD MASS";
     std::vector<std::string> no_defaults, celldim_v;
-    std::vector<std::string> kdname_v, masskd_v;
+    std::vector<std::string> kdname_v, masskd_v, phi3_mesh_v;
     std::map<std::string, std::string> general_var_dict;
 
     if (from_stdin) {
@@ -188,6 +194,11 @@ void Input::parse_general_vars()
     printsymmetry = false;
     sym_time_reversal = false;
     use_triplet_symmetry = true;
+    phi3_cache_size = 0;
+    tetra_memory_size = 0;
+    for (i = 0; i < 3; ++i) phi3_mesh[i] = 0;
+    use_triplet_file = false;
+    use_mixed_precision = false;
 
     // if file_result exists in the current directory, 
     // restart mode will be automatically turned on.
@@ -235,6 +246,27 @@ void Input::parse_general_vars()
 
 
     assign_val(use_triplet_symmetry, "TRISYM", general_var_dict);
+    assign_val(phi3_cache_size, "PHI3_CACHE", general_var_dict);
+    assign_val(tetra_memory_size, "TETRA_MEMORY", general_var_dict);
+    assign_val(use_triplet_file, "TRIPLET_FILE", general_var_dict);
+    assign_val(use_mixed_precision, "V3_MIXED", general_var_dict);
+
+    if (!general_var_dict["PHI3_MESH"].empty()) {
+        split_str_by_space(general_var_dict["PHI3_MESH"], phi3_mesh_v);
+
+        if (phi3_mesh_v.size() != 3) {
+            error->exit("parse_general_vars",
+                        "The number of entries for PHI3_MESH should be 3.");
+        }
+
+        for (i = 0; i < 3; ++i) {
+            phi3_mesh[i] = my_cast<int>(phi3_mesh_v[i]);
+            if (phi3_mesh[i] < 1) {
+                error->exit("parse_general_vars",
+                            "Please give positive integers in PHI3_MESH.");
+            }
+        }
+    }
 
     if (nonanalytic > 2) {
         error->exit("parse_general_vars",
@@ -286,6 +318,11 @@ void Input::parse_general_vars()
 
     integration->ismear = ismear;
     relaxation->use_triplet_symmetry = use_triplet_symmetry;
+    relaxation->phi3_cache_size = phi3_cache_size;
+    relaxation->tetra_memory_size = tetra_memory_size;
+    for (i = 0; i < 3; ++i) relaxation->phi3_mesh[i] = phi3_mesh[i];
+    relaxation->use_triplet_file = use_triplet_file;
+    relaxation->use_mixed_precision = use_mixed_precision;
 
     general_var_dict.clear();
 }
@@ -298,7 +335,7 @@ void Input::parse_analysis_vars(const bool use_default_values)
     std::string str_allowed_list = "PRINTEVEC PRINTXSF PRINTVEL QUARTIC KS_INPUT ATOMPROJ REALPART \
                                    ISOTOPE ISOFACT FSTATE_W FSTATE_K PRINTMSD PDOS TDOS GRUNEISEN NEWFCS DELTA_A \
                                    ANIME ANIME_CELLSIZE ANIME_FORMAT SPS PRINTV3 PRINTPR KAPPA_SPEC \
-                                   SELF_W";
+                                   SELF_W BTE BTE_MAXITER BTE_TOL";
 
     bool fstate_omega, fstate_k;
     bool ks_analyze_mode, atom_project_mode, calc_realpart;
@@ -308,14 +345,17 @@ void Input::parse_analysis_vars(const bool use_default_values)
     bool print_xsf, print_anime;
     bool print_V3, participation_ratio;
     bool bubble_omega;
+    bool solve_bte;
 
     int quartic_mode;
     int include_isotope;
     int scattering_phase_space;
     int calculate_kappa_spec;
+    int bte_maxiter;
     unsigned int cellsize[3];
 
     double delta_a;
+    double bte_tolerance;
     double *isotope_factor;
     std::string ks_input, anime_format;
     std::map<std::string, std::string> analysis_var_dict;
@@ -351,6 +391,9 @@ void Input::parse_analysis_vars(const bool use_default_values)
 
     calculate_kappa_spec = 0;
 
+    solve_bte = false;
+    bte_maxiter = 100;
+    bte_tolerance = 1.0e-5;
 
     // Assign values to variables
 
@@ -377,6 +420,9 @@ void Input::parse_analysis_vars(const bool use_default_values)
         assign_val(ks_input, "KS_INPUT", analysis_var_dict);
         assign_val(calculate_kappa_spec, "KAPPA_SPEC", analysis_var_dict);
         assign_val(bubble_omega, "SELF_W", analysis_var_dict);
+        assign_val(solve_bte, "BTE", analysis_var_dict);
+        assign_val(bte_maxiter, "BTE_MAXITER", analysis_var_dict);
+        assign_val(bte_tolerance, "BTE_TOL", analysis_var_dict);
 
         assign_val(print_xsf, "PRINTXSF", analysis_var_dict);
         assign_val(print_V3, "PRINTV3", analysis_var_dict);
@@ -444,6 +490,13 @@ void Input::parse_analysis_vars(const bool use_default_values)
         }
     }
 
+    if (bte_maxiter < 1) {
+        error->exit("parse_analysis_vars", "BTE_MAXITER must be a positive integer.");
+    }
+    if (bte_tolerance <= 0.0) {
+        error->exit("parse_analysis_vars", "BTE_TOL must be positive.");
+    }
+
     // Copy the values to appropriate classes
 
     phonon_velocity->print_velocity = print_vel;
@@ -467,6 +520,9 @@ void Input::parse_analysis_vars(const bool use_default_values)
     dos->scattering_phase_space = scattering_phase_space;
 
     conductivity->calc_kappa_spec = calculate_kappa_spec;
+    conductivity->solve_bte = solve_bte;
+    conductivity->bte_maxiter = bte_maxiter;
+    conductivity->bte_tolerance = bte_tolerance;
     relaxation->quartic_mode = quartic_mode;
     relaxation->atom_project_mode = atom_project_mode;
     relaxation->calc_realpart = calc_realpart;
@@ -310,7 +310,6 @@ void Dos::calc_two_phonon_dos(const unsigned int n,
     double **weight;
     double emax2 = 2.0 * emax;
 
-    double xk_tmp[3];
 
     int loc;
     int *k_pair;
@@ -333,8 +332,7 @@ void Dos::calc_two_phonon_dos(const unsigned int n,
         knum = kpinfo[ik][0].knum;
 
         for (jk = 0; jk < nk; ++jk) {
-            for (i = 0; i < 3; ++i) xk_tmp[i] = kpoint->xk[knum][i] + kpoint->xk[jk][i];
-            k_pair[jk] = kpoint->get_knum(xk_tmp[0], xk_tmp[1], xk_tmp[2]);
+            k_pair[jk] = kpoint->knum_diff(knum, kpoint->knum_minus[jk]);
         }
 
         for (i = 0; i < n; ++i) {
@@ -458,7 +456,6 @@ void Dos::calc_total_scattering_phase_space(double **omega,
                 double *weight;
                 int js, ks;
                 int jk, loc;
-                double xk_tmp[3];
 
                 memory->allocate(weight, nk);
                 memory->allocate(e_tmp, 2, nk);
@@ -472,8 +469,7 @@ void Dos::calc_total_scattering_phase_space(double **omega,
 
                     for (jk = 0; jk < nk; ++jk) {
 
-                        for (i = 0; i < 3; ++i) xk_tmp[i] = kpoint->xk[knum][i] + kpoint->xk[jk][i];
-                        loc = kpoint->get_knum(xk_tmp[0], xk_tmp[1], xk_tmp[2]);
+                        loc = kpoint->knum_diff(knum, kpoint->knum_minus[jk]);
 
                         e_tmp[0][jk] = writes->in_kayser(omega[jk][js] + omega[loc][ks]);
                         e_tmp[1][jk] = writes->in_kayser(omega[jk][js] - omega[loc][ks]);
@@ -533,7 +529,6 @@ void Dos::calc_scattering_phase_space_with_Bose(double **eval,
 {
     unsigned int i, j, k;
     unsigned int knum, snum;
-    double xk_tmp[3];
     double **ret_mode;
     double omega0;
     double Tmin = system->Tmin;
@@ -545,7 +540,7 @@ void Dos::calc_scattering_phase_space_with_Bose(double **eval,
     unsigned int nk_irred = kpoint->nk_reduced;
     unsigned int nk = kpoint->nk;
     unsigned int ns = dynamical->neval;
-    unsigned int k1, k2;
+    unsigned int k1;
     unsigned int imode;
     unsigned int *k2_arr;
     unsigned int ns2 = ns * ns;
@@ -638,9 +633,7 @@ void Dos::calc_scattering_phase_space_with_Bose(double **eval,
             snum = iks % ns;
 
             for (k1 = 0; k1 < nk; ++k1) {
-                for (j = 0; j < 3; ++j) xk_tmp[j] = kpoint->xk[knum][j] - kpoint->xk[k1][j];
-                k2 = kpoint->get_knum(xk_tmp[0], xk_tmp[1], xk_tmp[2]);
-                k2_arr[k1] = k2;
+                k2_arr[k1] = kpoint->knum_diff(knum, k1);
             }
 
             omega0 = eval[knum][snum];
@@ -85,6 +85,47 @@ void Phonon_velocity::calc_group_velocity(const int kpmode)
 }
 
 void Phonon_velocity::calc_phonon_vel_band(double **phvel_out)
+{
+    unsigned int i;
+    unsigned int ik;
+    unsigned int nk = kpoint->nk;
+    unsigned int n = dynamical->neval;
+
+    if (mympi->my_rank == 0) {
+        std::cout << " Calculating group velocities of phonon along given k path ... ";
+    }
+
+    if (dynamical->nonanalytic) {
+
+        calc_phonon_vel_band_fd(phvel_out);
+
+    } else {
+
+        // Velocities along the k path by the Hellmann-Feynman theorem
+
+        double **dir_cart, **vel_tmp;
+
+        memory->allocate(dir_cart, 1, 3);
+        memory->allocate(vel_tmp, n, 1);
+
+        for (ik = 0; ik < nk; ++ik) {
+            for (i = 0; i < 3; ++i) dir_cart[0][i] = kpoint->kvec_na[ik][i];
+
+            phonon_vel_k_analytic(kpoint->xk[ik], dir_cart[0], 1, dir_cart, vel_tmp, ik);
+
+            for (i = 0; i < n; ++i) phvel_out[ik][i] = vel_tmp[i][0];
+        }
+
+        memory->deallocate(dir_cart);
+        memory->deallocate(vel_tmp);
+    }
+
+    if (mympi->my_rank == 0) {
+        std::cout << "done!" << std::endl;
+    }
+}
+
+void Phonon_velocity::calc_phonon_vel_band_fd(double **phvel_out)
 {
     unsigned int i;
     unsigned int ik, idiff;
@@ -101,10 +142,6 @@ void Phonon_velocity::calc_phonon_vel_band(double **phvel_out)
 
     memory->allocate(evec_tmp, 1, 1);
 
-    if (mympi->my_rank == 0) {
-        std::cout << " Calculating group velocities of phonon along given k path ... ";
-    }
-
     ndiff = 2;
     memory->allocate(xk_shift, ndiff, 3);
     memory->allocate(omega_shift, ndiff, n);
@@ -158,10 +195,6 @@ void Phonon_velocity::calc_phonon_vel_band(double **phvel_out)
     memory->deallocate(xk_tmp);
 
     memory->deallocate(evec_tmp);
-
-    if (mympi->my_rank == 0) {
-        std::cout << "done!" << std::endl;
-    }
 }
 
 void Phonon_velocity::calc_phonon_vel_mesh(double **phvel_out,
@@ -179,11 +212,7 @@ void Phonon_velocity::calc_phonon_vel_mesh(double **phvel_out,
     memory->allocate(vel, ns, 3);
 
     for (i = 0; i < nk; ++i) {
-        phonon_vel_k(kpoint->xk[i], vel);
-//        phonon_vel_k2(kpoint->xk[i],
-//                      dynamical->eval_phonon[i],
-//                      dynamical->evec_phonon[i],
-//                      vel);
+        phonon_vel_k(kpoint->xk[i], vel, i);
 
         for (j = 0; j < ns; ++j) {
             rotvec(vel[j], vel[j], system->lavec_p);
@@ -205,8 +234,57 @@ void Phonon_velocity::calc_phonon_vel_mesh(double **phvel_out,
 }
 
 void Phonon_velocity::phonon_vel_k(double *xk_in,
-                                   double **vel_out)
+                                   double **vel_out,
+                                   const int knum)
 {
+    // Calculate the derivatives of phonon frequencies with respect to
+    // the fractional coordinates of xk_in. The velocities are obtained
+    // analytically when the non-analytic correction is not considered.
+
+    unsigned int i, j;
+    unsigned int n = dynamical->neval;
+    double **dir_cart;
+    double symmetrizer_k[3][3];
+    std::vector<int> smallgroup_k;
+    // A generic direction used to resolve the degeneracy
+    double dir_perturb[3] = {1.0 / std::sqrt(14.0),
+                             2.0 / std::sqrt(14.0),
+                             3.0 / std::sqrt(14.0)};
+
+    if (dynamical->nonanalytic) {
+        phonon_vel_k_fd(xk_in, vel_out);
+        return;
+    }
+
+    memory->allocate(dir_cart, 3, 3);
+
+    for (i = 0; i < 3; ++i) {
+        for (j = 0; j < 3; ++j) {
+            dir_cart[i][j] = (i == j) ? 1.0 : 0.0;
+        }
+    }
+
+    phonon_vel_k_analytic(xk_in, dir_perturb, 3, dir_cart, vel_out, knum);
+
+    // d omega / d xk = rlavec_p * (d omega / d k_cart).
+    // The velocities are then symmetrized by the small group of k so that
+    // those of the degenerate modes also respect the crystal symmetry.
+
+    kpoint->get_small_group_k(xk_in, smallgroup_k, symmetrizer_k);
+
+    for (i = 0; i < n; ++i) {
+        rotvec(vel_out[i], vel_out[i], system->rlavec_p);
+        rotvec(vel_out[i], vel_out[i], symmetrizer_k, 'T');
+    }
+
+    memory->deallocate(dir_cart);
+}
+
+void Phonon_velocity::phonon_vel_k_fd(double *xk_in,
+                                      double **vel_out)
+{
+    // Finite-difference version of phonon_vel_k, used with NONANALYTIC > 0.
+
     unsigned int i, j;
     unsigned int idiff;
     unsigned int ndiff;
@@ -297,177 +375,203 @@ double Phonon_velocity::diff(double *f,
     return df;
 }
 
-void Phonon_velocity::phonon_vel_k2(double *xk_in,
-                                    double *omega_in,
-                                    std::complex<double> **evec_in,
-                                    double **vel_out)
+void Phonon_velocity::phonon_vel_k_analytic(double *xk_in,
+                                            double *dir_perturb,
+                                            const unsigned int ndir,
+                                            double **dir_in,
+                                            double **vel_out,
+                                            const int knum)
 {
-    unsigned int i, j, k, l, m;
-    unsigned int icrd;
+    // Calculate group velocities of all modes at xk_in (fractional basis)
+    // along the Cartesian directions dir_in[ndir] by the Hellmann-Feynman theorem:
+    //   v = <e|dD/dk|e> / (2 * omega).
+    // Within a degenerate subspace, the eigenvectors are rotated so that
+    // they diagonalize the velocity operator along dir_perturb, which
+    // corresponds to approaching xk_in from that direction.
+    // When xk_in is the knum-th k point of kpoint->xk (knum >= 0), the stored
+    // eigenvalues and eigenvectors are reused instead of diagonalizing D(k) again.
+
+    int i, j, k, l, m;
+    unsigned int idir;
+    int is, ideg;
     int nmode = 3 * system->natmin;
-
-    std::complex<double> ***ddyn;
+    int INFO;
+    int LWORK = (2 * nmode - 1) * 10;
+    char JOBZ = 'V';
+    char UPLO = 'U';
+    double tol_omega = 1.0e-7; // Approximately equal to 0.01 cm^{-1}
+    double *eval, *omega, *eval_tmp;
+    double *RWORK;
+    std::complex<double> **dymat, ***ddyn, **ddyn_dir, **mat_tmp;
+    std::complex<double> *amat, *WORK, *ctmp_vec;
     std::complex<double> ctmp;
-    std::complex<double> **vel_tmp;
-    std::complex<double> ***mat_tmp;
     std::complex<double> czero(0.0, 0.0);
-    std::vector<int> smallgroup_k;
-    double **eval_tmp;
-
-    if (dynamical->nonanalytic) {
-
-        error->exit("phonon_vel_k2", "Sorry. Analytic calculation of \
-            group velocity is not supported for NONANALYTIC>0.");
-
-    }
 
+    memory->allocate(dymat, nmode, nmode);
     memory->allocate(ddyn, 3, nmode, nmode);
-    memory->allocate(vel_tmp, 3, nmode);
-    calc_derivative_dynmat_k(xk_in, fcs_phonon->fc2_ext, ddyn);
-
-    bool do_diagonalize = false;
+    memory->allocate(ddyn_dir, nmode, nmode);
+    memory->allocate(mat_tmp, nmode, nmode);
+    memory->allocate(amat, nmode * nmode);
+    memory->allocate(eval, nmode);
+    memory->allocate(omega, nmode);
+    memory->allocate(eval_tmp, nmode);
+    memory->allocate(ctmp_vec, nmode * nmode);
+    memory->allocate(RWORK, 3 * nmode - 2);
+    memory->allocate(WORK, LWORK);
 
+    calc_dynmat_derivative_k(xk_in, fcs_phonon->fc2_ext, dymat, ddyn);
 
-    if (do_diagonalize) {
-        // Detect degeneracy at the given k
-        double tol_omega = 1.0e-7; // Approximately equal to 0.01 cm^{-1}
+    if (knum >= 0 && dynamical->eigenvectors) {
 
-        std::vector<int> degeneracy_at_k;
-        double omega_now, omega_prev;
+        for (i = 0; i < nmode; ++i) {
+            omega[i] = dynamical->eval_phonon[knum][i];
+            for (m = 0; m < nmode; ++m) {
+                amat[i * nmode + m] = dynamical->evec_phonon[knum][i][m];
+            }
+        }
 
-        degeneracy_at_k.clear();
+    } else {
 
-        omega_prev = omega_in[0];
-        int ideg = 1;
+        // Force the dynamical matrix be real when k point is
+        // zone-center or zone-boundaries as in Dynamical::eval_k.
 
-        for (i = 1; i < nmode; ++i) {
-            omega_now = omega_in[i];
+        if (std::sqrt(std::pow(std::fmod(xk_in[0], 0.5), 2.0)
+            + std::pow(std::fmod(xk_in[1], 0.5), 2.0)
+            + std::pow(std::fmod(xk_in[2], 0.5), 2.0)) < eps) {
 
-            if (std::abs(omega_now - omega_prev) < tol_omega) {
-                ++ideg;
-            } else {
-                degeneracy_at_k.push_back(ideg);
-                ideg = 1;
-                omega_prev = omega_now;
+            for (i = 0; i < nmode; ++i) {
+                for (j = 0; j < nmode; ++j) {
+                    dymat[i][j] = std::complex<double>(dymat[i][j].real(), 0.0);
+                }
             }
         }
-        degeneracy_at_k.push_back(ideg);
 
-        int is = 0;
-
-        for (i = 0; i < degeneracy_at_k.size(); ++i) {
-            ideg = degeneracy_at_k[i];
+        k = 0;
+        for (j = 0; j < nmode; ++j) {
+            for (i = 0; i < nmode; ++i) {
+                amat[k++] = dymat[i][j];
+            }
+        }
 
-            if (ideg == 1) {
+        // The eigenvector of the i-th mode is stored in amat[i * nmode : (i + 1) * nmode]
+        zheev_(&JOBZ, &UPLO, &nmode, amat, &nmode, eval, WORK, &LWORK, RWORK, &INFO);
 
-                // When the branch is non-degenerate, the velocity can be calculated 
-                // from the diagonal element of e^{*} * DDYN * e.
+        for (i = 0; i < nmode; ++i) omega[i] = dynamical->freq(eval[i]);
+    }
 
-                for (icrd = 0; icrd < 3; ++icrd) {
-                    vel_tmp[icrd][is] = czero;
+    // Rotate the eigenvectors within each degenerate subspace
 
-                    for (l = 0; l < nmode; ++l) {
-                        ctmp = czero;
-                        for (m = 0; m < nmode; ++m) {
-                            ctmp += ddyn[icrd][l][m] * evec_in[is][m];
-                        }
-                        vel_tmp[icrd][is] += std::conj(evec_in[is][l]) * ctmp;
-                    }
-                    vel_tmp[icrd][is] /= 2.0 * omega_in[is];
-                }
+    for (l = 0; l < nmode; ++l) {
+        for (m = 0; m < nmode; ++m) {
+            ddyn_dir[l][m] = dir_perturb[0] * ddyn[0][l][m]
+                + dir_perturb[1] * ddyn[1][l][m]
+                + dir_perturb[2] * ddyn[2][l][m];
+        }
+    }
 
-            } else if (ideg > 1) {
+    is = 0;
 
-                // When the branch is degenerated with two or more branches, 
-                // we have to construct a MxM matrix and diagonalize it to obtain 
-                // group velocities.
+    while (is < nmode) {
 
-                memory->allocate(mat_tmp, 3, ideg, ideg);
-                memory->allocate(eval_tmp, 3, ideg);
+        ideg = 1;
+        while (is + ideg < nmode
+            && std::abs(omega[is + ideg] - omega[is]) < tol_omega) {
+            ++ideg;
+        }
 
-                for (icrd = 0; icrd < 3; ++icrd) {
+        if (ideg > 1) {
 
-                    for (j = 0; j < ideg; ++j) {
-                        for (k = 0; k < ideg; ++k) {
-                            mat_tmp[icrd][j][k] = czero;
+            // Matrix elements e_j^{*} * DDYN * e_k in the degenerate subspace
 
-                            for (l = 0; l < nmode; ++l) {
-                                ctmp = czero;
-                                for (m = 0; m < nmode; ++m) {
-                                    ctmp += ddyn[icrd][l][m] * evec_in[j + is][m];
-                                }
-                                mat_tmp[icrd][j][k] += std::conj(evec_in[k + is][l]) * ctmp;
-                            }
-                        }
+            for (k = 0; k < ideg; ++k) {
+                for (l = 0; l < nmode; ++l) {
+                    ctmp = czero;
+                    for (m = 0; m < nmode; ++m) {
+                        ctmp += ddyn_dir[l][m] * amat[(k + is) * nmode + m];
                     }
-                    // Diagonalize the matrix here
-
-                    diagonalize_hermite_mat(ideg, mat_tmp[icrd], eval_tmp[icrd]);
-
-                    for (j = 0; j < ideg; ++j) {
-                        vel_tmp[icrd][j + is] = eval_tmp[icrd][j] / (2.0 * omega_in[j + is]);
+                    ctmp_vec[l] = ctmp;
+                }
+                for (j = 0; j < ideg; ++j) {
+                    ctmp = czero;
+                    for (l = 0; l < nmode; ++l) {
+                        ctmp += std::conj(amat[(j + is) * nmode + l]) * ctmp_vec[l];
                     }
+                    mat_tmp[j][k] = ctmp;
                 }
-
-                memory->deallocate(mat_tmp);
-                memory->deallocate(eval_tmp);
-
-            } else {
-                error->exit("phonon_vel_k2", "This cannot happen.");
             }
 
-            is += ideg;
-        }
-    } else {
-
-        for (icrd = 0; icrd < 3; ++icrd) {
-            
-            for (j = 0; j < nmode; ++j) {
-                vel_tmp[icrd][j] = czero;
+            diagonalize_hermite_mat(ideg, mat_tmp, eval_tmp);
 
-                for (l = 0; l < nmode; ++l) {
+            for (j = 0; j < ideg; ++j) {
+                for (m = 0; m < nmode; ++m) {
                     ctmp = czero;
-                    for (m = 0; m < nmode; ++m) {
-                        ctmp += ddyn[icrd][l][m] * evec_in[j][m];
+                    for (k = 0; k < ideg; ++k) {
+                        ctmp += amat[(k + is) * nmode + m] * mat_tmp[k][j];
                     }
-                    vel_tmp[icrd][j] += std::conj(evec_in[j][l]) * ctmp;
+                    ctmp_vec[j * nmode + m] = ctmp;
                 }
             }
-            for (j = 0; j < nmode; ++j) {
-                vel_tmp[icrd][j] /= 2.0 * omega_in[j];
+            for (j = 0; j < ideg * nmode; ++j) {
+                amat[is * nmode + j] = ctmp_vec[j];
             }
         }
-    }
-    
 
-    for (icrd = 0; icrd < 3; ++icrd) {
-        for (i = 0; i < nmode; ++i) {
-            vel_out[i][icrd] = vel_tmp[icrd][i].real();
-        }
+        is += ideg;
     }
 
+    for (idir = 0; idir < ndir; ++idir) {
 
-    if (ddyn) {
-        memory->deallocate(ddyn);
-    }
-    if (vel_tmp) {
-        memory->deallocate(vel_tmp);
-    }
+        for (l = 0; l < nmode; ++l) {
+            for (m = 0; m < nmode; ++m) {
+                ddyn_dir[l][m] = dir_in[idir][0] * ddyn[0][l][m]
+                    + dir_in[idir][1] * ddyn[1][l][m]
+                    + dir_in[idir][2] * ddyn[2][l][m];
+            }
+        }
 
-    double symmetrizer_k[3][3];
+        for (j = 0; j < nmode; ++j) {
 
-    kpoint->get_small_group_k(xk_in, smallgroup_k, symmetrizer_k);
+            // The velocities of the acoustic modes at Gamma are set to zero
+            // as in the finite-difference approach.
 
-    for (i = 0; i < nmode; ++i) {
-        rotvec(vel_out[i], vel_out[i], symmetrizer_k, 'T');
+            if (std::abs(omega[j]) < eps6) {
+                vel_out[j][idir] = 0.0;
+                continue;
+            }
+
+            ctmp = czero;
+            for (l = 0; l < nmode; ++l) {
+                for (m = 0; m < nmode; ++m) {
+                    ctmp += std::conj(amat[j * nmode + l]) * ddyn_dir[l][m] * amat[j * nmode + m];
+                }
+            }
+            vel_out[j][idir] = ctmp.real() / (2.0 * std::abs(omega[j]));
+        }
     }
+
+    memory->deallocate(dymat);
+    memory->deallocate(ddyn);
+    memory->deallocate(ddyn_dir);
+    memory->deallocate(mat_tmp);
+    memory->deallocate(amat);
+    memory->deallocate(eval);
+    memory->deallocate(omega);
+    memory->deallocate(eval_tmp);
+    memory->deallocate(ctmp_vec);
+    memory->deallocate(RWORK);
+    memory->deallocate(WORK);
 }
 
 
-void Phonon_velocity::calc_derivative_dynmat_k(double *xk_in,
-                                               std::vector<FcsClassExtent> fc2_in,
+void Phonon_velocity::calc_dynmat_derivative_k(double *xk_in,
+                                               const std::vector<FcsClassExtent> &fc2_in,
+                                               std::complex<double> **dymat_out,
                                                std::complex<double> ***ddyn_out)
 {
+    // Calculate the analytic part of the dynamical matrix D(k) and its
+    // derivatives dD/dk with respect to the Cartesian components of k
+    // in one pass over the harmonic force constants.
+
     int i, j, k;
     unsigned int atm1_s, atm2_s;
     unsigned int atm1_p, atm2_p;
@@ -476,18 +580,22 @@ void Phonon_velocity::calc_derivative_dynmat_k(double *xk_in,
 
     int nmode = 3 * system->natmin;
 
-    double vec[3];
+    double vec[3], xk_cart[3];
     double phase;
     std::complex<double> im(0.0, 1.0);
+    std::complex<double> ctmp;
 
-    for (k = 0; k < 3; ++k) {
-        for (i = 0; i < nmode; ++i) {
-            for (j = 0; j < nmode; ++j) {
+    for (i = 0; i < nmode; ++i) {
+        for (j = 0; j < nmode; ++j) {
+            dymat_out[i][j] = std::complex<double>(0.0, 0.0);
+            for (k = 0; k < 3; ++k) {
                 ddyn_out[k][i][j] = std::complex<double>(0.0, 0.0);
             }
         }
     }
 
+    rotvec(xk_cart, xk_in, system->rlavec_p, 'T');
+
     for (std::vector<FcsClassExtent>::const_iterator it = fc2_in.begin();
          it != fc2_in.end(); ++it) {
 
@@ -505,23 +613,18 @@ void Phonon_velocity::calc_derivative_dynmat_k(double *xk_in,
                 - system->xr_s[system->map_p2s[atm2_p][0]][i];
         }
 
+        // Lattice vector in Cartesian coordinate
         rotvec(vec, vec, system->lavec_s);
-        rotvec(vec, vec, system->rlavec_p);
 
-        phase = vec[0] * xk_in[0] + vec[1] * xk_in[1] + vec[2] * xk_in[2];
+        phase = vec[0] * xk_cart[0] + vec[1] * xk_cart[1] + vec[2] * xk_cart[2];
 
-        for (k = 0; k < 3; ++k) {
-            ddyn_out[k][3 * atm1_p + xyz1][3 * atm2_p + xyz2]
-                += (*it).fcs_val * std::exp(im * phase) * vec[k] / std::sqrt(system->mass[atm1_s] * system->mass[atm2_s]);
-        }
+        ctmp = (*it).fcs_val * std::exp(im * phase)
+            / std::sqrt(system->mass[atm1_s] * system->mass[atm2_s]);
 
-    }
+        dymat_out[3 * atm1_p + xyz1][3 * atm2_p + xyz2] += ctmp;
 
-    for (k = 0; k < 3; ++k) {
-        for (i = 0; i < nmode; ++i) {
-            for (j = 0; j < nmode; ++j) {
-                ddyn_out[k][i][j] *= std::complex<double>(0.0, 1.0);
-            }
+        for (k = 0; k < 3; ++k) {
+            ddyn_out[k][3 * atm1_p + xyz1][3 * atm2_p + xyz2] += im * vec[k] * ctmp;
         }
     }
 }
@@ -537,7 +640,7 @@ void Phonon_velocity::diagonalize_hermite_mat(const int n,
     int INFO;
     std::complex<double> *WORK;
     double *RWORK;
-    char JOBZ = 'N';
+    char JOBZ = 'V';
     char UPLO = 'U';
     int n_ = n;
 
@@ -553,7 +656,16 @@ void Phonon_velocity::diagonalize_hermite_mat(const int n,
     }
 
     zheev_(&JOBZ, &UPLO, &n_, mat_1D, &n_, eval_out, WORK, &LWORK, RWORK, &INFO);
-    
+
+    // Return the eigenvectors as columns of mat_in
+
+    k = 0;
+    for (j = 0; j < n; ++j) {
+        for (i = 0; i < n; ++i) {
+            mat_in[i][j] = mat_1D[k++];
+        }
+    }
+
     memory->deallocate(RWORK);
     memory->deallocate(WORK);
     memory->deallocate(mat_1D);
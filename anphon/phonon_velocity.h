@@ -21,7 +21,7 @@ namespace PHON_NS
         ~Phonon_velocity();
 
         void calc_group_velocity(const int);
-        void phonon_vel_k(double *, double **);
+        void phonon_vel_k(double *, double **, const int knum = -1);
 
         bool print_velocity;
         double **phvel;
@@ -33,13 +33,18 @@ namespace PHON_NS
         double diff(double *, const unsigned int, double);
 
         void calc_phonon_vel_band(double **);
+        void calc_phonon_vel_band_fd(double **);
         void calc_phonon_vel_mesh(double **, double ***);
-        void phonon_vel_k2(double *,
-                           double *,
-                           std::complex<double> **,
-                           double **);
-        void calc_derivative_dynmat_k(double *,
-                                      std::vector<FcsClassExtent>,
+        void phonon_vel_k_fd(double *, double **);
+        void phonon_vel_k_analytic(double *,
+                                   double *,
+                                   const unsigned int,
+                                   double **,
+                                   double **,
+                                   const int);
+        void calc_dynmat_derivative_k(double *,
+                                      const std::vector<FcsClassExtent> &,
+                                      std::complex<double> **,
                                       std::complex<double> ***);
         void diagonalize_hermite_mat(const int,
                                      std::complex<double> **,
@@ -245,7 +245,9 @@ void PHON::execute_RTA()
         conductivity->setup_kappa();
         conductivity->prepare_restart();
         conductivity->calc_anharmonic_imagself();
+        conductivity->write_result();
         conductivity->compute_kappa();
+        conductivity->compute_kappa_bte();
         writes->write_kappa();
         writes->write_selfenergy_isotope();
     }
@@ -43,6 +43,13 @@ using namespace PHON_NS;
 Relaxation::Relaxation(PHON *phon) : Pointers(phon)
 {
     im = std::complex<double>(0.0, 1.0);
+    triplet_index_ready = false;
+    triplet_index_shared = false;
+    triplet_ngroup = 0;
+    triplet_nmember = 0;
+    triplet_gstart = 0;
+    triplet_member = 0;
+    use_mixed_precision = false;
 }
 
 Relaxation::~Relaxation()
@@ -63,7 +70,22 @@ void Relaxation::setup_relaxation()
     }
 
     setup_mode_analysis();
+
+    if (calc_fstate_k) {
+        use_tuned_ver = false;
+    } else {
+        use_tuned_ver = true;
+        nk_tmp[0] = kpoint->nkx;
+        nk_tmp[1] = kpoint->nky;
+        nk_tmp[2] = kpoint->nkz;
+        store_exponential_for_acceleration(nk_tmp, nk_represent,
+                                           exp_phase, exp_phase3);
+    }
+
     setup_cubic();
+    setup_phi3_interpolation();
+    setup_phi3_cache();
+    setup_tetrahedron_memory();
     sym_permutation = true;
 
     if (ks_analyze_mode) {
@@ -107,29 +129,30 @@ void Relaxation::setup_relaxation()
         dynamical->modify_eigenvectors();
     }
 
-    if (calc_fstate_k) {
-        use_tuned_ver = false;
-    } else {
-        use_tuned_ver = true;
-        nk_tmp[0] = kpoint->nkx;
-        nk_tmp[1] = kpoint->nky;
-        nk_tmp[2] = kpoint->nkz;
-        store_exponential_for_acceleration(nk_tmp, nk_represent,
-                                           exp_phase, exp_phase3);
-    }
+    setup_triplet_index();
+    setup_mixed_precision();
 
     if (phon->mode == "RTA") {
         detect_imaginary_branches(dynamical->eval_phonon);
+        if (use_mixed_precision && !ks_analyze_mode) estimate_mixed_precision_error();
     }
 }
 
 void Relaxation::finish_relaxation()
 {
-    memory->deallocate(vec_for_v3);
-    memory->deallocate(invmass_for_v3);
-    memory->deallocate(evec_index);
-    memory->deallocate(fcs_group);
+    if (phi3_cache_capacity > 0) {
+        print_phi3_cache_statistics();
+        phi3_cache.clear();
+        phi3_cache_lru.clear();
+    }
+    if (integration->ismear == -1) {
+        print_tetrahedron_memory();
+    }
+
+    fc3_group.deallocate();
+    if (use_phi3_interpolation) fc3_group_interp.deallocate();
     memory->deallocate(is_imaginary);
+    if (triplet_index_ready) deallocate_triplet_index();
 
     if (use_tuned_ver) {
         if (tune_type == 0) {
@@ -137,13 +160,11 @@ void Relaxation::finish_relaxation()
         } else if (tune_type == 1) {
             memory->deallocate(exp_phase3);
         }
+        if (xk_on_mesh) memory->deallocate(xk_int);
     }
 
     if (ks_analyze_mode && (quartic_mode > 0)) {
-        memory->deallocate(vec_for_v4);
-        memory->deallocate(invmass_for_v4);
-        memory->deallocate(evec_index4);
-        memory->deallocate(fcs_group2);
+        fc4_group.deallocate();
     }
 }
 
@@ -211,9 +232,9 @@ void Relaxation::detect_imaginary_branches(double **eval)
     }
 }
 
-void Relaxation::prepare_relative_vector(std::vector<FcsArrayWithCell> fcs_in,
+void Relaxation::prepare_relative_vector(const std::vector<FcsArrayWithCell> &fcs_in,
                                          const unsigned int N,
-                                         double ***vec_out)
+                                         double *vec_out)
 {
     int i, j, k;
     int ix, iy, iz;
@@ -290,8 +311,7 @@ void Relaxation::prepare_relative_vector(std::vector<FcsArrayWithCell> fcs_in,
             rotvec(vec, vec, mat_convert);
 
             for (j = 0; j < 3; ++j) {
-                //   vec_out[j][i][icount] = vec[j];
-                vec_out[icount][i][j] = vec[j];
+                vec_out[3 * ((N - 1) * icount + i) + j] = vec[j];
             }
         }
         ++icount;
@@ -299,67 +319,6 @@ void Relaxation::prepare_relative_vector(std::vector<FcsArrayWithCell> fcs_in,
     memory->deallocate(xshift_s);
 }
 
-void Relaxation::prepare_group_of_force_constants(std::vector<FcsArrayWithCell> fcs_in,
-                                                  const unsigned int N,
-                                                  int &number_of_groups,
-                                                  std::vector<double> *&fcs_group_out)
-{
-    // Find the number of groups which has different evecs.
-
-    unsigned int i;
-    std::vector<int> arr_old, arr_tmp;
-
-    number_of_groups = 0;
-
-    arr_old.clear();
-    for (i = 0; i < N; ++i) {
-        arr_old.push_back(-1);
-    }
-
-    for (std::vector<FcsArrayWithCell>::const_iterator it = fcs_in.begin(); it != fcs_in.end(); ++it) {
-
-        arr_tmp.clear();
-
-        for (i = 0; i < (*it).pairs.size(); ++i) {
-            arr_tmp.push_back((*it).pairs[i].index);
-        }
-
-        if (arr_tmp != arr_old) {
-            ++number_of_groups;
-            arr_old.clear();
-            arr_old.reserve(arr_tmp.size());
-            std::copy(arr_tmp.begin(), arr_tmp.end(), std::back_inserter(arr_old));
-        }
-    }
-
-    memory->allocate(fcs_group_out, number_of_groups);
-
-    int igroup = -1;
-
-    arr_old.clear();
-    for (i = 0; i < N; ++i) {
-        arr_old.push_back(-1);
-    }
-
-    for (std::vector<FcsArrayWithCell>::const_iterator it = fcs_in.begin(); it != fcs_in.end(); ++it) {
-
-        arr_tmp.clear();
-
-        for (i = 0; i < (*it).pairs.size(); ++i) {
-            arr_tmp.push_back((*it).pairs[i].index);
-        }
-
-        if (arr_tmp != arr_old) {
-            ++igroup;
-            arr_old.clear();
-            arr_old.reserve(arr_tmp.size());
-            std::copy(arr_tmp.begin(), arr_tmp.end(), std::back_inserter(arr_old));
-        }
-
-        fcs_group_out[igroup].push_back((*it).fcs_val);
-    }
-}
-
 void Relaxation::setup_mode_analysis()
 {
     // Judge if ks_analyze_mode should be turned on or not.
@@ -500,130 +459,177 @@ void Relaxation::setup_mode_analysis()
     }
 }
 
-std::complex<double> Relaxation::V3(const unsigned int ks[3])
+template <unsigned int N>
+std::complex<double> Relaxation::sum_fcs_with_phase_1d(const FcsGroupArray &fcs_in,
+                                                       const unsigned int igroup,
+                                                       const int *const *xk_in) const
 {
-    unsigned int i, j, ielem;
-    unsigned int kn[3], sn[3];
-    unsigned int nsize_group;
-
-    double phase, omega[3];
-    double phase3[3];
-
+    // Returns sum_{j in igroup} fcs[j] * exp(i * 2pi * (R1*k1 + ... + R_{N-1}*k_{N-1}) / nk_represent),
+    // where R are the integer lattice vectors of the IFC elements
+    // and k are the integer coordinates of the k points.
+    // Used when the mesh has the same number of divisions along all the nontrivial directions.
+
+    int j;
+    unsigned int l;
+    int iloc;
+    const int *lvec = fcs_in.lattice_vec + 3 * (N - 1) * fcs_in.group_start[igroup];
     std::complex<double> ret = std::complex<double>(0.0, 0.0);
-    std::complex<double> ret_in, vec_tmp;
-
-    int iloc, loc[3];
-    int ii;
-    double inv2pi = 1.0 / (2.0 * pi);
-    double dnk_represent = static_cast<double>(nk_represent);
-
-    dnk_represent *= inv2pi;
 
-    for (i = 0; i < 3; ++i) {
-        kn[i] = ks[i] / ns;
-        sn[i] = ks[i] % ns;
-        omega[i] = dynamical->eval_phonon[kn[i]][sn[i]];
+    for (j = fcs_in.group_start[igroup]; j < fcs_in.group_start[igroup + 1]; ++j) {
+        iloc = 0;
+        for (l = 0; l < N - 1; ++l) {
+            iloc += lvec[3 * l] * xk_in[l][0]
+                + lvec[3 * l + 1] * xk_in[l][1]
+                + lvec[3 * l + 2] * xk_in[l][2];
+        }
+        ret += fcs_in.fcs[j] * exp_phase[iloc % nk_represent + nk_represent - 1];
+        lvec += 3 * (N - 1);
     }
-    // Return zero if any of the involving phonon has imaginary frequency
-    if (omega[0] < 0.0 || omega[1] < 0.0 || omega[2] < 0.0) return 0.0;
-
-    ielem = 0;
-
-    if (use_tuned_ver) {
-        if (tune_type == 0) {
-
-            // Tuned version used when nk1=nk2=nk3.
-            for (i = 0; i < ngroup; ++i) {
-
-                vec_tmp
-                    = dynamical->evec_phonon[kn[0]][sn[0]][evec_index[i][0]]
-                    * dynamical->evec_phonon[kn[1]][sn[1]][evec_index[i][1]]
-                    * dynamical->evec_phonon[kn[2]][sn[2]][evec_index[i][2]]
-                    * invmass_for_v3[i];
-
-                ret_in = std::complex<double>(0.0, 0.0);
+    return ret;
+}
 
-                nsize_group = fcs_group[i].size();
+template <unsigned int N>
+std::complex<double> Relaxation::sum_fcs_with_phase_3d(const FcsGroupArray &fcs_in,
+                                                       const unsigned int igroup,
+                                                       const int *const *xk_in) const
+{
+    // Same as sum_fcs_with_phase_1d, but for general meshes.
+    // The flattened table exp_phase3 is indexed by the phase along each direction.
+
+    int j;
+    unsigned int l;
+    int ii, loc[3];
+    const int *lvec = fcs_in.lattice_vec + 3 * (N - 1) * fcs_in.group_start[igroup];
+    const std::complex<double> *exp_flat = &exp_phase3[0][0][0];
+    const int ndim1 = 2 * nk_grid[1] - 1;
+    const int ndim2 = 2 * nk_grid[2] - 1;
+    std::complex<double> ret = std::complex<double>(0.0, 0.0);
 
-                for (j = 0; j < nsize_group; ++j) {
+    for (j = fcs_in.group_start[igroup]; j < fcs_in.group_start[igroup + 1]; ++j) {
+        for (ii = 0; ii < 3; ++ii) {
+            loc[ii] = 0;
+            for (l = 0; l < N - 1; ++l) {
+                loc[ii] += lvec[3 * l + ii] * xk_in[l][ii];
+            }
+            loc[ii] = loc[ii] % nk_grid[ii] + nk_grid[ii] - 1;
+        }
+        ret += fcs_in.fcs[j] * exp_flat[(loc[0] * ndim1 + loc[1]) * ndim2 + loc[2]];
+        lvec += 3 * (N - 1);
+    }
+    return ret;
+}
 
-                    phase
-                        = vec_for_v3[ielem][0][0] * kpoint->xk[kn[1]][0]
-                        + vec_for_v3[ielem][0][1] * kpoint->xk[kn[1]][1]
-                        + vec_for_v3[ielem][0][2] * kpoint->xk[kn[1]][2]
-                        + vec_for_v3[ielem][1][0] * kpoint->xk[kn[2]][0]
-                        + vec_for_v3[ielem][1][1] * kpoint->xk[kn[2]][1]
-                        + vec_for_v3[ielem][1][2] * kpoint->xk[kn[2]][2];
+template <unsigned int N>
+std::complex<double> Relaxation::sum_fcs_with_phase(const FcsGroupArray &fcs_in,
+                                                    const unsigned int igroup,
+                                                    const unsigned int kernel,
+                                                    const double *const *xk_in) const
+{
+    // Returns sum_{j in igroup} fcs[j] * exp(i * (r1*k1 + ... + r_{N-1}*k_{N-1}))
+    // with floating-point phases.
+    // kernel = 0 : std::exp for each element
+    // kernel = 1 : table lookup (exp_phase or exp_phase3 depending on tune_type)
+
+    int j;
+    unsigned int l;
+    int ii, iloc, loc[3];
+    double phase, phase3[3];
+    double inv2pi = 1.0 / (2.0 * pi);
+    double dnk_represent = static_cast<double>(nk_represent) * inv2pi;
+    const double *vec = fcs_in.relvec + 3 * (N - 1) * fcs_in.group_start[igroup];
+    std::complex<double> ret = std::complex<double>(0.0, 0.0);
 
-                    iloc = nint(phase * dnk_represent) % nk_represent + nk_represent - 1;
-                    ret_in += fcs_group[i][j] * exp_phase[iloc];
+    if (kernel == 1 && tune_type == 1) {
 
-                    ++ielem;
+        for (j = fcs_in.group_start[igroup]; j < fcs_in.group_start[igroup + 1]; ++j) {
+            for (ii = 0; ii < 3; ++ii) {
+                phase3[ii] = 0.0;
+                for (l = 0; l < N - 1; ++l) {
+                    phase3[ii] += vec[3 * l + ii] * xk_in[l][ii];
                 }
-                ret += ret_in * vec_tmp;
+                loc[ii] = nint(phase3[ii] * dnk[ii] * inv2pi) % nk_grid[ii] + nk_grid[ii] - 1;
             }
-        } else if (tune_type == 1) {
-
-            // Tuned version used when nk1=nk2=nk3 is not met.
-            for (i = 0; i < ngroup; ++i) {
-
-                vec_tmp
-                    = dynamical->evec_phonon[kn[0]][sn[0]][evec_index[i][0]]
-                    * dynamical->evec_phonon[kn[1]][sn[1]][evec_index[i][1]]
-                    * dynamical->evec_phonon[kn[2]][sn[2]][evec_index[i][2]]
-                    * invmass_for_v3[i];
-
-                ret_in = std::complex<double>(0.0, 0.0);
-
-                nsize_group = fcs_group[i].size();
-
-                for (j = 0; j < nsize_group; ++j) {
+            ret += fcs_in.fcs[j] * exp_phase3[loc[0]][loc[1]][loc[2]];
+            vec += 3 * (N - 1);
+        }
 
-                    for (ii = 0; ii < 3; ++ii) {
-                        phase3[ii]
-                            = vec_for_v3[ielem][0][ii] * kpoint->xk[kn[1]][ii]
-                            + vec_for_v3[ielem][1][ii] * kpoint->xk[kn[2]][ii];
+    } else if (kernel == 1) {
 
-                        loc[ii] = nint(phase3[ii] * dnk[ii] * inv2pi) % nk_grid[ii] + nk_grid[ii] - 1;
-                    }
+        for (j = fcs_in.group_start[igroup]; j < fcs_in.group_start[igroup + 1]; ++j) {
+            phase = 0.0;
+            for (l = 0; l < N - 1; ++l) {
+                phase += vec[3 * l] * xk_in[l][0]
+                    + vec[3 * l + 1] * xk_in[l][1]
+                    + vec[3 * l + 2] * xk_in[l][2];
+            }
+            iloc = nint(phase * dnk_represent) % nk_represent + nk_represent - 1;
+            ret += fcs_in.fcs[j] * exp_phase[iloc];
+            vec += 3 * (N - 1);
+        }
 
-                    ret_in += fcs_group[i][j] * exp_phase3[loc[0]][loc[1]][loc[2]];
+    } else {
 
-                    ++ielem;
-                }
-                ret += ret_in * vec_tmp;
+        for (j = fcs_in.group_start[igroup]; j < fcs_in.group_start[igroup + 1]; ++j) {
+            phase = 0.0;
+            for (l = 0; l < N - 1; ++l) {
+                phase += vec[3 * l] * xk_in[l][0]
+                    + vec[3 * l + 1] * xk_in[l][1]
+                    + vec[3 * l + 2] * xk_in[l][2];
             }
+            ret += fcs_in.fcs[j] * std::exp(im * phase);
+            vec += 3 * (N - 1);
         }
+    }
+    return ret;
+}
 
-    } else {
-        // Original version
-        for (i = 0; i < ngroup; ++i) {
+std::complex<double> Relaxation::V3(const unsigned int ks[3])
+{
+    unsigned int i;
+    unsigned int kn[3], sn[3];
+
+    double omega[3];
+
+    std::complex<double> ret = std::complex<double>(0.0, 0.0);
+    std::complex<double> vec_tmp;
 
-            vec_tmp
-                = dynamical->evec_phonon[kn[0]][sn[0]][evec_index[i][0]]
-                * dynamical->evec_phonon[kn[1]][sn[1]][evec_index[i][1]]
-                * dynamical->evec_phonon[kn[2]][sn[2]][evec_index[i][2]]
-                * invmass_for_v3[i];
+    const int *evec_idx;
 
-            ret_in = std::complex<double>(0.0, 0.0);
+    for (i = 0; i < 3; ++i) {
+        kn[i] = ks[i] / ns;
+        sn[i] = ks[i] % ns;
+        omega[i] = dynamical->eval_phonon[kn[i]][sn[i]];
+    }
+    // Return zero if any of the involving phonon has imaginary frequency
+    if (omega[0] < 0.0 || omega[1] < 0.0 || omega[2] < 0.0) return 0.0;
 
-            nsize_group = fcs_group[i].size();
+    const int *xk_int_tmp[2];
+    const double *xk_tmp[2] = {kpoint->xk[kn[1]], kpoint->xk[kn[2]]};
 
-            for (j = 0; j < nsize_group; ++j) {
+    if (phase_kernel_v3 == 2) {
+        xk_int_tmp[0] = xk_int[kn[1]];
+        xk_int_tmp[1] = xk_int[kn[2]];
+    }
 
-                phase
-                    = vec_for_v3[ielem][0][0] * kpoint->xk[kn[1]][0]
-                    + vec_for_v3[ielem][0][1] * kpoint->xk[kn[1]][1]
-                    + vec_for_v3[ielem][0][2] * kpoint->xk[kn[1]][2]
-                    + vec_for_v3[ielem][1][0] * kpoint->xk[kn[2]][0]
-                    + vec_for_v3[ielem][1][1] * kpoint->xk[kn[2]][1]
-                    + vec_for_v3[ielem][1][2] * kpoint->xk[kn[2]][2];
+    for (i = 0; i < fc3_group.ngroup; ++i) {
 
-                ret_in += fcs_group[i][j] * std::exp(im * phase);
+        evec_idx = fc3_group.evec_index + 3 * i;
 
-                ++ielem;
+        vec_tmp
+            = dynamical->evec_phonon[kn[0]][sn[0]][evec_idx[0]]
+            * dynamical->evec_phonon[kn[1]][sn[1]][evec_idx[1]]
+            * dynamical->evec_phonon[kn[2]][sn[2]][evec_idx[2]]
+            * fc3_group.invmass[i];
+
+        if (phase_kernel_v3 == 2) {
+            // Phase factors from the integer lattice vectors of the IFCs
+            if (tune_type == 0) {
+                ret += sum_fcs_with_phase_1d<3>(fc3_group, i, xk_int_tmp) * vec_tmp;
+            } else {
+                ret += sum_fcs_with_phase_3d<3>(fc3_group, i, xk_int_tmp) * vec_tmp;
             }
-            ret += ret_in * vec_tmp;
+        } else {
+            ret += sum_fcs_with_phase<3>(fc3_group, i, phase_kernel_v3, xk_tmp) * vec_tmp;
         }
     }
 
@@ -633,21 +639,15 @@ std::complex<double> Relaxation::V3(const unsigned int ks[3])
 
 std::complex<double> Relaxation::V4(const unsigned int ks[4])
 {
-    int ii;
-    unsigned int i, j, ielem;
+    unsigned int i;
     unsigned int kn[4], sn[4];
 
-    double phase, phase3[3];
     double omega[4];
 
-    std::complex<double> ctmp, ret_in, vec_tmp;
+    std::complex<double> vec_tmp;
     std::complex<double> ret = std::complex<double>(0.0, 0.0);
 
-    int iloc, loc[3];
-    double inv2pi = 1.0 / (2.0 * pi);
-    double dnk_represent = static_cast<double>(nk_represent);
-
-    dnk_represent *= inv2pi;
+    const int *evec_idx;
 
     for (i = 0; i < 4; ++i) {
         kn[i] = ks[i] / ns;
@@ -655,295 +655,1034 @@ std::complex<double> Relaxation::V4(const unsigned int ks[4])
         omega[i] = dynamical->eval_phonon[kn[i]][sn[i]];
     }
 
-    ielem = 0;
-
-    if (use_tuned_ver) {
-        if (tune_type == 0) {
-            for (i = 0; i < ngroup2; ++i) {
-
-                vec_tmp
-                    = dynamical->evec_phonon[kn[0]][sn[0]][evec_index4[i][0]]
-                    * dynamical->evec_phonon[kn[1]][sn[1]][evec_index4[i][1]]
-                    * dynamical->evec_phonon[kn[2]][sn[2]][evec_index4[i][2]]
-                    * dynamical->evec_phonon[kn[3]][sn[3]][evec_index4[i][3]]
-                    * invmass_for_v4[i];
-
-                ret_in = std::complex<double>(0.0, 0.0);
-
-                for (j = 0; j < fcs_group2[i].size(); ++j) {
-                    phase
-                        = vec_for_v4[ielem][0][0] * kpoint->xk[kn[1]][0]
-                        + vec_for_v4[ielem][0][1] * kpoint->xk[kn[1]][1]
-                        + vec_for_v4[ielem][0][2] * kpoint->xk[kn[1]][2]
-                        + vec_for_v4[ielem][1][0] * kpoint->xk[kn[2]][0]
-                        + vec_for_v4[ielem][1][1] * kpoint->xk[kn[2]][1]
-                        + vec_for_v4[ielem][1][2] * kpoint->xk[kn[2]][2]
-                        + vec_for_v4[ielem][2][0] * kpoint->xk[kn[3]][0]
-                        + vec_for_v4[ielem][2][1] * kpoint->xk[kn[3]][1]
-                        + vec_for_v4[ielem][2][2] * kpoint->xk[kn[3]][2];
-
-                    iloc = nint(phase * dnk_represent) % nk_represent + nk_represent - 1;
-
-                    ctmp = fcs_group2[i][j] * exp_phase[iloc];
-                    ret_in += ctmp;
-
-                    ++ielem;
-                }
-                ret += ret_in * vec_tmp;
-            }
-        } else if (tune_type == 1) {
-            for (i = 0; i < ngroup2; ++i) {
-
-                vec_tmp
-                    = dynamical->evec_phonon[kn[0]][sn[0]][evec_index4[i][0]]
-                    * dynamical->evec_phonon[kn[1]][sn[1]][evec_index4[i][1]]
-                    * dynamical->evec_phonon[kn[2]][sn[2]][evec_index4[i][2]]
-                    * dynamical->evec_phonon[kn[3]][sn[3]][evec_index4[i][3]]
-                    * invmass_for_v4[i];
-
-                ret_in = std::complex<double>(0.0, 0.0);
-
-                for (j = 0; j < fcs_group2[i].size(); ++j) {
+    const int *xk_int_tmp[3];
+    const double *xk_tmp[3] = {kpoint->xk[kn[1]], kpoint->xk[kn[2]], kpoint->xk[kn[3]]};
 
-                    for (ii = 0; ii < 3; ++ii) {
-                        phase3[ii]
-                            = vec_for_v4[ielem][0][ii] * kpoint->xk[kn[1]][ii]
-                            + vec_for_v4[ielem][1][ii] * kpoint->xk[kn[2]][ii]
-                            + vec_for_v4[ielem][2][ii] * kpoint->xk[kn[3]][ii];
+    if (phase_kernel_v4 == 2) {
+        xk_int_tmp[0] = xk_int[kn[1]];
+        xk_int_tmp[1] = xk_int[kn[2]];
+        xk_int_tmp[2] = xk_int[kn[3]];
+    }
 
-                        loc[ii] = nint(phase3[ii] * dnk[ii] * inv2pi) % nk_grid[ii] + nk_grid[ii] - 1;
-                    }
+    for (i = 0; i < fc4_group.ngroup; ++i) {
 
-                    ctmp = fcs_group2[i][j] * exp_phase3[loc[0]][loc[1]][loc[2]];
-                    ret_in += ctmp;
+        evec_idx = fc4_group.evec_index + 4 * i;
 
-                    ++ielem;
-                }
-                ret += ret_in * vec_tmp;
+        vec_tmp
+            = dynamical->evec_phonon[kn[0]][sn[0]][evec_idx[0]]
+            * dynamical->evec_phonon[kn[1]][sn[1]][evec_idx[1]]
+            * dynamical->evec_phonon[kn[2]][sn[2]][evec_idx[2]]
+            * dynamical->evec_phonon[kn[3]][sn[3]][evec_idx[3]]
+            * fc4_group.invmass[i];
+
+        if (phase_kernel_v4 == 2) {
+            // Phase factors from the integer lattice vectors of the IFCs
+            if (tune_type == 0) {
+                ret += sum_fcs_with_phase_1d<4>(fc4_group, i, xk_int_tmp) * vec_tmp;
+            } else {
+                ret += sum_fcs_with_phase_3d<4>(fc4_group, i, xk_int_tmp) * vec_tmp;
             }
+        } else {
+            ret += sum_fcs_with_phase<4>(fc4_group, i, phase_kernel_v4, xk_tmp) * vec_tmp;
         }
+    }
 
-    } else {
-        for (i = 0; i < ngroup2; ++i) {
+    return ret / std::sqrt(omega[0] * omega[1] * omega[2] * omega[3]);
+}
 
-            vec_tmp
-                = dynamical->evec_phonon[kn[0]][sn[0]][evec_index4[i][0]]
-                * dynamical->evec_phonon[kn[1]][sn[1]][evec_index4[i][1]]
-                * dynamical->evec_phonon[kn[2]][sn[2]][evec_index4[i][2]]
-                * dynamical->evec_phonon[kn[3]][sn[3]][evec_index4[i][3]]
-                * invmass_for_v4[i];
 
-            ret_in = std::complex<double>(0.0, 0.0);
+void Relaxation::calc_phase_sum_v3(const FcsGroupArray &fcs_in,
+                                   const unsigned int k1,
+                                   const unsigned int k2,
+                                   std::complex<double> *ret)
+{
+    // Returns the phase-weighted sum of cubic force constants
+    // sum_{j} Phi3(j) * exp(i(k1*r1 + k2*r2)) / sqrt(m0*m1*m2) for each group.
+    // The result only depends on (k1, k2) and is shared by all branch pairs.
+
+    unsigned int i;
+    const double *xk_tmp[2] = {kpoint->xk[k1], kpoint->xk[k2]};
 
-            for (j = 0; j < fcs_group2[i].size(); ++j) {
-                phase
-                    = vec_for_v4[ielem][0][0] * kpoint->xk[kn[1]][0]
-                    + vec_for_v4[ielem][0][1] * kpoint->xk[kn[1]][1]
-                    + vec_for_v4[ielem][0][2] * kpoint->xk[kn[1]][2]
-                    + vec_for_v4[ielem][1][0] * kpoint->xk[kn[2]][0]
-                    + vec_for_v4[ielem][1][1] * kpoint->xk[kn[2]][1]
-                    + vec_for_v4[ielem][1][2] * kpoint->xk[kn[2]][2]
-                    + vec_for_v4[ielem][2][0] * kpoint->xk[kn[3]][0]
-                    + vec_for_v4[ielem][2][1] * kpoint->xk[kn[3]][1]
-                    + vec_for_v4[ielem][2][2] * kpoint->xk[kn[3]][2];
+    if (phase_kernel_v3 == 2) {
 
-                ctmp = fcs_group2[i][j] * std::exp(im * phase);
-                ret_in += ctmp;
+        const int *xk_int_tmp[2] = {xk_int[k1], xk_int[k2]};
 
-                ++ielem;
+        if (tune_type == 0) {
+            for (i = 0; i < fcs_in.ngroup; ++i) {
+                ret[i] = sum_fcs_with_phase_1d<3>(fcs_in, i, xk_int_tmp) * fcs_in.invmass[i];
+            }
+        } else {
+            for (i = 0; i < fcs_in.ngroup; ++i) {
+                ret[i] = sum_fcs_with_phase_3d<3>(fcs_in, i, xk_int_tmp) * fcs_in.invmass[i];
             }
-            ret += ret_in * vec_tmp;
         }
-    }
-
 
-    return ret / std::sqrt(omega[0] * omega[1] * omega[2] * omega[3]);
+    } else {
+        for (i = 0; i < fcs_in.ngroup; ++i) {
+            ret[i] = sum_fcs_with_phase<3>(fcs_in, i, phase_kernel_v3, xk_tmp) * fcs_in.invmass[i];
+        }
+    }
 }
 
 
-std::complex<double> Relaxation::V3_mode(int mode,
-                                         double *xk2,
-                                         double *xk3,
-                                         int is,
-                                         int js,
-                                         double **eval,
-                                         std::complex<double> ***evec)
+void Relaxation::setup_phi3_cache()
 {
-    int i, j;
-    int ielem;
-    int nsize_group;
+    // Setup the LRU cache of the phase-weighted cubic force constants.
+    // The capacity (number of (k1, k2) pairs) is determined from the memory budget
+    // PHI3_CACHE given in units of MB.
 
-    double phase;
-    std::complex<double> ctmp = std::complex<double>(0.0, 0.0);
-    std::complex<double> vec_tmp, ret_in;
+    double size_entry;
 
-    // Return zero if any of the involving phonon has imaginary frequency
-    if (eval[0][mode] < 0.0 || eval[1][is] < 0.0 || eval[2][js] < 0.0) return 0.0;
+    MPI_Bcast(&phi3_cache_size, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
-    ielem = 0;
+    phi3_cache_hit = 0;
+    phi3_cache_miss = 0;
+    phi3_cache_evict = 0;
+    phi3_cache.clear();
+    phi3_cache_lru.clear();
 
-    for (i = 0; i < ngroup; ++i) {
+    // Memory for the data plus a rough estimate of the overhead of the containers
+    size_entry = static_cast<double>(fc3_group.ngroup) * sizeof(std::complex<double>)
+        + sizeof(Phi3CacheEntry) + 128.0;
 
-        vec_tmp
-            = evec[0][mode][evec_index[i][0]]
-            * evec[1][is][evec_index[i][1]]
-            * evec[2][js][evec_index[i][2]]
-            * invmass_for_v3[i];
+    if (phi3_cache_size > 0) {
+        phi3_cache_capacity
+            = static_cast<unsigned long>(static_cast<double>(phi3_cache_size) * 1.0e+6 / size_entry);
+    } else {
+        phi3_cache_capacity = 0;
+    }
 
-        ret_in = std::complex<double>(0.0, 0.0);
+    if (mympi->my_rank == 0 && phi3_cache_size > 0) {
+        std::cout << std::endl;
+        std::cout << " PHI3_CACHE = " << phi3_cache_size
+            << " (MB) : Phase-weighted cubic IFCs Phi3(k1,k2) will be cached" << std::endl;
+        std::cout << "                   in memory (up to " << phi3_cache_capacity
+            << " pairs of (k1,k2) per MPI process)." << std::endl;
+        if (phi3_cache_capacity == 0) {
+            std::cout << "                   The given memory size is too small. The cache is switched off." << std::endl;
+        }
+        std::cout << std::endl;
+    }
+}
 
-        nsize_group = fcs_group[i].size();
 
-        for (j = 0; j < nsize_group; ++j) {
+void Relaxation::setup_tetrahedron_memory()
+{
+    // Upper limit of the memory size (in units of MB) used for the work arrays
+    // of calc_damping_tetrahedron. When TETRA_MEMORY = 0, all triplets
+    // are processed at once.
 
-            phase
-                = vec_for_v3[ielem][0][0] * xk2[0]
-                + vec_for_v3[ielem][0][1] * xk2[1]
-                + vec_for_v3[ielem][0][2] * xk2[2]
-                + vec_for_v3[ielem][1][0] * xk3[0]
-                + vec_for_v3[ielem][1][1] * xk3[1]
-                + vec_for_v3[ielem][1][2] * xk3[2];
+    MPI_Bcast(&tetra_memory_size, 1, MPI_INT, 0, MPI_COMM_WORLD);
 
-            ret_in += fcs_group[i][j] * std::exp(im * phase);
+    tetra_memory_peak = 0.0;
 
-            ++ielem;
-        }
-        ctmp += ret_in * vec_tmp;
+    if (mympi->my_rank == 0 && tetra_memory_size > 0 && integration->ismear == -1) {
+        std::cout << std::endl;
+        std::cout << " TETRA_MEMORY = " << tetra_memory_size
+            << " (MB) : Triplets will be processed in blocks" << std::endl;
+        std::cout << "                     in the tetrahedron integration." << std::endl;
+        std::cout << std::endl;
     }
-
-    return ctmp / std::sqrt(eval[0][mode] * eval[1][is] * eval[2][js]);
 }
 
 
-void Relaxation::calc_damping_smearing(const unsigned int N,
-                                       double *T,
-                                       const double omega,
-                                       const unsigned int ik_in,
-                                       const unsigned int snum,
-                                       double *ret)
+void Relaxation::print_tetrahedron_memory()
 {
-    // This function returns the imaginary part of phonon self-energy 
-    // for the given frequency omega.
-    // Lorentzian or Gaussian smearing will be used.
-    // This version employs the crystal symmetry to reduce the computational cost
-
-    unsigned int i;
-    int ik;
-    unsigned int is, js;
-    unsigned int arr[3];
-
-    int k1, k2;
-    int npair_uniq;
+    double mem_max;
 
-    double T_tmp;
-    double n1, n2;
-    double omega_inner[2];
+    MPI_Reduce(&tetra_memory_peak, &mem_max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
 
-    int knum, knum_minus;
-    double multi;
+    if (mympi->my_rank == 0 && mem_max > 0.0) {
+        std::cout << std::endl;
+        std::cout << " Peak memory of the work arrays in the tetrahedron integration : "
+            << std::fixed << std::setprecision(3) << mem_max * 1.0e-6
+            << " (MB per MPI process)" << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+        std::cout << std::setprecision(6) << std::endl;
+    }
+}
 
-    for (i = 0; i < N; ++i) ret[i] = 0.0;
 
-    double **v3_arr;
-    double ***delta_arr;
-    double ret_tmp;
+void Relaxation::setup_phi3_interpolation()
+{
+    // Fourier interpolation of Phi3(k1, k2) from the coarse mesh PHI3_MESH.
+    // Sampling Phi3 at all the (q1, q2) pairs of the coarse mesh and transforming it
+    // back to real space gives the cubic IFCs folded onto the supercell of the coarse mesh.
+    // Here, the folded IFCs are constructed directly from the real-space IFCs:
+    // elements whose lattice vectors coincide modulo the coarse mesh are merged,
+    // and the most compact image of the cluster is used as the representative.
+    // The merged IFCs are then used to evaluate Phi3 at (k1, k2) of the fine mesh.
+
+    unsigned int i, j, l, m;
+    unsigned int igroup, iimage;
+    unsigned int nelem_new;
+    const unsigned int N = 3;
+    int lvec;
+    double r[N][3], xtmp[3];
+    double dist, dtmp;
+    double **xc_prim;
+    std::vector<int> key(3 * (N - 1));
+    std::vector<int> group_start_new, elem_new;
+    std::vector<double> fcs_new, dist_min;
+    std::map<std::vector<int>, unsigned int> index_map;
+    std::map<std::vector<int>, unsigned int>::iterator it;
+
+    MPI_Bcast(phi3_mesh, 3, MPI_INT, 0, MPI_COMM_WORLD);
+
+    use_phi3_interpolation = phi3_mesh[0] > 0 && phi3_mesh[1] > 0 && phi3_mesh[2] > 0;
+
+    if (!use_phi3_interpolation) return;
+
+    if (!fc3_group.has_lattice_vec) {
+        error->exit("setup_phi3_interpolation",
+                    "The cubic IFCs cannot be mapped onto lattice vectors of the primitive cell.");
+    }
 
-    double f1, f2;
+    // Cartesian coordinates of the atoms in the primitive cell
+    // consistent with the relative vectors of the IFCs
 
-    double epsilon = integration->epsilon;
+    memory->allocate(xc_prim, system->natmin, 3);
 
-    std::vector<KsListGroup> triplet;
+    for (i = 0; i < system->natmin; ++i) {
+        for (m = 0; m < 3; ++m) xtmp[m] = system->xr_s_anharm[system->map_p2s_anharm[i][0]][m];
+        rotvec(xc_prim[i], xtmp, system->lavec_s_anharm);
+    }
 
-    get_unique_triplet_k(ik_in,
-                         use_triplet_symmetry,
-                         sym_permutation,
-                         triplet);
+    // The IFCs are identical on all MPI processes.
+    // Therefore, the folded IFCs are constructed on each process.
 
-    npair_uniq = triplet.size();
+    for (igroup = 0; igroup < fc3_group.ngroup; ++igroup) {
 
-    memory->allocate(v3_arr, npair_uniq, ns * ns);
-    memory->allocate(delta_arr, npair_uniq, ns * ns, 2);
+        group_start_new.push_back(fcs_new.size());
+        index_map.clear();
 
-    knum = kpoint->kpoint_irred_all[ik_in][0].knum;
-    knum_minus = kpoint->knum_minus[knum];
-#ifdef _OPENMP
-#pragma omp parallel for private(multi, arr, k1, k2, is, js, omega_inner)
-#endif
-    for (ik = 0; ik < npair_uniq; ++ik) {
-        multi = static_cast<double>(triplet[ik].group.size());
+        for (m = 0; m < 3; ++m) r[0][m] = xc_prim[fc3_group.evec_index[N * igroup] / 3][m];
 
-        arr[0] = ns * knum_minus + snum;
+        for (j = fc3_group.group_start[igroup]; j < static_cast<unsigned int>(fc3_group.group_start[igroup + 1]); ++j) {
 
-        k1 = triplet[ik].group[0].ks[0];
-        k2 = triplet[ik].group[0].ks[1];
+            for (l = 0; l < N - 1; ++l) {
+                for (m = 0; m < 3; ++m) {
+                    lvec = fc3_group.lattice_vec[3 * ((N - 1) * j + l) + m];
+                    key[3 * l + m] = (lvec % phi3_mesh[m] + phi3_mesh[m]) % phi3_mesh[m];
+                    xtmp[m] = static_cast<double>(lvec);
+                }
+                rotvec(r[l + 1], xtmp, system->lavec_p);
+                for (m = 0; m < 3; ++m) {
+                    r[l + 1][m] += xc_prim[fc3_group.evec_index[N * igroup + l + 1] / 3][m];
+                }
+            }
 
-        for (is = 0; is < ns; ++is) {
-            arr[1] = ns * k1 + is;
-            omega_inner[0] = dynamical->eval_phonon[k1][is];
+            // Sum of the squared distances between the atoms of the cluster
+            dist = 0.0;
+            for (l = 0; l < N; ++l) {
+                for (i = l + 1; i < N; ++i) {
+                    for (m = 0; m < 3; ++m) {
+                        dtmp = r[l][m] - r[i][m];
+                        dist += dtmp * dtmp;
+                    }
+                }
+            }
 
-            for (js = 0; js < ns; ++js) {
-                arr[2] = ns * k2 + js;
-                omega_inner[1] = dynamical->eval_phonon[k2][js];
+            it = index_map.find(key);
 
-                v3_arr[ik][ns * is + js] = std::norm(V3(arr)) * multi;
-
-                if (integration->ismear == 0) {
-                    delta_arr[ik][ns * is + js][0]
-                        = delta_lorentz(omega - omega_inner[0] - omega_inner[1], epsilon)
-                        - delta_lorentz(omega + omega_inner[0] + omega_inner[1], epsilon);
-                    delta_arr[ik][ns * is + js][1]
-                        = delta_lorentz(omega - omega_inner[0] + omega_inner[1], epsilon)
-                        - delta_lorentz(omega + omega_inner[0] - omega_inner[1], epsilon);
-                } else if (integration->ismear == 1) {
-                    delta_arr[ik][ns * is + js][0]
-                        = delta_gauss(omega - omega_inner[0] - omega_inner[1], epsilon)
-                        - delta_gauss(omega + omega_inner[0] + omega_inner[1], epsilon);
-                    delta_arr[ik][ns * is + js][1]
-                        = delta_gauss(omega - omega_inner[0] + omega_inner[1], epsilon)
-                        - delta_gauss(omega + omega_inner[0] - omega_inner[1], epsilon);
+            if (it == index_map.end()) {
+                index_map[key] = fcs_new.size();
+                fcs_new.push_back(fc3_group.fcs[j]);
+                dist_min.push_back(dist);
+                elem_new.push_back(j);
+            } else {
+                iimage = (*it).second;
+                fcs_new[iimage] += fc3_group.fcs[j];
+                if (dist < dist_min[iimage] - eps6) {
+                    dist_min[iimage] = dist;
+                    elem_new[iimage] = j;
                 }
             }
         }
     }
 
-    for (i = 0; i < N; ++i) {
-        T_tmp = T[i];
-        ret_tmp = 0.0;
-#ifdef _OPENMP
-#pragma omp parallel for private(k1, k2, is, js, omega_inner, n1, n2, f1, f2), reduction(+:ret_tmp)
-#endif
-        for (ik = 0; ik < npair_uniq; ++ik) {
+    memory->deallocate(xc_prim);
 
-            k1 = triplet[ik].group[0].ks[0];
-            k2 = triplet[ik].group[0].ks[1];
+    nelem_new = fcs_new.size();
+    group_start_new.push_back(nelem_new);
 
-            for (is = 0; is < ns; ++is) {
+    fc3_group_interp.allocate(N, fc3_group.ngroup, nelem_new);
 
-                omega_inner[0] = dynamical->eval_phonon[k1][is];
-                f1 = thermodynamics->fB(omega_inner[0], T_tmp);
+    for (igroup = 0; igroup <= fc3_group.ngroup; ++igroup) {
+        fc3_group_interp.group_start[igroup] = group_start_new[igroup];
+    }
+    for (igroup = 0; igroup < fc3_group.ngroup; ++igroup) {
+        fc3_group_interp.invmass[igroup] = fc3_group.invmass[igroup];
+        for (l = 0; l < N; ++l) {
+            fc3_group_interp.evec_index[N * igroup + l] = fc3_group.evec_index[N * igroup + l];
+        }
+    }
+    for (j = 0; j < nelem_new; ++j) {
+        fc3_group_interp.fcs[j] = fcs_new[j];
+        for (l = 0; l < 3 * (N - 1); ++l) {
+            fc3_group_interp.relvec[3 * (N - 1) * j + l]
+                = fc3_group.relvec[3 * (N - 1) * elem_new[j] + l];
+            fc3_group_interp.lattice_vec[3 * (N - 1) * j + l]
+                = fc3_group.lattice_vec[3 * (N - 1) * elem_new[j] + l];
+        }
+    }
+    fc3_group_interp.has_lattice_vec = true;
+
+    if (mympi->my_rank == 0) {
+        std::cout << std::endl;
+        std::cout << " PHI3_MESH = " << phi3_mesh[0] << " " << phi3_mesh[1] << " " << phi3_mesh[2]
+            << " : Phi3(k1,k2) will be Fourier interpolated" << std::endl;
+        std::cout << "                   from the coarse mesh." << std::endl;
+        std::cout << "  Number of cubic IFC elements : " << fc3_group.nelem
+            << " (direct) -> " << nelem_new << " (interpolated)" << std::endl;
+    }
+
+    estimate_phi3_interpolation_error();
+}
+
+
+void Relaxation::estimate_phi3_interpolation_error()
+{
+    // Estimate the error of the interpolated |V3|^2 by comparing with
+    // the direct evaluation for a sample of triplets (k0, k1, k2)
+    // with k0 + k1 + k2 = G. The triplets including the Gamma point are skipped.
+
+    const unsigned int nsample_max = 100;
+    unsigned int i, s0;
+    unsigned int isample, nsample;
+    unsigned long ipair;
+    int k0, k1, k2;
+    int ncount, ncount_sum;
+    double xk0[3];
+    double norm2, diff2, err;
+    double err_sum, err_max, err_sum_all, err_max_all;
+    double *v3_direct, *v3_interp;
+    std::complex<double> *phase_direct, *phase_interp;
+
+    nsample = nsample_max;
+    if (static_cast<unsigned long>(nk) * static_cast<unsigned long>(nk) < nsample) {
+        nsample = nk * nk;
+    }
+
+    memory->allocate(phase_direct, fc3_group.ngroup);
+    memory->allocate(phase_interp, fc3_group.ngroup);
+    memory->allocate(v3_direct, ns * ns);
+    memory->allocate(v3_interp, ns * ns);
+
+    ncount = 0;
+    err_sum = 0.0;
+    err_max = 0.0;
+
+    for (isample = mympi->my_rank; isample < nsample; isample += mympi->nprocs) {
+
+        // Quasi-random (k1, k2) pairs
+        ipair = (static_cast<unsigned long>(isample) * 2654435761UL + 1)
+            % (static_cast<unsigned long>(nk) * static_cast<unsigned long>(nk));
+        k1 = ipair / nk;
+        k2 = ipair % nk;
+
+        for (i = 0; i < 3; ++i) xk0[i] = -kpoint->xk[k1][i] - kpoint->xk[k2][i];
+        k0 = kpoint->get_knum(xk0[0], xk0[1], xk0[2]);
+
+        if (k0 == -1) continue;
+        if (is_gamma_point(k0) || is_gamma_point(k1) || is_gamma_point(k2)) continue;
+
+        calc_phase_sum_v3(fc3_group, k1, k2, phase_direct);
+        calc_phase_sum_v3(fc3_group_interp, k1, k2, phase_interp);
+
+        norm2 = 0.0;
+        diff2 = 0.0;
+
+        for (s0 = 0; s0 < ns; ++s0) {
+            if (dynamical->eval_phonon[k0][s0] < 0.0) continue;
+
+            contract_phase_sum_v3(k0, s0, k1, k2, phase_direct, v3_direct);
+            contract_phase_sum_v3(k0, s0, k1, k2, phase_interp, v3_interp);
+
+            for (i = 0; i < ns * ns; ++i) {
+                norm2 += v3_direct[i] * v3_direct[i];
+                diff2 += std::pow(v3_interp[i] - v3_direct[i], 2);
+            }
+        }
+
+        if (norm2 < eps15) continue;
+
+        err = std::sqrt(diff2 / norm2);
+        err_sum += err;
+        err_max = std::max<double>(err_max, err);
+        ++ncount;
+    }
+
+    memory->deallocate(phase_direct);
+    memory->deallocate(phase_interp);
+    memory->deallocate(v3_direct);
+    memory->deallocate(v3_interp);
+
+    MPI_Reduce(&ncount, &ncount_sum, 1, MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&err_sum, &err_sum_all, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+    MPI_Reduce(&err_max, &err_max_all, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    if (mympi->my_rank == 0) {
+        std::cout << "  Relative error of |V3|^2 against the direct evaluation" << std::endl;
+        std::cout << "  (" << ncount_sum << " sampled triplets) :" << std::endl;
+        if (ncount_sum > 0) {
+            std::cout << "   Average : " << std::scientific << std::setprecision(3)
+                << err_sum_all / static_cast<double>(ncount_sum) << std::endl;
+            std::cout << "   Maximum : " << err_max_all << std::endl;
+            std::cout.unsetf(std::ios::scientific);
+            std::cout << std::setprecision(6);
+        }
+        std::cout << std::endl;
+    }
+}
+
+
+bool Relaxation::is_gamma_point(const unsigned int knum)
+{
+    for (unsigned int i = 0; i < 3; ++i) {
+        if (std::abs(kpoint->xk[knum][i]) > eps8) return false;
+    }
+    return true;
+}
+
+
+void Relaxation::get_phase_sum_v3(const unsigned int k1,
+                                  const unsigned int k2,
+                                  std::complex<double> *ret)
+{
+    // Returns the phase-weighted sum of cubic force constants for (k1, k2).
+    // If the cache is active, the stored value is reused when possible.
+    // Least recently used entries are discarded when the cache is full.
+
+    int i;
+    bool found;
+    unsigned long key;
+    std::map<unsigned long, Phi3CacheEntry>::iterator it;
+
+    const FcsGroupArray &fcs_in = use_phi3_interpolation ? fc3_group_interp : fc3_group;
+
+    if (phi3_cache_capacity == 0) {
+        calc_phase_sum_v3(fcs_in, k1, k2, ret);
+        return;
+    }
+
+    key = static_cast<unsigned long>(k1) * static_cast<unsigned long>(nk) + k2;
+    found = false;
+
+#ifdef _OPENMP
+#pragma omp critical (phi3_cache_access)
+#endif
+    {
+        it = phi3_cache.find(key);
+        if (it != phi3_cache.end()) {
+            found = true;
+            for (i = 0; i < static_cast<int>(fc3_group.ngroup); ++i) ret[i] = (*it).second.phi3[i];
+            phi3_cache_lru.splice(phi3_cache_lru.begin(), phi3_cache_lru, (*it).second.pos_lru);
+            ++phi3_cache_hit;
+        } else {
+            ++phi3_cache_miss;
+        }
+    }
+
+    if (found) return;
+
+    calc_phase_sum_v3(fcs_in, k1, k2, ret);
+
+#ifdef _OPENMP
+#pragma omp critical (phi3_cache_access)
+#endif
+    {
+        // Another thread may have stored the same entry in the meantime.
+        if (phi3_cache.find(key) == phi3_cache.end()) {
+
+            if (phi3_cache.size() >= phi3_cache_capacity) {
+                phi3_cache.erase(phi3_cache_lru.back());
+                phi3_cache_lru.pop_back();
+                ++phi3_cache_evict;
+            }
+
+            phi3_cache_lru.push_front(key);
+            Phi3CacheEntry &entry = phi3_cache[key];
+            entry.phi3.assign(ret, ret + fc3_group.ngroup);
+            entry.pos_lru = phi3_cache_lru.begin();
+        }
+    }
+}
+
+
+void Relaxation::print_phi3_cache_statistics()
+{
+    unsigned long nstat[3], nstat_sum[3];
+    double ratio;
+
+    nstat[0] = phi3_cache_hit;
+    nstat[1] = phi3_cache_miss;
+    nstat[2] = phi3_cache_evict;
+
+    MPI_Reduce(&nstat[0], &nstat_sum[0], 3, MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if (mympi->my_rank == 0) {
+        if (nstat_sum[0] + nstat_sum[1] > 0) {
+            ratio = static_cast<double>(nstat_sum[0])
+                / static_cast<double>(nstat_sum[0] + nstat_sum[1]);
+        } else {
+            ratio = 0.0;
+        }
+        std::cout << std::endl;
+        std::cout << " Statistics of the Phi3(k1,k2) cache (sum over MPI processes) :" << std::endl;
+        std::cout << "  Hits      : " << std::setw(12) << nstat_sum[0] << std::endl;
+        std::cout << "  Misses    : " << std::setw(12) << nstat_sum[1] << std::endl;
+        std::cout << "  Evictions : " << std::setw(12) << nstat_sum[2] << std::endl;
+        std::cout << "  Hit ratio : " << std::setw(12) << std::fixed
+            << std::setprecision(4) << ratio << std::endl;
+        std::cout.unsetf(std::ios::fixed);
+        std::cout << std::setprecision(6) << std::endl;
+    }
+}
+
+
+void Relaxation::calc_V3norm2_batch(const unsigned int k0,
+                                    const unsigned int s0,
+                                    const unsigned int k1,
+                                    const unsigned int k2,
+                                    double *ret)
+{
+    // Returns |V3(k0 s0, k1 is, k2 js)|^2 for all (is, js) at once.
+    // ret[ns * is + js] corresponds to the pair (is, js).
+    //
+    // The phase factors only depend on (k1, k2) and are evaluated once per group.
+
+    unsigned int i;
+    unsigned int is, js;
+    std::complex<double> *phase_sum;
+
+    // Return zero if the first phonon has imaginary frequency
+    if (dynamical->eval_phonon[k0][s0] < 0.0) {
+        for (i = 0; i < ns * ns; ++i) ret[i] = 0.0;
+        return;
+    }
+
+    memory->allocate(phase_sum, fc3_group.ngroup);
+
+    get_phase_sum_v3(k1, k2, phase_sum);
+    if (use_mixed_precision) {
+        contract_phase_sum_v3_mixed(k0, s0, k1, k2, phase_sum, ret);
+    } else {
+        contract_phase_sum_v3(k0, s0, k1, k2, phase_sum, ret);
+    }
+
+    memory->deallocate(phase_sum);
+
+    if (use_phi3_interpolation || use_mixed_precision) {
+        // The interpolated IFCs satisfy the acoustic sum rule only approximately,
+        // and the rounding errors of the mixed-precision contraction are
+        // amplified by 1/omega of the acoustic modes at Gamma.
+        // Scattering by the acoustic modes at Gamma, which must vanish,
+        // is therefore removed explicitly.
+        for (is = 0; is < ns; ++is) {
+            for (js = 0; js < ns; ++js) {
+                if ((is_gamma_point(k1) && is < 3) || (is_gamma_point(k2) && js < 3)) {
+                    ret[ns * is + js] = 0.0;
+                }
+            }
+        }
+    }
+}
+
+
+void Relaxation::contract_phase_sum_v3(const unsigned int k0,
+                                       const unsigned int s0,
+                                       const unsigned int k1,
+                                       const unsigned int k2,
+                                       const std::complex<double> *phase_sum,
+                                       double *ret)
+{
+    // Contracts the phase-weighted cubic force constants with the eigenvectors
+    // and returns |V3(k0 s0, k1 is, k2 js)|^2 in ret[ns * is + js].
+    // The contraction is performed as
+    //   V(is, js) = sum_{b, c} e1(is, b) * M(b, c) * e2(js, c),
+    // where M(b, c) = sum_{i in groups with (b, c)} P_i * e0(a_i),
+    // which can be done by two dense complex matrix-matrix multiplications.
+    // The frequency of the first phonon must be non-negative.
+
+    unsigned int i;
+    unsigned int is, js;
+    int n = ns;
+    const int *evec_idx;
+    double omega0, factor;
+    std::complex<double> *mat_fc, *mat_tmp, *mat_v3;
+    std::complex<double> alpha = std::complex<double>(1.0, 0.0);
+    std::complex<double> beta = std::complex<double>(0.0, 0.0);
+    char TRANSA, TRANSB;
+
+    omega0 = dynamical->eval_phonon[k0][s0];
+
+    memory->allocate(mat_fc, ns * ns);
+    memory->allocate(mat_tmp, ns * ns);
+    memory->allocate(mat_v3, ns * ns);
+
+    // Build M(b, c) in the column-major order
+    for (i = 0; i < ns * ns; ++i) mat_fc[i] = std::complex<double>(0.0, 0.0);
+
+    for (i = 0; i < fc3_group.ngroup; ++i) {
+        evec_idx = fc3_group.evec_index + 3 * i;
+        mat_fc[evec_idx[1] + ns * evec_idx[2]]
+            += phase_sum[i] * dynamical->evec_phonon[k0][s0][evec_idx[0]];
+    }
+
+    // evec_phonon[k][s][b] is regarded as the column-major matrix E^T(b, s).
+
+    // T(b, js) = sum_c M(b, c) * e2(js, c)
+    TRANSA = 'N';
+    TRANSB = 'N';
+    zgemm_(&TRANSA, &TRANSB, &n, &n, &n, &alpha, mat_fc, &n,
+           &dynamical->evec_phonon[k2][0][0], &n, &beta, mat_tmp, &n);
+
+    // V(is, js) = sum_b e1(is, b) * T(b, js)
+    TRANSA = 'T';
+    zgemm_(&TRANSA, &TRANSB, &n, &n, &n, &alpha,
+           &dynamical->evec_phonon[k1][0][0], &n, mat_tmp, &n, &beta, mat_v3, &n);
+
+    for (is = 0; is < ns; ++is) {
+        for (js = 0; js < ns; ++js) {
+            if (dynamical->eval_phonon[k1][is] < 0.0 || dynamical->eval_phonon[k2][js] < 0.0) {
+                ret[ns * is + js] = 0.0;
+            } else {
+                factor = omega0 * dynamical->eval_phonon[k1][is] * dynamical->eval_phonon[k2][js];
+                ret[ns * is + js] = std::norm(mat_v3[is + ns * js]) / factor;
+            }
+        }
+    }
+
+    memory->deallocate(mat_fc);
+    memory->deallocate(mat_tmp);
+    memory->deallocate(mat_v3);
+}
+
+
+void Relaxation::setup_mixed_precision()
+{
+    // V3_MIXED = 1 : the eigenvectors and the phase-weighted IFCs are rounded
+    // to single precision in the contraction of |V3|^2, while the sums are
+    // accumulated in double precision (see matmul_mixed). The phase sums
+    // Phi3(k1,k2) themselves are always evaluated in double precision because
+    // rounding the IFCs breaks the cancellation due to the acoustic sum rule.
+
+    MPI_Bcast(&use_mixed_precision, 1, MPI_LOGICAL, 0, MPI_COMM_WORLD);
+
+    if (mympi->my_rank == 0 && use_mixed_precision) {
+        std::cout << std::endl;
+        std::cout << " V3_MIXED = 1 : |V3|^2 will be contracted with single-precision products" << std::endl;
+        std::cout << "                and double-precision accumulation." << std::endl;
+    }
+}
+
+
+void Relaxation::estimate_mixed_precision_error()
+{
+    // Compare the linewidths of sampled phonon modes at TMIN and TMAX evaluated
+    // with the mixed-precision contraction with those evaluated in double precision.
+    // Half of the samples are the modes of the lowest frequencies, for which
+    // the cancellation in V3 is the strongest, and the rest are chosen quasi-randomly.
+    // The mixed-precision contraction is switched off when the deviation
+    // exceeds the tolerance.
+
+    const unsigned int nsample_max = 16;
+    const double tolerance = 1.0e-4;
+    unsigned int i, isample, nsample;
+    unsigned int ik, snum, knum;
+    unsigned long nks_irred, iks;
+    int ncount, ncount_sum;
+    double omega, T[2];
+    double gamma_double[2], gamma_mixed[2];
+    double err, err_max, err_max_all;
+    std::vector<std::pair<double, unsigned long> > mode_list;
+    std::vector<unsigned long> sample_list;
+
+    nks_irred = static_cast<unsigned long>(kpoint->kpoint_irred_all.size()) * ns;
+
+    for (iks = 0; iks < nks_irred; ++iks) {
+        knum = kpoint->kpoint_irred_all[iks / ns][0].knum;
+        omega = dynamical->eval_phonon[knum][iks % ns];
+        if (omega < eps8) continue;
+        mode_list.push_back(std::make_pair(omega, iks));
+    }
+    std::sort(mode_list.begin(), mode_list.end());
+
+    nsample = nsample_max;
+    if (mode_list.size() < nsample) nsample = mode_list.size();
+
+    for (isample = 0; isample < nsample / 2; ++isample) {
+        sample_list.push_back(mode_list[isample].second);
+    }
+    for (isample = nsample / 2; isample < nsample; ++isample) {
+        iks = (static_cast<unsigned long>(isample) * 2654435761UL + 1) % mode_list.size();
+        sample_list.push_back(mode_list[iks].second);
+    }
+
+    T[0] = system->Tmin;
+    T[1] = system->Tmax;
+
+    ncount = 0;
+    err_max = 0.0;
+
+    for (isample = mympi->my_rank; isample < nsample; isample += mympi->nprocs) {
+
+        ik = sample_list[isample] / ns;
+        snum = sample_list[isample] % ns;
+        knum = kpoint->kpoint_irred_all[ik][0].knum;
+        omega = dynamical->eval_phonon[knum][snum];
+
+        use_mixed_precision = false;
+        if (integration->ismear == -1) {
+            calc_damping_tetrahedron(2, T, omega, ik, snum, gamma_double);
+        } else {
+            calc_damping_smearing(2, T, omega, ik, snum, gamma_double);
+        }
+
+        use_mixed_precision = true;
+        if (integration->ismear == -1) {
+            calc_damping_tetrahedron(2, T, omega, ik, snum, gamma_mixed);
+        } else {
+            calc_damping_smearing(2, T, omega, ik, snum, gamma_mixed);
+        }
+
+        for (i = 0; i < 2; ++i) {
+            if (std::abs(gamma_double[i]) < eps15) continue;
+            err = std::abs(gamma_mixed[i] - gamma_double[i]) / std::abs(gamma_double[i]);
+            err_max = std::max<double>(err_max, err);
+        }
+        ++ncount;
+    }
+
+    MPI_Allreduce(&ncount, &ncount_sum, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&err_max, &err_max_all, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+
+    if (mympi->my_rank == 0) {
+        std::cout << "  Relative deviation of the linewidths from the double-precision values" << std::endl;
+        std::cout << "  (" << ncount_sum << " sampled modes at T = " << T[0]
+            << " and " << T[1] << " K) :" << std::endl;
+        std::cout << "   Maximum : " << std::scientific << std::setprecision(3)
+            << err_max_all << std::endl;
+        std::cout.unsetf(std::ios::scientific);
+        std::cout << std::setprecision(6);
+        std::cout << std::endl;
+    }
+
+    if (err_max_all > tolerance) {
+        use_mixed_precision = false;
+        if (mympi->my_rank == 0) {
+            error->warn("estimate_mixed_precision_error",
+                        "The deviation exceeds 1.0e-4. V3_MIXED is switched off.");
+        }
+    }
+}
+
+
+void Relaxation::contract_phase_sum_v3_mixed(const unsigned int k0,
+                                             const unsigned int s0,
+                                             const unsigned int k1,
+                                             const unsigned int k2,
+                                             const std::complex<double> *phase_sum,
+                                             double *ret)
+{
+    // Mixed-precision version of contract_phase_sum_v3.
+    // M(b, c) and the eigenvectors of k1 and k2 are rounded to single precision
+    // and multiplied by cgemm, while M(b, c), T(b, js), and V(is, js) are
+    // accumulated in double precision.
+
+    unsigned int i;
+    unsigned int is, js;
+    int n = ns;
+    const int *evec_idx;
+    const std::complex<double> *evec0 = dynamical->evec_phonon[k0][s0];
+    double omega0, factor;
+    float p_re, p_im, e_re, e_im;
+    std::complex<double> *mat_fc, *mat_tmp;
+    std::complex<float> *mat_a, *mat_b, *mat_work;
+
+    omega0 = dynamical->eval_phonon[k0][s0];
+
+    memory->allocate(mat_fc, ns * ns);
+    memory->allocate(mat_tmp, ns * ns);
+    memory->allocate(mat_a, ns * ns);
+    memory->allocate(mat_b, ns * ns);
+    memory->allocate(mat_work, ns * ns);
+
+    // M(b, c) in the column-major order with single-precision products
+    for (i = 0; i < ns * ns; ++i) mat_fc[i] = std::complex<double>(0.0, 0.0);
+
+    for (i = 0; i < fc3_group.ngroup; ++i) {
+        evec_idx = fc3_group.evec_index + 3 * i;
+        p_re = static_cast<float>(phase_sum[i].real());
+        p_im = static_cast<float>(phase_sum[i].imag());
+        e_re = static_cast<float>(evec0[evec_idx[0]].real());
+        e_im = static_cast<float>(evec0[evec_idx[0]].imag());
+        mat_fc[evec_idx[1] + ns * evec_idx[2]]
+            += std::complex<double>(p_re * e_re - p_im * e_im, p_re * e_im + p_im * e_re);
+    }
+
+    // T(b, js) = sum_c M(b, c) * e2(js, c)
+    for (i = 0; i < ns * ns; ++i) {
+        mat_a[i] = std::complex<float>(mat_fc[i]);
+        mat_b[i] = std::complex<float>((&dynamical->evec_phonon[k2][0][0])[i]);
+    }
+    matmul_mixed('N', n, mat_a, mat_b, mat_work, mat_tmp);
+
+    // V(is, js) = sum_b e1(is, b) * T(b, js)
+    for (i = 0; i < ns * ns; ++i) {
+        mat_a[i] = std::complex<float>((&dynamical->evec_phonon[k1][0][0])[i]);
+        mat_b[i] = std::complex<float>(mat_tmp[i]);
+    }
+    matmul_mixed('T', n, mat_a, mat_b, mat_work, mat_fc);
+
+    for (is = 0; is < ns; ++is) {
+        for (js = 0; js < ns; ++js) {
+            if (dynamical->eval_phonon[k1][is] < 0.0 || dynamical->eval_phonon[k2][js] < 0.0) {
+                ret[ns * is + js] = 0.0;
+            } else {
+                factor = omega0 * dynamical->eval_phonon[k1][is] * dynamical->eval_phonon[k2][js];
+                ret[ns * is + js] = std::norm(mat_fc[is + ns * js]) / factor;
+            }
+        }
+    }
+
+    memory->deallocate(mat_fc);
+    memory->deallocate(mat_tmp);
+    memory->deallocate(mat_a);
+    memory->deallocate(mat_b);
+    memory->deallocate(mat_work);
+}
+
+
+void Relaxation::matmul_mixed(const char transa,
+                              int n,
+                              std::complex<float> *mat_a,
+                              std::complex<float> *mat_b,
+                              std::complex<float> *mat_work,
+                              std::complex<double> *mat_c)
+{
+    // C = op(A) * B for complex n x n matrices in the column-major order,
+    // where op(A) = A (transa = 'N') or A^T (transa = 'T').
+    // The summation index is split into blocks of nblock. The partial products of
+    // each block are evaluated by cgemm and accumulated in double precision,
+    // so that the rounding error does not grow with n.
+
+    const int nblock = 64;
+    int i, kstart, nk_block;
+    std::complex<float> alpha = std::complex<float>(1.0, 0.0);
+    std::complex<float> beta = std::complex<float>(0.0, 0.0);
+    char TRANSB = 'N';
+
+    for (i = 0; i < n * n; ++i) mat_c[i] = std::complex<double>(0.0, 0.0);
+
+    for (kstart = 0; kstart < n; kstart += nblock) {
+        nk_block = std::min<int>(nblock, n - kstart);
+
+        if (transa == 'N') {
+            cgemm_(&transa, &TRANSB, &n, &n, &nk_block, &alpha, mat_a + n * kstart, &n,
+                   mat_b + kstart, &n, &beta, mat_work, &n);
+        } else {
+            cgemm_(&transa, &TRANSB, &n, &n, &nk_block, &alpha, mat_a + kstart, &n,
+                   mat_b + kstart, &n, &beta, mat_work, &n);
+        }
+
+        for (i = 0; i < n * n; ++i) mat_c[i] += std::complex<double>(mat_work[i]);
+    }
+}
+
+
+std::complex<double> Relaxation::V3_mode(int mode,
+                                         double *xk2,
+                                         double *xk3,
+                                         int is,
+                                         int js,
+                                         double **eval,
+                                         std::complex<double> ***evec)
+{
+    unsigned int i;
+    const int *evec_idx;
+    const double *xk_tmp[2] = {xk2, xk3};
+
+    std::complex<double> ctmp = std::complex<double>(0.0, 0.0);
+    std::complex<double> vec_tmp;
+
+    // Return zero if any of the involving phonon has imaginary frequency
+    if (eval[0][mode] < 0.0 || eval[1][is] < 0.0 || eval[2][js] < 0.0) return 0.0;
+
+    for (i = 0; i < fc3_group.ngroup; ++i) {
+
+        evec_idx = fc3_group.evec_index + 3 * i;
+
+        vec_tmp
+            = evec[0][mode][evec_idx[0]]
+            * evec[1][is][evec_idx[1]]
+            * evec[2][js][evec_idx[2]]
+            * fc3_group.invmass[i];
+
+        ctmp += sum_fcs_with_phase<3>(fc3_group, i, 0, xk_tmp) * vec_tmp;
+    }
+
+    return ctmp / std::sqrt(eval[0][mode] * eval[1][is] * eval[2][js]);
+}
 
-                for (js = 0; js < ns; ++js) {
 
+void Relaxation::calc_damping_smearing(const unsigned int N,
+                                       double *T,
+                                       const double omega,
+                                       const unsigned int ik_in,
+                                       const unsigned int snum,
+                                       double *ret,
+                                       ScatteringRecord *record)
+{
+    // This function returns the imaginary part of phonon self-energy 
+    // for the given frequency omega.
+    // Lorentzian or Gaussian smearing will be used.
+    // This version employs the crystal symmetry to reduce the computational cost
+    // When record is given, the scattering weights of each triplet are also
+    // returned for the iterative solution of the BTE.
+
+    unsigned int i;
+    int ik;
+    unsigned int is, js;
+
+    int k1, k2;
+    int npair_uniq;
+
+    double omega_inner[2];
+    double delta_tmp[2];
+
+    int knum, knum_minus;
+    double multi;
+
+    if (integration->ismear != 0 && integration->ismear != 1) {
+        error->exit("calc_damping_smearing", "Invalid ismear");
+    }
+
+    for (i = 0; i < N; ++i) ret[i] = 0.0;
+
+    double *v3_tmp;
+    double **f1_tmp, **f2_tmp;
+    double *ret_loc;
+    double *f1, *f2;
+    double w1, w2;
+
+    double epsilon = integration->epsilon;
+    double prefactor = pi * std::pow(0.5, 4) / static_cast<double>(nk);
+
+    std::vector<KsListGroup> triplet;
+    std::vector<std::vector<int> > ibranch_tri;
+    std::vector<std::vector<float> > weight_tri;
+
+    get_unique_triplet_k(ik_in,
+                         use_triplet_symmetry,
+                         sym_permutation,
+                         triplet);
+
+    npair_uniq = triplet.size();
+
+    knum = kpoint->kpoint_irred_all[ik_in][0].knum;
+    knum_minus = kpoint->knum_minus[knum];
+
+    if (record) {
+        ibranch_tri.resize(npair_uniq);
+        weight_tri.resize(npair_uniq);
+    }
+
+    // All temperatures are evaluated in a single pass over the triplets.
+    // For each pair (k1,k2), the Bose-Einstein occupations of all branches
+    // are tabulated for all temperatures once, and the innermost loop
+    // runs over temperatures.
+
+#ifdef _OPENMP
+#pragma omp parallel private(i, multi, k1, k2, is, js, omega_inner, delta_tmp, \
+    v3_tmp, f1_tmp, f2_tmp, ret_loc, f1, f2, w1, w2)
+#endif
+    {
+        memory->allocate(v3_tmp, ns * ns);
+        memory->allocate(f1_tmp, ns, N);
+        memory->allocate(f2_tmp, ns, N);
+        memory->allocate(ret_loc, N);
+
+        for (i = 0; i < N; ++i) ret_loc[i] = 0.0;
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+        for (ik = 0; ik < npair_uniq; ++ik) {
+            multi = static_cast<double>(triplet[ik].group.size());
+
+            k1 = triplet[ik].group[0].ks[0];
+            k2 = triplet[ik].group[0].ks[1];
+
+            calc_V3norm2_batch(knum_minus, snum, k1, k2, v3_tmp);
+
+            for (is = 0; is < ns; ++is) {
+                for (i = 0; i < N; ++i) {
+                    f1_tmp[is][i] = thermodynamics->fB(dynamical->eval_phonon[k1][is], T[i]);
+                    f2_tmp[is][i] = thermodynamics->fB(dynamical->eval_phonon[k2][is], T[i]);
+                }
+            }
+
+            for (is = 0; is < ns; ++is) {
+                omega_inner[0] = dynamical->eval_phonon[k1][is];
+                f1 = f1_tmp[is];
+
+                for (js = 0; js < ns; ++js) {
                     omega_inner[1] = dynamical->eval_phonon[k2][js];
-                    f2 = thermodynamics->fB(omega_inner[1], T_tmp);
+                    f2 = f2_tmp[js];
 
-                    n1 = f1 + f2 + 1.0;
-                    n2 = f1 - f2;
+                    if (integration->ismear == 0) {
+                        delta_tmp[0]
+                            = delta_lorentz(omega - omega_inner[0] - omega_inner[1], epsilon)
+                            - delta_lorentz(omega + omega_inner[0] + omega_inner[1], epsilon);
+                        delta_tmp[1]
+                            = delta_lorentz(omega - omega_inner[0] + omega_inner[1], epsilon)
+                            - delta_lorentz(omega + omega_inner[0] - omega_inner[1], epsilon);
+                    } else {
+                        delta_tmp[0]
+                            = delta_gauss(omega - omega_inner[0] - omega_inner[1], epsilon)
+                            - delta_gauss(omega + omega_inner[0] + omega_inner[1], epsilon);
+                        delta_tmp[1]
+                            = delta_gauss(omega - omega_inner[0] + omega_inner[1], epsilon)
+                            - delta_gauss(omega + omega_inner[0] - omega_inner[1], epsilon);
+                    }
+
+                    w1 = multi * v3_tmp[ns * is + js] * delta_tmp[0];
+                    w2 = multi * v3_tmp[ns * is + js] * delta_tmp[1];
 
-                    ret_tmp += v3_arr[ik][ns * is + js]
-                        * (n1 * delta_arr[ik][ns * is + js][0]
-                            - n2 * delta_arr[ik][ns * is + js][1]);
+                    if (record && (w1 != 0.0 || w2 != 0.0)) {
+                        ibranch_tri[ik].push_back(ns * is + js);
+                        weight_tri[ik].push_back(prefactor * v3_tmp[ns * is + js] * delta_tmp[0]);
+                        weight_tri[ik].push_back(prefactor * v3_tmp[ns * is + js] * delta_tmp[1]);
+                    }
+
+                    // n1 = f1 + f2 + 1, n2 = f1 - f2
+                    for (i = 0; i < N; ++i) {
+                        ret_loc[i] += w1 * (f1[i] + f2[i] + 1.0) - w2 * (f1[i] - f2[i]);
+                    }
                 }
             }
         }
-        ret[i] = ret_tmp;
+
+#ifdef _OPENMP
+#pragma omp critical (damping_smearing_reduction)
+#endif
+        {
+            for (i = 0; i < N; ++i) ret[i] += ret_loc[i];
+        }
+
+        memory->deallocate(v3_tmp);
+        memory->deallocate(f1_tmp);
+        memory->deallocate(f2_tmp);
+        memory->deallocate(ret_loc);
     }
 
-    memory->deallocate(v3_arr);
-    memory->deallocate(delta_arr);
+    if (record) store_scattering_record(triplet, ibranch_tri, weight_tri, record);
+
     triplet.clear();
 
-    for (i = 0; i < N; ++i) ret[i] *= pi * std::pow(0.5, 4) / static_cast<double>(nk);
+    for (i = 0; i < N; ++i) ret[i] *= prefactor;
 }
 
 void Relaxation::calc_damping_tetrahedron(const unsigned int N,
@@ -951,13 +1690,25 @@ void Relaxation::calc_damping_tetrahedron(const unsigned int N,
                                           const double omega,
                                           const unsigned int ik_in,
                                           const unsigned int snum,
-                                          double *ret)
+                                          double *ret,
+                                          ScatteringRecord *record)
 {
     // This function returns the imaginary part of phonon self-energy 
     // for the given frequency omega.
     // Tetrahedron method will be used.
     // This version employs the crystal symmetry to reduce the computational cost
 
+    // The triplets are processed in blocks so that the work arrays fit in
+    // the memory size given by TETRA_MEMORY. The contribution of each triplet
+    // is summed in the order of the triplets, so the result does not depend
+    // on the block size nor on the number of threads.
+    // The tetrahedron weights of all branch pairs are computed once and kept
+    // when they fit in TETRA_MEMORY together with one triplet. Otherwise,
+    // they are recomputed for each block.
+    // When record is given, the scattering weights of each triplet are also
+    // returned for the iterative solution of the BTE. The tetrahedron weights
+    // of the representative pair are used for all the members of the group.
+
     int ik, ib;
     int ns2 = ns * ns;
 
@@ -965,27 +1716,34 @@ void Relaxation::calc_damping_tetrahedron(const unsigned int N,
     unsigned int jk;
     unsigned int is, js;
     unsigned int k1, k2;
-    unsigned int arr[3];
     unsigned int npair_uniq;
+    unsigned int nblock, ik_begin, ik_end, nlocal;
+    int nthreads;
 
     int knum, knum_minus;
+    bool has_weight;
 
-    double T_tmp;
-    double n1, n2;
-    double f1, f2;
-
-    double xk_tmp[3];
-    double omega_inner[2];
-
-    double ret_tmp;
+    double w1, w2;
+    double mem_fixed, mem_per_triplet, mem_tmp;
 
     int *kmap_identity;
+    bool cache_weight;
+    double mem_weight;
     double **energy_tmp;
     double **weight_tetra;
+    double **weight_pair;
+    double *weight_now;
     double **v3_arr;
     double ***delta_arr;
+    double **ret_arr;
+    double ***delta_rep;
+    double **f1_tmp, **f2_tmp;
+    double *f1, *f2;
+    double prefactor = pi * std::pow(0.5, 4);
 
     std::vector<KsListGroup> triplet;
+    std::vector<std::vector<int> > ibranch_tri;
+    std::vector<std::vector<float> > weight_tri;
 
     for (i = 0; i < N; ++i) ret[i] = 0.0;
 
@@ -996,119 +1754,312 @@ void Relaxation::calc_damping_tetrahedron(const unsigned int N,
 
     npair_uniq = triplet.size();
 
-    memory->allocate(v3_arr, npair_uniq, ns2);
-    memory->allocate(delta_arr, npair_uniq, ns2, 2);
-
     knum = kpoint->kpoint_irred_all[ik_in][0].knum;
     knum_minus = kpoint->knum_minus[knum];
 
+    if (record) {
+        ibranch_tri.resize(npair_uniq);
+        weight_tri.resize(npair_uniq);
+    }
+
+    // Determine the number of triplets processed at once
+
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#else
+    nthreads = 1;
+#endif
+
+    mem_fixed = static_cast<double>(sizeof(int) * nk)
+        + static_cast<double>(nthreads) * sizeof(double) * (8.0 * nk + 2.0 * ns * N);
+    mem_per_triplet = sizeof(double) * (3.0 * ns2 + N);
+    if (record) mem_per_triplet += sizeof(double) * 2.0 * ns2;
+    mem_weight = sizeof(double) * 2.0 * ns2 * nk;
+
+    cache_weight = false;
+
+    if (tetra_memory_size > 0) {
+        mem_tmp = static_cast<double>(tetra_memory_size) * 1.0e+6 - mem_fixed;
+        if (mem_tmp - mem_weight > mem_per_triplet
+            && mem_tmp / mem_per_triplet < static_cast<double>(npair_uniq)) {
+            cache_weight = true;
+            mem_tmp -= mem_weight;
+        }
+        if (mem_tmp > mem_per_triplet) {
+            nblock = static_cast<unsigned int>(std::min(mem_tmp / mem_per_triplet,
+                                                        static_cast<double>(npair_uniq)));
+        } else {
+            nblock = 1;
+        }
+    } else {
+        nblock = npair_uniq;
+    }
+    if (nblock == 0) nblock = 1;
+
+    mem_tmp = mem_fixed + static_cast<double>(nblock) * mem_per_triplet;
+    if (cache_weight) mem_tmp += mem_weight;
+    if (mem_tmp > tetra_memory_peak) tetra_memory_peak = mem_tmp;
+
+    memory->allocate(v3_arr, nblock, ns2);
+    memory->allocate(delta_arr, nblock, ns2, 2);
+    if (record) memory->allocate(delta_rep, nblock, ns2, 2);
+    memory->allocate(ret_arr, nblock, N);
     memory->allocate(kmap_identity, nk);
 
     for (i = 0; i < nk; ++i) kmap_identity[i] = i;
 
+    if (cache_weight) {
+        memory->allocate(weight_pair, ns2, 2 * nk);
 
 #ifdef _OPENMP
-#pragma omp parallel private(is, js, k1, k2, xk_tmp, energy_tmp, i, weight_tetra, ik, jk, arr)
+#pragma omp parallel private(energy_tmp, weight_tetra)
 #endif
-    {
-        memory->allocate(energy_tmp, 3, nk);
-        memory->allocate(weight_tetra, 3, nk);
+        {
+            memory->allocate(energy_tmp, 3, nk);
+            memory->allocate(weight_tetra, 3, nk);
 
 #ifdef _OPENMP
 #pragma omp for
 #endif
-        for (ib = 0; ib < ns2; ++ib) {
-            is = ib / ns;
-            js = ib % ns;
+            for (ib = 0; ib < ns2; ++ib) {
+                calc_weight_tetrahedron_pair(knum, ib, omega, kmap_identity,
+                                             energy_tmp, weight_tetra, weight_pair[ib]);
+            }
 
-            for (k1 = 0; k1 < nk; ++k1) {
+            memory->deallocate(energy_tmp);
+            memory->deallocate(weight_tetra);
+        }
+    }
 
-                // Prepare two-phonon frequency for the tetrahedron method
+    for (ik_begin = 0; ik_begin < npair_uniq; ik_begin += nblock) {
 
-                for (i = 0; i < 3; ++i) xk_tmp[i] = kpoint->xk[knum][i] - kpoint->xk[k1][i];
+        ik_end = std::min(ik_begin + nblock, npair_uniq);
+        nlocal = ik_end - ik_begin;
 
-                k2 = kpoint->get_knum(xk_tmp[0], xk_tmp[1], xk_tmp[2]);
+        // Accumulate the tetrahedron weights of the triplets in the block
 
-                energy_tmp[0][k1] = dynamical->eval_phonon[k1][is] + dynamical->eval_phonon[k2][js];
-                energy_tmp[1][k1] = dynamical->eval_phonon[k1][is] - dynamical->eval_phonon[k2][js];
-                energy_tmp[2][k1] = -energy_tmp[1][k1];
+#ifdef _OPENMP
+#pragma omp parallel private(energy_tmp, i, weight_tetra, weight_now, ik, jk)
+#endif
+        {
+            if (!cache_weight) {
+                memory->allocate(energy_tmp, 3, nk);
+                memory->allocate(weight_tetra, 3, nk);
+                memory->allocate(weight_now, 2 * nk);
             }
 
-            for (i = 0; i < 3; ++i) {
-                integration->calc_weight_tetrahedron(nk, kmap_identity,
-                                                     weight_tetra[i], energy_tmp[i], omega);
+#ifdef _OPENMP
+#pragma omp for
+#endif
+            for (ib = 0; ib < ns2; ++ib) {
+
+                if (cache_weight) {
+                    weight_now = weight_pair[ib];
+                } else {
+                    calc_weight_tetrahedron_pair(knum, ib, omega, kmap_identity,
+                                                 energy_tmp, weight_tetra, weight_now);
+                }
+
+                // Loop for irreducible k points
+                for (ik = 0; ik < static_cast<int>(nlocal); ++ik) {
+
+                    delta_arr[ik][ib][0] = 0.0;
+                    delta_arr[ik][ib][1] = 0.0;
+
+                    for (i = 0; i < triplet[ik + ik_begin].group.size(); ++i) {
+                        jk = triplet[ik + ik_begin].group[i].ks[0];
+                        delta_arr[ik][ib][0] += weight_now[2 * jk];
+                        delta_arr[ik][ib][1] += weight_now[2 * jk + 1];
+                    }
+
+                    if (record) {
+                        jk = triplet[ik + ik_begin].group[0].ks[0];
+                        delta_rep[ik][ib][0] = weight_now[2 * jk];
+                        delta_rep[ik][ib][1] = weight_now[2 * jk + 1];
+                    }
+                }
             }
 
-            // Loop for irreducible k points
-            for (ik = 0; ik < npair_uniq; ++ik) {
+            if (!cache_weight) {
+                memory->deallocate(energy_tmp);
+                memory->deallocate(weight_tetra);
+                memory->deallocate(weight_now);
+            }
+        }
 
-                delta_arr[ik][ib][0] = 0.0;
-                delta_arr[ik][ib][1] = 0.0;
+        // Calculate the matrix elements V3 of all branch pairs at once
+        // only for the triplets having nonzero weights, and
+        // evaluate the contribution of each triplet for all temperatures.
 
-                for (i = 0; i < triplet[ik].group.size(); ++i) {
-                    jk = triplet[ik].group[i].ks[0];
-                    delta_arr[ik][ib][0] += weight_tetra[0][jk];
-                    delta_arr[ik][ib][1] += weight_tetra[1][jk] - weight_tetra[2][jk];
+#ifdef _OPENMP
+#pragma omp parallel private(ib, i, is, js, k1, k2, has_weight, f1_tmp, f2_tmp, f1, f2, w1, w2)
+#endif
+        {
+            memory->allocate(f1_tmp, ns, N);
+            memory->allocate(f2_tmp, ns, N);
+
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic)
+#endif
+            for (ik = 0; ik < static_cast<int>(nlocal); ++ik) {
+
+                for (i = 0; i < N; ++i) ret_arr[ik][i] = 0.0;
+
+                has_weight = false;
+                for (ib = 0; ib < ns2; ++ib) {
+                    if (delta_arr[ik][ib][0] > 0.0 || std::abs(delta_arr[ik][ib][1]) > 0.0) {
+                        has_weight = true;
+                        break;
+                    }
                 }
 
-                // Calculate the matrix element V3 only when the weight is nonzero.
-                if (delta_arr[ik][ib][0] > 0.0 || std::abs(delta_arr[ik][ib][1]) > 0.0) {
-                    k1 = triplet[ik].group[0].ks[0];
-                    k2 = triplet[ik].group[0].ks[1];
+                if (!has_weight) continue;
 
-                    arr[0] = ns * knum_minus + snum;
-                    arr[1] = ns * k1 + is;
-                    arr[2] = ns * k2 + js;
+                k1 = triplet[ik + ik_begin].group[0].ks[0];
+                k2 = triplet[ik + ik_begin].group[0].ks[1];
 
-                    v3_arr[ik][ib] = std::norm(V3(arr));
-                } else {
-                    v3_arr[ik][ib] = 0.0;
+                calc_V3norm2_batch(knum_minus, snum, k1, k2, v3_arr[ik]);
+
+                for (is = 0; is < ns; ++is) {
+                    for (i = 0; i < N; ++i) {
+                        f1_tmp[is][i] = thermodynamics->fB(dynamical->eval_phonon[k1][is], T[i]);
+                        f2_tmp[is][i] = thermodynamics->fB(dynamical->eval_phonon[k2][is], T[i]);
+                    }
+                }
+
+                for (is = 0; is < ns; ++is) {
+                    f1 = f1_tmp[is];
+                    for (js = 0; js < ns; ++js) {
+                        ib = ns * is + js;
+                        if (!(delta_arr[ik][ib][0] > 0.0 || std::abs(delta_arr[ik][ib][1]) > 0.0)) continue;
+
+                        f2 = f2_tmp[js];
+                        w1 = v3_arr[ik][ib] * delta_arr[ik][ib][0];
+                        w2 = v3_arr[ik][ib] * delta_arr[ik][ib][1];
+
+                        if (record && (delta_rep[ik][ib][0] != 0.0 || delta_rep[ik][ib][1] != 0.0)) {
+                            ibranch_tri[ik + ik_begin].push_back(ib);
+                            weight_tri[ik + ik_begin].push_back(prefactor * v3_arr[ik][ib] * delta_rep[ik][ib][0]);
+                            weight_tri[ik + ik_begin].push_back(prefactor * v3_arr[ik][ib] * delta_rep[ik][ib][1]);
+                        }
+
+                        // n1 = f1 + f2 + 1, n2 = f1 - f2
+                        for (i = 0; i < N; ++i) {
+                            ret_arr[ik][i] += w1 * (f1[i] + f2[i] + 1.0) - w2 * (f1[i] - f2[i]);
+                        }
+                    }
                 }
             }
+
+            memory->deallocate(f1_tmp);
+            memory->deallocate(f2_tmp);
+        }
+
+        for (ik = 0; ik < static_cast<int>(nlocal); ++ik) {
+            for (i = 0; i < N; ++i) ret[i] += ret_arr[ik][i];
         }
+    }
+
+    memory->deallocate(v3_arr);
+    memory->deallocate(delta_arr);
+    memory->deallocate(ret_arr);
+    memory->deallocate(kmap_identity);
+    if (cache_weight) memory->deallocate(weight_pair);
+    if (record) {
+        memory->deallocate(delta_rep);
+        store_scattering_record(triplet, ibranch_tri, weight_tri, record);
+    }
+
+    for (i = 0; i < N; ++i) ret[i] *= prefactor;
+}
+
+
+void Relaxation::calc_weight_tetrahedron_pair(const int knum,
+                                              const int ib,
+                                              const double omega,
+                                              int *kmap_identity,
+                                              double **energy_tmp,
+                                              double **weight_tetra,
+                                              double *weight_out)
+{
+    // Tetrahedron weights of the branch pair ib = ns * is + js for all k1.
+    // weight_out[2 * k1] is the weight of delta(omega - w1 - w2) and
+    // weight_out[2 * k1 + 1] is that of delta(omega - w1 + w2) - delta(omega + w1 - w2),
+    // where k2 = k - k1.
+
+    unsigned int i, k1, k2;
+    unsigned int is = ib / ns;
+    unsigned int js = ib % ns;
+    double xk_tmp[3];
+
+    for (k1 = 0; k1 < nk; ++k1) {
+
+        // Prepare two-phonon frequency for the tetrahedron method
+
+        for (i = 0; i < 3; ++i) xk_tmp[i] = kpoint->xk[knum][i] - kpoint->xk[k1][i];
+
+        k2 = kpoint->get_knum(xk_tmp[0], xk_tmp[1], xk_tmp[2]);
+
+        energy_tmp[0][k1] = dynamical->eval_phonon[k1][is] + dynamical->eval_phonon[k2][js];
+        energy_tmp[1][k1] = dynamical->eval_phonon[k1][is] - dynamical->eval_phonon[k2][js];
+        energy_tmp[2][k1] = -energy_tmp[1][k1];
+    }
+
+    for (i = 0; i < 3; ++i) {
+        integration->calc_weight_tetrahedron(nk, kmap_identity,
+                                             weight_tetra[i], energy_tmp[i], omega);
+    }
 
-        memory->deallocate(energy_tmp);
-        memory->deallocate(weight_tetra);
+    for (k1 = 0; k1 < nk; ++k1) {
+        weight_out[2 * k1] = weight_tetra[0][k1];
+        weight_out[2 * k1 + 1] = weight_tetra[1][k1] - weight_tetra[2][k1];
     }
+}
 
-    for (i = 0; i < N; ++i) {
-        T_tmp = T[i];
-        ret_tmp = 0.0;
-#ifdef _OPENMP
-#pragma omp parallel for private(k1, k2, is, js, omega_inner, n1, n2, f1, f2), reduction(+:ret_tmp)
-#endif
-        for (ik = 0; ik < npair_uniq; ++ik) {
+void Relaxation::store_scattering_record(const std::vector<KsListGroup> &triplet,
+                                         const std::vector<std::vector<int> > &ibranch_tri,
+                                         const std::vector<std::vector<float> > &weight_tri,
+                                         ScatteringRecord *record)
+{
+    // Collect the scattering weights of the triplets in the order of the triplets.
+    // The members of each group are oriented as the representative pair (k1, k2):
+    // when the pair was swapped by the permutation symmetry, (k2, k1) is stored.
 
-            k1 = triplet[ik].group[0].ks[0];
-            k2 = triplet[ik].group[0].ks[1];
+    unsigned int ik, i;
+    int k1, k2, k1_sym;
 
-            for (is = 0; is < ns; ++is) {
+    record->clear();
 
-                omega_inner[0] = dynamical->eval_phonon[k1][is];
-                f1 = thermodynamics->fB(omega_inner[0], T_tmp);
+    for (ik = 0; ik < triplet.size(); ++ik) {
 
-                for (js = 0; js < ns; ++js) {
+        if (ibranch_tri[ik].empty()) continue;
 
-                    omega_inner[1] = dynamical->eval_phonon[k2][js];
-                    f2 = thermodynamics->fB(omega_inner[1], T_tmp);
+        k1 = triplet[ik].group[0].ks[0];
+        k2 = triplet[ik].group[0].ks[1];
 
-                    n1 = f1 + f2 + 1.0;
-                    n2 = f1 - f2;
+        record->nmember.push_back(triplet[ik].group.size());
+        record->nentry.push_back(ibranch_tri[ik].size());
 
-                    ret_tmp += v3_arr[ik][ns * is + js]
-                        * (n1 * delta_arr[ik][ns * is + js][0]
-                            - n2 * delta_arr[ik][ns * is + js][1]);
-                }
+        for (i = 0; i < triplet[ik].group.size(); ++i) {
+
+            const KsList &member = triplet[ik].group[i];
+
+            k1_sym = kpoint->knum_sym(k1, member.symnum);
+
+            if (k1_sym == member.ks[0] || k1 == k2) {
+                record->kpair.push_back(member.ks[0]);
+                record->kpair.push_back(member.ks[1]);
+            } else {
+                record->kpair.push_back(member.ks[1]);
+                record->kpair.push_back(member.ks[0]);
             }
         }
-        ret[i] = ret_tmp;
-    }
-
-    memory->deallocate(v3_arr);
-    memory->deallocate(delta_arr);
-    memory->deallocate(kmap_identity);
 
-    for (i = 0; i < N; ++i) ret[i] *= pi * std::pow(0.5, 4);
+        record->ibranch.insert(record->ibranch.end(),
+                               ibranch_tri[ik].begin(), ibranch_tri[ik].end());
+        record->weight.insert(record->weight.end(),
+                              weight_tri[ik].begin(), weight_tri[ik].end());
+    }
 }
 
 
@@ -2613,10 +3564,25 @@ bool Relaxation::is_symmorphic(const int isym)
     return ret;
 }
 
-void Relaxation::get_unique_triplet_k(const int ik,
-                                      const bool use_triplet_symmetry,
-                                      const bool use_permutation_symmetry,
-                                      std::vector<KsListGroup> &triplet)
+unsigned int Relaxation::get_number_of_unique_triplets(const unsigned int ik_in)
+{
+    // Number of symmetry-reduced (k1,k2) pairs contributing to
+    // the self-energy of the irreducible k point ik_in.
+
+    std::vector<KsListGroup> triplet;
+
+    get_unique_triplet_k(ik_in,
+                         use_triplet_symmetry,
+                         sym_permutation,
+                         triplet);
+
+    return triplet.size();
+}
+
+void Relaxation::generate_unique_triplet_k(const int ik,
+                                           const bool use_triplet_symmetry,
+                                           const bool use_permutation_symmetry,
+                                           std::vector<KsListGroup> &triplet)
 {
     int i, ik1, ik2, isym;
     int num_group_k, tmp;
@@ -2624,7 +3590,6 @@ void Relaxation::get_unique_triplet_k(const int ik,
     int knum = kpoint->kpoint_irred_all[ik][0].knum;
     bool *flag_found;
     std::vector<KsList> kslist;
-    double xk[3], xk1[3], xk2[3];
 
     memory->allocate(flag_found, kpoint->nk);
 
@@ -2634,17 +3599,13 @@ void Relaxation::get_unique_triplet_k(const int ik,
         num_group_k = 1;
     }
 
-    for (i = 0; i < 3; ++i) xk[i] = kpoint->xk[knum][i];
     for (i = 0; i < kpoint->nk; ++i) flag_found[i] = false;
 
     triplet.clear();
 
     for (ik1 = 0; ik1 < nk; ++ik1) {
 
-        for (i = 0; i < 3; ++i) xk1[i] = kpoint->xk[ik1][i];
-        for (i = 0; i < 3; ++i) xk2[i] = xk[i] - xk1[i];
-
-        ik2 = kpoint->get_knum(xk2[0], xk2[1], xk2[2]);
+        ik2 = kpoint->knum_diff(knum, ik1);
 
         kslist.clear();
 
@@ -2678,17 +3639,457 @@ void Relaxation::get_unique_triplet_k(const int ik,
     memory->deallocate(flag_found);
 }
 
+void Relaxation::get_unique_triplet_k(const int ik,
+                                      const bool use_triplet_symmetry,
+                                      const bool use_permutation_symmetry,
+                                      std::vector<KsListGroup> &triplet)
+{
+    // Unique triplets of the irreducible k point ik taken from the triplet index.
+    // They are generated on the fly when the index is not available
+    // for the given symmetry options.
+
+    long ig, im;
+    int ks_in[2];
+    int knum, nsym;
+    std::vector<KsList> kslist;
+
+    if (!triplet_index_ready
+        || use_triplet_symmetry != triplet_index_trisym
+        || use_permutation_symmetry != triplet_index_permutation) {
+        generate_unique_triplet_k(ik, use_triplet_symmetry, use_permutation_symmetry, triplet);
+        return;
+    }
+
+    knum = kpoint->kpoint_irred_all[ik][0].knum;
+    nsym = symmetry->nsym;
+
+    triplet.clear();
+    triplet.reserve(triplet_kstart[ik + 1] - triplet_kstart[ik]);
+
+    for (ig = triplet_kstart[ik]; ig < triplet_kstart[ik + 1]; ++ig) {
+        kslist.clear();
+        for (im = triplet_gstart[ig]; im < triplet_gstart[ig + 1]; ++im) {
+            ks_in[0] = triplet_member[im] / nsym;
+            ks_in[1] = kpoint->knum_diff(knum, ks_in[0]);
+            kslist.push_back(KsList(2, ks_in, triplet_member[im] % nsym));
+        }
+        triplet.push_back(kslist);
+    }
+}
+
+void Relaxation::setup_triplet_index()
+{
+    // Build the unique triplets of all the irreducible k points at once.
+    // This is skipped when only the k points given by KS_INPUT are analyzed.
+    // When TRIPLET_FILE = 1, the index is saved in the binary file PREFIX.triplet
+    // together with a hash of the mesh and the symmetry, so that it is reused
+    // by later runs on the same mesh.
+
+    unsigned int key;
+    bool found = false;
+    std::string file_triplet;
+
+    triplet_index_ready = false;
+
+    if (kpoint->kpoint_mode != 2 || ks_analyze_mode) return;
+
+    MPI_Bcast(&use_triplet_file, 1, MPI_LOGICAL, 0, MPI_COMM_WORLD);
+
+    triplet_index_trisym = use_triplet_symmetry;
+    triplet_index_permutation = sym_permutation;
+
+    key = get_triplet_index_key();
+    file_triplet = input->job_title + ".triplet";
+
+    if (use_triplet_file) found = load_triplet_index(file_triplet, key);
+
+    if (!found) {
+        build_triplet_index();
+        if (use_triplet_file && mympi->my_rank == 0) save_triplet_index(file_triplet, key);
+    }
+
+    triplet_index_ready = true;
+
+    if (mympi->my_rank == 0) {
+        std::cout << std::endl;
+        if (found) {
+            std::cout << " Unique triplets are loaded from the file " << file_triplet << std::endl;
+        } else if (use_triplet_file) {
+            std::cout << " Unique triplets are generated and saved to the file " << file_triplet << std::endl;
+        } else {
+            std::cout << " Unique triplets are generated for all irreducible k points." << std::endl;
+        }
+        std::cout << " Number of unique triplets : " << triplet_ngroup << std::endl;
+    }
+}
+
+void Relaxation::build_triplet_index()
+{
+    // The irreducible k points are divided into contiguous ranges over the
+    // MPI processes and distributed over the OpenMP threads.
+    // Each process writes its own part of the index, which is then
+    // sent to the other nodes by share_triplet_index.
+
+    int ik, irank;
+    long ig, im;
+    int nk_irred = kpoint->nk_reduced;
+    int nsym = symmetry->nsym;
+    int *ngroup, *nmember;
+    int *ngroup_loc, *nmember_loc;
+    std::vector<long> ik_split, group_split, member_split;
+    std::vector<long> offset_member;
+    std::vector<std::vector<KsListGroup> > triplet_loc;
+
+    ik_split.resize(mympi->nprocs + 1);
+    for (irank = 0; irank <= mympi->nprocs; ++irank) {
+        ik_split[irank] = static_cast<long>(nk_irred) * irank / mympi->nprocs;
+    }
+
+    triplet_loc.resize(nk_irred);
+
+    memory->allocate(ngroup, nk_irred);
+    memory->allocate(nmember, nk_irred);
+    memory->allocate(ngroup_loc, nk_irred);
+    memory->allocate(nmember_loc, nk_irred);
+
+    for (ik = 0; ik < nk_irred; ++ik) {
+        ngroup_loc[ik] = 0;
+        nmember_loc[ik] = 0;
+    }
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+    for (ik = ik_split[mympi->my_rank]; ik < ik_split[mympi->my_rank + 1]; ++ik) {
+        generate_unique_triplet_k(ik, triplet_index_trisym, triplet_index_permutation,
+                                  triplet_loc[ik]);
+        ngroup_loc[ik] = triplet_loc[ik].size();
+        for (std::size_t j = 0; j < triplet_loc[ik].size(); ++j) {
+            nmember_loc[ik] += triplet_loc[ik][j].group.size();
+        }
+    }
+
+    MPI_Allreduce(ngroup_loc, ngroup, nk_irred, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(nmember_loc, nmember, nk_irred, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+    triplet_kstart.resize(nk_irred + 1);
+    offset_member.resize(nk_irred + 1);
+    triplet_kstart[0] = 0;
+    offset_member[0] = 0;
+    for (ik = 0; ik < nk_irred; ++ik) {
+        triplet_kstart[ik + 1] = triplet_kstart[ik] + ngroup[ik];
+        offset_member[ik + 1] = offset_member[ik] + nmember[ik];
+    }
+
+    allocate_triplet_index(triplet_kstart[nk_irred], offset_member[nk_irred]);
+
+    // Each process fills the entries of its own k points
+
+    if (triplet_index_shared) MPI_Win_fence(0, triplet_window);
+
+    for (ik = ik_split[mympi->my_rank]; ik < ik_split[mympi->my_rank + 1]; ++ik) {
+        ig = triplet_kstart[ik];
+        im = offset_member[ik];
+
+        for (std::size_t j = 0; j < triplet_loc[ik].size(); ++j) {
+            const std::vector<KsList> &group = triplet_loc[ik][j].group;
+
+            triplet_gstart[ig++] = im;
+            for (std::size_t k = 0; k < group.size(); ++k) {
+                triplet_member[im++] = group[k].ks[0] * nsym + group[k].symnum;
+            }
+        }
+        triplet_loc[ik].clear();
+    }
+    if (!triplet_index_shared || mympi->my_rank_node == 0) {
+        triplet_gstart[triplet_ngroup] = triplet_nmember;
+    }
+
+    group_split.resize(mympi->nprocs + 1);
+    member_split.resize(mympi->nprocs + 1);
+    for (irank = 0; irank <= mympi->nprocs; ++irank) {
+        group_split[irank] = triplet_kstart[ik_split[irank]];
+        member_split[irank] = offset_member[ik_split[irank]];
+    }
+
+    share_triplet_index(group_split, member_split);
+
+    memory->deallocate(ngroup);
+    memory->deallocate(nmember);
+    memory->deallocate(ngroup_loc);
+    memory->deallocate(nmember_loc);
+}
+
+void Relaxation::allocate_triplet_index(const long ngroup,
+                                        const long nmember)
+{
+    // Allocate triplet_gstart[ngroup + 1] and triplet_member[nmember].
+    // If several processes run on a node, both arrays are placed in one
+    // MPI-3 shared memory window owned by the first process of the node.
+
+    triplet_ngroup = ngroup;
+    triplet_nmember = nmember;
+    triplet_index_shared = false;
+
+#if MPI_VERSION >= 3
+    if (mympi->nprocs_node > 1) {
+
+        int disp_unit;
+        MPI_Aint nbytes;
+        char *base;
+
+        nbytes = (mympi->my_rank_node == 0)
+                     ? static_cast<MPI_Aint>(sizeof(long) * (ngroup + 1) + sizeof(int) * nmember)
+                     : 0;
+
+        MPI_Win_allocate_shared(nbytes, 1, MPI_INFO_NULL, mympi->comm_node, &base, &triplet_window);
+        MPI_Win_shared_query(triplet_window, 0, &nbytes, &disp_unit, &base);
+
+        triplet_gstart = reinterpret_cast<long *>(base);
+        triplet_member = reinterpret_cast<int *>(base + sizeof(long) * (ngroup + 1));
+        triplet_index_shared = true;
+        return;
+    }
+#endif
+
+    memory->allocate(triplet_gstart, ngroup + 1);
+    memory->allocate(triplet_member, nmember);
+}
+
+void Relaxation::deallocate_triplet_index()
+{
+    if (triplet_index_shared) {
+        MPI_Win_free(&triplet_window);
+        triplet_index_shared = false;
+    } else {
+        memory->deallocate(triplet_gstart);
+        memory->deallocate(triplet_member);
+    }
+    triplet_gstart = 0;
+    triplet_member = 0;
+    triplet_ngroup = 0;
+    triplet_nmember = 0;
+}
+
+void Relaxation::share_triplet_index(const std::vector<long> &group_split,
+                                     const std::vector<long> &member_split)
+{
+    // The process irank holds the valid entries [group_split[irank], group_split[irank + 1])
+    // of triplet_gstart and [member_split[irank], member_split[irank + 1]) of triplet_member.
+    // They are broadcast to all the nodes. When the index is shared within a node,
+    // only the first process of each node takes part in the communication.
+
+    int irank, color, my_leader, nleader;
+    long i, n;
+    const long nchunk = 1L << 28;
+    std::vector<int> leader_of_rank;
+    MPI_Comm comm_leader;
+
+    color = (!triplet_index_shared || mympi->my_rank_node == 0) ? 0 : MPI_UNDEFINED;
+    MPI_Comm_split(MPI_COMM_WORLD, color, mympi->my_rank, &comm_leader);
+
+    my_leader = 0;
+    if (comm_leader != MPI_COMM_NULL) MPI_Comm_rank(comm_leader, &my_leader);
+    if (triplet_index_shared) MPI_Bcast(&my_leader, 1, MPI_INT, 0, mympi->comm_node);
+
+    leader_of_rank.resize(mympi->nprocs);
+    MPI_Allgather(&my_leader, 1, MPI_INT, &leader_of_rank[0], 1, MPI_INT, MPI_COMM_WORLD);
+
+    if (triplet_index_shared) MPI_Win_fence(0, triplet_window);
+
+    if (comm_leader != MPI_COMM_NULL) {
+
+        MPI_Comm_size(comm_leader, &nleader);
+
+        // MPI counts are int, so large parts are sent in chunks.
+
+        if (nleader > 1) {
+            for (irank = 0; irank < mympi->nprocs; ++irank) {
+
+                n = group_split[irank + 1] - group_split[irank];
+                for (i = 0; i < n; i += nchunk) {
+                    MPI_Bcast(triplet_gstart + group_split[irank] + i,
+                              static_cast<int>(std::min<long>(nchunk, n - i)),
+                              MPI_LONG, leader_of_rank[irank], comm_leader);
+                }
+
+                n = member_split[irank + 1] - member_split[irank];
+                for (i = 0; i < n; i += nchunk) {
+                    MPI_Bcast(triplet_member + member_split[irank] + i,
+                              static_cast<int>(std::min<long>(nchunk, n - i)),
+                              MPI_INT, leader_of_rank[irank], comm_leader);
+                }
+            }
+        }
+        MPI_Comm_free(&comm_leader);
+    }
+
+    if (triplet_index_shared) MPI_Win_fence(0, triplet_window);
+}
+
+unsigned int Relaxation::get_triplet_index_key() const
+{
+    // Hash of the mesh, the symmetry operations, and the symmetry options
+
+    unsigned int i, j, k;
+    unsigned int hash;
+    int ival[7];
+
+    ival[0] = kpoint->nkx;
+    ival[1] = kpoint->nky;
+    ival[2] = kpoint->nkz;
+    ival[3] = symmetry->nsym;
+    ival[4] = symmetry->time_reversal_sym ? 1 : 0;
+    ival[5] = triplet_index_trisym ? 1 : 0;
+    ival[6] = triplet_index_permutation ? 1 : 0;
+
+    hash = fnv1a_hash(reinterpret_cast<const char *>(ival), sizeof(ival));
+
+    for (i = 0; i < symmetry->nsym; ++i) {
+        for (j = 0; j < 3; ++j) {
+            for (k = 0; k < 3; ++k) {
+                hash = fnv1a_hash(reinterpret_cast<const char *>(&symmetry->SymmList[i].rot[j][k]),
+                                sizeof(int), hash);
+            }
+        }
+    }
+    for (i = 0; i < kpoint->nk_reduced; ++i) {
+        hash = fnv1a_hash(reinterpret_cast<const char *>(&kpoint->kpoint_irred_all[i][0].knum),
+                        sizeof(unsigned int), hash);
+    }
+
+    return hash;
+}
+
+void Relaxation::save_triplet_index(const std::string &file_triplet,
+                                    const unsigned int key) const
+{
+    // Layout: magic[8], key, nk_reduced, ngroup, nmember (long),
+    // triplet_kstart, triplet_gstart (long), triplet_member (int), checksum
+
+    long header[4];
+    unsigned int hash;
+    std::ofstream ofs;
+
+    header[0] = static_cast<long>(key);
+    header[1] = triplet_kstart.size() - 1;
+    header[2] = triplet_ngroup;
+    header[3] = triplet_nmember;
+
+    hash = fnv1a_hash(reinterpret_cast<const char *>(header), sizeof(header));
+    hash = fnv1a_hash(reinterpret_cast<const char *>(&triplet_kstart[0]), sizeof(long) * (header[1] + 1), hash);
+    hash = fnv1a_hash(reinterpret_cast<const char *>(triplet_gstart), sizeof(long) * (header[2] + 1), hash);
+    hash = fnv1a_hash(reinterpret_cast<const char *>(triplet_member), sizeof(int) * header[3], hash);
+
+    ofs.open(file_triplet.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!ofs) {
+        error->warn("save_triplet_index", "Could not open the file to save the triplets");
+        return;
+    }
+
+    ofs.write("ANPHTRI2", 8);
+    ofs.write(reinterpret_cast<const char *>(header), sizeof(header));
+    ofs.write(reinterpret_cast<const char *>(&triplet_kstart[0]), sizeof(long) * (header[1] + 1));
+    ofs.write(reinterpret_cast<const char *>(triplet_gstart), sizeof(long) * (header[2] + 1));
+    ofs.write(reinterpret_cast<const char *>(triplet_member), sizeof(int) * header[3]);
+    ofs.write(reinterpret_cast<const char *>(&hash), sizeof(hash));
+    ofs.close();
+}
+
+bool Relaxation::load_triplet_index(const std::string &file_triplet,
+                                    const unsigned int key)
+{
+    // The file is read by the first process and the index is sent to all the nodes.
+    // Returns false if the file does not exist or does not match the present mesh and symmetry.
+
+    int found = 0;
+    long header[4];
+    unsigned int hash, hash_file;
+    char magic[8];
+    std::size_t nbytes;
+    std::ifstream ifs;
+    std::vector<long> group_split, member_split;
+
+    if (mympi->my_rank == 0) {
+        ifs.open(file_triplet.c_str(), std::ios::in | std::ios::binary);
+        if (ifs) {
+            ifs.seekg(0, std::ios::end);
+            nbytes = static_cast<std::size_t>(ifs.tellg());
+            ifs.seekg(0, std::ios::beg);
+
+            ifs.read(magic, 8);
+            ifs.read(reinterpret_cast<char *>(header), sizeof(header));
+
+            if (ifs && std::string(magic, 8) == "ANPHTRI2"
+                && header[0] == static_cast<long>(key)
+                && header[1] == static_cast<long>(kpoint->nk_reduced)
+                && header[2] >= 0 && header[3] >= 0
+                && nbytes == 8 + sizeof(header) + sizeof(long) * (header[1] + header[2] + 2)
+                + sizeof(int) * header[3] + sizeof(unsigned int)) {
+                found = 1;
+            }
+        }
+    }
+    MPI_Bcast(&found, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!found) return false;
+
+    MPI_Bcast(header, 4, MPI_LONG, 0, MPI_COMM_WORLD);
+
+    triplet_kstart.resize(header[1] + 1);
+    allocate_triplet_index(header[2], header[3]);
+
+    if (triplet_index_shared) MPI_Win_fence(0, triplet_window);
+
+    if (mympi->my_rank == 0) {
+        ifs.read(reinterpret_cast<char *>(&triplet_kstart[0]), sizeof(long) * (header[1] + 1));
+        ifs.read(reinterpret_cast<char *>(triplet_gstart), sizeof(long) * (header[2] + 1));
+        ifs.read(reinterpret_cast<char *>(triplet_member), sizeof(int) * header[3]);
+        ifs.read(reinterpret_cast<char *>(&hash_file), sizeof(hash_file));
+
+        hash = fnv1a_hash(reinterpret_cast<const char *>(header), sizeof(header));
+        hash = fnv1a_hash(reinterpret_cast<const char *>(&triplet_kstart[0]), sizeof(long) * (header[1] + 1), hash);
+        hash = fnv1a_hash(reinterpret_cast<const char *>(triplet_gstart), sizeof(long) * (header[2] + 1), hash);
+        hash = fnv1a_hash(reinterpret_cast<const char *>(triplet_member), sizeof(int) * header[3], hash);
+
+        if (!ifs || hash != hash_file) {
+            error->warn("load_triplet_index", "The triplet file is broken and will be regenerated");
+            found = 0;
+        }
+        ifs.close();
+    }
+    MPI_Bcast(&found, 1, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (!found) {
+        if (triplet_index_shared) MPI_Win_fence(0, triplet_window);
+        deallocate_triplet_index();
+        triplet_kstart.clear();
+        return false;
+    }
+
+    MPI_Bcast(&triplet_kstart[0], header[1] + 1, MPI_LONG, 0, MPI_COMM_WORLD);
+
+    group_split.assign(mympi->nprocs + 1, header[2] + 1);
+    member_split.assign(mympi->nprocs + 1, header[3]);
+    group_split[0] = 0;
+    member_split[0] = 0;
+    share_triplet_index(group_split, member_split);
+
+    return true;
+}
+
 
 void Relaxation::calc_V3norm2(const unsigned int ik_in,
                               const unsigned int snum,
                               double **ret)
 {
-    int ib;
-    unsigned int ik;
-    unsigned int is, js;
+    // The printed |V3|^2 are always evaluated from the original cubic IFCs,
+    // even if Phi3(k1,k2) is interpolated for the linewidth (PHI3_MESH).
+
+    int ib, ik;
+    int npair_uniq;
     unsigned int k1, k2;
-    unsigned int arr[3];
     unsigned int knum, knum_minus;
+    std::complex<double> *phase_sum;
 
     int ns2 = ns * ns;
 
@@ -2702,103 +4103,159 @@ void Relaxation::calc_V3norm2(const unsigned int ik_in,
                          use_triplet_symmetry,
                          sym_permutation,
                          triplet);
+    npair_uniq = triplet.size();
+
 #ifdef _OPENMP
-#pragma omp parallel for private(is, js, ik, k1, k2, arr)
+#pragma omp parallel private(ib, k1, k2, phase_sum)
 #endif
-    for (ib = 0; ib < ns2; ++ib) {
-        is = ib / ns;
-        js = ib % ns;
+    {
+        if (use_phi3_interpolation) memory->allocate(phase_sum, fc3_group.ngroup);
 
-        for (ik = 0; ik < triplet.size(); ++ik) {
+#ifdef _OPENMP
+#pragma omp for
+#endif
+        for (ik = 0; ik < npair_uniq; ++ik) {
 
             k1 = triplet[ik].group[0].ks[0];
             k2 = triplet[ik].group[0].ks[1];
 
-            arr[0] = ns * knum_minus + snum;
-            arr[1] = ns * k1 + is;
-            arr[2] = ns * k2 + js;
+            if (!use_phi3_interpolation) {
+                calc_V3norm2_batch(knum_minus, snum, k1, k2, ret[ik]);
+            } else if (dynamical->eval_phonon[knum_minus][snum] < 0.0) {
+                for (ib = 0; ib < ns2; ++ib) ret[ik][ib] = 0.0;
+            } else {
+                calc_phase_sum_v3(fc3_group, k1, k2, phase_sum);
+                contract_phase_sum_v3(knum_minus, snum, k1, k2, phase_sum, ret[ik]);
+            }
 
-            ret[ik][ib] = std::norm(V3(arr)) * factor;
+            for (ib = 0; ib < ns2; ++ib) ret[ik][ib] *= factor;
         }
+
+        if (use_phi3_interpolation) memory->deallocate(phase_sum);
     }
 }
 
 void Relaxation::setup_cubic()
 {
-    int i, j, k;
+    setup_fcs_group(fcs_phonon->force_constant_with_cell[1], 3, fc3_group);
+
+    // Choose the kernel for the phase factors of V3
+    if (!use_tuned_ver) {
+        phase_kernel_v3 = 0;
+    } else if (xk_on_mesh && fc3_group.has_lattice_vec) {
+        phase_kernel_v3 = 2;
+    } else {
+        phase_kernel_v3 = 1;
+    }
+}
+
+void Relaxation::setup_quartic()
+{
+    setup_fcs_group(fcs_phonon->force_constant_with_cell[2], 4, fc4_group);
+
+    // Choose the kernel for the phase factors of V4
+    if (!use_tuned_ver) {
+        phase_kernel_v4 = 0;
+    } else if (xk_on_mesh && fc4_group.has_lattice_vec) {
+        phase_kernel_v4 = 2;
+    } else {
+        phase_kernel_v4 = 1;
+    }
+}
+
+void Relaxation::setup_fcs_group(std::vector<FcsArrayWithCell> &fcs_in,
+                                 const unsigned int N,
+                                 FcsGroupArray &fcs_group_out)
+{
+    // Sort the anharmonic IFCs and store them in the contiguous arrays of
+    // fcs_group_out grouped by the atomic indices.
+    // The arrays are constructed on the root process and broadcasted.
+
+    unsigned int i, j;
+    unsigned int nelem, igroup;
+    unsigned long nbytes, ioffset;
+    const unsigned long nchunk = 1UL << 30;
     double *invsqrt_mass_p;
+    std::vector<int> arr_old, arr_tmp;
+    std::vector<char> buf;
 
-    // Sort force_constant[1] using the operator defined in fcs_phonons.h
-    // This sorting is necessary.
-    std::sort(fcs_phonon->force_constant_with_cell[1].begin(),
-              fcs_phonon->force_constant_with_cell[1].end());
-    prepare_group_of_force_constants(fcs_phonon->force_constant_with_cell[1],
-                                     3, ngroup, fcs_group);
+    if (mympi->my_rank == 0) {
 
-    memory->allocate(vec_for_v3, fcs_phonon->force_constant_with_cell[1].size(), 2, 3);
+        // Sort fcs_in using the operator defined in fcs_phonons.h
+        // This sorting is necessary.
+        std::sort(fcs_in.begin(), fcs_in.end());
 
-    memory->allocate(invmass_for_v3, ngroup);
-    memory->allocate(evec_index, ngroup, 3);
+        nelem = fcs_in.size();
 
-    prepare_relative_vector(fcs_phonon->force_constant_with_cell[1], 3, vec_for_v3);
+        // Find the number of groups which has different evecs.
 
-    memory->allocate(invsqrt_mass_p, system->natmin);
+        arr_old.assign(N, -1);
+        igroup = 0;
 
-    for (i = 0; i < system->natmin; ++i) {
-        invsqrt_mass_p[i] = std::sqrt(1.0 / system->mass[system->map_p2s[i][0]]);
-    }
+        for (std::vector<FcsArrayWithCell>::const_iterator it = fcs_in.begin(); it != fcs_in.end(); ++it) {
+            arr_tmp.clear();
+            for (i = 0; i < (*it).pairs.size(); ++i) {
+                arr_tmp.push_back((*it).pairs[i].index);
+            }
+            if (arr_tmp != arr_old) {
+                ++igroup;
+                arr_old = arr_tmp;
+            }
+        }
 
-    k = 0;
-    for (i = 0; i < ngroup; ++i) {
-        for (j = 0; j < 3; ++j) {
-            evec_index[i][j] = fcs_phonon->force_constant_with_cell[1][k].pairs[j].index;
+        fcs_group_out.allocate(N, igroup, nelem);
+
+        memory->allocate(invsqrt_mass_p, system->natmin);
+
+        for (i = 0; i < system->natmin; ++i) {
+            invsqrt_mass_p[i] = std::sqrt(1.0 / system->mass[system->map_p2s[i][0]]);
         }
-        invmass_for_v3[i]
-            = invsqrt_mass_p[evec_index[i][0] / 3]
-            * invsqrt_mass_p[evec_index[i][1] / 3]
-            * invsqrt_mass_p[evec_index[i][2] / 3];
-        k += fcs_group[i].size();
-    }
 
-    memory->deallocate(invsqrt_mass_p);
-}
+        arr_old.assign(N, -1);
+        igroup = 0;
 
-void Relaxation::setup_quartic()
-{
-    int i, j, k;
-    double *invsqrt_mass_p;
-    std::sort(fcs_phonon->force_constant_with_cell[2].begin(),
-              fcs_phonon->force_constant_with_cell[2].end());
-    prepare_group_of_force_constants(fcs_phonon->force_constant_with_cell[2],
-                                     4, ngroup2, fcs_group2);
+        for (i = 0; i < nelem; ++i) {
+            arr_tmp.clear();
+            for (j = 0; j < N; ++j) {
+                arr_tmp.push_back(fcs_in[i].pairs[j].index);
+            }
+            if (arr_tmp != arr_old) {
+                fcs_group_out.group_start[igroup] = i;
+                fcs_group_out.invmass[igroup] = 1.0;
+                for (j = 0; j < N; ++j) {
+                    fcs_group_out.evec_index[N * igroup + j] = arr_tmp[j];
+                    fcs_group_out.invmass[igroup] *= invsqrt_mass_p[arr_tmp[j] / 3];
+                }
+                ++igroup;
+                arr_old = arr_tmp;
+            }
+            fcs_group_out.fcs[i] = fcs_in[i].fcs_val;
+        }
+        fcs_group_out.group_start[igroup] = nelem;
 
-    memory->allocate(vec_for_v4, fcs_phonon->force_constant_with_cell[2].size(), 3, 3);
+        memory->deallocate(invsqrt_mass_p);
 
-    memory->allocate(invmass_for_v4, ngroup2);
-    memory->allocate(evec_index4, ngroup2, 4);
+        prepare_relative_vector(fcs_in, N, fcs_group_out.relvec);
+        fcs_group_out.set_lattice_vector();
 
-    prepare_relative_vector(fcs_phonon->force_constant_with_cell[2], 4, vec_for_v4);
+        fcs_group_out.serialize(buf);
+        nbytes = buf.size();
+    }
 
-    memory->allocate(invsqrt_mass_p, system->natmin);
+    // MPI counts are int, so the buffer is sent in chunks.
 
-    for (i = 0; i < system->natmin; ++i) {
-        invsqrt_mass_p[i] = std::sqrt(1.0 / system->mass[system->map_p2s[i][0]]);
+    MPI_Bcast(&nbytes, 1, MPI_UNSIGNED_LONG, 0, MPI_COMM_WORLD);
+    buf.resize(nbytes);
+    for (ioffset = 0; ioffset < nbytes; ioffset += nchunk) {
+        MPI_Bcast(&buf[ioffset], static_cast<int>(std::min(nchunk, nbytes - ioffset)),
+                  MPI_CHAR, 0, MPI_COMM_WORLD);
     }
 
-    k = 0;
-    for (i = 0; i < ngroup2; ++i) {
-        for (j = 0; j < 4; ++j) {
-            evec_index4[i][j] = fcs_phonon->force_constant_with_cell[2][k].pairs[j].index;
+    if (mympi->my_rank > 0) {
+        if (!fcs_group_out.deserialize(buf)) {
+            error->exit("setup_fcs_group", "Broadcast of the anharmonic IFCs failed.");
         }
-        invmass_for_v4[i]
-            = invsqrt_mass_p[evec_index4[i][0] / 3]
-            * invsqrt_mass_p[evec_index4[i][1] / 3]
-            * invsqrt_mass_p[evec_index4[i][2] / 3]
-            * invsqrt_mass_p[evec_index4[i][3] / 3];
-        k += fcs_group2[i].size();
     }
-
-    memory->deallocate(invsqrt_mass_p);
 }
 
 void Relaxation::store_exponential_for_acceleration(const int nk_in[3],
@@ -2890,6 +4347,30 @@ void Relaxation::store_exponential_for_acceleration(const int nk_in[3],
                 }
             }
         }
+
+        // Integer coordinates of the k points in units of the mesh spacing.
+        // These are used for the phase factors only when all k points are on the mesh.
+
+        double xtmp;
+
+        memory->allocate(xk_int, kpoint->nk, 3);
+        xk_on_mesh = true;
+
+        for (i = 0; i < static_cast<int>(kpoint->nk); ++i) {
+            for (ii = 0; ii < 3; ++ii) {
+                if (tune_type == 0) {
+                    xtmp = kpoint->xk[i][ii] * static_cast<double>(nkrep_out);
+                } else {
+                    xtmp = kpoint->xk[i][ii] * dnk[ii];
+                }
+                xk_int[i][ii] = nint(xtmp);
+                if (std::abs(xtmp - static_cast<double>(xk_int[i][ii])) > eps6) xk_on_mesh = false;
+            }
+        }
+
+        if (!xk_on_mesh) memory->deallocate(xk_int);
+    } else {
+        xk_on_mesh = false;
     }
 }
 
@@ -11,10 +11,14 @@ or http://opensource.org/licenses/mit-license.php for information.
 #pragma once
 
 #include "pointers.h"
+#include "mpi_common.h"
 #include <complex>
 #include <vector>
 #include <string>
+#include <list>
+#include <map>
 #include "fcs_phonon.h"
+#include "fcs_group.h"
 
 namespace PHON_NS
 {
@@ -104,6 +108,37 @@ namespace PHON_NS
     };
 
 
+    class Phi3CacheEntry
+    {
+    public:
+        std::vector<std::complex<double> > phi3;
+        std::list<unsigned long>::iterator pos_lru;
+    };
+
+    class ScatteringRecord
+    {
+    public:
+        // Scattering weights of a phonon mode for the iterative solution of the BTE.
+        // For each triplet group, kpair holds (k1, k2) of all the members oriented
+        // as the representative, and the weights of the branch pairs ibranch = ns * is + js
+        // are stored as |V3|^2 * delta for the two types of processes.
+        // Branch pairs with zero weights are omitted.
+        std::vector<int> nmember;
+        std::vector<int> nentry;
+        std::vector<int> kpair;
+        std::vector<int> ibranch;
+        std::vector<float> weight;
+
+        void clear()
+        {
+            nmember.clear();
+            nentry.clear();
+            kpair.clear();
+            ibranch.clear();
+            weight.clear();
+        }
+    };
+
     class Relaxation : protected Pointers
     {
     public:
@@ -117,11 +152,11 @@ namespace PHON_NS
 
         void calc_damping_smearing(const unsigned int, double *, const double,
                                    const unsigned int, const unsigned int,
-                                   double *);
+                                   double *, ScatteringRecord *record = 0);
 
         void calc_damping_tetrahedron(const unsigned int, double *, const double,
                                       const unsigned int, const unsigned int,
-                                      double *);
+                                      double *, ScatteringRecord *record = 0);
 
         int quartic_mode;
         bool ks_analyze_mode;
@@ -136,6 +171,12 @@ namespace PHON_NS
         bool use_triplet_symmetry;
         bool **is_imaginary;
 
+        int phi3_cache_size;
+        int tetra_memory_size;
+        int phi3_mesh[3];
+        bool use_triplet_file;
+        bool use_mixed_precision;
+
         std::string ks_input;
         std::vector<unsigned int> kslist;
 
@@ -143,6 +184,10 @@ namespace PHON_NS
         std::complex<double> V3(const unsigned int [3]);
         std::complex<double> V4(const unsigned int [4]);
 
+        void calc_V3norm2_batch(const unsigned int, const unsigned int,
+                                const unsigned int, const unsigned int,
+                                double *);
+
 
         std::complex<double> V3_mode(int, double *, double *,
                                      int, int, double **,
@@ -150,12 +195,10 @@ namespace PHON_NS
 
         void calc_V3norm2(const unsigned int, const unsigned int, double **);
 
-        void prepare_relative_vector(std::vector<FcsArrayWithCell>,
-                                     const unsigned int, double ***);
+        unsigned int get_number_of_unique_triplets(const unsigned int);
 
-        void prepare_group_of_force_constants(std::vector<FcsArrayWithCell>,
-                                              const unsigned int, int &,
-                                              std::vector<double> *&);
+        void prepare_relative_vector(const std::vector<FcsArrayWithCell> &,
+                                     const unsigned int, double *);
 
         void detect_imaginary_branches(double **);
 
@@ -164,10 +207,8 @@ namespace PHON_NS
         std::vector<KsListMode> kslist_fstate_k;
         std::complex<double> im;
 
-        double ***vec_for_v3, *invmass_for_v3;
-        double ***vec_for_v4, *invmass_for_v4;
-        int **evec_index;
-        int **evec_index4;
+        // Grouped anharmonic force constants for V3 and V4
+        FcsGroupArray fc3_group, fc4_group;
 
         bool sym_permutation;
 
@@ -178,10 +219,70 @@ namespace PHON_NS
 
         void setup_cubic();
         void setup_quartic();
+        void setup_fcs_group(std::vector<FcsArrayWithCell> &,
+                             const unsigned int, FcsGroupArray &);
+        void calc_phase_sum_v3(const FcsGroupArray &,
+                               const unsigned int, const unsigned int,
+                               std::complex<double> *);
+        void contract_phase_sum_v3(const unsigned int, const unsigned int,
+                                   const unsigned int, const unsigned int,
+                                   const std::complex<double> *, double *);
+        void get_phase_sum_v3(const unsigned int, const unsigned int,
+                              std::complex<double> *);
+
+        // Contraction of V3 with single-precision products and
+        // double-precision accumulation (V3_MIXED = 1)
+        void setup_mixed_precision();
+        void estimate_mixed_precision_error();
+        void contract_phase_sum_v3_mixed(const unsigned int, const unsigned int,
+                                         const unsigned int, const unsigned int,
+                                         const std::complex<double> *, double *);
+        void matmul_mixed(const char, int,
+                          std::complex<float> *, std::complex<float> *,
+                          std::complex<float> *, std::complex<double> *);
+
+        // LRU cache of the phase-weighted cubic IFCs Phi3(k1,k2)
+        unsigned long phi3_cache_capacity;
+        unsigned long phi3_cache_hit, phi3_cache_miss, phi3_cache_evict;
+        std::list<unsigned long> phi3_cache_lru;
+        std::map<unsigned long, Phi3CacheEntry> phi3_cache;
+
+        void setup_phi3_cache();
+        void print_phi3_cache_statistics();
+
+        // Fourier interpolation of Phi3(k1,k2) from a coarse mesh
+        bool use_phi3_interpolation;
+        FcsGroupArray fc3_group_interp;
+
+        void setup_phi3_interpolation();
+        void estimate_phi3_interpolation_error();
+        bool is_gamma_point(const unsigned int);
+
+        // Memory usage of the work arrays in calc_damping_tetrahedron
+        double tetra_memory_peak;
+
+        void setup_tetrahedron_memory();
+        void print_tetrahedron_memory();
         void store_exponential_for_acceleration(const int nk[3], int &,
                                                 std::complex<double> *,
                                                 std::complex<double> ***);
 
+        // Integer lattice vectors of the IFC elements and integer k points
+        // for evaluating the phase factors of V3 and V4
+        unsigned int phase_kernel_v3, phase_kernel_v4;
+        bool xk_on_mesh;
+        int **xk_int;
+
+        template <unsigned int N>
+        std::complex<double> sum_fcs_with_phase_1d(const FcsGroupArray &, const unsigned int,
+                                                   const int *const *) const;
+        template <unsigned int N>
+        std::complex<double> sum_fcs_with_phase_3d(const FcsGroupArray &, const unsigned int,
+                                                   const int *const *) const;
+        template <unsigned int N>
+        std::complex<double> sum_fcs_with_phase(const FcsGroupArray &, const unsigned int,
+                                                const unsigned int, const double *const *) const;
+
         void calc_frequency_resolved_final_state(const unsigned int, double *, const double,
                                                  const unsigned int, const double *,
                                                  const unsigned int, const unsigned int,
@@ -205,11 +306,42 @@ namespace PHON_NS
                                   const bool,
                                   const bool,
                                   std::vector<KsListGroup> &);
+        void generate_unique_triplet_k(const int,
+                                       const bool,
+                                       const bool,
+                                       std::vector<KsListGroup> &);
+
+        // Unique triplets of all the irreducible k points in the CSR format.
+        // The groups of the irreducible k point ik are [triplet_kstart[ik], triplet_kstart[ik + 1]),
+        // and the members of the group ig are [triplet_gstart[ig], triplet_gstart[ig + 1]).
+        // Each member is stored as ks[0] * nsym + symnum; ks[1] follows from
+        // the momentum conservation.
+        // triplet_gstart and triplet_member are placed once per node in an MPI-3
+        // shared memory window when several processes run on a node.
+        bool triplet_index_ready;
+        bool triplet_index_trisym, triplet_index_permutation;
+        bool triplet_index_shared;
+        long triplet_ngroup, triplet_nmember;
+        std::vector<long> triplet_kstart;
+        long *triplet_gstart;
+        int *triplet_member;
+        MPI_Win triplet_window;
+
+        void setup_triplet_index();
+        void build_triplet_index();
+        void allocate_triplet_index(const long, const long);
+        void deallocate_triplet_index();
+        void share_triplet_index(const std::vector<long> &, const std::vector<long> &);
+        unsigned int get_triplet_index_key() const;
+        bool load_triplet_index(const std::string &, const unsigned int);
+        void save_triplet_index(const std::string &, const unsigned int) const;
+        void calc_weight_tetrahedron_pair(const int, const int, const double,
+                                          int *, double **, double **, double *);
+        void store_scattering_record(const std::vector<KsListGroup> &,
+                                     const std::vector<std::vector<int> > &,
+                                     const std::vector<std::vector<float> > &,
+                                     ScatteringRecord *);
 
-        int ngroup;
-        int ngroup2;
-        std::vector<double> *fcs_group;
-        std::vector<double> *fcs_group2;
         std::complex<double> *exp_phase, ***exp_phase3;
 
         int nk_grid[3];
@@ -101,6 +101,19 @@ void Writes::write_input_vars()
     if (phon->mode == "RTA") {
         std::cout << "  RESTART = " << phon->restart_flag << std::endl;
         std::cout << "  TRISYM = " << relaxation->use_triplet_symmetry << std::endl;
+        if (relaxation->phi3_cache_size > 0) {
+            std::cout << "  PHI3_CACHE = " << relaxation->phi3_cache_size << std::endl;
+        }
+        if (relaxation->tetra_memory_size > 0) {
+            std::cout << "  TETRA_MEMORY = " << relaxation->tetra_memory_size << std::endl;
+        }
+        if (relaxation->use_mixed_precision) {
+            std::cout << "  V3_MIXED = " << relaxation->use_mixed_precision << std::endl;
+        }
+        if (relaxation->phi3_mesh[0] > 0) {
+            std::cout << "  PHI3_MESH = " << relaxation->phi3_mesh[0] << " "
+                << relaxation->phi3_mesh[1] << " " << relaxation->phi3_mesh[2] << std::endl;
+        }
         std::cout << std::endl;
     }
     std::cout << std::endl;
@@ -156,6 +169,12 @@ void Writes::write_input_vars()
         }
 
         std::cout << "  KAPPA_SPEC = " << conductivity->calc_kappa_spec << std::endl;
+        std::cout << "  BTE = " << conductivity->solve_bte;
+        if (conductivity->solve_bte) {
+            std::cout << "; BTE_MAXITER = " << conductivity->bte_maxiter;
+            std::cout << "; BTE_TOL = " << conductivity->bte_tolerance;
+        }
+        std::cout << std::endl;
 
         //        std::cout << "  KS_INPUT = " << relaxation->ks_input << std::endl;
         //        std::cout << "  QUARTIC = " << relaxation->quartic_mode << std::endl;
@@ -313,45 +332,50 @@ void Writes::setup_result_io()
                             "Could not open file_result");
             }
 
-            fs_result << "## General information" << std::endl;
-            fs_result << "#SYSTEM" << std::endl;
-            fs_result << system->natmin << " " << system->nkd << std::endl;
-            fs_result << system->volume_p << std::endl;
-            fs_result << "#END SYSTEM" << std::endl;
-
-            fs_result << "#KPOINT" << std::endl;
-            fs_result << kpoint->nkx << " " << kpoint->nky << " " << kpoint->nkz << std::endl;
-            fs_result << kpoint->nk_reduced << std::endl;
-
-            for (int i = 0; i < kpoint->nk_reduced; ++i) {
-                fs_result << std::setw(6) << i + 1 << ":";
-                for (int j = 0; j < 3; ++j) {
-                    fs_result << std::setw(15)
-                        << std::scientific << kpoint->kpoint_irred_all[i][0].kval[j];
-                }
-                fs_result << std::setw(12)
-                    << std::fixed << kpoint->weight_k[i] << std::endl;
-            }
-            fs_result.unsetf(std::ios::fixed);
+            write_result_header();
+        }
+    }
+}
 
-            fs_result << "#END KPOINT" << std::endl;
+void Writes::write_result_header()
+{
+    fs_result << "## General information" << std::endl;
+    fs_result << "#SYSTEM" << std::endl;
+    fs_result << system->natmin << " " << system->nkd << std::endl;
+    fs_result << system->volume_p << std::endl;
+    fs_result << "#END SYSTEM" << std::endl;
+
+    fs_result << "#KPOINT" << std::endl;
+    fs_result << kpoint->nkx << " " << kpoint->nky << " " << kpoint->nkz << std::endl;
+    fs_result << kpoint->nk_reduced << std::endl;
+
+    for (unsigned int i = 0; i < kpoint->nk_reduced; ++i) {
+        fs_result << std::setw(6) << i + 1 << ":";
+        for (int j = 0; j < 3; ++j) {
+            fs_result << std::setw(15)
+                << std::scientific << kpoint->kpoint_irred_all[i][0].kval[j];
+        }
+        fs_result << std::setw(12)
+            << std::fixed << kpoint->weight_k[i] << std::endl;
+    }
+    fs_result.unsetf(std::ios::fixed);
 
-            fs_result << "#FCSXML" << std::endl;
-            fs_result << fcs_phonon->file_fcs << std::endl;
-            fs_result << "#END  FCSXML" << std::endl;
+    fs_result << "#END KPOINT" << std::endl;
 
-            fs_result << "#SMEARING" << std::endl;
-            fs_result << integration->ismear << std::endl;
-            fs_result << integration->epsilon * Ry_to_kayser << std::endl;
-            fs_result << "#END SMEARING" << std::endl;
+    fs_result << "#FCSXML" << std::endl;
+    fs_result << fcs_phonon->file_fcs << std::endl;
+    fs_result << "#END  FCSXML" << std::endl;
 
-            fs_result << "#TEMPERATURE" << std::endl;
-            fs_result << system->Tmin << " " << system->Tmax << " " << system->dT << std::endl;
-            fs_result << "#END TEMPERATURE" << std::endl;
+    fs_result << "#SMEARING" << std::endl;
+    fs_result << integration->ismear << std::endl;
+    fs_result << integration->epsilon * Ry_to_kayser << std::endl;
+    fs_result << "#END SMEARING" << std::endl;
 
-            fs_result << "##END General information" << std::endl;
-        }
-    }
+    fs_result << "#TEMPERATURE" << std::endl;
+    fs_result << system->Tmin << " " << system->Tmax << " " << system->dT << std::endl;
+    fs_result << "#END TEMPERATURE" << std::endl;
+
+    fs_result << "##END General information" << std::endl;
 }
 
 void Writes::print_phonon_energy()
@@ -1172,10 +1196,11 @@ void Writes::write_kappa()
     // Write lattice thermal conductivity
 
     if (mympi->my_rank == 0) {
-        int i, j, k;
+        unsigned int i, j, k;
 
         std::string file_kappa = input->job_title + ".kl";
         std::string file_kappa2 = input->job_title + ".kl_spec";
+        std::string file_kappa3 = input->job_title + ".kl_bte";
 
         std::ofstream ofs_kl;
 
@@ -1201,6 +1226,31 @@ void Writes::write_kappa()
         }
         ofs_kl.close();
 
+        if (conductivity->solve_bte) {
+
+            ofs_kl.open(file_kappa3.c_str(), std::ios::out);
+            if (!ofs_kl) error->exit("write_kappa", "Could not open file_kappa3");
+
+            ofs_kl << "# Temperature [K], Thermal Conductivity (xx, xy, xz, yx, yy, yz, zx, zy, zz) [W/mK]" << std::endl;
+            ofs_kl << "# Iterative solution of the linearized BTE." << std::endl;
+
+            if (isotope->include_isotope) {
+                ofs_kl << "# Isotope effects are included." << std::endl;
+            }
+
+            for (i = 0; i < conductivity->ntemp; ++i) {
+                ofs_kl << std::setw(10) << std::right << std::fixed << std::setprecision(2)
+                    << conductivity->Temperature[i];
+                for (j = 0; j < 3; ++j) {
+                    for (k = 0; k < 3; ++k) {
+                        ofs_kl << std::setw(15) << std::fixed
+                            << std::setprecision(4) << conductivity->kappa_bte[i][j][k];
+                    }
+                }
+                ofs_kl << std::endl;
+            }
+            ofs_kl.close();
+        }
 
         if (conductivity->calc_kappa_spec) {
 
@@ -1214,7 +1264,7 @@ void Writes::write_kappa()
             }
 
             for (i = 0; i < conductivity->ntemp; ++i) {
-                for (j = 0; j < dos->n_energy; ++j) {
+                for (j = 0; j < static_cast<unsigned int>(dos->n_energy); ++j) {
                     ofs_kl << std::setw(10) << std::right << std::fixed << std::setprecision(2)
                         << conductivity->Temperature[i];
                     ofs_kl << std::setw(10) << dos->energy_dos[j];
@@ -1233,6 +1283,10 @@ void Writes::write_kappa()
         std::cout << std::endl;
         std::cout << " -----------------------------------------------------------------" << std::endl << std::endl;
         std::cout << " Lattice thermal conductivity is stored in the file " << file_kappa << std::endl;
+        if (conductivity->solve_bte) {
+            std::cout << " Thermal conductivity by the iterative BTE solution is stored in the file "
+                << file_kappa3 << std::endl;
+        }
         if (conductivity->calc_kappa_spec) {
             std::cout << " Thermal conductivity spectra is stored in the file " << file_kappa2 << std::endl;
         }
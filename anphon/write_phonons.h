@@ -27,6 +27,7 @@ namespace PHON_NS
         void print_phonon_energy();
         void write_gruneisen();
         void setup_result_io();
+        void write_result_header();
         void write_input_vars();
         void write_kappa();
         void write_selfenergy_isotope();
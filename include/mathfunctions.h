@@ -12,6 +12,20 @@
 
 #include <iostream>
 #include <cstdlib>
+#include <cstddef>
+
+inline unsigned int fnv1a_hash(const char *buf, const std::size_t nbytes,
+                               unsigned int hash = 2166136261u)
+{
+	// 32-bit FNV-1a hash of nbytes bytes.
+	// Pass the returned value as hash to continue over another buffer.
+
+	for (std::size_t i = 0; i < nbytes; ++i) {
+		hash ^= static_cast<unsigned char>(buf[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
 
 template <typename T>
 inline void matmul3(T ret[3][3], T amat[3][3], T bmat[3][3]) {